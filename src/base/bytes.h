@@ -23,6 +23,11 @@ inline auto byteswap(uint32_t data) -> uint32_t
     return __builtin_bswap32(data);
 }
 
+inline auto byteswap(uint64_t data) -> uint64_t
+{
+    return __builtin_bswap64(data);
+}
+
 inline auto bytepack(uint8_t hi, uint8_t lo) -> uint16_t
 {
     return uint16_t(uint16_t(hi) << 8) | uint16_t(lo);
@@ -27,6 +27,11 @@ public:
         impl->fire(args...);
     }
 
+    auto isEmpty() const -> bool
+    {
+        return impl->hookImpls_m.empty();
+    }
+
 private:
     class Impl final
     {
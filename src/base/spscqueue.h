@@ -0,0 +1,63 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+// Lock-free ring buffer for exactly one producer thread and one consumer
+// thread. Neither side ever waits: push and pop transfer as much as fits
+
+template <typename T>
+class SpscQueue final
+{
+public:
+    explicit SpscQueue(size_t capacity):
+        buf_m(capacity + 1), head_m(0), tail_m(0)
+    {}
+
+    SpscQueue(const SpscQueue &) = delete;
+    auto operator = (const SpscQueue &) -> SpscQueue & = delete;
+
+    // Producer side
+    auto push(const T * data, size_t count) -> size_t
+    {
+        size_t tail = tail_m.load(std::memory_order_relaxed);
+        size_t head = head_m.load(std::memory_order_acquire);
+        count = std::min(count, (head + buf_m.size() - tail - 1) % buf_m.size());
+
+        size_t firstCount = std::min(count, buf_m.size() - tail);
+        std::copy(data, data + firstCount, buf_m.begin() + ptrdiff_t(tail));
+        std::copy(data + firstCount, data + count, buf_m.begin());
+
+        tail_m.store((tail + count) % buf_m.size(), std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side
+    auto pop(T * data, size_t count) -> size_t
+    {
+        size_t head = head_m.load(std::memory_order_relaxed);
+        size_t tail = tail_m.load(std::memory_order_acquire);
+        count = std::min(count, (tail + buf_m.size() - head) % buf_m.size());
+
+        size_t firstCount = std::min(count, buf_m.size() - head);
+        std::copy(buf_m.begin() + ptrdiff_t(head), buf_m.begin() + ptrdiff_t(head + firstCount), data);
+        std::copy(buf_m.begin(), buf_m.begin() + ptrdiff_t(count - firstCount), data + firstCount);
+
+        head_m.store((head + count) % buf_m.size(), std::memory_order_release);
+        return count;
+    }
+
+    auto isEmpty() const -> bool
+    {
+        return (head_m.load(std::memory_order_acquire) == tail_m.load(std::memory_order_acquire));
+    }
+
+private:
+    std::vector<T> buf_m;
+    alignas(64) std::atomic<size_t> head_m; // owned by consumer
+    alignas(64) std::atomic<size_t> tail_m; // owned by producer
+};
+
+#endif // SPSCQUEUE_H
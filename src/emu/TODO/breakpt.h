@@ -1,6 +0,0 @@
-#ifndef BREAKPT_H
-#define BREAKPT_H
-
-void initBreakPt();
-
-#endif // BREAKPT_H
@@ -0,0 +1,113 @@
+#include "adaptivecomparator.h"
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+constexpr double dcCutoff       = 50.0;   // Hz, well below the long pulse frequency
+constexpr double noiseCutoff    = 8000.0; // Hz, well above the short pulse frequency
+constexpr double peakReleaseMs  = 20.0;   // several long pulses
+constexpr double levelReleaseMs = 2000.0; // longer than gaps between blocks
+constexpr float  hysteresis     = 0.35f;  // part of the peak level
+constexpr float  squelch        = 0.5f;   // part of the long term level
+constexpr float  silenceLevel   = 256.0f;
+
+constexpr std::array<int32_t, 5> edgeSamples = {
+    -32767, -24576, 0, 24576, 32767
+};
+
+} // namespace
+
+class AdaptiveComparator::Impl final:
+        public AdaptiveComparator
+{
+public:
+    explicit Impl(int sampleRate):
+        dcFactor_m(float(1.0 - exp(-2.0 * pi * dcCutoff / sampleRate))),
+        noiseFactor_m(float(1.0 - exp(-2.0 * pi * std::min(noiseCutoff, sampleRate * 0.4) / sampleRate))),
+        peakFactor_m(float(exp(-1000.0 / (peakReleaseMs * sampleRate)))),
+        levelFactor_m(float(exp(-1000.0 / (levelReleaseMs * sampleRate)))),
+        dc_m(0), lowpass_m(0), peak_m(0), level_m(0), isPrimed_m(false),
+        isHighLevel_m(false), edgeSamplePos_m(0)
+    {}
+
+    virtual void convert(Slice<const uint8_t> * source, Slice<uint8_t> * target) override
+    {
+        convert(reinterpret_cast<Slice<const int32_t> *>(source),
+                reinterpret_cast<Slice<int32_t> *>(target));
+    }
+
+    virtual auto isValid() const -> bool override
+    {
+        return true;
+    }
+
+    virtual void recover() override
+    {
+    }
+
+private:
+    void convert(Slice<const int32_t> * source, Slice<int32_t> * target)
+    {
+        while(source->count() > 0 && target->count() > 0) {
+            float s = float(*source->data());
+            if(!isPrimed_m) {
+                dc_m = s;
+                lowpass_m = s;
+                isPrimed_m = true;
+            }
+
+            // Broadband noise low-pass, then DC removal high-pass
+            lowpass_m += (s - lowpass_m) * noiseFactor_m;
+            dc_m += (lowpass_m - dc_m) * dcFactor_m;
+            s = lowpass_m - dc_m;
+
+            // Envelope followers with instant attack
+            peak_m = std::max(std::fabs(s), peak_m * peakFactor_m);
+            level_m = std::max(peak_m, level_m * levelFactor_m);
+
+            // Gain normalized trigger, level is held through the silence and
+            // the noise between blocks
+            if(peak_m > silenceLevel && peak_m > level_m * squelch) {
+                float level = s / peak_m;
+                if(isHighLevel_m ? level < -hysteresis : level > hysteresis) {
+                    isHighLevel_m = !isHighLevel_m;
+                }
+            }
+
+            if(isHighLevel_m) {
+                if(edgeSamplePos_m < edgeSamples.size() - 1) {
+                    ++edgeSamplePos_m;
+                }
+            } else {
+                if(edgeSamplePos_m > 0) {
+                    --edgeSamplePos_m;
+                }
+            }
+            *target->data() = edgeSamples[edgeSamplePos_m];
+
+            source->advance();
+            target->advance();
+        }
+    }
+
+    const float dcFactor_m;
+    const float noiseFactor_m;
+    const float peakFactor_m;
+    const float levelFactor_m;
+    float dc_m;
+    float lowpass_m;
+    float peak_m;
+    float level_m;
+    bool isPrimed_m;
+    bool isHighLevel_m;
+    size_t edgeSamplePos_m;
+};
+
+auto AdaptiveComparator::create(int sampleRate) -> std::unique_ptr<AdaptiveComparator>
+{
+    return std::make_unique<Impl>(sampleRate);
+}
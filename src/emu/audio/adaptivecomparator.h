@@ -0,0 +1,20 @@
+#ifndef ADAPTIVECOMPARATOR_H
+#define ADAPTIVECOMPARATOR_H
+
+#include "cvtstream.h"
+
+// Comparator for captures of unknown level: removes DC offset, follows the
+// signal envelope and derives the trigger hysteresis from the running peak
+
+class AdaptiveComparator:
+        public ICvt
+{
+public:
+    static auto create(int sampleRate) -> std::unique_ptr<AdaptiveComparator>;
+
+private:
+    class Impl;
+    explicit AdaptiveComparator() = default;
+};
+
+#endif // ADAPTIVECOMPARATOR_H
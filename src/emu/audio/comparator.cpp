@@ -1,4 +1,5 @@
 #include "comparator.h"
+#include <array>
 
 namespace {
 
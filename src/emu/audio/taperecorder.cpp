@@ -0,0 +1,278 @@
+#include "taperecorder.h"
+#include "video.h"
+#include "wav.h"
+#include "cvtstream.h"
+#include "spscqueue.h"
+#include <thread>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+
+namespace {
+
+constexpr WavParams recordParams = { 1, wavDefaultSampleRate, 16 };
+
+constexpr int16_t recordLevel = 24576;
+
+constexpr size_t queueSize = size_t(wavDefaultSampleRate) * 4; // samples, enough to ride out disk stalls
+constexpr size_t writeBufSize = 4096;
+
+constexpr auto writerIdleTime = std::chrono::milliseconds(20);
+
+// Writer thread doesn't log, but leaves its status to be reported on the
+// emulation thread
+enum struct WriterStatus {
+    ok,
+    openFailed,
+    formatMismatch,
+    writeFailed
+};
+
+} // namespace
+
+class TapeRecorder::Impl final:
+        public TapeRecorder
+{
+public:
+    explicit Impl(Timeline * timeline, Cpu * cpu):
+        timeline_m(timeline), cpu_m(cpu), cpuRegs_m(cpu->cpuRegs()),
+        queue_m(queueSize), isStopping_m(false), writerStatus_m(WriterStatus::ok)
+    {}
+
+    ~Impl()
+    {
+        close();
+    }
+
+    virtual void open(const std::string & fileName) override
+    {
+        close();
+
+        fileName_m = fileName;
+        edges_m.clear();
+        frameBuf_m.clear();
+        sampleRemainder_m = 0;
+        tapeLevel_m = false;
+        renderLevel_m = false;
+        isMotorOn_m = false;
+        wasMotorOn_m = false;
+        isOverflowReported_m = false;
+        isWriterFailed_m = false;
+        frameNum_m = timeline_m->frameNum();
+
+        wavFileWriter_m = WavFileWriter::create();
+        wavFileWriter_m->setLog(std::make_unique<NullLog>());
+        wavCvt_m = WavCvt::create();
+        wavCvt_m->setLog(std::make_unique<NullLog>());
+        cvtWriter_m = CvtWriter::create(wavCvt_m.get(), writeBufSize * sizeof(int16_t));
+        cvtWriter_m->setLog(std::make_unique<NullLog>());
+
+        frameHook_m = timeline_m->createFrameHook(memFunc(this, &Impl::frameHookFunc));
+        tapeOutHook_m = cpu_m->createTapeOutHook(memFunc(this, &Impl::tapeOutHookFunc));
+
+        isStopping_m = false;
+        writerStatus_m = WriterStatus::ok;
+        writerThread_m = std::thread(&Impl::writerThreadFunc, this);
+    }
+
+    // Edges recorded since the last frame hook are rendered, so the end of
+    // the recording is kept. Between frames it's the whole frame ended, and
+    // in the middle of the frame it's the part up to the current clock
+    virtual void close() override
+    {
+        if(frameHook_m && timeline_m->frameNum() != frameNum_m) {
+            frameHookFunc();
+        } else if(frameHook_m && wasMotorOn_m && !isWriterFailed_m) {
+            unsigned frameSampleCount = (unsigned(recordParams.sampleRate) + sampleRemainder_m) / videoFps;
+            size_t clock = std::min(size_t(cpuRegs_m->clock), clocksPerFrame);
+            renderSamples(unsigned(uint64_t(frameSampleCount) * clock / clocksPerFrame), frameSampleCount);
+        }
+        frameHook_m = nullptr;
+        tapeOutHook_m = nullptr;
+
+        if(writerThread_m.joinable()) {
+            isStopping_m = true;
+            writerThread_m.join();
+            checkWriter();
+        }
+    }
+
+private:
+    void tapeOutHookFunc(uint8_t port82)
+    {
+        bool tapeLevel = (port82 & TapeBit::out);
+        if(tapeLevel != tapeLevel_m) {
+            tapeLevel_m = tapeLevel;
+            edges_m.push_back(cpuRegs_m->clock);
+        }
+        isMotorOn_m = (port82 & TapeBit::motor);
+        wasMotorOn_m = wasMotorOn_m || isMotorOn_m;
+    }
+
+    // Fired at the start of the frame, so edges of the previous one are
+    // rendered. Edges made by the instruction crossing the frame boundary
+    // are moved to the next frame
+    void frameHookFunc()
+    {
+        checkWriter();
+        frameNum_m = timeline_m->frameNum();
+
+        unsigned sampleCount = (unsigned(recordParams.sampleRate) + sampleRemainder_m) / videoFps;
+        sampleRemainder_m = (unsigned(recordParams.sampleRate) + sampleRemainder_m) % videoFps;
+
+        size_t edgePos = 0;
+        if(wasMotorOn_m && !isWriterFailed_m) {
+            edgePos = renderSamples(sampleCount, sampleCount);
+        }
+
+        while(edgePos < edges_m.size() && edges_m[edgePos] < clocksPerFrame) {
+            renderLevel_m = !renderLevel_m;
+            ++edgePos;
+        }
+        edges_m.erase(edges_m.begin(), edges_m.begin() + ptrdiff_t(edgePos));
+        for(unsigned & edge: edges_m) {
+            edge -= clocksPerFrame;
+        }
+
+        wasMotorOn_m = isMotorOn_m;
+    }
+
+    // Renders the first sampleCount samples of the frame, returns position of
+    // the first edge not rendered
+    auto renderSamples(unsigned sampleCount, unsigned frameSampleCount) -> size_t
+    {
+        size_t edgePos = 0;
+        frameBuf_m.resize(sampleCount);
+        for(unsigned i = 0; i < sampleCount; ++i) {
+            unsigned sampleClock = unsigned(uint64_t(i) * clocksPerFrame / frameSampleCount);
+            while(edgePos < edges_m.size() && edges_m[edgePos] <= sampleClock) {
+                renderLevel_m = !renderLevel_m;
+                ++edgePos;
+            }
+            frameBuf_m[i] = (renderLevel_m ? recordLevel : -recordLevel);
+        }
+        if(queue_m.push(frameBuf_m.data(), frameBuf_m.size()) < frameBuf_m.size() && !isOverflowReported_m) {
+            msg(LogLevel::warn, "Tape recording can't keep up, some sound is lost");
+            isOverflowReported_m = true;
+        }
+        return edgePos;
+    }
+
+    // Recording stops on the first writer failure
+    void checkWriter()
+    {
+        if(isWriterFailed_m) {
+            return;
+        }
+        switch(writerStatus_m) {
+            case WriterStatus::ok:
+                return;
+            case WriterStatus::openFailed:
+                msg(LogLevel::error, "Could not open tape recording file \"%s\"", fileName_m.data());
+                break;
+            case WriterStatus::formatMismatch:
+                msg(LogLevel::error, "Can't append tape recording to WAV file of different format");
+                break;
+            case WriterStatus::writeFailed:
+                msg(LogLevel::error, "Could not write tape recording file \"%s\"", fileName_m.data());
+                break;
+        }
+        isWriterFailed_m = true;
+    }
+
+    // File is opened on the first recorded sound, and WAV header is kept up
+    // to date by the writer itself and on every idle period
+    void writerThreadFunc()
+    {
+        std::array<int16_t, writeBufSize> buf;
+        bool isOpen = false;
+        bool isFlushed = true;
+
+        while(true) {
+            bool isStopping = isStopping_m;
+            size_t count = queue_m.pop(buf.data(), buf.size());
+            if(count == 0) {
+                if(!isFlushed) {
+                    cvtWriter_m->flush();
+                    isFlushed = true;
+                }
+                if(isStopping) {
+                    break;
+                }
+                std::this_thread::sleep_for(writerIdleTime);
+                continue;
+            }
+
+            if(!isOpen) {
+                WriterStatus status = openWavFile();
+                if(status != WriterStatus::ok) {
+                    writerStatus_m = status;
+                    break;
+                }
+                isOpen = true;
+            }
+            cvtWriter_m->write(reinterpret_cast<const uint8_t *>(buf.data()), count * sizeof(int16_t));
+            isFlushed = false;
+            if(!wavFileWriter_m->isValid()) {
+                writerStatus_m = WriterStatus::writeFailed;
+                break;
+            }
+        }
+
+        cvtWriter_m->close();
+        wavFileWriter_m->close();
+    }
+
+    // Recording is converted to the format of the file being appended to
+    auto openWavFile() -> WriterStatus
+    {
+        bool isAppend = std::ifstream(fileName_m).good();
+        wavFileWriter_m->open(fileName_m, !isAppend, recordParams);
+        if(!wavFileWriter_m->isValid()) {
+            return WriterStatus::openFailed;
+        }
+
+        wavCvt_m->setSourceParams(recordParams);
+        wavCvt_m->setTargetParams(wavFileWriter_m->params());
+        if(!wavCvt_m->isValid()) {
+            wavFileWriter_m->close();
+            return WriterStatus::formatMismatch;
+        }
+        cvtWriter_m->open(wavFileWriter_m.get());
+        return WriterStatus::ok;
+    }
+
+    Timeline * timeline_m;
+    Cpu * cpu_m;
+    CpuRegs * cpuRegs_m;
+
+    std::unique_ptr<FrameHook> frameHook_m;
+    std::unique_ptr<TapeOutHook> tapeOutHook_m;
+
+    std::string fileName_m;
+    std::vector<unsigned> edges_m;
+    std::vector<int16_t> frameBuf_m;
+    unsigned sampleRemainder_m;
+    unsigned frameNum_m; // of the last frame hook
+    bool tapeLevel_m;
+    bool renderLevel_m;
+    bool isMotorOn_m;
+    bool wasMotorOn_m;
+    bool isOverflowReported_m;
+    bool isWriterFailed_m; // reported already
+
+    std::unique_ptr<WavFileWriter> wavFileWriter_m;
+    std::unique_ptr<WavCvt> wavCvt_m;
+    std::unique_ptr<CvtWriter> cvtWriter_m;
+    SpscQueue<int16_t> queue_m;
+    std::thread writerThread_m;
+    std::atomic<bool> isStopping_m;
+    std::atomic<WriterStatus> writerStatus_m;
+};
+
+auto TapeRecorder::create(Timeline * timeline, Cpu * cpu) -> std::unique_ptr<TapeRecorder>
+{
+    return std::make_unique<Impl>(timeline, cpu);
+}
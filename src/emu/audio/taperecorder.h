@@ -0,0 +1,25 @@
+#ifndef TAPERECORDER_H
+#define TAPERECORDER_H
+
+#include "timeline.h"
+#include "cpu.h"
+
+// Records tape output into WAV file while the tape motor is on. Edges are
+// rendered into samples once per frame and handed over to a background
+// thread through a lock-free queue, so emulation never waits for disk
+
+class TapeRecorder:
+        public Logger
+{
+public:
+    static auto create(Timeline * timeline, Cpu * cpu) -> std::unique_ptr<TapeRecorder>;
+
+    virtual void open(const std::string & fileName) = 0;
+    virtual void close() = 0;
+
+private:
+    class Impl;
+    explicit TapeRecorder() = default;
+};
+
+#endif // TAPERECORDER_H
@@ -1,18 +1,23 @@
 #include "bios.h"
-#include "libretro.h"
 #include "cas.h"
+#include "pwe.h"
+#include "taperecorder.h"
 #include <cstring>
 
 constexpr size_t biosSize = 16384;
+
+constexpr size_t stackGuardSize = 16;
 extern uint8_t bios[biosSize];
 
 class Bios::Impl final:
         public Bios
 {
 public:
-    explicit Impl(Media * media, Memory * memory, Cpu * cpu):
-        media_m(media), memBanks_m(memory->memBanks()),
-        cpu_m(cpu), cpuRegs_m(cpu->cpuRegs())
+    explicit Impl(IEnvironment * environment, Media * media, Timeline * timeline, Memory * memory, Cpu * cpu):
+        environment_m(environment), media_m(media), timeline_m(timeline),
+        memBanks_m(memory->memBanks()), ioPorts_m(memory->ioPorts()),
+        cpu_m(cpu), cpuRegs_m(cpu->cpuRegs()),
+        isInstantLoad_m(true), isLoadHacked_m(false), atEnd_m(false)
     {}
 
     virtual void init() override
@@ -22,32 +27,169 @@ public:
 
     virtual void reset() override
     {
-        casFileReader_m->close();
+        if(casFileReader_m) {
+            casFileReader_m->close();
+        }
         isLoadHacked_m = false;
+
+        if(pweFileReader_m) {
+            rewindTape();
+        }
+        if(pmiImage_m) {
+            restoreImage();
+        }
     }
 
     virtual void close() override
     {
+        tapeRecorder_m = nullptr;
+        if(casFileWriter_m) {
+            casFileWriter_m->close();
+        }
+    }
+
+    virtual void setInstantLoad(bool isInstantLoad) override
+    {
+        isInstantLoad_m = isInstantLoad;
     }
 
     virtual void initMediaHooks() override
     {
+        pmiImage_m = nullptr;
+        pweFileReader_m = nullptr;
+        tapeInHook_m = nullptr;
+        tapeOutHook_m = nullptr;
+
         switch(media_m->playbackFile.fileFmt()) {
             case FileFmt::cas:
-                opHook_m = cpu_m->createOpHook(memFunc(this, &Impl::casOpHookFunc));
+                opHooks_m = createPcHooks({0x0199, 0x34ca, 0x36d2, 0x35cc, 0x3517, 0x370e},
+                                          memFunc(this, &Impl::casOpHookFunc));
                 casFileReader_m = CasFileReader::create();
                 captureLog(casFileReader_m.get());
                 break;
             case FileFmt::wav:
-                opHook_m = cpu_m->createOpHook(memFunc(this, &Impl::wavOpHookFunc));
+                opHooks_m.clear();
+                break;
+            case FileFmt::pwe:
+                opHooks_m = createPcHooks({0x0199}, memFunc(this, &Impl::pweOpHookFunc));
+                tapeInHook_m = cpu_m->createTapeInHook(memFunc(this, &Impl::pweTapeInHookFunc));
+                tapeOutHook_m = cpu_m->createTapeOutHook(memFunc(this, &Impl::pweTapeOutHookFunc));
+                pweFileReader_m = PweFileReader::create();
+                captureLog(pweFileReader_m.get());
+                pweFileReader_m->open(media_m->playbackFile.fileName(), media_m->playbackFile.memBuf());
+                rewindTape();
+                break;
+            case FileFmt::pmi:
+            {
+                opHooks_m.clear();
+                std::unique_ptr<PmiFileReader> pmiFileReader = PmiFileReader::create();
+                captureLog(pmiFileReader.get());
+                pmiFileReader->open(media_m->playbackFile.fileName(), media_m->playbackFile.memBuf());
+                pmiImage_m = std::make_unique<PmiImage>();
+                pmiFileReader->read(pmiImage_m.get());
+                if(!pmiFileReader->isValid()) {
+                    pmiImage_m = nullptr;
+                    environment_m->popupMsg("Could not load memory image");
+                    break;
+                }
+                restoreImage();
                 break;
+            }
             default:
-                opHook_m = nullptr;
+                opHooks_m.clear();
                 break;
         }
+
+        tapeRecorder_m = nullptr;
+        casFileWriter_m = nullptr;
+
+        switch(media_m->recordFile.fileFmt()) {
+            case FileFmt::cas:
+                recordOpHooks_m = createPcHooks({0x362b, 0x365b, 0x3621}, memFunc(this, &Impl::casRecordOpHookFunc));
+                casFileWriter_m = CasFileWriter::create();
+                captureLog(casFileWriter_m.get());
+                break;
+            case FileFmt::wav:
+                recordOpHooks_m.clear();
+                tapeRecorder_m = TapeRecorder::create(timeline_m, cpu_m);
+                captureLog(tapeRecorder_m.get());
+                tapeRecorder_m->open(media_m->recordFile.fileName());
+                break;
+            default:
+                recordOpHooks_m.clear();
+                break;
+        }
+    }
+
+    virtual void captureImage(PmiImage * image) override
+    {
+        image->regs.clock = uint32_t(cpuRegs_m->clock);
+        image->regs.state = uint16_t(cpuRegs_m->state);
+        image->regs.psw   = cpuRegs_m->psw;
+        image->regs.bc    = cpuRegs_m->bc;
+        image->regs.de    = cpuRegs_m->de;
+        image->regs.hl    = cpuRegs_m->hl;
+        image->regs.sp    = cpuRegs_m->sp;
+        image->regs.pc    = cpuRegs_m->pc;
+
+        image->ports.fill(0xff);
+        for(auto & port: imagePorts()) {
+            image->ports[port.first - pmiPortBase] = *port.second;
+        }
+
+        image->ram = memBanks_m->ram;
     }
 
 private:
+    // Bios is reset after memory and cpu, and memory map is rebuilt from
+    // ports on frame start, so the image is applied as is
+    void restoreImage()
+    {
+        cpuRegs_m->clock = pmiImage_m->regs.clock;
+        cpuRegs_m->state = pmiImage_m->regs.state;
+        cpuRegs_m->psw   = pmiImage_m->regs.psw;
+        cpuRegs_m->bc    = pmiImage_m->regs.bc;
+        cpuRegs_m->de    = pmiImage_m->regs.de;
+        cpuRegs_m->hl    = pmiImage_m->regs.hl;
+        cpuRegs_m->sp    = pmiImage_m->regs.sp;
+        cpuRegs_m->pc    = pmiImage_m->regs.pc;
+
+        for(auto & port: imagePorts()) {
+            *port.second = pmiImage_m->ports[port.first - pmiPortBase];
+        }
+
+        memBanks_m->ram = pmiImage_m->ram;
+        cpu_m->memChanged();
+    }
+
+    // Hooked addresses are the bios entry points handled by the hook function
+    auto createPcHooks(std::initializer_list<uint16_t> pcs, const PcHook::HookFunc & hookFunc)
+        -> std::vector<std::unique_ptr<PcHook>>
+    {
+        std::vector<std::unique_ptr<PcHook>> hooks;
+        for(uint16_t pc: pcs) {
+            hooks.push_back(cpu_m->createPcHook(pc, hookFunc));
+        }
+        return hooks;
+    }
+
+    // Output ports only, input ones reflect controllers state
+    auto imagePorts() -> std::array<std::pair<size_t, uint8_t *>, 10>
+    {
+        return {{
+            {0x80, &ioPorts_m->port80},
+            {0x82, &ioPorts_m->port82},
+            {0x84, &ioPorts_m->port84},
+            {0x85, &ioPorts_m->port85},
+            {0x86, &ioPorts_m->port86},
+            {0x88, &ioPorts_m->port88},
+            {0x90, &ioPorts_m->port90},
+            {0x91, &ioPorts_m->port91},
+            {0x92, &ioPorts_m->port92},
+            {0x93, &ioPorts_m->port93}
+        }};
+    }
+
     void casOpHookFunc()
     {
         switch(cpuRegs_m->pc) {
@@ -59,7 +201,7 @@ private:
                 isLoadHacked_m = true;
 
                 std::unique_ptr<CasFileReader> casFileReader = CasFileReader::create();
-                casFileReader->open(media_m->playbackFile.fileName());
+                casFileReader->open(media_m->playbackFile.fileName(), media_m->playbackFile.memBuf());
                 std::array<uint8_t, 16> buf;
                 casFileReader->read(buf.data(), 16);
                 if(!casFileReader->isValid()) {
@@ -72,24 +214,7 @@ private:
                     break;
                 }
 
-                // TODO: Find direct bios entry points. Although it seems that
-                // method used below is the most native and harmless
-                switch(buf[0]) {
-                    case 0xd0: // load binary program and run
-                    {
-                        std::string inject = stringf("bload\"%.6s\",r\x0d", buf.data() + 10);
-                        memcpy(memBanks_m->ram.data() + 0xfb85, inject.data(), inject.size());
-                        memcpy(memBanks_m->ram.data() + 0xfa2a, "\x95\xfb\x85\xfb", 4);
-                        break;
-                    }
-                    case 0xd3: // load BASIC program and run
-                    {
-                        std::string inject = stringf("cload\"%.6s\":run\x0d", buf.data() + 10);
-                        memcpy(memBanks_m->ram.data() + 0xfb85, inject.data(), inject.size());
-                        memcpy(memBanks_m->ram.data() + 0xfa2a, "\x97\xfb\x85\xfb", 4);
-                        break;
-                    }
-                }
+                injectLoadCommand(buf[0], reinterpret_cast<const char *>(buf.data() + 10));
                 break;
             }
             case 0x34ca: // load routine entry
@@ -100,7 +225,7 @@ private:
             case 0x36d2: // wait for initial tone
             {
                 if(!casFileReader_m->isValid()) {
-                    casFileReader_m->open(media_m->playbackFile.fileName());
+                    casFileReader_m->open(media_m->playbackFile.fileName(), media_m->playbackFile.memBuf());
                     if(!casFileReader_m->isValid()) {
                         cpuRegs_m->pc = 0x3772; // "Device I/O error"
                         break;
@@ -119,13 +244,67 @@ private:
                         cpuRegs_m->pc = 0x3772; // "Device I/O error"
                         break;
                     }
-                    LibRetro::popupMsg("End of media reached");
+                    environment_m->popupMsg("End of media reached");
                     atEnd_m = true;
                     break;
                 }
                 cpuRegs_m->pc = 0x370d; // initial tone detected
                 break;
             }
+            case 0x35cc: // load bc bytes to hl
+            {
+                if(!isInstantLoad_m || !isBulkLoadAllowed()) {
+                    break;
+                }
+                // Some loaders overwrite return addresses of the running bios loop
+                // to take control, so the area right below the stack pointer is
+                // left for bios to load byte by byte
+                size_t bulkCount = cpuRegs_m->bc;
+                size_t stackGuardAddr = (cpuRegs_m->sp > stackGuardSize ? cpuRegs_m->sp - stackGuardSize : 0);
+                if(cpuRegs_m->hl < cpuRegs_m->sp && cpuRegs_m->hl + bulkCount > stackGuardAddr) {
+                    bulkCount = (cpuRegs_m->hl < stackGuardAddr ? stackGuardAddr - cpuRegs_m->hl : 0);
+                }
+                size_t count;
+                do {
+                    count = casFileReader_m->read(loadBuf_m.data(), std::min(bulkCount, loadBuf_m.size()), false);
+                    bulkCount -= count;
+                    for(size_t i = 0; i < count; ++i) {
+                        cpu_m->memPoke(cpuRegs_m->hl++, loadBuf_m[i]);
+                    }
+                    cpuRegs_m->bc -= uint16_t(count);
+                } while(bulkCount != 0 && count > 0);
+                if(cpuRegs_m->bc != 0) {
+                    break; // let bios loop continue or fail on the lack of data
+                }
+                cpuRegs_m->a = 0;
+                cpuRegs_m->f = 0x02 | CpuFlag::z | CpuFlag::p; // as after "ora c" with bc = 0
+                emulateRet();
+                break;
+            }
+            case 0x3517: // load BASIC program to hl until 11 zeros in a row
+            {
+                if(!isInstantLoad_m || !isBulkLoadAllowed()) {
+                    break;
+                }
+                unsigned zeroCount = 0;
+                uint8_t data;
+                while(zeroCount < 11 && casFileReader_m->read(&data, 1, false) > 0) {
+                    cpu_m->memPoke(cpuRegs_m->hl++, data);
+                    zeroCount = (data == 0 ? zeroCount + 1 : 0);
+                }
+                if(zeroCount == 0) {
+                    break; // let bios loop fail on the lack of data
+                }
+                cpuRegs_m->a = 0;
+                cpuRegs_m->b = uint8_t(11 - zeroCount);
+                if(cpuRegs_m->b != 0) {
+                    cpuRegs_m->pc = 0x3519; // let bios loop fail on the lack of data
+                    break;
+                }
+                cpuRegs_m->f = 0x02 | CpuFlag::z | CpuFlag::p; // as after "dcr b" with b = 0
+                cpuRegs_m->pc = 0x3538; // program loaded
+                break;
+            }
             case 0x370e: // load byte
             {
                 casFileReader_m->read(&cpuRegs_m->h, sizeof(cpuRegs_m->h));
@@ -139,22 +318,175 @@ private:
         }
     }
 
-    void wavOpHookFunc()
+    void injectLoadCommand(uint8_t type, const char * name)
+    {
+        // TODO: Find direct bios entry points. Although it seems that
+        // method used below is the most native and harmless
+        switch(type) {
+            case 0xd0: // load binary program and run
+            {
+                std::string inject = stringf("bload\"%.6s\",r\x0d", name);
+                memcpy(memBanks_m->ram.data() + 0xfb85, inject.data(), inject.size());
+                memcpy(memBanks_m->ram.data() + 0xfa2a, "\x95\xfb\x85\xfb", 4);
+                break;
+            }
+            case 0xd3: // load BASIC program and run
+            {
+                std::string inject = stringf("cload\"%.6s\":run\x0d", name);
+                memcpy(memBanks_m->ram.data() + 0xfb85, inject.data(), inject.size());
+                memcpy(memBanks_m->ram.data() + 0xfa2a, "\x97\xfb\x85\xfb", 4);
+                break;
+            }
+        }
+        cpu_m->memChanged();
+    }
+
+    // Whole chunks are copied into memory bypassing bios per byte loop, which
+    // only stores bytes in load mode (as opposed to verify mode)
+    auto isBulkLoadAllowed() -> bool
+    {
+        uint8_t isLoadMode;
+        cpu_m->memPeek(&isLoadMode, 0xfa41);
+        return (isLoadMode != 0 && casFileReader_m->isValid());
+    }
+
+    void emulateRet()
+    {
+        uint8_t lo, hi;
+        cpu_m->memPeek(&lo, cpuRegs_m->sp++);
+        cpu_m->memPeek(&hi, cpuRegs_m->sp++);
+        cpuRegs_m->pc = bytepack(hi, lo);
+    }
+
+    // Bytes go to CAS file right away, so the save takes no emulated time
+    void casRecordOpHookFunc()
+    {
+        switch(cpuRegs_m->pc) {
+            case 0x362b: // write initial tone
+            {
+                if(!casFileWriter_m->isValid()) {
+                    casFileWriter_m->open(media_m->recordFile.fileName(), false);
+                    if(!casFileWriter_m->isValid()) {
+                        cpuRegs_m->pc = 0x3772; // "Device I/O error"
+                        break;
+                    }
+                }
+                casFileWriter_m->addBlock();
+                ioPorts_m->port82 |= TapeBit::motor; // to be switched off by bios as usual
+                // Tone routine ends with di, kept for the bytes written, and
+                // a STOP key check, skipped as the tone takes no time here
+                cpuRegs_m->state &= ~CpuState::inte;
+                cpuRegs_m->f &= ~CpuFlag::c;
+                emulateRet();
+                break;
+            }
+            case 0x365b: // write byte
+            {
+                casFileWriter_m->write(&cpuRegs_m->a, sizeof(cpuRegs_m->a));
+                if(!casFileWriter_m->isValid()) {
+                    cpuRegs_m->pc = 0x3772; // "Device I/O error"
+                    break;
+                }
+                cpuRegs_m->f &= ~CpuFlag::c;
+                emulateRet();
+                break;
+            }
+            case 0x3621: // tape motor off
+            {
+                casFileWriter_m->flush();
+                break;
+            }
+        }
+    }
+
+    void pweOpHookFunc()
     {
+        if(cpuRegs_m->pc != 0x0199 || isLoadHacked_m) { // test keyboard buffer
+            return;
+        }
+        isLoadHacked_m = true;
+
+        for(size_t i = 0; i < pweFileReader_m->blockCount(); ++i) {
+            PweBlockInfo block = pweFileReader_m->blockInfo(i);
+            if(block.type != 0) {
+                injectLoadCommand(block.type, block.name.data());
+                break;
+            }
+        }
     }
 
+    // Tape moves only while the motor is on. Edges passed since the previous
+    // port access are skipped, so the cost is constant per edge
+    void pweTapeInHookFunc(bool * tapeBit)
+    {
+        advanceTape();
+        uint64_t edgeClock = (pweClockRate_m == pweDefaultClockRate ?
+                                  tapeClock_m : tapeClock_m * pweClockRate_m / pweDefaultClockRate);
+        while(nextEdgeClock_m <= edgeClock) {
+            tapeLevel_m = !tapeLevel_m;
+            nextEdgeClock_m = pweFileReader_m->nextEdge();
+        }
+        *tapeBit = tapeLevel_m;
+    }
+
+    void pweTapeOutHookFunc(uint8_t port82)
+    {
+        advanceTape();
+        isMotorOn_m = (port82 & TapeBit::motor);
+    }
+
+    void advanceTape()
+    {
+        uint64_t clock = uint64_t(timeline_m->frameNum()) * clocksPerFrame + cpuRegs_m->clock;
+        if(isMotorOn_m && clock > lastClock_m) {
+            tapeClock_m += clock - lastClock_m;
+        }
+        lastClock_m = clock;
+    }
+
+    void rewindTape()
+    {
+        pweFileReader_m->seekBlock(0);
+        pweClockRate_m = pweFileReader_m->clockRate();
+        tapeLevel_m = false;
+        nextEdgeClock_m = pweFileReader_m->nextEdge();
+        tapeClock_m = 0;
+        lastClock_m = 0;
+        isMotorOn_m = false;
+    }
+
+    IEnvironment * environment_m;
     Media * media_m;
+    Timeline * timeline_m;
     MemBanks * memBanks_m;
+    IoPorts * ioPorts_m;
     Cpu * cpu_m;
     CpuRegs * cpuRegs_m;
 
-    std::unique_ptr<OpHook> opHook_m;
+    std::vector<std::unique_ptr<PcHook>> opHooks_m;
     std::unique_ptr<CasFileReader> casFileReader_m;
+    std::unique_ptr<PmiImage> pmiImage_m;
+
+    std::unique_ptr<PweFileReader> pweFileReader_m;
+    std::unique_ptr<TapeInHook> tapeInHook_m;
+    std::unique_ptr<TapeOutHook> tapeOutHook_m;
+    uint32_t pweClockRate_m;
+    uint64_t tapeClock_m;
+    uint64_t lastClock_m;
+    uint64_t nextEdgeClock_m;
+    bool tapeLevel_m;
+    bool isMotorOn_m;
+
+    std::vector<std::unique_ptr<PcHook>> recordOpHooks_m;
+    std::unique_ptr<CasFileWriter> casFileWriter_m;
+    std::unique_ptr<TapeRecorder> tapeRecorder_m;
+    std::array<uint8_t, 4096> loadBuf_m;
+    bool isInstantLoad_m;
     bool isLoadHacked_m;
     bool atEnd_m;
 };
 
-auto Bios::create(Media * media, Memory * memory, Cpu * cpu) -> std::unique_ptr<Bios>
+auto Bios::create(IEnvironment * environment, Media * media, Timeline * timeline, Memory * memory, Cpu * cpu) -> std::unique_ptr<Bios>
 {
-    return std::make_unique<Impl>(media, memory, cpu);
+    return std::make_unique<Impl>(environment, media, timeline, memory, cpu);
 }
@@ -1,19 +1,30 @@
 #ifndef BIOS_H
 #define BIOS_H
 
+#include "environment.h"
 #include "media.h"
+#include "timeline.h"
 #include "memory.h"
 #include "cpu.h"
+#include "pmi.h"
 
 class Bios:
         public ISubSystem,
         public Logger
 {
 public:
-    static auto create(Media * media, Memory * memory, Cpu * cpu) -> std::unique_ptr<Bios>;
+    static auto create(IEnvironment * environment, Media * media, Timeline * timeline, Memory * memory, Cpu * cpu) -> std::unique_ptr<Bios>;
+
+    // Instant load copies CAS data into memory by whole chunks instead of
+    // feeding bios load routine byte by byte. Enabled by default
+    virtual void setInstantLoad(bool isInstantLoad) = 0;
 
     virtual void initMediaHooks() = 0;
 
+    // Memory image is restored on media init and on every reset, so loaded
+    // program starts instantly instead of being loaded from tape
+    virtual void captureImage(PmiImage * image) = 0;
+
 private:
     class Impl;
     explicit Bios() = default;
@@ -77,11 +77,15 @@ class Joysticks::Impl final:
         public Joysticks
 {
 public:
-    explicit Impl(Memory * memory, Keyboard * keyboard):
+    explicit Impl(Memory * memory, Cpu * cpu, Keyboard * keyboard):
         ioPorts_m(memory->ioPorts()), targetJoystickMatrix_m(&targetJoystick_m),
-        targetKeyboardMatrix_m(keyboard->createTargetKeyboardMatrix())
+        targetKeyboardMatrix_m(keyboard->createTargetKeyboardMatrix()),
+        inPortHook_m(cpu->createInPortHook(memFunc(this, &Impl::inPortHookFunc))),
+        isLateLatch_m(false)
     {
         portMode_m.fill(JoystickPortMode::disabled);
+        pressMask_m.fill(0);
+        releaseMask_m.fill(0);
 
         retroJoystick_m.setStateFunc(memFunc(this, &Impl::retroJoystickStateFunc));
         targetJoystick_m.setStateFunc(memFunc(this, &Impl::targetJoystickStateFunc));
@@ -96,7 +100,8 @@ public:
     {
         retroJoystick_m.reset();
         targetJoystick_m.reset();
-        targetKeyboardMatrix_m.reset();
+        targetKeyboardMatrix_m->reset();
+        latchPorts();
     }
 
     virtual void close() override
@@ -112,6 +117,14 @@ public:
         // TODO: reset affected matrices
     }
 
+    virtual void setLateLatch(bool isLateLatch) override
+    {
+        isLateLatch_m = isLateLatch;
+        if(!isLateLatch_m) {
+            latchPorts();
+        }
+    }
+
     virtual auto createRetroJoystickMatrix() -> std::unique_ptr<RetroJoystickMatrix> override
     {
         return std::make_unique<RetroJoystickMatrix>(&retroJoystick_m);
@@ -171,23 +184,43 @@ private:
 
         auto it = portMap.find(key);
         if(it != portMap.end()) {
-            std::array<uint8_t *, joystickPortCount> joystickPorts = {
-                &ioPorts_m->port8c,
-                &ioPorts_m->port8d
-            };
-
             const PortMask & portMask = it->second;
-            uint8_t * port = joystickPorts[portMask.port];
             uint8_t mask = portMask.mask;
 
             if(isPressed) {
-                *port |= mask;
+                pressMask_m[portMask.port] |= mask;
+                releaseMask_m[portMask.port] &= ~mask;
             } else {
-                *port &= ~mask;
+                releaseMask_m[portMask.port] |= mask;
+                pressMask_m[portMask.port] &= ~mask;
+            }
+            if(!isLateLatch_m) {
+                latchPorts();
             }
         }
     }
 
+    void inPortHookFunc(uint8_t port)
+    {
+        if(port == 0x8c || port == 0x8d) {
+            latchPorts();
+        }
+    }
+
+    void latchPorts()
+    {
+        std::array<uint8_t *, joystickPortCount> joystickPorts = {
+            &ioPorts_m->port8c,
+            &ioPorts_m->port8d
+        };
+
+        for(size_t i = 0; i < joystickPorts.size(); ++i) {
+            *joystickPorts[i] = (*joystickPorts[i] | pressMask_m[i]) & ~releaseMask_m[i];
+        }
+        pressMask_m.fill(0);
+        releaseMask_m.fill(0);
+    }
+
     IoPorts * ioPorts_m;
 
     std::array<JoystickPortMode, joystickPortCount> portMode_m;
@@ -200,9 +233,16 @@ private:
 
     RetroJoystickHook::HookTrigger retroJoystickHookTrigger_m;
     TargetJoystickHook::HookTrigger targetJoystickHookTrigger_m;
+
+    std::unique_ptr<InPortHook> inPortHook_m;
+
+    // Port bits changed since the last latch
+    bool isLateLatch_m;
+    std::array<uint8_t, joystickPortCount> pressMask_m;
+    std::array<uint8_t, joystickPortCount> releaseMask_m;
 };
 
-auto Joysticks::create(Memory * memory, Keyboard * keyboard) -> std::unique_ptr<Joysticks>
+auto Joysticks::create(Memory * memory, Cpu * cpu, Keyboard * keyboard) -> std::unique_ptr<Joysticks>
 {
-    return std::make_unique<Impl>(memory, keyboard);
+    return std::make_unique<Impl>(memory, cpu, keyboard);
 }
@@ -55,10 +55,13 @@ class Joysticks:
         public Logger
 {
 public:
-    static auto create(Memory * memory, Keyboard * keyboard) -> std::unique_ptr<Joysticks>;
+    static auto create(Memory * memory, Cpu * cpu, Keyboard * keyboard) -> std::unique_ptr<Joysticks>;
 
     virtual void setPortMode(size_t port, JoystickPortMode portMode) = 0;
 
+    // Same as for keyboard, but for ports 8ch and 8dh
+    virtual void setLateLatch(bool isLateLatch) = 0;
+
     virtual auto createRetroJoystickMatrix() -> std::unique_ptr<RetroJoystickMatrix> = 0;
     virtual auto createTargetJoystickMatrix() -> std::unique_ptr<TargetJoystickMatrix> = 0;
 
@@ -232,10 +232,15 @@ class Keyboard::Impl:
         public Keyboard
 {
 public:
-    explicit Impl(Memory * memory):
+    explicit Impl(Memory * memory, Cpu * cpu):
         ioPorts_m(memory->ioPorts()),
-        targetKeyboardMatrix_m(&targetKeyboard_m)
+        targetKeyboardMatrix_m(&targetKeyboard_m),
+        inPortHook_m(cpu->createInPortHook(memFunc(this, &Impl::inPortHookFunc))),
+        isLateLatch_m(false)
     {
+        pressMask_m.fill(0);
+        releaseMask_m.fill(0);
+
         retroKeyboard_m.setStateFunc(memFunc(this, &Impl::retroKeyboardStateFunc));
         targetKeyboard_m.setStateFunc(memFunc(this, &Impl::targetKeyboardStateFunc));
     }
@@ -249,12 +254,21 @@ public:
     {
         retroKeyboard_m.reset();
         targetKeyboard_m.reset();
+        latchPorts();
     }
 
     virtual void close() override
     {
     }
 
+    virtual void setLateLatch(bool isLateLatch) override
+    {
+        isLateLatch_m = isLateLatch;
+        if(!isLateLatch_m) {
+            latchPorts();
+        }
+    }
+
     virtual auto createRetroKeyboardMatrix() -> std::unique_ptr<RetroKeyboardMatrix> override
     {
         return std::make_unique<RetroKeyboardMatrix>(&retroKeyboard_m);
@@ -305,14 +319,35 @@ private:
             const PortMask & portMask = it->second;
             if(isPressed) {
                 for(size_t i = 0; i < ioPorts_m->port81.size(); ++i) {
-                    ioPorts_m->port81[i] &= ~portMask[i];
+                    pressMask_m[i] |= portMask[i];
+                    releaseMask_m[i] &= ~portMask[i];
                 }
             } else {
                 for(size_t i = 0; i < ioPorts_m->port81.size(); ++i) {
-                    ioPorts_m->port81[i] |= portMask[i];
+                    releaseMask_m[i] |= portMask[i];
+                    pressMask_m[i] &= ~portMask[i];
                 }
             }
+            if(!isLateLatch_m) {
+                latchPorts();
+            }
+        }
+    }
+
+    void inPortHookFunc(uint8_t port)
+    {
+        if(port == 0x81) {
+            latchPorts();
+        }
+    }
+
+    void latchPorts()
+    {
+        for(size_t i = 0; i < ioPorts_m->port81.size(); ++i) {
+            ioPorts_m->port81[i] = (ioPorts_m->port81[i] & ~pressMask_m[i]) | releaseMask_m[i];
         }
+        pressMask_m.fill(0);
+        releaseMask_m.fill(0);
     }
 
     IoPorts * ioPorts_m;
@@ -323,9 +358,16 @@ private:
 
     RetroKeyboardHook::HookTrigger retroKeyboardHookTrigger_m;
     TargetKeyboardHook::HookTrigger targetKeyboardHookTrigger_m;
+
+    std::unique_ptr<InPortHook> inPortHook_m;
+
+    // Port bits changed since the last latch
+    bool isLateLatch_m;
+    PortMask pressMask_m;
+    PortMask releaseMask_m;
 };
 
-auto Keyboard::create(Memory * memory) -> std::unique_ptr<Keyboard>
+auto Keyboard::create(Memory * memory, Cpu * cpu) -> std::unique_ptr<Keyboard>
 {
-    return std::make_unique<Impl>(memory);
+    return std::make_unique<Impl>(memory, cpu);
 }
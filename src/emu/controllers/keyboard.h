@@ -4,6 +4,7 @@
 #include "controllers.h"
 #include "hooks.h"
 #include "memory.h"
+#include "cpu.h"
 
 using RetroKeyboardKey = int; // emilator's keyboard key
 
@@ -114,7 +115,11 @@ class Keyboard:
         public Logger
 {
 public:
-    static auto create(Memory * memory) -> std::unique_ptr<Keyboard>;
+    static auto create(Memory * memory, Cpu * cpu) -> std::unique_ptr<Keyboard>;
+
+    // Late latch holds port changes back until the program reads port 81h
+    // next time, so input may be polled right at that read
+    virtual void setLateLatch(bool isLateLatch) = 0;
 
     virtual auto createRetroKeyboardMatrix() -> std::unique_ptr<RetroKeyboardMatrix> = 0;
     virtual auto createTargetKeyboardMatrix() -> std::unique_ptr<TargetKeyboardMatrix> = 0;
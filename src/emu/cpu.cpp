@@ -1,5 +1,8 @@
 #include "cpu.h"
+#include "jit.h"
 //#include "audio.h"
+#include <algorithm>
+#include <utility>
 
 namespace {
 
@@ -17,16 +20,468 @@ const std::array<MemBankType, 4> writeBankTypes = {
     MemBankType::ram
 };
 
+// Operands as encoded in ops
+enum OpReg: unsigned {
+    opRegB, opRegC, opRegD, opRegE, opRegH, opRegL, opRegM, opRegA
+};
+
+enum OpPair: unsigned {
+    opPairBC, opPairDE, opPairHL, opPairSP,
+    opPairPSW // in place of sp for push and pop
+};
+
+enum struct AluOp {
+    add, adc, sub, sbb, ana, xra, ora, cmp
+};
+
+constexpr std::array<uint8_t, 4> conditionFlags = {
+    CpuFlag::z, CpuFlag::c, CpuFlag::p, CpuFlag::s
+};
+
+constexpr auto opLength(uint8_t op) -> size_t
+{
+    if((op & 0xcf) == 0x01 || (op & 0xe7) == 0x22 || (op & 0xc7) == 0xc2 || (op & 0xc7) == 0xc4 ||
+       op == 0xc3 || op == 0xcb || (op & 0xcf) == 0xcd)
+    {
+        return 3;
+    }
+    if((op & 0xc7) == 0x06 || (op & 0xc7) == 0xc6 || op == 0xd3 || op == 0xdb) {
+        return 2;
+    }
+    return 1;
+}
+
+// Hot idioms run by a single handler, as op sequences with operands left out
+// and zero padded. Sequences ending with a jump back to their start run as
+// loops. Longer sequences go first to take precedence
+constexpr size_t maxFusedOps = 10;
+constexpr std::array<std::array<uint8_t, maxFusedOps>, 16> fusedSeqs = {{
+    {0x1a, 0x77, 0x3e, 0x12, 0x23, 0x13, 0x0b, 0x78, 0xb1, 0xc2}, // ldax d; mov m,a; mvi a,n; stax d; inx h; inx d; dcx b; mov a,b; ora c; jnz
+    {0x1a, 0x77, 0x23, 0x13, 0x0b, 0x78, 0xb1, 0xc2}, // ldax d; mov m,a; inx h; inx d; dcx b; mov a,b; ora c; jnz
+    {0x7e, 0x12, 0x23, 0x13, 0x0b, 0x78, 0xb1, 0xc2}, // mov a,m; stax d; inx h; inx d; dcx b; mov a,b; ora c; jnz
+    {0x0a, 0x12, 0x03, 0x13, 0x2b, 0x7c, 0xb5, 0xc2}, // ldax b; stax d; inx b; inx d; dcx h; mov a,h; ora l; jnz
+    {0x77, 0x23, 0x0b, 0x78, 0xb1, 0xc2}, // mov m,a; inx h; dcx b; mov a,b; ora c; jnz
+    {0x12, 0x13, 0x0b, 0x78, 0xb1, 0xc2}, // stax d; inx d; dcx b; mov a,b; ora c; jnz
+    {0x1a, 0x77, 0x23, 0x13},             // ldax d; mov m,a; inx h; inx d
+    {0x77, 0x23},                         // mov m,a; inx h
+    {0x0b, 0x78, 0xb1, 0xc2},             // dcx b; mov a,b; ora c; jnz
+    {0x0b, 0x79, 0xb0, 0xc2},             // dcx b; mov a,c; ora b; jnz
+    {0x1b, 0x7a, 0xb3, 0xc2},             // dcx d; mov a,d; ora e; jnz
+    {0x1b, 0x7b, 0xb2, 0xc2},             // dcx d; mov a,e; ora d; jnz
+    {0x05, 0xc2},                         // dcr b; jnz
+    {0x0d, 0xc2},                         // dcr c; jnz
+    {0x15, 0xc2},                         // dcr d; jnz
+    {0x1d, 0xc2}                          // dcr e; jnz
+}};
+
+constexpr auto fusedSeqSize(size_t seqNum) -> size_t
+{
+    size_t size = 0;
+    while(size < maxFusedOps && fusedSeqs[seqNum][size] != 0) {
+        ++size;
+    }
+    return size;
+}
+
+// Delay loops count a register down by the head op until it gets zero, and
+// change nothing but the accumulator and flags otherwise
+constexpr auto isDelaySeq(size_t seqNum) -> bool
+{
+    const auto & fusedSeq = fusedSeqs[seqNum];
+    size_t size = fusedSeqSize(seqNum);
+    uint8_t head = fusedSeq[0];
+    if(((head & 0xcf) != 0x0b || head == 0x3b) && ((head & 0xc7) != 0x05 || head == 0x35 || head == 0x3d)) {
+        return false;
+    }
+    for(size_t i = 1; i + 1 < size; ++i) {
+        uint8_t op = fusedSeq[i];
+        bool isMovA = (op >= 0x78 && op < 0x80 && op != 0x7e);
+        bool isAlu = (op >= 0x80 && op < 0xc0 && (op & 0x07) != 0x06);
+        if(!isMovA && !isAlu) {
+            return false;
+        }
+    }
+    return (fusedSeq[size - 1] == 0xc2);
+}
+
+constexpr auto isFusedHead(uint8_t op) -> bool
+{
+    for(const auto & fusedSeq: fusedSeqs) {
+        if(fusedSeq[0] == op) {
+            return true;
+        }
+    }
+    return false;
+}
+
 enum class RamMode {
     mode0, // screen 0 and undocumented screen
     mode1  // screen 1 and screen 2
 };
 
+constexpr unsigned maxLoopBytes  = 256;  // backward jump distance to consider a loop
+constexpr unsigned maxLoopClocks = 4096; // duration of a single iteration
+constexpr size_t   maxLoopWrites = 32;   // distinct bytes changed by a single iteration
+constexpr size_t   maxLoopWaits  = 256;  // ram accesses of a single iteration
+constexpr unsigned maxWaitPeriod = 1280;
+constexpr unsigned maxLoopBackoff = 64;  // iterations to wait before checking a busy loop again
+constexpr size_t   maxDelayWaits  = 16;  // ram accesses of a single delay loop iteration
+
+// Replays ram waits logged at the given points, in clocks without waits since
+// the start. Returns clock of the end, or clock limit if it is reached earlier
+template <typename WaitFunc>
+auto replayWaits(const WaitFunc & waitFunc, const unsigned * waits, size_t waitCount,
+                 unsigned clock, unsigned baseClocks, unsigned clockLimit) -> unsigned
+{
+    unsigned prevWait = 0;
+    for(size_t i = 0; i < waitCount; ++i) {
+        clock += waits[i] - prevWait;
+        if(clock >= clockLimit) {
+            return clockLimit;
+        }
+        clock += waitFunc(clock);
+        prevWait = waits[i];
+    }
+    return clock + baseClocks - prevWait;
+}
+
+// Busy loop detection: an iteration is idle if it starts with the same
+// registers and memory as the previous one and writes no ports, so the
+// following iterations take the same path. Memory may change in between,
+// e.g. by calls made from the loop, but has to be restored by the iteration
+// end. Iteration time still depends on clock through ram wait states, so
+// iterations are skipped by replaying the wait states of the last one, and
+// once the loop head is reached again at the same wait phase, the whole
+// cycle of iterations is skipped at once
+
+class IdleLoop final
+{
+public:
+    explicit IdleLoop(CpuRegs * cpuRegs):
+        cpuRegs_m(cpuRegs), isActive_m(false), runNum_m(0)
+    {
+        phaseClocks_m.fill(0);
+        phaseRuns_m.fill(0);
+        reset();
+    }
+
+    void reset()
+    {
+        isStarted_m = false;
+        isDirty_m = false;
+        writeCount_m = 0;
+        waitCount_m = 0;
+        waitSum_m = 0;
+        backoff_m = 1;
+        backoffCount_m = 0;
+    }
+
+    void activate(bool isActive = true)
+    {
+        isActive_m = isActive;
+        reset();
+    }
+
+    auto isActive() const -> bool
+    {
+        return isActive_m;
+    }
+
+    void markDirty()
+    {
+        isDirty_m = true;
+    }
+
+    // True while an iteration is being logged, which takes every op interpreted
+    auto isLogging() const -> bool
+    {
+        return (isActive_m && isStarted_m && !isDirty_m && cpuRegs_m->clock - headClock_m <= maxLoopClocks);
+    }
+
+    // Called before the memory byte gets changed
+    void logWrite(uint8_t * data)
+    {
+        if(!isActive_m || isDirty_m) {
+            return;
+        }
+        for(size_t i = 0; i < writeCount_m; ++i) {
+            if(writes_m[i].data == data) {
+                return;
+            }
+        }
+        if(writeCount_m == writes_m.size()) {
+            isDirty_m = true;
+            return;
+        }
+        writes_m[writeCount_m++] = {data, *data};
+    }
+
+    void logWait(unsigned clock, unsigned waitClocks)
+    {
+        if(!isActive_m || isDirty_m) {
+            return;
+        }
+        if(waitCount_m == waits_m.size()) {
+            isDirty_m = true;
+            return;
+        }
+        waits_m[waitCount_m++] = clock - headClock_m - waitSum_m;
+        waitSum_m += waitClocks;
+    }
+
+    // Called when control goes back. Returns clocks which may be skipped
+    // without reaching the clock limit
+    template <typename WaitFunc>
+    auto loopBack(const WaitFunc & waitFunc, unsigned waitPeriod, unsigned clockLimit) -> unsigned
+    {
+        unsigned clock = cpuRegs_m->clock;
+        bool isSameHead = (isStarted_m && cpuRegs_m->pc == headPc_m);
+        if(isSameHead && backoffCount_m > 0) {
+            if(--backoffCount_m == 0) {
+                start();
+            }
+            return 0;
+        }
+        if(!isSameHead || isDirty_m || !isSameRegs() || !isSameMemory() || clock - headClock_m > maxLoopClocks) {
+            if(isSameHead) {
+                // The loop goes on being busy, so logging is suspended for a while
+                backoff_m = std::min(backoff_m * 2, maxLoopBackoff);
+                backoffCount_m = backoff_m;
+                isDirty_m = true;
+                return 0;
+            }
+            backoff_m = 1;
+            start();
+            return 0;
+        }
+
+        unsigned baseClocks = clock - headClock_m - waitSum_m;
+        unsigned headClock = clock;
+        while(headClock < clockLimit) {
+            unsigned phase = headClock % waitPeriod;
+            if(phaseRuns_m[phase] == runNum_m) {
+                unsigned cycleClocks = headClock - phaseClocks_m[phase];
+                unsigned cycleCount = (clockLimit - headClock) / cycleClocks;
+                if(cycleCount > 1) {
+                    headClock += (cycleCount - 1) * cycleClocks;
+                }
+            }
+            phaseClocks_m[phase] = headClock;
+            phaseRuns_m[phase] = runNum_m;
+
+            unsigned nextHeadClock = replayWaits(waitFunc, waits_m.data(), waitCount_m, headClock, baseClocks, clockLimit);
+            if(nextHeadClock >= clockLimit) {
+                break; // the last iteration gets interpreted
+            }
+            headClock = nextHeadClock;
+        }
+
+        headClock_m = headClock;
+        writeCount_m = 0;
+        waitCount_m = 0;
+        waitSum_m = 0;
+        return headClock - clock;
+    }
+
+private:
+    void start()
+    {
+        headPc_m = cpuRegs_m->pc;
+        headRegs_m = *cpuRegs_m;
+        headClock_m = cpuRegs_m->clock;
+        ++runNum_m; // phases of previous runs become stale
+        isStarted_m = true;
+        isDirty_m = false;
+        writeCount_m = 0;
+        waitCount_m = 0;
+        waitSum_m = 0;
+    }
+
+    auto isSameRegs() const -> bool
+    {
+        return (cpuRegs_m->state == headRegs_m.state &&
+                cpuRegs_m->psw == headRegs_m.psw &&
+                cpuRegs_m->bc == headRegs_m.bc &&
+                cpuRegs_m->de == headRegs_m.de &&
+                cpuRegs_m->hl == headRegs_m.hl &&
+                cpuRegs_m->sp == headRegs_m.sp);
+    }
+
+    auto isSameMemory() const -> bool
+    {
+        for(size_t i = 0; i < writeCount_m; ++i) {
+            if(*writes_m[i].data != writes_m[i].value) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    CpuRegs * cpuRegs_m;
+
+    bool isActive_m;
+    bool isStarted_m;
+    bool isDirty_m;
+    uint16_t headPc_m;
+    CpuRegs headRegs_m;
+    unsigned headClock_m;
+
+    // Original values of the bytes changed since the loop head
+    struct LoopWrite final
+    {
+        uint8_t * data;
+        uint8_t value;
+    };
+    std::array<LoopWrite, maxLoopWrites> writes_m;
+    size_t writeCount_m;
+
+    // Ram wait points since the loop head, in clocks without waits
+    std::array<unsigned, maxLoopWaits> waits_m;
+    size_t waitCount_m;
+    unsigned waitSum_m;
+
+    // Head clock by its wait phase, valid for the current run only
+    std::array<unsigned, maxWaitPeriod> phaseClocks_m;
+    std::array<unsigned, maxWaitPeriod> phaseRuns_m;
+    unsigned runNum_m;
+
+    unsigned backoff_m;
+    unsigned backoffCount_m;
+};
+
+// Delay loops do nothing but count a register down, so once an iteration is
+// logged, the following ones are skipped by replaying its wait states, as
+// long as the register does not get zero and an iteration is left to be
+// interpreted before the clock limit, making the accumulator and flags right
+
+class DelayLoop final
+{
+public:
+    explicit DelayLoop():
+        state_m(State::idle), runNum_m(0)
+    {
+        phases_m.fill({0, 0, 0});
+    }
+
+    void reset()
+    {
+        state_m = State::idle;
+    }
+
+    void logWait(unsigned clock, unsigned waitClocks)
+    {
+        if(state_m != State::logging) {
+            return;
+        }
+        if(waitCount_m == waits_m.size()) {
+            state_m = State::failed;
+            return;
+        }
+        waits_m[waitCount_m++] = clock - headClock_m - waitSum_m;
+        waitSum_m += waitClocks;
+    }
+
+    // Called at the loop head with iterations left, the current one included.
+    // Returns iterations which may be skipped, and clocks they take
+    template <typename WaitFunc>
+    auto loopBack(const WaitFunc & waitFunc, unsigned clock, unsigned count, unsigned waitPeriod,
+                  unsigned clockLimit, unsigned * skipClocks) -> unsigned
+    {
+        *skipClocks = 0;
+        if(state_m == State::idle) {
+            state_m = State::logging;
+            headClock_m = clock;
+            waitCount_m = 0;
+            waitSum_m = 0;
+            return 0;
+        }
+        if(state_m == State::logging) {
+            state_m = State::logged;
+            baseClocks_m = clock - headClock_m - waitSum_m;
+        }
+        if(state_m != State::logged) {
+            return 0;
+        }
+
+        // Iteration at the head always fits before the clock limit, and so does
+        // the one following the skipped ones, which takes as long as the same
+        // phase one did
+        ++runNum_m; // phases of previous calls become stale
+        unsigned maxSkipCount = count - 1;
+        unsigned skipCount = 0;
+        unsigned headClock = clock;
+        unsigned nextHeadClock = replay(waitFunc, headClock, clockLimit);
+        while(skipCount < maxSkipCount && nextHeadClock < clockLimit) {
+            DelayPhase & delayPhase = phases_m[headClock % waitPeriod];
+            if(delayPhase.runNum == runNum_m) {
+                unsigned cycleClocks = headClock - delayPhase.clock;
+                unsigned cycleIters = skipCount - delayPhase.skipCount;
+                unsigned cycleCount = std::min((maxSkipCount - skipCount) / cycleIters,
+                                               (clockLimit - 1 - nextHeadClock) / cycleClocks);
+                headClock += cycleCount * cycleClocks;
+                nextHeadClock += cycleCount * cycleClocks;
+                skipCount += cycleCount * cycleIters;
+                if(skipCount == maxSkipCount) {
+                    break;
+                }
+            }
+            delayPhase = {runNum_m, headClock, skipCount};
+
+            unsigned nextNextHeadClock = replay(waitFunc, nextHeadClock, clockLimit);
+            if(nextNextHeadClock >= clockLimit) {
+                break;
+            }
+            headClock = nextHeadClock;
+            nextHeadClock = nextNextHeadClock;
+            ++skipCount;
+        }
+
+        *skipClocks = headClock - clock;
+        return skipCount;
+    }
+
+private:
+    template <typename WaitFunc>
+    auto replay(const WaitFunc & waitFunc, unsigned clock, unsigned clockLimit) const -> unsigned
+    {
+        return replayWaits(waitFunc, waits_m.data(), waitCount_m, clock, baseClocks_m, clockLimit);
+    }
+
+    enum class State {
+        idle,
+        logging,
+        logged,
+        failed // too many waits to log
+    };
+    State state_m;
+
+    unsigned headClock_m;
+    unsigned baseClocks_m;
+
+    // Ram wait points since the loop head, in clocks without waits
+    std::array<unsigned, maxDelayWaits> waits_m;
+    size_t waitCount_m;
+    unsigned waitSum_m;
+
+    // Head clock and iterations skipped by its wait phase, valid for the
+    // current call only
+    struct DelayPhase final
+    {
+        unsigned runNum;
+        unsigned clock;
+        unsigned skipCount;
+    };
+    std::array<DelayPhase, maxWaitPeriod> phases_m;
+    unsigned runNum_m;
+};
+
 class MemIo final
 {
 public:
-    explicit MemIo(CpuRegs * cpuRegs, MemBanks * memBanks, IoPorts * ioPorts):
-        cpuRegs_m(cpuRegs), memBanks_m(memBanks), ioPorts_m(ioPorts)
+    explicit MemIo(CpuRegs * cpuRegs, MemBanks * memBanks, IoPorts * ioPorts, IdleLoop * idleLoop, DelayLoop * delayLoop):
+        cpuRegs_m(cpuRegs), memBanks_m(memBanks), ioPorts_m(ioPorts),
+        ramMode_m(RamMode::mode0), idleLoop_m(idleLoop), delayLoop_m(delayLoop), jit_m(nullptr), codeMap_m(nullptr),
+        watchPages_m()
     {
         unsigned * p = ramClockBuf_m.data();
         for(size_t i = 0; i < 2; ++i) {
@@ -71,6 +526,8 @@ public:
             *pp++ = &ramClockBuf_m[128];
             *pp++ = &ramClockBuf_m[64];
         }
+
+        readBanks_m.fill(MemBankType::ram);
     }
 
     void init()
@@ -80,10 +537,30 @@ public:
             size_t bankPos = port80 & 0x03;
             readBankMap_m[i] = memBank(readBankTypes[bankPos])->data();
             writeBankMap_m[i] = memBank(writeBankTypes[bankPos])->data();
+            readBanks_m[i] = readBankTypes[bankPos];
             port80 >>= 2;
         }
 
-        ramMode_m = (ioPorts_m->port84 & 0x20 ? RamMode::mode0 : RamMode::mode1);
+        RamMode ramMode = (ioPorts_m->port84 & 0x20 ? RamMode::mode0 : RamMode::mode1);
+        bool isRamModeChanged = (ramMode != ramMode_m);
+        ramMode_m = ramMode;
+
+        if(jit_m) {
+            jit_m->setReadBanks(readBanks_m);
+            if(isRamModeChanged) {
+                jit_m->setRamWaits(memFunc(this, &MemIo::ramWait));
+            }
+        }
+    }
+
+    void setJit(Jit * jit)
+    {
+        jit_m = jit;
+        codeMap_m = (jit ? jit->codeMap() : nullptr);
+        if(jit_m) {
+            jit_m->setReadBanks(readBanks_m);
+            jit_m->setRamWaits(memFunc(this, &MemIo::ramWait));
+        }
     }
 
     void peek(uint8_t * data, uint16_t addr)
@@ -94,6 +571,8 @@ public:
     void poke(uint16_t addr, uint8_t data)
     {
         writeBankMap_m[addr >> 14][addr] = data;
+        idleLoop_m->markDirty();
+        invalidateCode(addr);
     }
 
     void read(uint8_t * data, uint16_t addr)
@@ -104,6 +583,9 @@ public:
         MemBankType memBankType = readBankTypes[bankPos];
         wait(MemAccessType::read, memBankType, addr);
         memHookTrigger_m.fire(MemAccessType::read, memBankType, addr);
+        if(watchPages_m[size_t(MemAccessType::read)][addr >> 8]) {
+            watchHookTrigger_m.fire(MemAccessType::read, memBankType, addr);
+        }
         ++cpuRegs_m->clock;
         *data = memBankData[addr];
     }
@@ -124,8 +606,15 @@ public:
         MemBankType memBankType = writeBankTypes[bankPos];
         wait(MemAccessType::write, memBankType, addr);
         memHookTrigger_m.fire(MemAccessType::write, memBankType, addr);
+        if(watchPages_m[size_t(MemAccessType::write)][addr >> 8]) {
+            watchHookTrigger_m.fire(MemAccessType::write, memBankType, addr);
+        }
         ++cpuRegs_m->clock;
+        if(memBankData[addr] != data) {
+            idleLoop_m->logWrite(&memBankData[addr]);
+        }
         memBankData[addr] = data;
+        invalidateCode(addr);
     }
 
     void write(uint16_t addr, uint16_t data)
@@ -166,6 +655,44 @@ public:
         return std::make_unique<MemHook>(&memHookTrigger_m, hookFunc);
     }
 
+    auto createWatchHook(MemAccessType accessType, uint16_t firstAddr, uint16_t lastAddr,
+                         const WatchHook::HookFunc & hookFunc) -> std::unique_ptr<WatchHook>
+    {
+        return std::make_unique<WatchHook>(&watchPages_m[size_t(accessType)], &watchHookTrigger_m,
+                                           accessType, firstAddr, lastAddr, hookFunc);
+    }
+
+    auto hasMemHooks() const -> bool
+    {
+        return !memHookTrigger_m.isEmpty();
+    }
+
+    // Watched accesses are missed by native code and skipped loop iterations
+    auto hasWatchHooks() const -> bool
+    {
+        return !watchHookTrigger_m.isEmpty();
+    }
+
+    auto readBank(uint16_t addr) const -> MemBankType
+    {
+        return readBanks_m[addr >> 14];
+    }
+
+    auto ramWait(unsigned clock) -> unsigned
+    {
+        if(ramMode_m == RamMode::mode0) {
+            return ramClock_m[clock >> 8][clock & 0xff];
+        } else {
+            return 3 - (clock & 3);
+        }
+    }
+
+    // Wait states repeat every 5 scanlines in mode 0 and every 4 clocks in mode 1
+    auto waitPeriod() const -> unsigned
+    {
+        return (ramMode_m == RamMode::mode0 ? maxWaitPeriod : 4);
+    }
+
 private:
     auto memBank(MemBankType memBankType) -> MemBank *
     {
@@ -183,14 +710,21 @@ private:
         return nullptr;
     }
 
+    // Writes go to ram only, which is the only bank holding code to be changed
+    void invalidateCode(uint16_t addr)
+    {
+        if(codeMap_m && codeMap_m[addr]) {
+            jit_m->invalidate(addr);
+        }
+    }
+
     void wait(MemAccessType memAccessType, MemBankType memBankType, uint16_t addr)
     {
         if(memBankType == MemBankType::ram) {
-            if(ramMode_m == RamMode::mode0) {
-                cpuRegs_m->clock += ramClock_m[cpuRegs_m->clock >> 8][cpuRegs_m->clock & 0xff];
-            } else {
-                cpuRegs_m->clock += 3 - (cpuRegs_m->clock & 3);
-            }
+            unsigned waitClocks = ramWait(cpuRegs_m->clock);
+            idleLoop_m->logWait(cpuRegs_m->clock, waitClocks);
+            delayLoop_m->logWait(cpuRegs_m->clock, waitClocks);
+            cpuRegs_m->clock += waitClocks;
         }
     }
 
@@ -205,7 +739,17 @@ private:
     std::array<unsigned, 388> ramClockBuf_m;
     std::array<unsigned *, 200> ramClock_m;
 
+    IdleLoop * idleLoop_m;
+    DelayLoop * delayLoop_m;
+
+    Jit * jit_m;
+    const uint8_t * codeMap_m;
+    std::array<MemBankType, 4> readBanks_m;
+
     MemHook::HookTrigger memHookTrigger_m;
+
+    std::array<WatchHook::PageCounts, 2> watchPages_m; // by access type
+    WatchHook::HookTrigger watchHookTrigger_m;
 };
 
 } // namespace
@@ -213,33 +757,49 @@ private:
 class RetHook::Impl final
 {
 public:
-    explicit Impl(CpuRegs * cpuRegs, HookTrigger * trigger, const HookFunc & hookFunc):
-        cpuRegs_m(cpuRegs), hook_m(trigger, memFunc(this, &Impl::hookFunc)),
-        hookFunc_m(hookFunc), isActive_m(false)
+    explicit Impl(CpuRegs * cpuRegs, SpCounts * spCounts, HookTrigger * trigger, const HookFunc & hookFunc):
+        cpuRegs_m(cpuRegs), spCounts_m(spCounts), hook_m(trigger, memFunc(this, &Impl::hookFunc)),
+        hookFunc_m(hookFunc), isActive_m(false), sp_m(0)
     {}
 
+    ~Impl()
+    {
+        activate(false);
+    }
+
     void setHookFunc(const HookFunc & hookFunc)
     {
         hookFunc_m = hookFunc;
     }
 
-    void activate(bool isActive = true)
+    void activate(bool isActive)
     {
-        isActive_m = isActive;
         if(isActive) {
-            sp_m = cpuRegs_m->sp;
+            activateAt(cpuRegs_m->sp);
+        } else if(isActive_m) {
+            isActive_m = false;
+            --(*spCounts_m)[sp_m];
         }
     }
 
+    void activateAt(uint16_t sp)
+    {
+        activate(false);
+        isActive_m = true;
+        sp_m = sp;
+        ++(*spCounts_m)[sp_m];
+    }
+
     void hookFunc()
     {
         if(isActive_m && cpuRegs_m->sp == sp_m) {
-            isActive_m = false;
+            activate(false);
             hookFunc_m();
         }
     }
 
     CpuRegs * cpuRegs_m;
+    SpCounts * spCounts_m;
 
     Hook<> hook_m;
     HookFunc hookFunc_m;
@@ -248,8 +808,8 @@ public:
     uint16_t sp_m;
 };
 
-RetHook::RetHook(CpuRegs * cpuRegs, HookTrigger * trigger, const HookFunc & hookFunc):
-    impl(std::make_unique<Impl>(cpuRegs, trigger, hookFunc))
+RetHook::RetHook(CpuRegs * cpuRegs, SpCounts * spCounts, HookTrigger * trigger, const HookFunc & hookFunc):
+    impl(std::make_unique<Impl>(cpuRegs, spCounts, trigger, hookFunc))
 {
 }
 
@@ -267,560 +827,480 @@ void RetHook::activate(bool isActive)
     impl->activate(isActive);
 }
 
+void RetHook::activateAt(uint16_t sp)
+{
+    impl->activateAt(sp);
+}
+
 auto RetHook::isActive() const -> bool
 {
     return impl->isActive_m;
 }
 
-class Cpu::Impl final:
-        public Cpu
+class WatchHook::Impl final
 {
 public:
-    explicit Impl(Memory * memory):
-        memIo_m(&cpuRegs_m, memory->memBanks(), memory->ioPorts()),
-        ioPorts_m(memory->ioPorts())
+    explicit Impl(PageCounts * pageCounts, HookTrigger * trigger, MemAccessType accessType,
+                  uint16_t firstAddr, uint16_t lastAddr, const HookFunc & hookFunc):
+        pageCounts_m(pageCounts), hook_m(trigger, memFunc(this, &Impl::hookFunc)), hookFunc_m(hookFunc),
+        accessType_m(accessType), firstAddr_m(firstAddr), lastAddr_m(lastAddr)
     {
-        for(size_t i = 0; i < 256; ++i) {
-            flags_m[i] = 2;
-
-            if(i & 0x80) {
-                flags_m[i] |= CpuFlag::s;
-            }
-            if(i == 0) {
-                flags_m[i] |= CpuFlag::z;
-            }
-
-            size_t a = i;
-            a ^= a >> 4;
-            a ^= a >> 2;
-            a ^= a >> 1;
-            a &= 1;
-            if(!a) {
-                flags_m[i] |= CpuFlag::p;
-            }
+        for(unsigned page = firstAddr >> 8; page <= unsigned(lastAddr >> 8); ++page) {
+            ++(*pageCounts_m)[page];
         }
     }
 
-    virtual void init() override
+    ~Impl()
     {
-        reset();
+        for(unsigned page = firstAddr_m >> 8; page <= unsigned(lastAddr_m >> 8); ++page) {
+            --(*pageCounts_m)[page];
+        }
     }
 
-    virtual void reset() override
+    void setHookFunc(const HookFunc & hookFunc)
     {
-        cpuRegs_m.state = 0;
-        cpuRegs_m.clock = 0;
-        cpuRegs_m.a  = 0;
-        cpuRegs_m.f  = 2;
-        cpuRegs_m.bc = 0;
-        cpuRegs_m.de = 0;
-        cpuRegs_m.hl = 0;
-        cpuRegs_m.sp = 0;
-        cpuRegs_m.pc = 0;
+        hookFunc_m = hookFunc;
     }
 
-    virtual void close() override
+private:
+    void hookFunc(MemAccessType accessType, MemBankType bankType, uint16_t addr)
     {
+        if(accessType == accessType_m && addr >= firstAddr_m && addr <= lastAddr_m) {
+            hookFunc_m(accessType, bankType, addr);
+        }
     }
 
-    virtual void startFrame() override
-    {
-        memIo_m.init();
-    }
+    PageCounts * pageCounts_m;
 
-    virtual void renderFrame() override
-    {
-        if(cpuRegs_m.state & CpuState::inte) {
-            cpuRegs_m.state &= ~CpuState::halt;
-            rst7();
-            intHookTrigger_m.fire();
-        }
+    MemHook hook_m;
+    HookFunc hookFunc_m;
 
-        if(cpuRegs_m.state & CpuState::halt) {
-            cpuRegs_m.clock = clocksPerFrame;
-        }
+    MemAccessType accessType_m;
+    uint16_t firstAddr_m;
+    uint16_t lastAddr_m;
+};
 
-        while(cpuRegs_m.clock < clocksPerFrame) {
-            opHookTrigger_m.fire();
-            uint8_t op;
-            memIo_m.fetch(&op);
-            (this->*opFuncs[op])();
-        }
-    }
+WatchHook::WatchHook(PageCounts * pageCounts, HookTrigger * trigger, MemAccessType accessType,
+                     uint16_t firstAddr, uint16_t lastAddr, const HookFunc & hookFunc):
+    impl(std::make_unique<Impl>(pageCounts, trigger, accessType, firstAddr, lastAddr, hookFunc))
+{
+}
 
-    virtual void endFrame() override
-    {
-        cpuRegs_m.clock -= clocksPerFrame;
-    }
-
-    virtual auto cpuRegs() -> CpuRegs * override
-    {
-        return &cpuRegs_m;
-    }
-
-    virtual void memPeek(uint8_t * data, uint16_t addr) override
-    {
-        memIo_m.peek(data, addr);
-    }
-
-    virtual void memPoke(uint16_t addr, uint8_t data) override
-    {
-        memIo_m.poke(addr, data);
-    }
+WatchHook::~WatchHook()
+{
+}
 
-    virtual auto createMemHook(const MemHook::HookFunc & hookFunc) -> std::unique_ptr<MemHook> override
-    {
-        return memIo_m.createMemHook(hookFunc);
-    }
+void WatchHook::setHookFunc(const HookFunc & hookFunc)
+{
+    impl->setHookFunc(hookFunc);
+}
 
-    virtual auto createIntHook(const IntHook::HookFunc & hookFunc) -> std::unique_ptr<IntHook> override
-    {
-        return std::make_unique<IntHook>(&intHookTrigger_m, hookFunc);
-    }
+class PcHook::Impl final
+{
+public:
+    explicit Impl(HookTrigger * trigger, uint16_t firstPc, uint16_t lastPc,
+                  const HookFunc & hookFunc, const ReleaseFunc & releaseFunc):
+        hook_m(std::make_unique<Hook<uint16_t>>(trigger, memFunc(this, &Impl::hookFunc))),
+        hookFunc_m(hookFunc), releaseFunc_m(releaseFunc), firstPc_m(firstPc), lastPc_m(lastPc)
+    {}
 
-    virtual auto createOpHook (const OpHook::HookFunc  & hookFunc) -> std::unique_ptr<OpHook> override
+    ~Impl()
     {
-        return std::make_unique<OpHook>(&opHookTrigger_m, hookFunc);
+        hook_m = nullptr;
+        releaseFunc_m(firstPc_m, lastPc_m);
     }
 
-    virtual auto createRetHook(const RetHook::HookFunc & hookFunc) -> std::unique_ptr<RetHook> override
+    void setHookFunc(const HookFunc & hookFunc)
     {
-        return std::make_unique<RetHook>(&cpuRegs_m, &retHookTrigger_m, hookFunc);
+        hookFunc_m = hookFunc;
     }
 
 private:
-        //-- mov r, r --//
-
-    void movRR(uint8_t * r1, uint8_t r2)
-    {
-        cpuRegs_m.clock += 2;
-        *r1 = r2;
-    }
-
-        //-- mov a, r --//
-
-    void movAA()
-    {
-        movRR(&cpuRegs_m.a, cpuRegs_m.a);
-    }
-
-    void movAB()
-    {
-        movRR(&cpuRegs_m.a, cpuRegs_m.b);
-    }
-
-    void movAC()
-    {
-        movRR(&cpuRegs_m.a, cpuRegs_m.c);
-    }
-
-    void movAD()
-    {
-        movRR(&cpuRegs_m.a, cpuRegs_m.d);
-    }
-
-    void movAE()
-    {
-        movRR(&cpuRegs_m.a, cpuRegs_m.e);
-    }
-
-    void movAH()
-    {
-        movRR(&cpuRegs_m.a, cpuRegs_m.h);
-    }
-
-    void movAL()
-    {
-        movRR(&cpuRegs_m.a, cpuRegs_m.l);
-    }
-
-        //-- mov b, r --//
-
-    void movBA()
-    {
-        movRR(&cpuRegs_m.b, cpuRegs_m.a);
-    }
-
-    void movBB()
-    {
-        movRR(&cpuRegs_m.b, cpuRegs_m.b);
-    }
-
-    void movBC()
-    {
-        movRR(&cpuRegs_m.b, cpuRegs_m.c);
-    }
-
-    void movBD()
-    {
-        movRR(&cpuRegs_m.b, cpuRegs_m.d);
-    }
-
-    void movBE()
-    {
-        movRR(&cpuRegs_m.b, cpuRegs_m.e);
-    }
-
-    void movBH()
-    {
-        movRR(&cpuRegs_m.b, cpuRegs_m.h);
-    }
-
-    void movBL()
-    {
-        movRR(&cpuRegs_m.b, cpuRegs_m.l);
-    }
-
-        //-- mov c, r --//
-
-    void movCA()
-    {
-        movRR(&cpuRegs_m.c, cpuRegs_m.a);
-    }
-
-    void movCB()
-    {
-        movRR(&cpuRegs_m.c, cpuRegs_m.b);
-    }
-
-    void movCC()
-    {
-        movRR(&cpuRegs_m.c, cpuRegs_m.c);
-    }
-
-    void movCD()
+    void hookFunc(uint16_t pc)
     {
-        movRR(&cpuRegs_m.c, cpuRegs_m.d);
-    }
-
-    void movCE()
-    {
-        movRR(&cpuRegs_m.c, cpuRegs_m.e);
-    }
-
-    void movCH()
-    {
-        movRR(&cpuRegs_m.c, cpuRegs_m.h);
-    }
-
-    void movCL()
-    {
-        movRR(&cpuRegs_m.c, cpuRegs_m.l);
-    }
-
-        //-- mov d, r --//
-
-    void movDA()
-    {
-        movRR(&cpuRegs_m.d, cpuRegs_m.a);
-    }
-
-    void movDB()
-    {
-        movRR(&cpuRegs_m.d, cpuRegs_m.b);
-    }
-
-    void movDC()
-    {
-        movRR(&cpuRegs_m.d, cpuRegs_m.c);
-    }
-
-    void movDD()
-    {
-        movRR(&cpuRegs_m.d, cpuRegs_m.d);
+        if(pc >= firstPc_m && pc <= lastPc_m) {
+            hookFunc_m();
+        }
     }
 
-    void movDE()
-    {
-        movRR(&cpuRegs_m.d, cpuRegs_m.e);
-    }
+    std::unique_ptr<Hook<uint16_t>> hook_m;
+    HookFunc hookFunc_m;
+    ReleaseFunc releaseFunc_m;
+    uint16_t firstPc_m;
+    uint16_t lastPc_m;
+};
 
-    void movDH()
-    {
-        movRR(&cpuRegs_m.d, cpuRegs_m.h);
-    }
+PcHook::PcHook(HookTrigger * trigger, uint16_t firstPc, uint16_t lastPc,
+               const HookFunc & hookFunc, const ReleaseFunc & releaseFunc):
+    impl(std::make_unique<Impl>(trigger, firstPc, lastPc, hookFunc, releaseFunc))
+{
+}
 
-    void movDL()
-    {
-        movRR(&cpuRegs_m.d, cpuRegs_m.l);
-    }
+PcHook::~PcHook()
+{
+}
 
-        //-- mov e, r --//
+void PcHook::setHookFunc(const HookFunc & hookFunc)
+{
+    impl->setHookFunc(hookFunc);
+}
 
-    void movEA()
+class Cpu::Impl final:
+        public Cpu
+{
+public:
+    explicit Impl(Memory * memory):
+        idleLoop_m(&cpuRegs_m),
+        memIo_m(&cpuRegs_m, memory->memBanks(), memory->ioPorts(), &idleLoop_m, &delayLoop_m),
+        memBanks_m(memory->memBanks()), ioPorts_m(memory->ioPorts()), isFusion_m(true),
+        retHookSps_m{}, isCallStack_m(false), pcHooks_m{}
     {
-        movRR(&cpuRegs_m.e, cpuRegs_m.a);
-    }
+        for(size_t i = 0; i < 256; ++i) {
+            flags_m[i] = 2;
 
-    void movEB()
-    {
-        movRR(&cpuRegs_m.e, cpuRegs_m.b);
-    }
+            if(i & 0x80) {
+                flags_m[i] |= CpuFlag::s;
+            }
+            if(i == 0) {
+                flags_m[i] |= CpuFlag::z;
+            }
 
-    void movEC()
-    {
-        movRR(&cpuRegs_m.e, cpuRegs_m.c);
+            size_t a = i;
+            a ^= a >> 4;
+            a ^= a >> 2;
+            a ^= a >> 1;
+            a &= 1;
+            if(!a) {
+                flags_m[i] |= CpuFlag::p;
+            }
+        }
     }
 
-    void movED()
+    virtual void init() override
     {
-        movRR(&cpuRegs_m.e, cpuRegs_m.d);
+        reset();
     }
 
-    void movEE()
+    virtual void reset() override
     {
-        movRR(&cpuRegs_m.e, cpuRegs_m.e);
-    }
+        cpuRegs_m.state = 0;
+        cpuRegs_m.clock = 0;
+        cpuRegs_m.a  = 0;
+        cpuRegs_m.f  = 2;
+        cpuRegs_m.bc = 0;
+        cpuRegs_m.de = 0;
+        cpuRegs_m.hl = 0;
+        cpuRegs_m.sp = 0;
+        cpuRegs_m.pc = 0;
 
-    void movEH()
-    {
-        movRR(&cpuRegs_m.e, cpuRegs_m.h);
+        if(jit_m) {
+            jit_m->flush();
+        }
     }
 
-    void movEL()
+    virtual void close() override
     {
-        movRR(&cpuRegs_m.e, cpuRegs_m.l);
     }
 
-        //-- mov h, r --//
-
-    void movHA()
+    virtual void startFrame() override
     {
-        movRR(&cpuRegs_m.h, cpuRegs_m.a);
+        memIo_m.init();
+        idleLoop_m.reset();
     }
 
-    void movHB()
+    virtual void renderFrame() override
     {
-        movRR(&cpuRegs_m.h, cpuRegs_m.b);
+        takeInterrupt();
+        while(cpuRegs_m.clock < clocksPerFrame) {
+            runStep();
+        }
     }
 
-    void movHC()
+    virtual void endFrame() override
     {
-        movRR(&cpuRegs_m.h, cpuRegs_m.c);
+        cpuRegs_m.clock -= clocksPerFrame;
     }
 
-    void movHD()
+    virtual void setIdleSkip(bool isIdleSkip) override
     {
-        movRR(&cpuRegs_m.h, cpuRegs_m.d);
+        idleLoop_m.activate(isIdleSkip);
+        if(jit_m) {
+            jit_m->setLoopExit(isIdleSkip ? maxLoopBytes : 0);
+        }
     }
 
-    void movHE()
+    virtual auto isIdleSkip() const -> bool override
     {
-        movRR(&cpuRegs_m.h, cpuRegs_m.e);
+        return idleLoop_m.isActive();
     }
 
-    void movHH()
+    virtual void setJit(bool isJit) override
     {
-        movRR(&cpuRegs_m.h, cpuRegs_m.h);
-    }
+        if(!isJit) {
+            memIo_m.setJit(nullptr);
+            jit_m = nullptr;
+            return;
+        }
+        if(jit_m) {
+            return;
+        }
 
-    void movHL()
-    {
-        movRR(&cpuRegs_m.h, cpuRegs_m.l);
+        jit_m = Jit::create(&cpuRegs_m, memBanks_m);
+        if(!jit_m) {
+            msg(LogLevel::warn, "Native code translation is not supported on this platform");
+            return;
+        }
+        captureLog(jit_m.get());
+        jit_m->setLoopExit(idleLoop_m.isActive() ? maxLoopBytes : 0);
+        for(unsigned pc = 0; pc < pcHooks_m.size(); ++pc) {
+            if(pcHooks_m[pc]) {
+                jit_m->addTraps(uint16_t(pc), uint16_t(pc));
+            }
+        }
+        memIo_m.setJit(jit_m.get());
     }
 
-        //-- mov l, r --//
-
-    void movLA()
+    virtual auto isJit() const -> bool override
     {
-        movRR(&cpuRegs_m.l, cpuRegs_m.a);
+        return (jit_m != nullptr);
     }
 
-    void movLB()
+    virtual void setFusion(bool isFusion) override
     {
-        movRR(&cpuRegs_m.l, cpuRegs_m.b);
+        isFusion_m = isFusion;
     }
 
-    void movLC()
+    virtual auto isFusion() const -> bool override
     {
-        movRR(&cpuRegs_m.l, cpuRegs_m.c);
+        return isFusion_m;
     }
 
-    void movLD()
+    virtual void setCallStack(bool isCallStack) override
     {
-        movRR(&cpuRegs_m.l, cpuRegs_m.d);
+        isCallStack_m = isCallStack;
+        callStack_m.clear();
     }
 
-    void movLE()
+    virtual auto isCallStack() const -> bool override
     {
-        movRR(&cpuRegs_m.l, cpuRegs_m.e);
+        return isCallStack_m;
     }
 
-    void movLH()
+    virtual auto callStack() const -> const std::vector<CallFrame> & override
     {
-        movRR(&cpuRegs_m.l, cpuRegs_m.h);
+        return callStack_m;
     }
 
-    void movLL()
+    virtual void takeInterrupt() override
     {
-        movRR(&cpuRegs_m.l, cpuRegs_m.l);
-    }
-
-        //-- mov r, m --//
+        if(cpuRegs_m.state & CpuState::inte) {
+            cpuRegs_m.state &= ~CpuState::halt;
+            rst<0x38, true>();
+            intHookTrigger_m.fire();
+        }
 
-    void movRM(uint8_t * r)
-    {
-        ++cpuRegs_m.clock;
-        memIo_m.read(r, cpuRegs_m.hl);
+        if(cpuRegs_m.state & CpuState::halt) {
+            cpuRegs_m.clock = clocksPerFrame;
+        }
     }
 
-    void movAM()
+    // Native code runs while nothing needs to watch every op or memory access,
+    // the interpreter takes the ops native code leaves to it
+    virtual void runStep() override
     {
-        movRM(&cpuRegs_m.a);
-    }
+        if(!jit_m || !opHookTrigger_m.isEmpty() || !retHookTrigger_m.isEmpty() || isCallStack_m ||
+           memIo_m.hasMemHooks() || memIo_m.hasWatchHooks() || idleLoop_m.isLogging())
+        {
+            step();
+            return;
+        }
 
-    void movBM()
-    {
-        movRM(&cpuRegs_m.b);
+        JitExit jitExit = jit_m->run(clocksPerFrame);
+        idleLoop_m.markDirty();
+        if(jitExit == JitExit::loop) {
+            skipIdleLoop();
+        } else if(jitExit == JitExit::interpret && cpuRegs_m.clock < clocksPerFrame) {
+            step();
+        }
     }
 
-    void movCM()
+    virtual auto cpuRegs() -> CpuRegs * override
     {
-        movRM(&cpuRegs_m.c);
+        return &cpuRegs_m;
     }
 
-    void movDM()
+    virtual void memPeek(uint8_t * data, uint16_t addr) override
     {
-        movRM(&cpuRegs_m.d);
+        memIo_m.peek(data, addr);
     }
 
-    void movEM()
+    virtual void memPoke(uint16_t addr, uint8_t data) override
     {
-        movRM(&cpuRegs_m.e);
+        memIo_m.poke(addr, data);
     }
 
-    void movHM()
+    virtual auto readBank(uint16_t addr) const -> MemBankType override
     {
-        movRM(&cpuRegs_m.h);
+        return memIo_m.readBank(addr);
     }
 
-    void movLM()
+    virtual void memChanged() override
     {
-        movRM(&cpuRegs_m.l);
+        idleLoop_m.markDirty();
+        if(jit_m) {
+            jit_m->flush();
+        }
     }
 
-        //-- mov m, r --//
-
-    inline void movMR(uint8_t r)
+    virtual auto createMemHook(const MemHook::HookFunc & hookFunc) -> std::unique_ptr<MemHook> override
     {
-        ++cpuRegs_m.clock;
-        memIo_m.write(cpuRegs_m.hl, r);
+        return memIo_m.createMemHook(hookFunc);
     }
 
-    void movMA()
+    virtual auto createIntHook(const IntHook::HookFunc & hookFunc) -> std::unique_ptr<IntHook> override
     {
-        movMR(cpuRegs_m.a);
+        return std::make_unique<IntHook>(&intHookTrigger_m, hookFunc);
     }
 
-    void movMB()
+    virtual auto createOpHook (const OpHook::HookFunc  & hookFunc) -> std::unique_ptr<OpHook> override
     {
-        movMR(cpuRegs_m.b);
+        return std::make_unique<OpHook>(&opHookTrigger_m, hookFunc);
     }
 
-    void movMC()
+    virtual auto createPcHook(uint16_t pc, const PcHook::HookFunc & hookFunc) -> std::unique_ptr<PcHook> override
     {
-        movMR(cpuRegs_m.c);
+        return createPcRangeHook(pc, pc, hookFunc);
     }
 
-    void movMD()
+    virtual auto createPcRangeHook(uint16_t firstPc, uint16_t lastPc,
+                                   const PcHook::HookFunc & hookFunc) -> std::unique_ptr<PcHook> override
     {
-        movMR(cpuRegs_m.d);
+        for(unsigned pc = firstPc; pc <= lastPc; ++pc) {
+            ++pcHooks_m[pc];
+        }
+        if(jit_m) {
+            jit_m->addTraps(firstPc, lastPc);
+        }
+        return std::make_unique<PcHook>(&pcHookTrigger_m, firstPc, lastPc, hookFunc,
+                                        memFunc(this, &Impl::releasePcHook));
     }
 
-    void movME()
+    virtual auto createRetHook(const RetHook::HookFunc & hookFunc) -> std::unique_ptr<RetHook> override
     {
-        movMR(cpuRegs_m.e);
+        return std::make_unique<RetHook>(&cpuRegs_m, &retHookSps_m, &retHookTrigger_m, hookFunc);
     }
 
-    void movMH()
+    virtual auto createWatchHook(MemAccessType accessType, uint16_t firstAddr, uint16_t lastAddr,
+                                 const WatchHook::HookFunc & hookFunc) -> std::unique_ptr<WatchHook> override
     {
-        movMR(cpuRegs_m.h);
+        return memIo_m.createWatchHook(accessType, firstAddr, lastAddr, hookFunc);
     }
 
-    void movML()
+    virtual auto createTapeInHook(const TapeInHook::HookFunc & hookFunc) -> std::unique_ptr<TapeInHook> override
     {
-        movMR(cpuRegs_m.l);
+        return std::make_unique<TapeInHook>(&tapeInHookTrigger_m, hookFunc);
     }
 
-        //-- mvi r, data --//
-
-    void mviR(uint8_t * r)
+    virtual auto createTapeOutHook(const TapeOutHook::HookFunc & hookFunc) -> std::unique_ptr<TapeOutHook> override
     {
-        ++cpuRegs_m.clock;
-        memIo_m.fetch(r);
+        return std::make_unique<TapeOutHook>(&tapeOutHookTrigger_m, hookFunc);
     }
 
-    void mviA()
+    virtual auto createInPortHook(const InPortHook::HookFunc & hookFunc) -> std::unique_ptr<InPortHook> override
     {
-        mviR(&cpuRegs_m.a);
+        return std::make_unique<InPortHook>(&inPortHookTrigger_m, hookFunc);
     }
 
-    void mviB()
+    virtual auto createIoHook(const IoHook::HookFunc & hookFunc) -> std::unique_ptr<IoHook> override
     {
-        mviR(&cpuRegs_m.b);
+        return std::make_unique<IoHook>(&ioHookTrigger_m, hookFunc);
     }
 
-    void mviC()
-    {
-        mviR(&cpuRegs_m.c);
+private:
+        //-- operands --//
+
+    template <unsigned r>
+    auto reg() -> uint8_t &
+    {
+        static_assert(r != opRegM, "memory operand has no register");
+        if constexpr(r == opRegB) {
+            return cpuRegs_m.b;
+        } else if constexpr(r == opRegC) {
+            return cpuRegs_m.c;
+        } else if constexpr(r == opRegD) {
+            return cpuRegs_m.d;
+        } else if constexpr(r == opRegE) {
+            return cpuRegs_m.e;
+        } else if constexpr(r == opRegH) {
+            return cpuRegs_m.h;
+        } else if constexpr(r == opRegL) {
+            return cpuRegs_m.l;
+        } else {
+            return cpuRegs_m.a;
+        }
     }
 
-    void mviD()
+    template <unsigned rp>
+    auto regPair() -> uint16_t &
     {
-        mviR(&cpuRegs_m.d);
+        if constexpr(rp == opPairBC) {
+            return cpuRegs_m.bc;
+        } else if constexpr(rp == opPairDE) {
+            return cpuRegs_m.de;
+        } else if constexpr(rp == opPairHL) {
+            return cpuRegs_m.hl;
+        } else if constexpr(rp == opPairSP) {
+            return cpuRegs_m.sp;
+        } else {
+            return cpuRegs_m.psw;
+        }
     }
 
-    void mviE()
+    template <uint8_t flag, bool isSet>
+    auto isCondition() const -> bool
     {
-        mviR(&cpuRegs_m.e);
+        return (((cpuRegs_m.f & flag) != 0) == isSet);
     }
 
-    void mviH()
-    {
-        mviR(&cpuRegs_m.h);
-    }
+        //-- mov r, r; mov r, m; mov m, r --//
 
-    void mviL()
+    template <unsigned dst, unsigned src>
+    void mov()
     {
-        mviR(&cpuRegs_m.l);
+        if constexpr(src == opRegM) {
+            ++cpuRegs_m.clock;
+            memIo_m.read(&reg<dst>(), cpuRegs_m.hl);
+        } else if constexpr(dst == opRegM) {
+            ++cpuRegs_m.clock;
+            memIo_m.write(cpuRegs_m.hl, reg<src>());
+        } else {
+            cpuRegs_m.clock += 2;
+            reg<dst>() = reg<src>();
+        }
     }
 
-        //-- mvi m, data --//
+        //-- mvi r/m, data --//
 
-    void mviM()
+    template <unsigned r>
+    void mvi()
     {
         ++cpuRegs_m.clock;
-        uint8_t tmp;
-        memIo_m.fetch(&tmp);
-        memIo_m.write(cpuRegs_m.hl, tmp);
+        if constexpr(r == opRegM) {
+            uint8_t tmp;
+            memIo_m.fetch(&tmp);
+            memIo_m.write(cpuRegs_m.hl, tmp);
+        } else {
+            memIo_m.fetch(&reg<r>());
+        }
     }
 
         //-- lxi rp, data --//
 
-    void lxiRP(uint16_t * rp)
+    template <unsigned rp>
+    void lxi()
     {
         ++cpuRegs_m.clock;
-        memIo_m.fetch(rp);
-    }
-
-    void lxiB()
-    {
-        lxiRP(&cpuRegs_m.bc);
-    }
-
-    void lxiD()
-    {
-        lxiRP(&cpuRegs_m.de);
-    }
-
-    void lxiH()
-    {
-        lxiRP(&cpuRegs_m.hl);
-    }
-
-    void lxiSP()
-    {
-        lxiRP(&cpuRegs_m.sp);
+        memIo_m.fetch(&regPair<rp>());
     }
 
         //-- lda/sta addr --//
@@ -833,819 +1313,186 @@ private:
         memIo_m.read(&cpuRegs_m.a, addr);
     }
 
-    void sta()
-    {
-        ++cpuRegs_m.clock;
-        uint16_t addr;
-        memIo_m.fetch(&addr);
-        memIo_m.write(addr, cpuRegs_m.a);
-    }
-
-        //-- lhld/shld addr --//
-
-    void lhld()
-    {
-        ++cpuRegs_m.clock;
-        uint16_t addr;
-        memIo_m.fetch(&addr);
-        memIo_m.read(&cpuRegs_m.hl, addr);
-    }
-
-    void shld()
-    {
-        ++cpuRegs_m.clock;
-        uint16_t addr;
-        memIo_m.fetch(&addr);
-        memIo_m.write(addr, cpuRegs_m.hl);
-    }
-
-        //-- ldax rp --//
-
-    void ldaxRP(uint16_t rp)
-    {
-        ++cpuRegs_m.clock;
-        memIo_m.read(&cpuRegs_m.a, rp);
-    }
-
-    void ldaxB()
-    {
-        ldaxRP(cpuRegs_m.bc);
-    }
-
-    void ldaxD()
-    {
-        ldaxRP(cpuRegs_m.de);
-    }
-
-        //-- stax rp --//
-
-    void staxRP(uint16_t rp)
-    {
-        ++cpuRegs_m.clock;
-        memIo_m.write(rp, cpuRegs_m.a);
-    }
-
-    void staxB()
-    {
-        staxRP(cpuRegs_m.bc);
-    }
-
-    void staxD()
-    {
-        staxRP(cpuRegs_m.de);
-    }
-
-        //-- xchg; sphl; xthl --//
-
-    void xchg()
-    {
-        ++cpuRegs_m.clock;
-        uint16_t tmp = cpuRegs_m.hl;
-        cpuRegs_m.hl = cpuRegs_m.de;
-        cpuRegs_m.de = tmp;
-    }
-
-    void sphl()
-    {
-        cpuRegs_m.clock += 2;
-        cpuRegs_m.sp = cpuRegs_m.hl;
-    }
-
-    void xthl()
-    {
-        ++cpuRegs_m.clock;
-        uint16_t tmp;
-        memIo_m.pop(&tmp);
-        memIo_m.push(cpuRegs_m.hl);
-        cpuRegs_m.clock += 2;
-        cpuRegs_m.hl = tmp;
-    }
-
-        //-- push rp --//
-
-    void pushRP(uint16_t rp)
-    {
-        cpuRegs_m.clock += 2;
-        memIo_m.push(rp);
-    }
-
-    void pushB()
-    {
-        pushRP(cpuRegs_m.bc);
-    }
-
-    void pushD()
-    {
-        pushRP(cpuRegs_m.de);
-    }
-
-    void pushH()
-    {
-        pushRP(cpuRegs_m.hl);
-    }
-
-    void pushPSW()
-    {
-        pushRP(cpuRegs_m.psw);
-    }
-
-        //-- pop rp --//
-
-    void popRP(uint16_t * rp)
-    {
-        ++cpuRegs_m.clock;
-        memIo_m.pop(rp);
-    }
-
-    void popB()
-    {
-        popRP(&cpuRegs_m.bc);
-    }
-
-    void popD()
-    {
-        popRP(&cpuRegs_m.de);
-    }
-
-    void popH()
-    {
-        popRP(&cpuRegs_m.hl);
-    }
-
-    void popPSW()
-    {
-        popRP(&cpuRegs_m.psw);
-    }
-
-        //-- add r/m; adi data --//
-
-    void add(uint8_t data)
-    {
-        ++cpuRegs_m.clock;
-        uint8_t ac = ((cpuRegs_m.a & ~0x10) + (data & ~0x10)) & 0x10;
-        uint16_t tmp = uint16_t(cpuRegs_m.a) + uint16_t(data);
-        cpuRegs_m.a = bytelo(tmp);
-        cpuRegs_m.f = flags_m[cpuRegs_m.a] | (bytehi(tmp) & 0x01) | ac;
-    }
-
-    void addA()
-    {
-        add(cpuRegs_m.a);
-    }
-
-    void addB()
-    {
-        add(cpuRegs_m.b);
-    }
-
-    void addC()
-    {
-        add(cpuRegs_m.c);
-    }
-
-    void addD()
-    {
-        add(cpuRegs_m.d);
-    }
-
-    void addE()
-    {
-        add(cpuRegs_m.e);
-    }
-
-    void addH()
-    {
-        add(cpuRegs_m.h);
-    }
-
-    void addL()
-    {
-        add(cpuRegs_m.l);
-    }
-
-    void addM()
-    {
-        uint8_t tmp;
-        memIo_m.read(&tmp, cpuRegs_m.hl);
-        add(tmp);
-    }
-
-    void adi()
-    {
-        uint8_t tmp;
-        memIo_m.fetch(&tmp);
-        add(tmp);
-    }
-
-        //-- adc r/m; aci data --//
-
-    void adc(uint8_t data)
-    {
-        ++cpuRegs_m.clock;
-        uint8_t ac = ((cpuRegs_m.a & ~0x10) + (data & ~0x10) + (cpuRegs_m.f & 0x01)) & 0x10;
-        uint16_t tmp = uint16_t(cpuRegs_m.a) + uint16_t(data) + uint16_t(cpuRegs_m.f & 0x01);
-        cpuRegs_m.a = bytelo(tmp);
-        cpuRegs_m.f = flags_m[cpuRegs_m.a] | (bytehi(tmp) & 0x01) | ac;
-    }
-
-    void adcA()
-    {
-        adc(cpuRegs_m.a);
-    }
-
-    void adcB()
-    {
-        adc(cpuRegs_m.b);
-    }
-
-    void adcC()
-    {
-        adc(cpuRegs_m.c);
-    }
-
-    void adcD()
-    {
-        adc(cpuRegs_m.d);
-    }
-
-    void adcE()
-    {
-        adc(cpuRegs_m.e);
-    }
-
-    void adcH()
-    {
-        adc(cpuRegs_m.h);
-    }
-
-    void adcL()
-    {
-        adc(cpuRegs_m.l);
-    }
-
-    void adcM()
-    {
-        uint8_t tmp;
-        memIo_m.read(&tmp, cpuRegs_m.hl);
-        adc(tmp);
-    }
-
-    void aci()
-    {
-        uint8_t tmp;
-        memIo_m.fetch(&tmp);
-        adc(tmp);
-    }
-
-        //-- sub r/m; sui data --//
-
-    void sub(uint8_t data)
-    {
-        ++cpuRegs_m.clock;
-        uint8_t ac = ((cpuRegs_m.a & ~0x10) - (data & ~0x10)) & 0x10;
-        uint16_t tmp = uint16_t(cpuRegs_m.a) - uint16_t(data);
-        cpuRegs_m.a = bytelo(tmp);
-        cpuRegs_m.f = flags_m[cpuRegs_m.a] | (bytehi(tmp) & 0x01) | ac;
-    }
-
-    void subA()
-    {
-        sub(cpuRegs_m.a);
-    }
-
-    void subB()
-    {
-        sub(cpuRegs_m.b);
-    }
-
-    void subC()
-    {
-        sub(cpuRegs_m.c);
-    }
-
-    void subD()
-    {
-        sub(cpuRegs_m.d);
-    }
-
-    void subE()
-    {
-        sub(cpuRegs_m.e);
-    }
-
-    void subH()
-    {
-        sub(cpuRegs_m.h);
-    }
-
-    void subL()
-    {
-        sub(cpuRegs_m.l);
-    }
-
-    void subM()
-    {
-        uint8_t tmp;
-        memIo_m.read(&tmp, cpuRegs_m.hl);
-        sub(tmp);
-    }
-
-    void sui()
-    {
-        uint8_t tmp;
-        memIo_m.fetch(&tmp);
-        sub(tmp);
-    }
-
-        //-- sbb r/m; sbi data --//
-
-    void sbb(uint8_t data)
-    {
-        ++cpuRegs_m.clock;
-        uint8_t ac = ((cpuRegs_m.a & ~0x10) - (data & ~0x10) - (cpuRegs_m.f & 0x01)) & 0x10;
-        uint16_t tmp = uint16_t(cpuRegs_m.a) - uint16_t(data) - uint16_t(cpuRegs_m.f & 0x01);
-        cpuRegs_m.a = bytelo(tmp);
-        cpuRegs_m.f = flags_m[cpuRegs_m.a] | (bytehi(tmp) & 0x01) | ac;
-    }
-
-    void sbbA()
-    {
-        sbb(cpuRegs_m.a);
-    }
-
-    void sbbB()
-    {
-        sbb(cpuRegs_m.b);
-    }
-
-    void sbbC()
-    {
-        sbb(cpuRegs_m.c);
-    }
-
-    void sbbD()
-    {
-        sbb(cpuRegs_m.d);
-    }
-
-    void sbbE()
-    {
-        sbb(cpuRegs_m.e);
-    }
-
-    void sbbH()
-    {
-        sbb(cpuRegs_m.h);
-    }
-
-    void sbbL()
-    {
-        sbb(cpuRegs_m.l);
-    }
-
-    void sbbM()
-    {
-        uint8_t tmp;
-        memIo_m.read(&tmp, cpuRegs_m.hl);
-        sbb(tmp);
-    }
-
-    void sbi()
-    {
-        uint8_t tmp;
-        memIo_m.fetch(&tmp);
-        sbb(tmp);
-    }
-
-        //-- ana r/m; ani data --//
-
-    void ana(uint8_t data)
-    {
-        ++cpuRegs_m.clock;
-        uint8_t ac = uint8_t(((cpuRegs_m.a & 0x08) | (data & 0x08)) << 1);
-        cpuRegs_m.a &= data;
-        cpuRegs_m.f = flags_m[cpuRegs_m.a] | ac;
-    }
-
-    void anaA()
-    {
-        ana(cpuRegs_m.a);
-    }
-
-    void anaB()
-    {
-        ana(cpuRegs_m.b);
-    }
-
-    void anaC()
-    {
-        ana(cpuRegs_m.c);
-    }
-
-    void anaD()
-    {
-        ana(cpuRegs_m.d);
-    }
-
-    void anaE()
-    {
-        ana(cpuRegs_m.e);
-    }
-
-    void anaH()
-    {
-        ana(cpuRegs_m.h);
-    }
-
-    void anaL()
-    {
-        ana(cpuRegs_m.l);
-    }
-
-    void anaM()
-    {
-        uint8_t tmp;
-        memIo_m.read(&tmp, cpuRegs_m.hl);
-        ana(tmp);
-    }
-
-    void ani()
-    {
-        uint8_t tmp;
-        memIo_m.fetch(&tmp);
-        ana(tmp);
-    }
-
-        //-- xra r/m; xri data --//
-
-    void xra(uint8_t data)
-    {
-        ++cpuRegs_m.clock;
-        cpuRegs_m.a ^= data;
-        cpuRegs_m.f = flags_m[cpuRegs_m.a];
-    }
-
-    void xraA()
-    {
-        xra(cpuRegs_m.a);
-    }
-
-    void xraB()
-    {
-        xra(cpuRegs_m.b);
-    }
-
-    void xraC()
-    {
-        xra(cpuRegs_m.c);
-    }
-
-    void xraD()
-    {
-        xra(cpuRegs_m.d);
-    }
-
-    void xraE()
-    {
-        xra(cpuRegs_m.e);
-    }
-
-    void xraH()
-    {
-        xra(cpuRegs_m.h);
-    }
-
-    void xraL()
-    {
-        xra(cpuRegs_m.l);
-    }
-
-    void xraM()
-    {
-        uint8_t tmp;
-        memIo_m.read(&tmp, cpuRegs_m.hl);
-        xra(tmp);
-    }
-
-    void xri()
-    {
-        uint8_t tmp;
-        memIo_m.fetch(&tmp);
-        xra(tmp);
-    }
-
-        //-- ora r/m; ori data --//
-
-    void ora(uint8_t data)
-    {
-        ++cpuRegs_m.clock;
-        cpuRegs_m.a |= data;
-        cpuRegs_m.f = flags_m[cpuRegs_m.a];
-    }
-
-    void oraA()
-    {
-        ora(cpuRegs_m.a);
-    }
-
-    void oraB()
-    {
-        ora(cpuRegs_m.b);
-    }
-
-    void oraC()
-    {
-        ora(cpuRegs_m.c);
-    }
-
-    void oraD()
-    {
-        ora(cpuRegs_m.d);
-    }
-
-    void oraE()
-    {
-        ora(cpuRegs_m.e);
-    }
-
-    void oraH()
-    {
-        ora(cpuRegs_m.h);
-    }
-
-    void oraL()
-    {
-        ora(cpuRegs_m.l);
-    }
-
-    void oraM()
-    {
-        uint8_t tmp;
-        memIo_m.read(&tmp, cpuRegs_m.hl);
-        ora(tmp);
-    }
-
-    void ori()
-    {
-        uint8_t tmp;
-        memIo_m.fetch(&tmp);
-        ora(tmp);
-    }
-
-        //-- cmp r/m; cpi data --//
-
-    void cmp(uint8_t data)
-    {
-        ++cpuRegs_m.clock;
-        uint8_t ac = ((cpuRegs_m.a & ~0x10) - (data & ~0x10)) & 0x10;
-        uint16_t tmp = uint16_t(cpuRegs_m.a) - uint16_t(data);
-        cpuRegs_m.f = flags_m[bytelo(tmp)] | (bytehi(tmp) & 0x01) | ac;
-    }
-
-    void cmpA()
-    {
-        cmp(cpuRegs_m.a);
-    }
-
-    void cmpB()
-    {
-        cmp(cpuRegs_m.b);
-    }
-
-    void cmpC()
-    {
-        cmp(cpuRegs_m.c);
-    }
-
-    void cmpD()
-    {
-        cmp(cpuRegs_m.d);
-    }
-
-    void cmpE()
-    {
-        cmp(cpuRegs_m.e);
-    }
-
-    void cmpH()
-    {
-        cmp(cpuRegs_m.h);
-    }
-
-    void cmpL()
-    {
-        cmp(cpuRegs_m.l);
-    }
-
-    void cmpM()
-    {
-        uint8_t tmp;
-        memIo_m.read(&tmp, cpuRegs_m.hl);
-        cmp(tmp);
-    }
-
-    void cpi()
-    {
-        uint8_t tmp;
-        memIo_m.fetch(&tmp);
-        cmp(tmp);
-    }
-
-        //-- inr r --//
-
-    void inrR(uint8_t * r)
-    {
-        cpuRegs_m.clock += 2;
-        uint8_t ac = ((*r & ~0x10) + 1) & 0x10;
-        cpuRegs_m.f = flags_m[++(*r)] | (cpuRegs_m.f & 0x01) | ac;
-    }
-
-    void inrA()
-    {
-        inrR(&cpuRegs_m.a);
-    }
-
-    void inrB()
-    {
-        inrR(&cpuRegs_m.b);
-    }
-
-    void inrC()
-    {
-        inrR(&cpuRegs_m.c);
-    }
-
-    void inrD()
-    {
-        inrR(&cpuRegs_m.d);
-    }
-
-    void inrE()
-    {
-        inrR(&cpuRegs_m.e);
-    }
-
-    void inrH()
-    {
-        inrR(&cpuRegs_m.h);
-    }
-
-    void inrL()
-    {
-        inrR(&cpuRegs_m.l);
-    }
-
-        //-- inr m --//
-
-    void inrM()
-    {
-        ++cpuRegs_m.clock;
-        uint8_t r;
-        memIo_m.read(&r, cpuRegs_m.hl);
-        uint8_t ac = ((r & ~0x10) + 1) & 0x10;
-        cpuRegs_m.f = flags_m[++r] | (cpuRegs_m.f & 0x01) | ac;
-        memIo_m.write(cpuRegs_m.hl, r);
-    }
-
-        //-- dcr r --//
-
-    void dcrR(uint8_t * r)
-    {
-        cpuRegs_m.clock += 2;
-        uint8_t ac = ((*r & ~0x10) - 1) & 0x10;
-        cpuRegs_m.f = flags_m[--(*r)] | (cpuRegs_m.f & 0x01) | ac;
-    }
-
-    void dcrA()
-    {
-        dcrR(&cpuRegs_m.a);
-    }
-
-    void dcrB()
-    {
-        dcrR(&cpuRegs_m.b);
-    }
-
-    void dcrC()
-    {
-        dcrR(&cpuRegs_m.c);
-    }
-
-    void dcrD()
+    void sta()
     {
-        dcrR(&cpuRegs_m.d);
+        ++cpuRegs_m.clock;
+        uint16_t addr;
+        memIo_m.fetch(&addr);
+        memIo_m.write(addr, cpuRegs_m.a);
     }
 
-    void dcrE()
-    {
-        dcrR(&cpuRegs_m.e);
-    }
+        //-- lhld/shld addr --//
 
-    void dcrH()
+    void lhld()
     {
-        dcrR(&cpuRegs_m.h);
+        ++cpuRegs_m.clock;
+        uint16_t addr;
+        memIo_m.fetch(&addr);
+        memIo_m.read(&cpuRegs_m.hl, addr);
     }
 
-    void dcrL()
+    void shld()
     {
-        dcrR(&cpuRegs_m.l);
+        ++cpuRegs_m.clock;
+        uint16_t addr;
+        memIo_m.fetch(&addr);
+        memIo_m.write(addr, cpuRegs_m.hl);
     }
 
-        //-- dcr m --//
+        //-- ldax/stax rp --//
 
-    void dcrM()
+    template <unsigned rp>
+    void ldax()
     {
         ++cpuRegs_m.clock;
-        uint8_t r;
-        memIo_m.read(&r, cpuRegs_m.hl);
-        uint8_t ac = ((r & ~0x10) + 1) & 0x10;
-        cpuRegs_m.f = flags_m[--r] | (cpuRegs_m.f & 0x01) | ac;
-        memIo_m.write(cpuRegs_m.hl, r);
+        memIo_m.read(&cpuRegs_m.a, regPair<rp>());
     }
 
-        //-- inx rp --//
-
-    void inxRP(uint16_t * rp)
+    template <unsigned rp>
+    void stax()
     {
-        cpuRegs_m.clock += 2;
-        ++(*rp);
+        ++cpuRegs_m.clock;
+        memIo_m.write(regPair<rp>(), cpuRegs_m.a);
     }
 
-    void inxB()
-    {
-        inxRP(&cpuRegs_m.bc);
-    }
+        //-- xchg; sphl; xthl --//
 
-    void inxD()
+    void xchg()
     {
-        inxRP(&cpuRegs_m.de);
+        ++cpuRegs_m.clock;
+        uint16_t tmp = cpuRegs_m.hl;
+        cpuRegs_m.hl = cpuRegs_m.de;
+        cpuRegs_m.de = tmp;
     }
 
-    void inxH()
-    {
-        inxRP(&cpuRegs_m.hl);
-    }
-    void inxSP()
+    void sphl()
     {
-        inxRP(&cpuRegs_m.sp);
+        cpuRegs_m.clock += 2;
+        cpuRegs_m.sp = cpuRegs_m.hl;
     }
 
-        //-- dcx rp --//
-
-    void dcxRP(uint16_t * rp)
+    void xthl()
     {
+        ++cpuRegs_m.clock;
+        uint16_t tmp;
+        memIo_m.pop(&tmp);
+        memIo_m.push(cpuRegs_m.hl);
         cpuRegs_m.clock += 2;
-        --(*rp);
+        cpuRegs_m.hl = tmp;
     }
 
-    void dcxB()
-    {
-        dcxRP(&cpuRegs_m.bc);
-    }
+        //-- push/pop rp --//
 
-    void dcxD()
+    template <unsigned rp>
+    void push()
     {
-        dcxRP(&cpuRegs_m.de);
+        cpuRegs_m.clock += 2;
+        memIo_m.push(regPair<rp>());
     }
 
-    void dcxH()
+    template <unsigned rp>
+    void pop()
     {
-        dcxRP(&cpuRegs_m.hl);
-    }
-    void dcxSP()
-    {
-        dcxRP(&cpuRegs_m.sp);
+        ++cpuRegs_m.clock;
+        memIo_m.pop(&regPair<rp>());
     }
 
-    //-- dad rp --//
+        //-- add/adc/sub/sbb/ana/xra/ora/cmp r/m; adi/aci/sui/sbi/ani/xri/ori/cpi data --//
 
-    void dadRP(uint16_t rp)
+    template <AluOp op>
+    void alu(uint8_t data)
     {
         ++cpuRegs_m.clock;
-        uint32_t tmp = uint32_t(cpuRegs_m.hl) + uint32_t(rp);
-        cpuRegs_m.hl = uint16_t(tmp);
-        cpuRegs_m.f = (cpuRegs_m.f & ~0x01) | (uint8_t(tmp >> 16) & 0x01);
-        cpuRegs_m.clock += 6;
+        if constexpr(op == AluOp::ana) {
+            uint8_t ac = uint8_t(((cpuRegs_m.a & 0x08) | (data & 0x08)) << 1);
+            cpuRegs_m.a &= data;
+            cpuRegs_m.f = flags_m[cpuRegs_m.a] | ac;
+        } else if constexpr(op == AluOp::xra) {
+            cpuRegs_m.a ^= data;
+            cpuRegs_m.f = flags_m[cpuRegs_m.a];
+        } else if constexpr(op == AluOp::ora) {
+            cpuRegs_m.a |= data;
+            cpuRegs_m.f = flags_m[cpuRegs_m.a];
+        } else {
+            uint8_t c = (op == AluOp::adc || op == AluOp::sbb ? cpuRegs_m.f & 0x01 : 0);
+            uint8_t ac;
+            uint16_t tmp;
+            if constexpr(op == AluOp::add || op == AluOp::adc) {
+                ac = ((cpuRegs_m.a & ~0x10) + (data & ~0x10) + c) & 0x10;
+                tmp = uint16_t(cpuRegs_m.a) + uint16_t(data) + uint16_t(c);
+            } else {
+                ac = ((cpuRegs_m.a & ~0x10) - (data & ~0x10) - c) & 0x10;
+                tmp = uint16_t(cpuRegs_m.a) - uint16_t(data) - uint16_t(c);
+            }
+            if constexpr(op != AluOp::cmp) {
+                cpuRegs_m.a = bytelo(tmp);
+            }
+            cpuRegs_m.f = flags_m[bytelo(tmp)] | (bytehi(tmp) & 0x01) | ac;
+        }
     }
 
-    void dadB()
+    template <AluOp op, unsigned r>
+    void aluR()
     {
-        dadRP(cpuRegs_m.bc);
+        if constexpr(r == opRegM) {
+            uint8_t tmp;
+            memIo_m.read(&tmp, cpuRegs_m.hl);
+            alu<op>(tmp);
+        } else {
+            alu<op>(reg<r>());
+        }
     }
 
-    void dadD()
+    template <AluOp op>
+    void aluI()
     {
-        dadRP(cpuRegs_m.de);
+        uint8_t tmp;
+        memIo_m.fetch(&tmp);
+        alu<op>(tmp);
+    }
+
+        //-- inr/dcr r/m --//
+
+    // Aux carry of dcr m is taken as for inr m
+    template <unsigned r, bool isDec>
+    void inrDcr()
+    {
+        if constexpr(r == opRegM) {
+            ++cpuRegs_m.clock;
+            uint8_t tmp;
+            memIo_m.read(&tmp, cpuRegs_m.hl);
+            uint8_t ac = ((tmp & ~0x10) + 1) & 0x10;
+            tmp = (isDec ? tmp - 1 : tmp + 1);
+            cpuRegs_m.f = flags_m[tmp] | (cpuRegs_m.f & 0x01) | ac;
+            memIo_m.write(cpuRegs_m.hl, tmp);
+        } else {
+            cpuRegs_m.clock += 2;
+            uint8_t & tmp = reg<r>();
+            uint8_t ac = ((tmp & ~0x10) + (isDec ? -1 : 1)) & 0x10;
+            tmp = (isDec ? tmp - 1 : tmp + 1);
+            cpuRegs_m.f = flags_m[tmp] | (cpuRegs_m.f & 0x01) | ac;
+        }
     }
 
-    void dadH()
+        //-- inx/dcx rp --//
+
+    template <unsigned rp, bool isDec>
+    void inxDcx()
     {
-        dadRP(cpuRegs_m.hl);
+        cpuRegs_m.clock += 2;
+        regPair<rp>() += (isDec ? -1 : 1);
     }
 
-    void dadSP()
+        //-- dad rp --//
+
+    template <unsigned rp>
+    void dad()
     {
-        dadRP(cpuRegs_m.sp);
+        ++cpuRegs_m.clock;
+        uint32_t tmp = uint32_t(cpuRegs_m.hl) + uint32_t(regPair<rp>());
+        cpuRegs_m.hl = uint16_t(tmp);
+        cpuRegs_m.f = (cpuRegs_m.f & ~0x01) | (uint8_t(tmp >> 16) & 0x01);
+        cpuRegs_m.clock += 6;
     }
 
         //-- daa; cma --//
@@ -1723,7 +1570,7 @@ private:
         cpuRegs_m.f ^= CpuFlag::c;
     }
 
-        //-- jmp addr --//
+        //-- jmp addr; j* addr --//
 
     void jmp()
     {
@@ -1731,180 +1578,93 @@ private:
         memIo_m.fetch(&cpuRegs_m.pc);
     }
 
-    //-- j* addr --//
-
-    void jf(uint8_t flag, bool isSet = true)
+    template <uint8_t flag, bool isSet>
+    void jcc()
     {
         cpuRegs_m.clock += 2;
         uint16_t addr;
         memIo_m.fetch(&addr);
-        if(((cpuRegs_m.f & flag) != 0) == isSet) {
+        if(isCondition<flag, isSet>()) {
             cpuRegs_m.pc = addr;
         }
     }
 
-    void jnz()
-    {
-        jf(CpuFlag::z, false);
-    }
-
-    void jz()
-    {
-        jf(CpuFlag::z);
-    }
-
-    void jnc()
-    {
-        jf(CpuFlag::c, false);
-    }
-
-    void jc()
-    {
-        jf(CpuFlag::c);
-    }
-
-    void jpo()
-    {
-        jf(CpuFlag::p, false);
-    }
-
-    void jpe()
-    {
-        jf(CpuFlag::p);
-    }
-
-    void jp()
-    {
-        jf(CpuFlag::s, false);
-    }
-
-    void jm()
-    {
-        jf(CpuFlag::s);
-    }
-
-        //-- call addr --//
+        //-- call addr; c* addr --//
 
     void call()
     {
+        uint16_t callPc = cpuRegs_m.pc - 1;
         cpuRegs_m.clock += 2;
         uint16_t addr;
         memIo_m.fetch(&addr);
         memIo_m.push(cpuRegs_m.pc);
         cpuRegs_m.pc = addr;
+        enterCall(callPc);
     }
 
-        //-- c* addr --//
-
-    void cf(uint8_t flag, bool isSet = true)
+    template <uint8_t flag, bool isSet>
+    void ccc()
     {
+        uint16_t callPc = cpuRegs_m.pc - 1;
         cpuRegs_m.clock += 2;
         uint16_t addr;
         memIo_m.fetch(&addr);
-        if(((cpuRegs_m.f & flag) != 0) == isSet) {
+        if(isCondition<flag, isSet>()) {
             memIo_m.push(cpuRegs_m.pc);
             cpuRegs_m.pc = addr;
+            enterCall(callPc);
         }
     }
 
-    void cnz()
-    {
-        cf(CpuFlag::z, false);
-    }
-
-    void cz()
-    {
-        cf(CpuFlag::z);
-    }
-
-    void cnc()
-    {
-        cf(CpuFlag::c, false);
-    }
-
-    void cc()
-    {
-        cf(CpuFlag::c);
-    }
-
-    void cpo()
-    {
-        cf(CpuFlag::p, false);
-    }
-
-    void cpe()
-    {
-        cf(CpuFlag::p);
-    }
-
-    void cp()
-    {
-        cf(CpuFlag::s, false);
-    }
-
-    void cm()
-    {
-        cf(CpuFlag::s);
-    }
-
-        //-- ret --//
+        //-- ret; r* --//
 
     void ret()
     {
         cpuRegs_m.clock += 2;
-        retHookTrigger_m.fire();
+        leaveCall();
         memIo_m.pop(&cpuRegs_m.pc);
     }
 
-        //-- r* --//
-
-    void rf(uint8_t flag, bool isSet = true)
+    template <uint8_t flag, bool isSet>
+    void rcc()
     {
         cpuRegs_m.clock += 2;
-        if(((cpuRegs_m.f & flag) != 0) == isSet) {
-            retHookTrigger_m.fire();
+        if(isCondition<flag, isSet>()) {
+            leaveCall();
             memIo_m.pop(&cpuRegs_m.pc);
         }
     }
 
-    void rnz()
-    {
-        rf(CpuFlag::z, false);
-    }
-
-    void rz()
-    {
-        rf(CpuFlag::z);
-    }
-
-    void rnc()
-    {
-        rf(CpuFlag::c, false);
-    }
-
-    void rc()
-    {
-        rf(CpuFlag::c);
-    }
-
-    void rpo()
-    {
-        rf(CpuFlag::p, false);
-    }
-
-    void rpe()
+    // Frames at or below the new one are abandoned
+    void enterCall(uint16_t callPc, bool isInterrupt = false)
     {
-        rf(CpuFlag::p);
-    }
-
-    void rp()
-    {
-        rf(CpuFlag::s, false);
+        if(!isCallStack_m) {
+            return;
+        }
+        while(!callStack_m.empty() && callStack_m.back().sp <= cpuRegs_m.sp) {
+            callStack_m.pop_back();
+        }
+        if(callStack_m.size() >= maxCallDepth) {
+            callStack_m.erase(callStack_m.begin());
+        }
+        callStack_m.push_back({ callPc, cpuRegs_m.pc, cpuRegs_m.sp, isInterrupt });
     }
 
-    void rm()
+    // Fired before return address is popped
+    void leaveCall()
     {
-        rf(CpuFlag::s);
+        if(retHookSps_m[cpuRegs_m.sp]) {
+            retHookTrigger_m.fire();
+        }
+        if(!isCallStack_m) {
+            return;
+        }
+        while(!callStack_m.empty() && callStack_m.back().sp < cpuRegs_m.sp) {
+            callStack_m.pop_back();
+        }
+        if(!callStack_m.empty() && callStack_m.back().sp == cpuRegs_m.sp) {
+            callStack_m.pop_back();
+        }
     }
 
         //-- pchl --//
@@ -1915,53 +1675,16 @@ private:
         cpuRegs_m.pc = cpuRegs_m.hl;
     }
 
-        //-- rst * --//
+        //-- rst n --//
 
-    void rst(uint16_t addr)
+    template <uint16_t addr, bool isInterrupt = false>
+    void rst()
     {
+        uint16_t callPc = (isInterrupt ? cpuRegs_m.pc : cpuRegs_m.pc - 1);
         cpuRegs_m.clock += 2;
         memIo_m.push(cpuRegs_m.pc);
         cpuRegs_m.pc = addr;
-    }
-
-    void rst0()
-    {
-        rst(0x0000);
-    }
-
-    void rst1()
-    {
-        rst(0x0008);
-    }
-
-    void rst2()
-    {
-        rst(0x0010);
-    }
-
-    void rst3()
-    {
-        rst(0x0018);
-    }
-
-    void rst4()
-    {
-        rst(0x0020);
-    }
-
-    void rst5()
-    {
-        rst(0x0028);
-    }
-
-    void rst6()
-    {
-        rst(0x0030);
-    }
-
-    void rst7()
-    {
-        rst(0x0038);
+        enterCall(callPc, isInterrupt);
     }
 
         //-- ei; di; hlt; nop --//
@@ -2002,16 +1725,19 @@ private:
         uint8_t port;
         memIo_m.fetch(&port);
         cpuRegs_m.clock += 3;
+        ioHookTrigger_m.fire(MemAccessType::read, port);
         (this->*inFuncs[port])();
         ++cpuRegs_m.clock;
     }
 
     void out()
     {
+        idleLoop_m.markDirty();
         ++cpuRegs_m.clock;
         uint8_t port;
         memIo_m.fetch(&port);
         cpuRegs_m.clock += 4;
+        ioHookTrigger_m.fire(MemAccessType::write, port);
         (this->*outFuncs[port])();
         ++cpuRegs_m.clock;
     }
@@ -2033,6 +1759,7 @@ private:
 
     void in81()
     {
+        inPortHookTrigger_m.fire(0x81);
         cpuRegs_m.a = ioPorts_m->port81[ioPorts_m->port82 & 0x0f];
     }
 
@@ -2045,10 +1772,13 @@ private:
 
     void out82()
     {
+        uint8_t changedBits = ioPorts_m->port82 ^ cpuRegs_m.a;
         ioPorts_m->port82 = cpuRegs_m.a;
+        if(changedBits & (TapeBit::motor | TapeBit::out)) {
+            tapeOutHookTrigger_m.fire(ioPorts_m->port82);
+        }
         // TODO:
         //setBeepBit(ioPorts_m->port & 0x80);
-        //setTapeBit(ioPorts_m->port & 0x40);
     }
 
         //-- port 84 --//
@@ -2103,6 +1833,7 @@ private:
 
     void in8c()
     {
+        inPortHookTrigger_m.fire(0x8c);
         cpuRegs_m.a = ioPorts_m->port8c & 0x3f;
     }
 
@@ -2110,11 +1841,16 @@ private:
 
     void in8d()
     {
+        inPortHookTrigger_m.fire(0x8d);
         cpuRegs_m.a = ioPorts_m->port8d & 0x3f;
-        // TODO:
-        //if(tapeBit()) {
-        //    cpuRegs_m.a |= 0x80;
-        //}
+        if(!tapeInHookTrigger_m.isEmpty()) {
+            idleLoop_m.markDirty(); // tape input changes with time
+        }
+        bool tapeBit = false;
+        tapeInHookTrigger_m.fire(&tapeBit);
+        if(tapeBit) {
+            cpuRegs_m.a |= TapeBit::in;
+        }
     }
 
         //-- port 90 --//
@@ -2176,270 +1912,428 @@ private:
     {
     }
 
+        //-- fused ops --//
+
+    // Ops of a sequence are run by their own handlers, so timing and memory
+    // access are exactly the same, while dispatch and per op checks are done
+    // once. Nothing watching single ops is allowed meanwhile, and the sequence
+    // breaks at the clock limit, at hooked addresses and at changed code
+    template <size_t op>
+    void fuse()
+    {
+        if(isFusion_m && opHookTrigger_m.isEmpty() && !memIo_m.hasMemHooks() &&
+           fuseSeq<op>(std::make_index_sequence<fusedSeqs.size()>()))
+        {
+            return;
+        }
+        (this->*opFunc<op>())();
+    }
+
+    template <size_t op, size_t... seqNums>
+    auto fuseSeq(std::index_sequence<seqNums...>) -> bool
+    {
+        return (fuseSeq<op, seqNums>() || ...);
+    }
+
+    template <size_t op, size_t seqNum>
+    auto fuseSeq() -> bool
+    {
+        if constexpr(fusedSeqs[seqNum][0] != op) {
+            return false;
+        } else {
+            if(!isFusedSeqAt(fusedSeqs[seqNum], cpuRegs_m.pc - 1)) {
+                return false;
+            }
+            runFusedSeq<seqNum>(std::make_index_sequence<fusedSeqSize(seqNum) - 1>());
+            return true;
+        }
+    }
+
+    auto isFusedSeqAt(const std::array<uint8_t, maxFusedOps> & fusedSeq, uint16_t addr) -> bool
+    {
+        for(size_t i = 0; i < maxFusedOps && fusedSeq[i] != 0; ++i) {
+            uint8_t op;
+            memIo_m.peek(&op, addr);
+            if(op != fusedSeq[i]) {
+                return false;
+            }
+            addr += opLength(op);
+        }
+        return true;
+    }
+
+    // Head op is fetched already
+    template <size_t seqNum, size_t... opNums>
+    void runFusedSeq(std::index_sequence<opNums...>)
+    {
+        constexpr const auto & fusedSeq = fusedSeqs[seqNum];
+        uint16_t headPc = cpuRegs_m.pc - 1;
+        if constexpr(isDelaySeq(seqNum)) {
+            delayLoop_m.reset();
+        }
+        (this->*opFunc<fusedSeq[0]>())();
+        while((stepFused<fusedSeq[opNums + 1]>() && ...) && cpuRegs_m.pc == headPc) {
+            if constexpr(isDelaySeq(seqNum)) {
+                skipDelay<fusedSeq[0]>();
+            }
+            if(!stepFused<fusedSeq[0]>()) {
+                break;
+            }
+        }
+        if constexpr(isDelaySeq(seqNum)) {
+            delayLoop_m.reset(); // stops logging
+        }
+    }
+
+    // Returns false once the sequence breaks, having the op run if fetched
+    template <size_t op>
+    auto stepFused() -> bool
+    {
+        if(cpuRegs_m.clock >= clocksPerFrame || pcHooks_m[cpuRegs_m.pc]) {
+            return false;
+        }
+        uint8_t data;
+        memIo_m.fetch(&data);
+        if(data != op) {
+            (this->*opFuncs[data])();
+            return false;
+        }
+        (this->*opFunc<op>())();
+        return true;
+    }
+
+    // Register counted down is the one of the head op. Called at the head,
+    // which has to run step by step if hooked, the rest breaking the
+    // sequence on hooks by itself
+    template <size_t op>
+    void skipDelay()
+    {
+        if(memIo_m.hasWatchHooks() || pcHooks_m[cpuRegs_m.pc]) {
+            return;
+        }
+        constexpr bool isPair = ((op & 0x0f) == 0x0b);
+        unsigned count;
+        if constexpr(isPair) {
+            count = (regPair<(op >> 4) & 3>() ? regPair<(op >> 4) & 3>() : 0x10000);
+        } else {
+            count = (reg<(op >> 3) & 7>() ? reg<(op >> 3) & 7>() : 0x100);
+        }
+
+        auto ramWait = [this](unsigned clock) {
+            return memIo_m.ramWait(clock);
+        };
+        unsigned skipClocks;
+        unsigned skipCount = delayLoop_m.loopBack(ramWait, cpuRegs_m.clock, count, memIo_m.waitPeriod(),
+                                                  clocksPerFrame, &skipClocks);
+        if(skipCount == 0) {
+            return;
+        }
+        if constexpr(isPair) {
+            regPair<(op >> 4) & 3>() -= skipCount;
+        } else {
+            reg<(op >> 3) & 7>() -= skipCount;
+        }
+        cpuRegs_m.clock += skipClocks;
+        idleLoop_m.markDirty(); // waits skipped are not logged
+    }
+
+    // Untraps runs of addresses left with no hook over them
+    void releasePcHook(uint16_t firstPc, uint16_t lastPc)
+    {
+        for(unsigned pc = firstPc; pc <= lastPc; ++pc) {
+            --pcHooks_m[pc];
+        }
+        if(!jit_m) {
+            return;
+        }
+        unsigned pc = firstPc;
+        while(pc <= lastPc) {
+            if(pcHooks_m[pc]) {
+                ++pc;
+                continue;
+            }
+            unsigned runFirst = pc;
+            while(pc + 1 <= lastPc && !pcHooks_m[pc + 1]) {
+                ++pc;
+            }
+            jit_m->removeTraps(uint16_t(runFirst), uint16_t(pc));
+            ++pc;
+        }
+    }
+
+    void step()
+    {
+        opHookTrigger_m.fire();
+        uint16_t pc = cpuRegs_m.pc;
+        if(pcHooks_m[pc]) {
+            pcHookTrigger_m.fire(pc);
+            pc = cpuRegs_m.pc;
+        }
+        uint8_t op;
+        memIo_m.fetch(&op);
+        (this->*opFuncs[op])();
+        if(cpuRegs_m.pc < pc && unsigned(pc - cpuRegs_m.pc) <= maxLoopBytes && idleLoop_m.isActive()) {
+            skipIdleLoop();
+        }
+    }
+
+    void skipIdleLoop()
+    {
+        if(memIo_m.hasMemHooks() || memIo_m.hasWatchHooks()) {
+            return;
+        }
+        auto ramWait = [this](unsigned clock) {
+            return memIo_m.ramWait(clock);
+        };
+        cpuRegs_m.clock += idleLoop_m.loopBack(ramWait, memIo_m.waitPeriod(), clocksPerFrame);
+    }
+
     CpuRegs cpuRegs_m;
 
+    IdleLoop idleLoop_m;
+    DelayLoop delayLoop_m;
     MemIo memIo_m;
+    MemBanks * memBanks_m;
     IoPorts * ioPorts_m;
 
+    std::unique_ptr<Jit> jit_m;
+    bool isFusion_m;
+
     std::array<uint8_t, 256> flags_m;
 
     IntHook::HookTrigger intHookTrigger_m;
     OpHook::HookTrigger  opHookTrigger_m;
     RetHook::HookTrigger retHookTrigger_m;
+    RetHook::SpCounts retHookSps_m;
+
+    bool isCallStack_m;
+    std::vector<CallFrame> callStack_m;
+
+    // Addresses hooked stay trapped until the last of their hooks is gone
+    PcHook::HookTrigger pcHookTrigger_m;
+    std::array<uint16_t, 65536> pcHooks_m; // hooks over each address
 
+    TapeInHook::HookTrigger  tapeInHookTrigger_m;
+    TapeOutHook::HookTrigger tapeOutHookTrigger_m;
+
+    InPortHook::HookTrigger inPortHookTrigger_m;
+    IoHook::HookTrigger ioHookTrigger_m;
+
+    // Dispatch tables are built at compile time by decoding every op and port
     using OpFunc = void (Impl::*)();
-    static constexpr std::array<OpFunc, 256> opFuncs = {
-        // 0x00
-        &Impl::nop,     &Impl::lxiB,    &Impl::staxB,   &Impl::inxB,
-        &Impl::inrB,    &Impl::dcrB,    &Impl::mviB,    &Impl::rlc,
-        &Impl::nop,     &Impl::dadB,    &Impl::ldaxB,   &Impl::dcxB,
-        &Impl::inrC,    &Impl::dcrC,    &Impl::mviC,    &Impl::rrc,
-        // 0x10
-        &Impl::nop,     &Impl::lxiD,    &Impl::staxD,   &Impl::inxD,
-        &Impl::inrD,    &Impl::dcrD,    &Impl::mviD,    &Impl::ral,
-        &Impl::nop,     &Impl::dadD,    &Impl::ldaxD,   &Impl::dcxD,
-        &Impl::inrE,    &Impl::dcrE,    &Impl::mviE,    &Impl::rar,
-        // 0x20
-        &Impl::nop,     &Impl::lxiH,    &Impl::shld,    &Impl::inxH,
-        &Impl::inrH,    &Impl::dcrH,    &Impl::mviH,    &Impl::daa,
-        &Impl::nop,     &Impl::dadH,    &Impl::lhld,    &Impl::dcxH,
-        &Impl::inrL,    &Impl::dcrL,    &Impl::mviL,    &Impl::cma,
-        // 0x30
-        &Impl::nop,     &Impl::lxiSP,   &Impl::sta,     &Impl::inxSP,
-        &Impl::inrM,    &Impl::dcrM,    &Impl::mviM,    &Impl::stc,
-        &Impl::nop,     &Impl::dadSP,   &Impl::lda,     &Impl::dcxSP,
-        &Impl::inrA,    &Impl::dcrA,    &Impl::mviA,    &Impl::cmc,
-        // 0x40
-        &Impl::movBB,   &Impl::movBC,   &Impl::movBD,   &Impl::movBE,
-        &Impl::movBH,   &Impl::movBL,   &Impl::movBM,   &Impl::movBA,
-        &Impl::movCB,   &Impl::movCC,   &Impl::movCD,   &Impl::movCE,
-        &Impl::movCH,   &Impl::movCL,   &Impl::movCM,   &Impl::movCA,
-        // 0x50
-        &Impl::movDB,   &Impl::movDC,   &Impl::movDD,   &Impl::movDE,
-        &Impl::movDH,   &Impl::movDL,   &Impl::movDM,   &Impl::movDA,
-        &Impl::movEB,   &Impl::movEC,   &Impl::movED,   &Impl::movEE,
-        &Impl::movEH,   &Impl::movEL,   &Impl::movEM,   &Impl::movEA,
-        // 0x60
-        &Impl::movHB,   &Impl::movHC,   &Impl::movHD,   &Impl::movHE,
-        &Impl::movHH,   &Impl::movHL,   &Impl::movHM,   &Impl::movHA,
-        &Impl::movLB,   &Impl::movLC,   &Impl::movLD,   &Impl::movLE,
-        &Impl::movLH,   &Impl::movLL,   &Impl::movLM,   &Impl::movLA,
-        // 0x70
-        &Impl::movMB,   &Impl::movMC,   &Impl::movMD,   &Impl::movME,
-        &Impl::movMH,   &Impl::movML,   &Impl::hlt,     &Impl::movMA,
-        &Impl::movAB,   &Impl::movAC,   &Impl::movAD,   &Impl::movAE,
-        &Impl::movAH,   &Impl::movAL,   &Impl::movAM,   &Impl::movAA,
-        // 0x80
-        &Impl::addB,    &Impl::addC,    &Impl::addD,    &Impl::addE,
-        &Impl::addH,    &Impl::addL,    &Impl::addM,    &Impl::addA,
-        &Impl::adcB,    &Impl::adcC,    &Impl::adcD,    &Impl::adcE,
-        &Impl::adcH,    &Impl::adcL,    &Impl::adcM,    &Impl::adcA,
-        // 0x90
-        &Impl::subB,    &Impl::subC,    &Impl::subD,    &Impl::subE,
-        &Impl::subH,    &Impl::subL,    &Impl::subM,    &Impl::subA,
-        &Impl::sbbB,    &Impl::sbbC,    &Impl::sbbD,    &Impl::sbbE,
-        &Impl::sbbH,    &Impl::sbbL,    &Impl::sbbM,    &Impl::sbbA,
-        // 0xa0
-        &Impl::anaB,    &Impl::anaC,    &Impl::anaD,    &Impl::anaE,
-        &Impl::anaH,    &Impl::anaL,    &Impl::anaM,    &Impl::anaA,
-        &Impl::xraB,    &Impl::xraC,    &Impl::xraD,    &Impl::xraE,
-        &Impl::xraH,    &Impl::xraL,    &Impl::xraM,    &Impl::xraA,
-        // 0xb0
-        &Impl::oraB,    &Impl::oraC,    &Impl::oraD,    &Impl::oraE,
-        &Impl::oraH,    &Impl::oraL,    &Impl::oraM,    &Impl::oraA,
-        &Impl::cmpB,    &Impl::cmpC,    &Impl::cmpD,    &Impl::cmpE,
-        &Impl::cmpH,    &Impl::cmpL,    &Impl::cmpM,    &Impl::cmpA,
-        // 0xc0
-        &Impl::rnz,     &Impl::popB,    &Impl::jnz,     &Impl::jmp,
-        &Impl::cnz,     &Impl::pushB,   &Impl::adi,     &Impl::rst0,
-        &Impl::rz,      &Impl::ret,     &Impl::jz,      &Impl::jmp,
-        &Impl::cz,      &Impl::call,    &Impl::aci,     &Impl::rst1,
-        // 0xd0
-        &Impl::rnc,     &Impl::popD,    &Impl::jnc,     &Impl::out,
-        &Impl::cnc,     &Impl::pushD,   &Impl::sui,     &Impl::rst2,
-        &Impl::rc,      &Impl::ret,     &Impl::jc,      &Impl::in,
-        &Impl::cc,      &Impl::call,    &Impl::sbi,     &Impl::rst3,
-        // 0xe0
-        &Impl::rpo,     &Impl::popH,    &Impl::jpo,     &Impl::xthl,
-        &Impl::cpo,     &Impl::pushH,   &Impl::ani,     &Impl::rst4,
-        &Impl::rpe,     &Impl::pchl,    &Impl::jpe,     &Impl::xchg,
-        &Impl::cpe,     &Impl::call,    &Impl::xri,     &Impl::rst5,
-        // 0xf0
-        &Impl::rp,      &Impl::popPSW,  &Impl::jp,      &Impl::di,
-        &Impl::cp,      &Impl::pushPSW, &Impl::ori,     &Impl::rst6,
-        &Impl::rm,      &Impl::sphl,    &Impl::jm,      &Impl::ei,
-        &Impl::cm,      &Impl::call,    &Impl::cpi,     &Impl::rst7
-    };
+    using PortFunc = void (Impl::*)();
+
+    template <size_t op>
+    static constexpr auto opFunc() -> OpFunc
+    {
+        constexpr unsigned dst = (op >> 3) & 7;
+        constexpr unsigned src = op & 7;
+        constexpr unsigned rp = (op >> 4) & 3;
+        constexpr unsigned stackRp = (rp == opPairSP ? opPairPSW : rp);
+        constexpr uint8_t flag = conditionFlags[(op >> 4) & 3];
+        constexpr bool isSet = ((op & 0x08) != 0);
+
+        if constexpr(op == 0x76) {
+            return &Impl::hlt;
+        } else if constexpr(op >= 0x40 && op < 0x80) {
+            return &Impl::mov<dst, src>;
+        } else if constexpr(op >= 0x80 && op < 0xc0) {
+            return &Impl::aluR<AluOp(dst), src>;
+        } else if constexpr(op < 0x40) {
+            switch(op) {
+                case 0x02:
+                case 0x12:
+                    return &Impl::stax<rp>;
+                case 0x0a:
+                case 0x1a:
+                    return &Impl::ldax<rp>;
+                case 0x22:
+                    return &Impl::shld;
+                case 0x2a:
+                    return &Impl::lhld;
+                case 0x32:
+                    return &Impl::sta;
+                case 0x3a:
+                    return &Impl::lda;
+                case 0x07:
+                    return &Impl::rlc;
+                case 0x0f:
+                    return &Impl::rrc;
+                case 0x17:
+                    return &Impl::ral;
+                case 0x1f:
+                    return &Impl::rar;
+                case 0x27:
+                    return &Impl::daa;
+                case 0x2f:
+                    return &Impl::cma;
+                case 0x37:
+                    return &Impl::stc;
+                case 0x3f:
+                    return &Impl::cmc;
+            }
+            switch(op & 0x0f) {
+                case 0x01:
+                    return &Impl::lxi<rp>;
+                case 0x03:
+                    return &Impl::inxDcx<rp, false>;
+                case 0x09:
+                    return &Impl::dad<rp>;
+                case 0x0b:
+                    return &Impl::inxDcx<rp, true>;
+            }
+            switch(op & 0x07) {
+                case 0x04:
+                    return &Impl::inrDcr<dst, false>;
+                case 0x05:
+                    return &Impl::inrDcr<dst, true>;
+                case 0x06:
+                    return &Impl::mvi<dst>;
+            }
+            return &Impl::nop; // 08h, 10h, 18h and so on are nop aliases
+        } else {
+            switch(op) {
+                case 0xc3:
+                case 0xcb:
+                    return &Impl::jmp;
+                case 0xc9:
+                case 0xd9:
+                    return &Impl::ret;
+                case 0xcd:
+                case 0xdd:
+                case 0xed:
+                case 0xfd:
+                    return &Impl::call;
+                case 0xd3:
+                    return &Impl::out;
+                case 0xdb:
+                    return &Impl::in;
+                case 0xe3:
+                    return &Impl::xthl;
+                case 0xe9:
+                    return &Impl::pchl;
+                case 0xeb:
+                    return &Impl::xchg;
+                case 0xf3:
+                    return &Impl::di;
+                case 0xf9:
+                    return &Impl::sphl;
+                case 0xfb:
+                    return &Impl::ei;
+            }
+            switch(op & 0x07) {
+                case 0x00:
+                    return &Impl::rcc<flag, isSet>;
+                case 0x01:
+                    return &Impl::pop<stackRp>;
+                case 0x02:
+                    return &Impl::jcc<flag, isSet>;
+                case 0x04:
+                    return &Impl::ccc<flag, isSet>;
+                case 0x05:
+                    return &Impl::push<stackRp>;
+                case 0x06:
+                    return &Impl::aluI<AluOp(dst)>;
+            }
+            return &Impl::rst<op & 0x38>;
+        }
+    }
 
-    using InFunc = void (Impl::*)();
-    static constexpr std::array<InFunc, 256> inFuncs = {
-        // 0x00
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0x10
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0x20
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0x30
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0x40
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0x50
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0x60
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0x70
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0x80
-        &Impl::in80,    &Impl::in81,    &Impl::in82,    &Impl::inNop,
-        &Impl::in84,    &Impl::in85,    &Impl::in86,    &Impl::inNop,
-        &Impl::in88,    &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::in8c,    &Impl::in8d,    &Impl::inNop,   &Impl::inNop,
-        // 0x90
-        &Impl::in90,    &Impl::in91,    &Impl::in92,    &Impl::in93,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0xa0
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0xb0
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0xc0
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0xd0
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0xe0
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        // 0xf0
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop,
-        &Impl::inNop,   &Impl::inNop,   &Impl::inNop,   &Impl::inNop
-    };
+    template <size_t op>
+    static constexpr auto fusingOpFunc() -> OpFunc
+    {
+        if constexpr(isFusedHead(op)) {
+            return &Impl::fuse<op>;
+        } else {
+            return opFunc<op>();
+        }
+    }
 
-    using OutFunc = void (Impl::*)();
-    static constexpr std::array<OutFunc, 256> outFuncs = {
-        // 0x00
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0x10
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0x20
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0x30
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0x40
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0x50
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0x60
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0x70
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0x80
-        &Impl::out80,   &Impl::outNop,  &Impl::out82,   &Impl::outNop,
-        &Impl::out84,   &Impl::out85,   &Impl::out86,   &Impl::outNop,
-        &Impl::out88,   &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0x90
-        &Impl::out90,   &Impl::out91,   &Impl::out92,   &Impl::out93,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0xa0
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0xb0
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0xc0
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0xd0
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0xe0
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        // 0xf0
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-        &Impl::outNop,  &Impl::outNop,  &Impl::outNop,  &Impl::outNop,
-    };
+    template <size_t... ops>
+    static constexpr auto makeOpFuncs(std::index_sequence<ops...>) -> std::array<OpFunc, sizeof...(ops)>
+    {
+        return {fusingOpFunc<ops>()...};
+    }
+
+    static constexpr auto inFunc(uint8_t port) -> PortFunc
+    {
+        switch(port) {
+            case 0x80:
+                return &Impl::in80;
+            case 0x81:
+                return &Impl::in81;
+            case 0x82:
+                return &Impl::in82;
+            case 0x84:
+                return &Impl::in84;
+            case 0x85:
+                return &Impl::in85;
+            case 0x86:
+                return &Impl::in86;
+            case 0x88:
+                return &Impl::in88;
+            case 0x8c:
+                return &Impl::in8c;
+            case 0x8d:
+                return &Impl::in8d;
+            case 0x90:
+                return &Impl::in90;
+            case 0x91:
+                return &Impl::in91;
+            case 0x92:
+                return &Impl::in92;
+            case 0x93:
+                return &Impl::in93;
+        }
+        return &Impl::inNop;
+    }
+
+    static constexpr auto outFunc(uint8_t port) -> PortFunc
+    {
+        switch(port) {
+            case 0x80:
+                return &Impl::out80;
+            case 0x82:
+                return &Impl::out82;
+            case 0x84:
+                return &Impl::out84;
+            case 0x85:
+                return &Impl::out85;
+            case 0x86:
+                return &Impl::out86;
+            case 0x88:
+                return &Impl::out88;
+            case 0x90:
+                return &Impl::out90;
+            case 0x91:
+                return &Impl::out91;
+            case 0x92:
+                return &Impl::out92;
+            case 0x93:
+                return &Impl::out93;
+        }
+        return &Impl::outNop;
+    }
+
+    template <typename Func>
+    static constexpr auto makePortFuncs(Func func) -> std::array<PortFunc, 256>
+    {
+        std::array<PortFunc, 256> funcs = {};
+        for(size_t port = 0; port < funcs.size(); ++port) {
+            funcs[port] = func(uint8_t(port));
+        }
+        return funcs;
+    }
+
+    static const std::array<OpFunc, 256> opFuncs;
+    static const std::array<PortFunc, 256> inFuncs;
+    static const std::array<PortFunc, 256> outFuncs;
 };
 
+constexpr std::array<Cpu::Impl::OpFunc, 256> Cpu::Impl::opFuncs = makeOpFuncs(std::make_index_sequence<256>());
+constexpr std::array<Cpu::Impl::PortFunc, 256> Cpu::Impl::inFuncs = makePortFuncs(&Cpu::Impl::inFunc);
+constexpr std::array<Cpu::Impl::PortFunc, 256> Cpu::Impl::outFuncs = makePortFuncs(&Cpu::Impl::outFunc);
+
 auto Cpu::create(Memory * memory) -> std::unique_ptr<Cpu>
 {
     return std::make_unique<Impl>(memory);
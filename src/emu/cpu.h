@@ -4,6 +4,7 @@
 #include "memory.h"
 #include "bytes.h"
 #include "hooks.h"
+#include <vector>
 
 constexpr size_t clocksPerFrame = 49280; // 308 scanlines with 160 cpu clocks per each
 
@@ -15,6 +16,12 @@ struct CpuFlag {
     static const uint8_t c  = 0x01;
 };
 
+struct TapeBit {
+    static const uint8_t motor = 0x10; // port 82
+    static const uint8_t out   = 0x40; // port 82
+    static const uint8_t in    = 0x80; // port 8d
+};
+
 struct CpuState {
     static const unsigned inte = 1;
     static const unsigned halt = 2;
@@ -95,18 +102,51 @@ using MemHook = Hook<MemAccessType /* accessType */, MemBankType /*bankType*/, u
 using IntHook = Hook<>;
 using OpHook  = Hook<>;
 
+using TapeInHook  = Hook<bool * /*tapeBit*/>;
+using TapeOutHook = Hook<uint8_t /*port82*/>; // fired on motor or out bit change
+
+using InPortHook = Hook<uint8_t /*port*/>; // fired right before controller port 81h, 8ch or 8dh is read
+using IoHook = Hook<MemAccessType /*accessType*/, uint8_t /*port*/>; // fired right before any port is read or written
+
+// Fired before the op at any pc of a range. Addresses are trapped, having
+// ops there interpreted, only while any pc hook is over them, and the whole
+// range is trapped or untrapped at once
+class PcHook final
+{
+public:
+    using HookTrigger = ::HookTrigger<uint16_t /*pc*/>;
+    using HookFunc = OpHook::HookFunc;
+    using ReleaseFunc = MemFunc<void(uint16_t /*firstPc*/, uint16_t /*lastPc*/)>;
+
+    explicit PcHook(HookTrigger * trigger, uint16_t firstPc, uint16_t lastPc,
+                    const HookFunc & hookFunc, const ReleaseFunc & releaseFunc);
+    ~PcHook();
+
+    void setHookFunc(const HookFunc & hookFunc);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Fires once on return with sp at the value it had on activation, or at the
+// value given, e.g. of a call stack frame for step-out. Returns are checked
+// against counts of hooks active for each sp value, so only the matching one
+// fires the trigger
 class RetHook final
 {
 public:
     using HookTrigger = ::HookTrigger<>;
     using HookFunc = MemFunc<void()>;
+    using SpCounts = std::array<uint16_t, 65536>;
 
-    explicit RetHook(CpuRegs * cpuRegs, HookTrigger * trigger, const HookFunc & hookFunc);
+    explicit RetHook(CpuRegs * cpuRegs, SpCounts * spCounts, HookTrigger * trigger, const HookFunc & hookFunc);
     ~RetHook();
 
     void setHookFunc(const HookFunc & hookFunc);
 
     void activate(bool isActive = true);
+    void activateAt(uint16_t sp);
     auto isActive() const -> bool;
 
 private:
@@ -114,6 +154,39 @@ private:
     std::unique_ptr<Impl> impl;
 };
 
+// Shadow stack entry pushed on call, rst or interrupt entry and popped on
+// the matching return
+struct CallFrame final
+{
+    uint16_t callPc;   // of the call or rst op, or the op interrupted
+    uint16_t targetPc;
+    uint16_t sp;       // with return address pushed
+    bool isInterrupt;
+};
+
+constexpr size_t maxCallDepth = 256;
+
+// Watches accesses of one type to an address range. Memory is split into
+// 256-byte pages counting watches over them, and only accesses to watched
+// pages are passed to watch hooks, so the rest goes at full speed
+class WatchHook final
+{
+public:
+    using HookTrigger = MemHook::HookTrigger;
+    using HookFunc = MemHook::HookFunc;
+    using PageCounts = std::array<unsigned, 256>;
+
+    explicit WatchHook(PageCounts * pageCounts, HookTrigger * trigger, MemAccessType accessType,
+                       uint16_t firstAddr, uint16_t lastAddr, const HookFunc & hookFunc);
+    ~WatchHook();
+
+    void setHookFunc(const HookFunc & hookFunc);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl;
+};
+
 class Cpu:
         public ITimelineSubSystem,
         public Logger
@@ -121,15 +194,64 @@ class Cpu:
 public:
     static auto create(Memory * memory) -> std::unique_ptr<Cpu>;
 
+    // Idle loops, which spin with no side effects, are skipped up to the frame
+    // end with exact timing. Op hooks still fire for the ops of the iterations
+    // taken to detect the loop, so hooks needing every op have to turn it off
+    virtual void setIdleSkip(bool isIdleSkip) = 0;
+    virtual auto isIdleSkip() const -> bool = 0;
+
+    // Native code translation, where supported. Ops are interpreted while
+    // any op, ret, memory or watch hook exists or the call stack is kept, while
+    // pc hooks trap their addresses only
+    virtual void setJit(bool isJit) = 0;
+    virtual auto isJit() const -> bool = 0;
+
+    // Hot op sequences run by a single handler, with delay loops skipped by
+    // the same means as idle loops. Ops are interpreted one by one while any
+    // op or memory hook exists, loops are not skipped while any watch hook does
+    virtual void setFusion(bool isFusion) = 0;
+    virtual auto isFusion() const -> bool = 0;
+
+    // Shadow call stack, kept while on. Frames abandoned by code resetting sp
+    // are dropped by the next call or return beyond them. Ops are interpreted
+    // while it's on
+    virtual void setCallStack(bool isCallStack) = 0;
+    virtual auto isCallStack() const -> bool = 0;
+    virtual auto callStack() const -> const std::vector<CallFrame> & = 0;
+
+    // Frame rendering split for running cpus side by side: the interrupt is
+    // taken first, then steps are run up to the frame end. A step is an op,
+    // or ops taken as a whole: a fused op sequence, an op followed by skipped
+    // loop iterations, or native code up to its exit
+    virtual void takeInterrupt() = 0;
+    virtual void runStep() = 0;
+
     virtual auto cpuRegs() -> CpuRegs * = 0;
 
     virtual void memPeek(uint8_t * data, uint16_t addr) = 0;
     virtual void memPoke(uint16_t addr, uint8_t data) = 0;
 
+    // Bank the cpu currently reads the address from
+    virtual auto readBank(uint16_t addr) const -> MemBankType = 0;
+
+    // To be called after memory banks are changed directly
+    virtual void memChanged() = 0;
+
     virtual auto createMemHook(const MemHook::HookFunc & hookFunc) -> std::unique_ptr<MemHook> = 0;
     virtual auto createIntHook(const IntHook::HookFunc & hookFunc) -> std::unique_ptr<IntHook> = 0;
     virtual auto createOpHook (const OpHook::HookFunc  & hookFunc) -> std::unique_ptr<OpHook>  = 0;
+    virtual auto createPcHook (uint16_t pc, const PcHook::HookFunc & hookFunc) -> std::unique_ptr<PcHook> = 0;
+    virtual auto createPcRangeHook(uint16_t firstPc, uint16_t lastPc,
+                                   const PcHook::HookFunc & hookFunc) -> std::unique_ptr<PcHook> = 0;
     virtual auto createRetHook(const RetHook::HookFunc & hookFunc) -> std::unique_ptr<RetHook> = 0;
+    virtual auto createWatchHook(MemAccessType accessType, uint16_t firstAddr, uint16_t lastAddr,
+                                 const WatchHook::HookFunc & hookFunc) -> std::unique_ptr<WatchHook> = 0;
+
+    virtual auto createTapeInHook (const TapeInHook::HookFunc  & hookFunc) -> std::unique_ptr<TapeInHook>  = 0;
+    virtual auto createTapeOutHook(const TapeOutHook::HookFunc & hookFunc) -> std::unique_ptr<TapeOutHook> = 0;
+
+    virtual auto createInPortHook(const InPortHook::HookFunc & hookFunc) -> std::unique_ptr<InPortHook> = 0;
+    virtual auto createIoHook(const IoHook::HookFunc & hookFunc) -> std::unique_ptr<IoHook> = 0;
 
 private:
     class Impl;
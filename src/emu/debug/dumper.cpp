@@ -10,8 +10,9 @@ class Dumper::Impl final:
         public Dumper
 {
 public:
-    explicit Impl(Timeline * timeline, Memory * memory, Cpu * cpu, Keyboard * keyboard):
-        timeline_m(timeline), memBanks_m(memory->memBanks()), ioPorts_m(memory->ioPorts()), cpuRegs_m(cpu->cpuRegs()),
+    explicit Impl(IEnvironment * environment, Timeline * timeline, Memory * memory, Cpu * cpu, Keyboard * keyboard):
+        environment_m(environment), timeline_m(timeline), memBanks_m(memory->memBanks()), ioPorts_m(memory->ioPorts()),
+        cpu_m(cpu), cpuRegs_m(cpu->cpuRegs()),
         retroKeyboardHook_m(keyboard->createRetroKeyboardHook(memFunc(this, &Impl::retroKeyboardHookFunc)))
     {}
 
@@ -29,7 +30,7 @@ public:
 
     virtual void dump() override
     {
-        std::string dumpDir = LibRetro::dumpDir();
+        std::string dumpDir = environment_m->dumpDir();
         if(dumpDir.empty()) {
             msg(LogLevel::error, "Dump directory doesn't specified");
             return;
@@ -133,6 +134,18 @@ public:
                 << "93      = " << std::setw(2) << uint16_t(ioPorts_m->port93)    << " " << std::bitset<8>(ioPorts_m->port93)    << std::endl
                 << std::endl;
 
+        if(cpu_m->isCallStack()) {
+            regDump << "    CALL STACK" << std::endl
+                    << std::endl;
+
+            const std::vector<CallFrame> & callStack = cpu_m->callStack();
+            for(auto frame = callStack.rbegin(); frame != callStack.rend(); ++frame) {
+                regDump << std::setw(4) << frame->targetPc << " from " << std::setw(4) << frame->callPc
+                        << ", sp " << std::setw(4) << frame->sp << (frame->isInterrupt ? ", interrupt" : "") << std::endl;
+            }
+            regDump << std::endl;
+        }
+
         file->open(fileName + ".reg.txt", true);
         file->write(reinterpret_cast<uint8_t *>(regDump.str().data()), regDump.str().length());
     }
@@ -146,7 +159,7 @@ private:
             case RETROK_F6:
                 if(isPressed) {
                     dump();
-                    LibRetro::popupMsg("Dump created");
+                    environment_m->popupMsg("Dump created");
                     *isConsumed = true;
                 }
                 break;
@@ -155,16 +168,18 @@ private:
         }
     }
 
+    IEnvironment * environment_m;
     Timeline * timeline_m;
     MemBanks * memBanks_m;
     IoPorts * ioPorts_m;
+    Cpu * cpu_m;
     CpuRegs * cpuRegs_m;
 
     std::unique_ptr<RetroKeyboardHook> retroKeyboardHook_m;
 };
 
-auto Dumper::create(Timeline * timeline, Memory * memory, Cpu * cpu, Keyboard * keyboard)
+auto Dumper::create(IEnvironment * environment, Timeline * timeline, Memory * memory, Cpu * cpu, Keyboard * keyboard)
                     -> std::unique_ptr<Dumper>
 {
-    return std::make_unique<Impl>(timeline, memory, cpu, keyboard);
+    return std::make_unique<Impl>(environment, timeline, memory, cpu, keyboard);
 }
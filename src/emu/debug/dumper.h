@@ -1,6 +1,7 @@
 #ifndef DUMPER_H
 #define DUMPER_H
 
+#include "environment.h"
 #include "timeline.h"
 #include "memory.h"
 #include "cpu.h"
@@ -11,7 +12,7 @@ class Dumper:
         public Logger
 {
 public:
-    static auto create(Timeline * timeline, Memory * memory, Cpu * cpu, Keyboard * keyboard)
+    static auto create(IEnvironment * environment, Timeline * timeline, Memory * memory, Cpu * cpu, Keyboard * keyboard)
                        -> std::unique_ptr<Dumper>;
 
     virtual void dump() = 0;
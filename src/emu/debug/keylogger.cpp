@@ -9,8 +9,8 @@ class KeyloggerImpl final:
         public Logger
 {
 public:
-    explicit KeyloggerImpl(Timeline * timeline, Keyboard * keyboard, Joysticks * joysticks):
-        timeline_m(timeline),
+    explicit KeyloggerImpl(IEnvironment * environment, Timeline * timeline, Keyboard * keyboard, Joysticks * joysticks):
+        environment_m(environment), timeline_m(timeline),
         retroKeyboardHook_m(keyboard->createRetroKeyboardHook(memFunc(this, &KeyloggerImpl::retroKeyboardHookFunc))),
         targetKeyboardHook_m(keyboard->createTargetKeyboardHook(memFunc(this, &KeyloggerImpl::targetKeyboardHookFunc))),
         retroJoystickHook_m(joysticks->createRetroJoystickHook(memFunc(this, &KeyloggerImpl::retroJoystickHookFunc))),
@@ -24,7 +24,7 @@ public:
 private:
     void start()
     {
-        std::string keylogDir = LibRetro::keylogDir();
+        std::string keylogDir = environment_m->keylogDir();
         if(keylogDir.empty()) {
             msg(LogLevel::error, "Keylog directory doesn't specified");
             deactivateByError();
@@ -88,6 +88,7 @@ private:
                             timeline_m->frameNum(), key.port, int(key.key), (isPressed ? "pressed" : "released")));
     }
 
+    IEnvironment * environment_m;
     Timeline * timeline_m;
 
     std::unique_ptr<RetroKeyboardHook> retroKeyboardHook_m;
@@ -104,8 +105,8 @@ class Keylogger::Impl final:
         public Keylogger
 {
 public:
-    explicit Impl(Timeline * timeline, Keyboard * keyboard, Joysticks * joysticks):
-        timeline_m(timeline), keyboard_m(keyboard), joysticks_m(joysticks),
+    explicit Impl(IEnvironment * environment, Timeline * timeline, Keyboard * keyboard, Joysticks * joysticks):
+        environment_m(environment), timeline_m(timeline), keyboard_m(keyboard), joysticks_m(joysticks),
         retroKeyboardHook_m(keyboard->createRetroKeyboardHook(memFunc(this, &Impl::retroKeyboardHookFunc)))
     {}
 
@@ -134,7 +135,7 @@ public:
             return;
         }
         if(isActive) {
-            keylogger_m = std::make_unique<KeyloggerImpl>(timeline_m, keyboard_m, joysticks_m);
+            keylogger_m = std::make_unique<KeyloggerImpl>(environment_m, timeline_m, keyboard_m, joysticks_m);
             captureLog(keylogger_m.get());
         } else {
             keylogger_m = nullptr;
@@ -156,7 +157,7 @@ private:
             case RETROK_F8:
                 if(isPressed) {
                     activate(!isActive());
-                    LibRetro::popupMsg("Keylog %s", (isActive() ? "ON" : "OFF"));
+                    environment_m->popupMsg("Keylog %s", (isActive() ? "ON" : "OFF"));
                     *isConsumed = true;
                 }
                 break;
@@ -165,6 +166,7 @@ private:
         }
     }
 
+    IEnvironment * environment_m;
     Timeline * timeline_m;
     Keyboard * keyboard_m;
     Joysticks * joysticks_m;
@@ -174,7 +176,8 @@ private:
     std::unique_ptr<KeyloggerImpl> keylogger_m;
 };
 
-auto Keylogger::create(Timeline * timeline, Keyboard * keyboard, Joysticks * joysticks) -> std::unique_ptr<Keylogger>
+auto Keylogger::create(IEnvironment * environment, Timeline * timeline, Keyboard * keyboard, Joysticks * joysticks)
+                       -> std::unique_ptr<Keylogger>
 {
-    return std::make_unique<Impl>(timeline, keyboard, joysticks);
+    return std::make_unique<Impl>(environment, timeline, keyboard, joysticks);
 }
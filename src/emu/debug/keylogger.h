@@ -1,6 +1,7 @@
 #ifndef KEYLOGGER_H
 #define KEYLOGGER_H
 
+#include "environment.h"
 #include "timeline.h"
 #include "keyboard.h"
 #include "joysticks.h"
@@ -10,7 +11,8 @@ class Keylogger:
         public Logger
 {
 public:
-    static auto create(Timeline * timeline, Keyboard * keyboard, Joysticks * joysticks) -> std::unique_ptr<Keylogger>;
+    static auto create(IEnvironment * environment, Timeline * timeline, Keyboard * keyboard, Joysticks * joysticks)
+                       -> std::unique_ptr<Keylogger>;
 
     virtual void activate(bool isActive = true) = 0;
     virtual auto isActive() const -> bool = 0;
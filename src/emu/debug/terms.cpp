@@ -0,0 +1,35 @@
+#include "terms.h"
+#include <cstdlib>
+
+auto parseNumber(const std::string & text, int base, unsigned maxValue, unsigned * value) -> bool
+{
+    if(text.empty()) {
+        return false;
+    }
+    char * end;
+    unsigned long number = strtoul(text.data(), &end, base);
+    if(*end != 0 || number > maxValue) {
+        return false;
+    }
+    *value = unsigned(number);
+    return true;
+}
+
+auto parseRange(const std::string & text, uint16_t * first, uint16_t * last) -> bool
+{
+    size_t pos = text.find('-');
+    unsigned firstValue, lastValue;
+    if(!parseNumber(text.substr(0, pos), 16, 0xffff, &firstValue)) {
+        return false;
+    }
+    lastValue = firstValue;
+    if(pos != std::string::npos && !parseNumber(text.substr(pos + 1), 16, 0xffff, &lastValue)) {
+        return false;
+    }
+    if(lastValue < firstValue) {
+        return false;
+    }
+    *first = uint16_t(firstValue);
+    *last = uint16_t(lastValue);
+    return true;
+}
@@ -0,0 +1,15 @@
+#ifndef TERMS_H
+#define TERMS_H
+
+#include <string>
+#include <cstdint>
+
+// Values of name=value terms read from debug lists, trigger.txt and watch.txt
+
+// Whole text has to be the number, not above the max value
+auto parseNumber(const std::string & text, int base, unsigned maxValue, unsigned * value) -> bool;
+
+// Hex address a or range a-b
+auto parseRange(const std::string & text, uint16_t * first, uint16_t * last) -> bool;
+
+#endif // TERMS_H
@@ -1,57 +1,213 @@
 #include "tracer.h"
+#include "terms.h"
 #include "libretro.h"
 #include "video.h"
 #include "file.h"
 #include "filesys.h"
+#include <fstream>
+#include <sstream>
 
 namespace {
 
+struct TraceTrigger final
+{
+    bool hasPc = false;
+    uint16_t pcFirst = 0;
+    uint16_t pcLast = 0;
+    bool hasBank = false;
+    MemBankType bank = MemBankType::ram;
+    bool hasPort = false;
+    uint8_t port = 0;
+    bool hasWrite = false;
+    uint16_t writeFirst = 0;
+    uint16_t writeLast = 0;
+    unsigned frameCount = 0;
+    unsigned intCount = 0;
+    unsigned traceFrames = 0; // zero for no limit
+};
+
+auto parseBank(const std::string & text, MemBankType * bank) -> bool
+{
+    if(text == "rom") {
+        *bank = MemBankType::rom;
+    } else if(text == "x1") {
+        *bank = MemBankType::x1;
+    } else if(text == "x2") {
+        *bank = MemBankType::x2;
+    } else if(text == "ram") {
+        *bank = MemBankType::ram;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+auto parseTerm(const std::string & term, TraceTrigger * trigger) -> bool
+{
+    size_t pos = term.find('=');
+    if(pos == std::string::npos) {
+        return false;
+    }
+    std::string name = term.substr(0, pos);
+    std::string value = term.substr(pos + 1);
+    unsigned number = 0;
+
+    if(name == "pc") {
+        trigger->hasPc = true;
+        return parseRange(value, &trigger->pcFirst, &trigger->pcLast);
+    } else if(name == "bank") {
+        trigger->hasBank = true;
+        return parseBank(value, &trigger->bank);
+    } else if(name == "port") {
+        trigger->hasPort = true;
+        bool isValid = parseNumber(value, 16, 0xff, &number);
+        trigger->port = uint8_t(number);
+        return isValid;
+    } else if(name == "write") {
+        trigger->hasWrite = true;
+        return parseRange(value, &trigger->writeFirst, &trigger->writeLast);
+    } else if(name == "frame") {
+        return parseNumber(value, 10, ~0u, &trigger->frameCount);
+    } else if(name == "int") {
+        return parseNumber(value, 10, ~0u, &trigger->intCount);
+    } else if(name == "for") {
+        return parseNumber(value, 10, ~0u, &trigger->traceFrames);
+    }
+    return false;
+}
+
+// Trigger conditions are watched by hooks created for them only, latched
+// ones are dropped once met. Tracing itself hooks every op, so with a pc
+// range it's suspended at the frame end once code has left the range, and
+// resumed by pc hooks on the range
+
 class TracerImpl final:
         public Logger
 {
 public:
-    explicit TracerImpl(Timeline * timeline, Cpu * cpu):
-        timeline_m(timeline), cpu_m(cpu), cpuRegs_m(cpu->cpuRegs()),
+    explicit TracerImpl(IEnvironment * environment, Timeline * timeline, Cpu * cpu, const TraceTrigger & trigger):
+        environment_m(environment), timeline_m(timeline), cpu_m(cpu), cpuRegs_m(cpu->cpuRegs()),
+        trigger_m(trigger),
         frameHook_m(timeline->createFrameHook(memFunc(this, &TracerImpl::frameHookFunc))),
         intHook_m(cpu->createIntHook(memFunc(this, &TracerImpl::intHookFunc))),
-        intRetHook_m(cpu->createRetHook(memFunc(this, &TracerImpl::intRetHookFunc))),
-        opHook_m(cpu->createOpHook(memFunc(this, &TracerImpl::opHookFunc))),
-        file_m(FileWriter::create()), colNum_m(0)
+        file_m(FileWriter::create()), colNum_m(0),
+        state_m(State::armed), frameCount_m(0), intCount_m(0), traceFrames_m(0),
+        isPortDone_m(false), isWriteDone_m(false), isPcLeft_m(false),
+        isIdleSkip_m(cpu->isIdleSkip())
     {
         captureLog(file_m.get());
-        start();
+        if(!start()) {
+            return;
+        }
+
+        if(trigger_m.hasPort) {
+            ioHook_m = cpu->createIoHook(memFunc(this, &TracerImpl::ioHookFunc));
+        }
+        if(trigger_m.hasWrite) {
+            writeHook_m = cpu->createWatchHook(MemAccessType::write, trigger_m.writeFirst, trigger_m.writeLast,
+                                             memFunc(this, &TracerImpl::writeHookFunc));
+        }
+        if(trigger_m.hasPc) {
+            pcHook_m = cpu->createPcRangeHook(trigger_m.pcFirst, trigger_m.pcLast,
+                                              memFunc(this, &TracerImpl::pcHookFunc));
+        }
+        update();
     }
 
     ~TracerImpl()
     {
         flushToFile();
+        suspendTracing();
     }
 
 private:
-    void start()
+    enum struct State {
+        armed, tracing, done
+    };
+
+    auto start() -> bool
     {
-        std::string traceDir = LibRetro::traceDir();
+        std::string traceDir = environment_m->traceDir();
         if(traceDir.empty()) {
             msg(LogLevel::error, "Trace directory doesn't specified");
             deactivateByError();
-            return;
+            return false;
         }
 
         FileSys fileSys;
         captureLog(&fileSys);
         if(!fileSys.mkdir(traceDir)) {
             deactivateByError();
-            return;
+            return false;
         }
 
         startNewFile();
+        return file_m->isValid();
+    }
+
+    auto isEventsMet() const -> bool
+    {
+        return ((!trigger_m.hasPort || isPortDone_m) &&
+                (!trigger_m.hasWrite || isWriteDone_m) &&
+                frameCount_m >= trigger_m.frameCount &&
+                intCount_m >= trigger_m.intCount);
+    }
+
+    auto isPcInRange() const -> bool
+    {
+        return (!trigger_m.hasPc || (cpuRegs_m->pc >= trigger_m.pcFirst && cpuRegs_m->pc <= trigger_m.pcLast));
+    }
+
+    auto isBankMatched() const -> bool
+    {
+        return (!trigger_m.hasBank || cpu_m->readBank(cpuRegs_m->pc) == trigger_m.bank);
+    }
+
+    // Starts tracing once events are met, with a pc range it's up to pc hooks
+    void update()
+    {
+        if(state_m == State::armed && !trigger_m.hasPc && isEventsMet()) {
+            startTracing();
+        }
+    }
+
+    void startTracing()
+    {
+        state_m = State::tracing;
+        isPcLeft_m = false;
+        isIdleSkip_m = cpu_m->isIdleSkip();
+        cpu_m->setIdleSkip(false); // every op has to be traced
+        intRetHook_m = cpu_m->createRetHook(memFunc(this, &TracerImpl::intRetHookFunc));
+        opHook_m = cpu_m->createOpHook(memFunc(this, &TracerImpl::opHookFunc));
+    }
+
+    void suspendTracing()
+    {
+        if(state_m != State::tracing) {
+            return;
+        }
+        state_m = State::armed;
+        flushToFile();
+        intRetHook_m = nullptr;
+        opHook_m = nullptr;
+        cpu_m->setIdleSkip(isIdleSkip_m);
+    }
+
+    void finishTracing()
+    {
+        suspendTracing();
+        state_m = State::done;
+        ioHook_m = nullptr;
+        writeHook_m = nullptr;
+        pcHook_m = nullptr;
+        msg(LogLevel::info, "Trace trigger is done");
     }
 
     void startNewFile()
     {
         startNewLine();
 
-        std::string traceDir = LibRetro::traceDir();
+        std::string traceDir = environment_m->traceDir();
         std::string fileName = stringf("%s/trace-%d-%06d.txt", traceDir.data(),
                                        timeline_m->startTime(), timeline_m->frameNum());
         file_m->open(fileName, true);
@@ -92,16 +248,43 @@ private:
 
     void deactivateByError()
     {
+        if(state_m == State::tracing) {
+            cpu_m->setIdleSkip(isIdleSkip_m);
+        }
+        state_m = State::done;
         frameHook_m = nullptr;
         intHook_m = nullptr;
         intRetHook_m = nullptr;
         opHook_m = nullptr;
+        ioHook_m = nullptr;
+        writeHook_m = nullptr;
+        pcHook_m = nullptr;
 
         msg(LogLevel::info, "Tracer is deactivated due to errors");
     }
 
     void frameHookFunc()
     {
+        ++frameCount_m;
+        if(isPortDone_m) {
+            ioHook_m = nullptr;
+        }
+        if(isWriteDone_m) {
+            writeHook_m = nullptr;
+        }
+
+        if(state_m == State::tracing) {
+            if(trigger_m.traceFrames > 0 && ++traceFrames_m >= trigger_m.traceFrames) {
+                finishTracing();
+            } else if(isPcLeft_m) {
+                suspendTracing();
+            }
+        }
+        update();
+        if(state_m != State::tracing) {
+            return;
+        }
+
         unsigned frame = timeline_m->frameNum();
         if(frame / videoFps * videoFps == frame) {
             startNewFile();
@@ -123,6 +306,12 @@ private:
 
     void intHookFunc()
     {
+        ++intCount_m;
+        update();
+        if(state_m != State::tracing) {
+            return;
+        }
+
         startNewLine();
         writeToFile(stringf("-------- interrupt %s\n", std::string(61, '-').data()));
         intRetHook_m->activate();
@@ -135,8 +324,42 @@ private:
         flushToFile();
     }
 
+    void ioHookFunc(MemAccessType accessType, uint8_t port)
+    {
+        if(port == trigger_m.port && !isPortDone_m) {
+            isPortDone_m = true;
+            update();
+        }
+    }
+
+    void writeHookFunc(MemAccessType accessType, MemBankType bankType, uint16_t addr)
+    {
+        if(!isWriteDone_m) {
+            isWriteDone_m = true;
+            update();
+        }
+    }
+
+    // Op hooks have already fired for this op
+    void pcHookFunc()
+    {
+        if(state_m == State::armed && isEventsMet()) {
+            startTracing();
+            opHookFunc();
+        }
+    }
+
     void opHookFunc()
     {
+        if(!isPcInRange()) {
+            isPcLeft_m = true;
+            return;
+        }
+        isPcLeft_m = false;
+        if(!isBankMatched()) {
+            return;
+        }
+
         uint8_t op;
         cpu_m->memPeek(&op, cpuRegs_m->pc);
         line_m += stringf("%04x %02x   ", cpuRegs_m->pc, op);
@@ -145,18 +368,33 @@ private:
         }
     }
 
+    IEnvironment * environment_m;
     Timeline * timeline_m;
     Cpu * cpu_m;
     CpuRegs * cpuRegs_m;
+    TraceTrigger trigger_m;
 
     std::unique_ptr<FrameHook> frameHook_m;
     std::unique_ptr<IntHook> intHook_m;
     std::unique_ptr<RetHook> intRetHook_m;
     std::unique_ptr<OpHook> opHook_m;
+    std::unique_ptr<IoHook> ioHook_m;
+    std::unique_ptr<WatchHook> writeHook_m;
+    std::unique_ptr<PcHook> pcHook_m;
 
     std::unique_ptr<FileWriter> file_m;
     std::string line_m;
     int colNum_m;
+
+    State state_m;
+    unsigned frameCount_m;
+    unsigned intCount_m;
+    unsigned traceFrames_m;
+    bool isPortDone_m;
+    bool isWriteDone_m;
+    bool isPcLeft_m; // at the last op
+
+    bool isIdleSkip_m;
 };
 
 } // namespace
@@ -165,9 +403,10 @@ class Tracer::Impl final:
         public Tracer
 {
 public:
-    explicit Impl(Timeline * timeline, Cpu * cpu, Keyboard * keyboard):
-        timeline_m(timeline), cpu_m(cpu),
-        retroKeyboardHook_m(keyboard->createRetroKeyboardHook(memFunc(this, &Impl::retroKeyboardHookFunc)))
+    explicit Impl(IEnvironment * environment, Timeline * timeline, Cpu * cpu, Keyboard * keyboard):
+        environment_m(environment), timeline_m(timeline), cpu_m(cpu),
+        retroKeyboardHook_m(keyboard->createRetroKeyboardHook(memFunc(this, &Impl::retroKeyboardHookFunc))),
+        isTrigger_m(false)
     {}
 
     virtual void init() override
@@ -195,7 +434,7 @@ public:
             return;
         }
         if(isActive) {
-            tracer_m = std::make_unique<TracerImpl>(timeline_m, cpu_m);
+            tracer_m = std::make_unique<TracerImpl>(environment_m, timeline_m, cpu_m, trigger_m);
             captureLog(tracer_m.get());
         } else {
             tracer_m = nullptr;
@@ -207,7 +446,36 @@ public:
         return (tracer_m.get() != nullptr);
     }
 
+    virtual auto setTrigger(const std::string & text) -> bool override
+    {
+        TraceTrigger trigger;
+        std::istringstream terms(text);
+        std::string term;
+        size_t termCount = 0;
+        while(terms >> term) {
+            if(!parseTerm(term, &trigger)) {
+                msg(LogLevel::error, "Invalid trace trigger term \"%s\"", term.data());
+                return false;
+            }
+            ++termCount;
+        }
+        trigger_m = trigger;
+        isTrigger_m = (termCount > 0);
+        return true;
+    }
+
 private:
+    void loadTrigger()
+    {
+        std::string traceDir = environment_m->traceDir();
+        if(traceDir.empty()) {
+            return;
+        }
+        std::ifstream file(traceDir + "/trigger.txt");
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        setTrigger(text);
+    }
+
     void retroKeyboardHookFunc(RetroKeyboardKey key, bool isPressed, bool * isConsumed)
     {
         if(*isConsumed) {
@@ -216,8 +484,11 @@ private:
         switch(key) {
             case RETROK_F7:
                 if(isPressed) {
+                    if(!isActive()) {
+                        loadTrigger();
+                    }
                     activate(!isActive());
-                    LibRetro::popupMsg("Trace %s", (isActive() ? "ON" : "OFF"));
+                    environment_m->popupMsg("Trace %s", (!isActive() ? "OFF" : isTrigger_m ? "ARMED" : "ON"));
                     *isConsumed = true;
                 }
                 break;
@@ -226,15 +497,20 @@ private:
         }
     }
 
+    IEnvironment * environment_m;
     Timeline * timeline_m;
     Cpu * cpu_m;
 
     std::unique_ptr<RetroKeyboardHook> retroKeyboardHook_m;
 
+    TraceTrigger trigger_m;
+    bool isTrigger_m;
+
     std::unique_ptr<TracerImpl> tracer_m;
 };
 
-auto Tracer::create(Timeline * timeline, Cpu * cpu, Keyboard * keyboard) -> std::unique_ptr<Tracer>
+auto Tracer::create(IEnvironment * environment, Timeline * timeline, Cpu * cpu, Keyboard * keyboard)
+                    -> std::unique_ptr<Tracer>
 {
-    return std::make_unique<Impl>(timeline, cpu, keyboard);
+    return std::make_unique<Impl>(environment, timeline, cpu, keyboard);
 }
@@ -1,6 +1,7 @@
 #ifndef TRACER_H
 #define TRACER_H
 
+#include "environment.h"
 #include "timeline.h"
 #include "cpu.h"
 #include "keyboard.h"
@@ -10,11 +11,25 @@ class Tracer:
         public Logger
 {
 public:
-    static auto create(Timeline * timeline, Cpu * cpu, Keyboard * keyboard) -> std::unique_ptr<Tracer>;
+    static auto create(IEnvironment * environment, Timeline * timeline, Cpu * cpu, Keyboard * keyboard) -> std::unique_ptr<Tracer>;
 
     virtual void activate(bool isActive = true) = 0;
     virtual auto isActive() const -> bool = 0;
 
+    // Trigger arming the tracer instead of tracing right away, made of terms
+    // all having to hold for ops to be traced:
+    //   pc=a[-b]     code run in address range
+    //   bank=name    code run from rom, x1, x2 or ram
+    //   port=p       after port is read or written
+    //   write=a[-b]  after memory in address range is written
+    //   frame=n      after n frames
+    //   int=n        after n-th interrupt
+    //   for=n        tracing stops n frames after it started
+    // Numbers are hex except frame, int and for counts. Empty trigger traces
+    // all. Takes effect on next activation. On F7, the trigger is read from
+    // trigger.txt in trace directory, if any
+    virtual auto setTrigger(const std::string & text) -> bool = 0;
+
 private:
     class Impl;
     explicit Tracer() = default;
@@ -0,0 +1,162 @@
+#include "validator.h"
+#include "stringf.h"
+#include <vector>
+
+class Validator::Impl final:
+        public Validator
+{
+public:
+    explicit Impl(Machine * machine, Machine * refMachine):
+        machine_m(machine), refMachine_m(refMachine),
+        cpu_m(machine->cpu()), refCpu_m(refMachine->cpu()),
+        cpuRegs_m(cpu_m->cpuRegs()), refCpuRegs_m(refCpu_m->cpuRegs()),
+        memBanks_m(machine->memory()->memBanks()), refMemBanks_m(refMachine->memory()->memBanks()),
+        ioPorts_m(machine->memory()->ioPorts()), refIoPorts_m(refMachine->memory()->ioPorts()),
+        refMemHook_m(refCpu_m->createMemHook(memFunc(this, &Impl::refMemHookFunc))),
+        opCount_m(0), stepCount_m(0)
+    {
+        refCpu_m->setIdleSkip(false);
+        refCpu_m->setJit(false);
+        refCpu_m->setFusion(false);
+    }
+
+    // Same as machine frame rendering, with cpus run step by step
+    virtual auto runFrame() -> bool override
+    {
+        machine_m->startFrame();
+        refMachine_m->startFrame();
+        machine_m->timeline()->renderFrame();
+        refMachine_m->timeline()->renderFrame();
+
+        cpu_m->takeInterrupt();
+        refCpu_m->takeInterrupt();
+        if(!isSame()) {
+            return false;
+        }
+
+        while(cpuRegs_m->clock < clocksPerFrame) {
+            cpu_m->runStep();
+            while(refCpuRegs_m->clock < cpuRegs_m->clock) {
+                refCpu_m->runStep();
+                ++opCount_m;
+            }
+            ++stepCount_m;
+            if(!isSame()) {
+                return false;
+            }
+        }
+
+        for(size_t addr = 0; addr < memBanks_m->ram.size(); ++addr) {
+            if(memBanks_m->ram[addr] != refMemBanks_m->ram[addr]) {
+                diverge(stringf("ram at %04x is %02x, %02x expected", unsigned(addr),
+                                memBanks_m->ram[addr], refMemBanks_m->ram[addr]));
+                return false;
+            }
+        }
+
+        machine_m->video()->renderFrame();
+        refMachine_m->video()->renderFrame();
+        machine_m->endFrame();
+        refMachine_m->endFrame();
+        return true;
+    }
+
+    virtual auto opCount() const -> uint64_t override
+    {
+        return opCount_m;
+    }
+
+    virtual auto stepCount() const -> uint64_t override
+    {
+        return stepCount_m;
+    }
+
+private:
+    void refMemHookFunc(MemAccessType memAccessType, MemBankType memBankType, uint16_t addr)
+    {
+        if(memAccessType == MemAccessType::write) {
+            refWrites_m.push_back(addr);
+        }
+    }
+
+    auto isSame() -> bool
+    {
+        if(!isSameValue("state", cpuRegs_m->state, refCpuRegs_m->state) ||
+           !isSameValue("clock", cpuRegs_m->clock, refCpuRegs_m->clock) ||
+           !isSameValue("a",  cpuRegs_m->a,  refCpuRegs_m->a)  ||
+           !isSameValue("f",  cpuRegs_m->f,  refCpuRegs_m->f)  ||
+           !isSameValue("bc", cpuRegs_m->bc, refCpuRegs_m->bc) ||
+           !isSameValue("de", cpuRegs_m->de, refCpuRegs_m->de) ||
+           !isSameValue("hl", cpuRegs_m->hl, refCpuRegs_m->hl) ||
+           !isSameValue("sp", cpuRegs_m->sp, refCpuRegs_m->sp) ||
+           !isSameValue("pc", cpuRegs_m->pc, refCpuRegs_m->pc))
+        {
+            return false;
+        }
+
+        const uint8_t * ports = reinterpret_cast<const uint8_t *>(ioPorts_m);
+        const uint8_t * refPorts = reinterpret_cast<const uint8_t *>(refIoPorts_m);
+        for(size_t i = 0; i < sizeof(IoPorts); ++i) {
+            if(ports[i] != refPorts[i]) {
+                diverge(stringf("io ports byte %u is %02x, %02x expected", unsigned(i), ports[i], refPorts[i]));
+                return false;
+            }
+        }
+
+        for(uint16_t addr: refWrites_m) {
+            if(memBanks_m->ram[addr] != refMemBanks_m->ram[addr]) {
+                diverge(stringf("ram written at %04x is %02x, %02x expected", addr,
+                                memBanks_m->ram[addr], refMemBanks_m->ram[addr]));
+                return false;
+            }
+        }
+        refWrites_m.clear();
+
+        return true;
+    }
+
+    auto isSameValue(const char * name, unsigned value, unsigned refValue) -> bool
+    {
+        if(value == refValue) {
+            return true;
+        }
+        diverge(stringf("%s is %x, %x expected", name, value, refValue));
+        return false;
+    }
+
+    void diverge(const std::string & text)
+    {
+        msg(LogLevel::error, "Divergence at frame %u, clock %u, pc %04x after %llu ops: %s",
+            machine_m->timeline()->frameNum(), refCpuRegs_m->clock, refCpuRegs_m->pc,
+            static_cast<unsigned long long>(opCount_m), text.data());
+
+        if(!machine_m->environment()->dumpDir().empty()) {
+            machine_m->dumper()->dump();
+        }
+        if(!refMachine_m->environment()->dumpDir().empty()) {
+            refMachine_m->dumper()->dump();
+        }
+    }
+
+    Machine * machine_m;
+    Machine * refMachine_m;
+    Cpu * cpu_m;
+    Cpu * refCpu_m;
+    CpuRegs * cpuRegs_m;
+    CpuRegs * refCpuRegs_m;
+    MemBanks * memBanks_m;
+    MemBanks * refMemBanks_m;
+    IoPorts * ioPorts_m;
+    IoPorts * refIoPorts_m;
+
+    std::unique_ptr<MemHook> refMemHook_m;
+    std::vector<uint16_t> refWrites_m; // since the last step compared
+
+    uint64_t opCount_m;
+    uint64_t stepCount_m;
+};
+
+auto Validator::create(Machine * machine, Machine * refMachine) -> std::unique_ptr<Validator>
+{
+    return std::make_unique<Impl>(machine, refMachine);
+}
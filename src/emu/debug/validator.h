@@ -0,0 +1,30 @@
+#ifndef VALIDATOR_H
+#define VALIDATOR_H
+
+#include "machine.h"
+
+// Runs a machine in lockstep with a reference one, set up the same way, but
+// interpreting ops one by one with no fusion, native code or idle skip. Both
+// have memory and ports of their own. After every step the machine cpu
+// takes, the reference catches up op by op, and registers, clock, ports and
+// memory written by the reference are compared, the whole ram once a frame.
+// The first divergence is reported and dumped for both machines
+
+class Validator:
+        public Logger
+{
+public:
+    static auto create(Machine * machine, Machine * refMachine) -> std::unique_ptr<Validator>;
+
+    // Returns false on divergence
+    virtual auto runFrame() -> bool = 0;
+
+    virtual auto opCount() const -> uint64_t = 0;   // ops run by the reference
+    virtual auto stepCount() const -> uint64_t = 0; // steps compared
+
+private:
+    class Impl;
+    explicit Validator() = default;
+};
+
+#endif // VALIDATOR_H
@@ -0,0 +1,167 @@
+#include "watcher.h"
+#include "terms.h"
+#include "libretro.h"
+#include <fstream>
+#include <vector>
+
+class Watcher::Impl final:
+        public Watcher
+{
+public:
+    explicit Impl(IEnvironment * environment, Timeline * timeline, Cpu * cpu, Dumper * dumper, Keyboard * keyboard):
+        environment_m(environment), cpu_m(cpu), cpuRegs_m(cpu->cpuRegs()), dumper_m(dumper),
+        frameHook_m(timeline->createFrameHook(memFunc(this, &Impl::frameHookFunc))),
+        retroKeyboardHook_m(keyboard->createRetroKeyboardHook(memFunc(this, &Impl::retroKeyboardHookFunc))),
+        isDumpOnHit_m(true), isHit_m(false), isCallStack_m(false)
+    {}
+
+    virtual void init() override
+    {
+        close();
+        reset();
+    }
+
+    virtual void reset() override
+    {
+    }
+
+    virtual void close() override
+    {
+        clear();
+    }
+
+    virtual void watch(MemAccessType accessType, uint16_t firstAddr, uint16_t lastAddr) override
+    {
+        // For hits to be dumped with the call stack
+        if(watchHooks_m.empty()) {
+            isCallStack_m = cpu_m->isCallStack();
+            if(!isCallStack_m) {
+                cpu_m->setCallStack(true);
+            }
+        }
+        watchHooks_m.push_back(cpu_m->createWatchHook(accessType, firstAddr, lastAddr,
+                                                      memFunc(this, &Impl::watchHookFunc)));
+        isHit_m = false;
+    }
+
+    virtual void clear() override
+    {
+        if(!watchHooks_m.empty() && !isCallStack_m) {
+            cpu_m->setCallStack(false);
+        }
+        watchHooks_m.clear();
+        isHit_m = false;
+    }
+
+    virtual auto isWatching() const -> bool override
+    {
+        return !watchHooks_m.empty();
+    }
+
+    virtual void setDumpOnHit(bool isDumpOnHit) override
+    {
+        isDumpOnHit_m = isDumpOnHit;
+    }
+
+    virtual auto createHitHook(const WatchHitHook::HookFunc & hookFunc) -> std::unique_ptr<WatchHitHook> override
+    {
+        return std::make_unique<WatchHitHook>(&hitHookTrigger_m, hookFunc);
+    }
+
+private:
+    // Watch hooks can't be dropped while they fire, so that waits for the frame end
+    void watchHookFunc(MemAccessType accessType, MemBankType bankType, uint16_t addr)
+    {
+        if(isHit_m) {
+            return;
+        }
+        isHit_m = true;
+
+        msg(LogLevel::info, "Watch hit: %s %04x at pc %04x",
+            (accessType == MemAccessType::read ? "read" : "write"), addr, cpuRegs_m->pc);
+        if(isDumpOnHit_m) {
+            dumper_m->dump();
+        }
+        hitHookTrigger_m.fire(accessType, addr);
+        environment_m->popupMsg("Watch hit at %04x", addr);
+    }
+
+    void frameHookFunc()
+    {
+        if(isHit_m) {
+            clear();
+        }
+    }
+
+    auto load() -> bool
+    {
+        std::string dumpDir = environment_m->dumpDir();
+        if(dumpDir.empty()) {
+            msg(LogLevel::error, "Dump directory doesn't specified");
+            return false;
+        }
+        std::ifstream file(dumpDir + "/watch.txt");
+        if(!file) {
+            msg(LogLevel::error, "Could not open watch list \"%s/watch.txt\"", dumpDir.data());
+            return false;
+        }
+
+        std::string term;
+        while(file >> term) {
+            size_t pos = term.find('=');
+            std::string type = term.substr(0, pos);
+            uint16_t firstAddr, lastAddr;
+            if(pos == std::string::npos || (type != "read" && type != "write") ||
+               !parseRange(term.substr(pos + 1), &firstAddr, &lastAddr))
+            {
+                msg(LogLevel::error, "Invalid watch \"%s\"", term.data());
+                clear();
+                return false;
+            }
+            watch((type == "read" ? MemAccessType::read : MemAccessType::write), firstAddr, lastAddr);
+        }
+        return isWatching();
+    }
+
+    void retroKeyboardHookFunc(RetroKeyboardKey key, bool isPressed, bool * isConsumed)
+    {
+        if(*isConsumed) {
+            return;
+        }
+        switch(key) {
+            case RETROK_F9:
+                if(isPressed) {
+                    if(isWatching()) {
+                        clear();
+                    } else {
+                        load();
+                    }
+                    environment_m->popupMsg("Watch %s", (isWatching() ? "ON" : "OFF"));
+                    *isConsumed = true;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    IEnvironment * environment_m;
+    Cpu * cpu_m;
+    CpuRegs * cpuRegs_m;
+    Dumper * dumper_m;
+
+    std::unique_ptr<FrameHook> frameHook_m;
+    std::unique_ptr<RetroKeyboardHook> retroKeyboardHook_m;
+    std::vector<std::unique_ptr<WatchHook>> watchHooks_m;
+    WatchHitHook::HookTrigger hitHookTrigger_m;
+
+    bool isDumpOnHit_m;
+    bool isHit_m;
+    bool isCallStack_m; // as set before watching
+};
+
+auto Watcher::create(IEnvironment * environment, Timeline * timeline, Cpu * cpu, Dumper * dumper, Keyboard * keyboard)
+                     -> std::unique_ptr<Watcher>
+{
+    return std::make_unique<Impl>(environment, timeline, cpu, dumper, keyboard);
+}
@@ -0,0 +1,39 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include "environment.h"
+#include "timeline.h"
+#include "cpu.h"
+#include "keyboard.h"
+#include "dumper.h"
+
+using WatchHitHook = Hook<MemAccessType /*accessType*/, uint16_t /*addr*/>;
+
+// Memory watchpoints over cpu watch hooks. Watches are one-shot: the first
+// hit dumps the machine, if enabled, and fires hit hooks, for a frontend to
+// pause on, and all watches are cleared at the frame end. On F9, watches are
+// read from watch.txt in dump directory as terms read=a[-b] and write=a[-b]
+// with hex addresses. The cpu call stack is kept while watching
+
+class Watcher:
+        public ISubSystem,
+        public Logger
+{
+public:
+    static auto create(IEnvironment * environment, Timeline * timeline, Cpu * cpu, Dumper * dumper, Keyboard * keyboard)
+                       -> std::unique_ptr<Watcher>;
+
+    virtual void watch(MemAccessType accessType, uint16_t firstAddr, uint16_t lastAddr) = 0;
+    virtual void clear() = 0;
+    virtual auto isWatching() const -> bool = 0;
+
+    virtual void setDumpOnHit(bool isDumpOnHit) = 0;
+
+    virtual auto createHitHook(const WatchHitHook::HookFunc & hookFunc) -> std::unique_ptr<WatchHitHook> = 0;
+
+private:
+    class Impl;
+    explicit Watcher() = default;
+};
+
+#endif // WATCHER_H
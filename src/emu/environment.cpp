@@ -0,0 +1,34 @@
+#include "environment.h"
+
+HeadlessEnvironment::HeadlessEnvironment(const std::string & baseDir):
+    baseDir_m(baseDir)
+{}
+
+auto HeadlessEnvironment::systemDir() -> std::string
+{
+    return baseDir_m;
+}
+
+auto HeadlessEnvironment::saveDir() -> std::string
+{
+    return (!baseDir_m.empty() ? baseDir_m + "/save" : std::string());
+}
+
+auto HeadlessEnvironment::dumpDir() -> std::string
+{
+    return (!baseDir_m.empty() ? baseDir_m + "/dump" : std::string());
+}
+
+auto HeadlessEnvironment::traceDir() -> std::string
+{
+    return (!baseDir_m.empty() ? baseDir_m + "/trace" : std::string());
+}
+
+auto HeadlessEnvironment::keylogDir() -> std::string
+{
+    return (!baseDir_m.empty() ? baseDir_m + "/keylog" : std::string());
+}
+
+void HeadlessEnvironment::popupMsg(const std::string & text)
+{
+}
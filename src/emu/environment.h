@@ -0,0 +1,52 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include "interface.h"
+#include "stringf.h"
+
+// Host environment the machine runs within. Each machine instance gets its
+// own environment pointer, so several machines may coexist in one process.
+// Implementations shared between threads must be thread-safe.
+
+class IEnvironment:
+        public Interface
+{
+public:
+    virtual auto systemDir() -> std::string = 0;
+    virtual auto saveDir() -> std::string = 0;
+    virtual auto dumpDir() -> std::string = 0;
+    virtual auto traceDir() -> std::string = 0;
+    virtual auto keylogDir() -> std::string = 0;
+
+    virtual void popupMsg(const std::string & text) = 0;
+
+    template <typename... Args>
+    void popupMsg(const std::string & text, Args&&... args)
+    {
+        popupMsg(stringf(text.data(), std::forward<Args>(args)...));
+    }
+};
+
+// Environment for headless runs: directories are derived from the given base
+// directory (none if empty), popup messages are discarded
+
+class HeadlessEnvironment final:
+        public IEnvironment
+{
+public:
+    explicit HeadlessEnvironment(const std::string & baseDir = std::string());
+
+    virtual auto systemDir() -> std::string override;
+    virtual auto saveDir() -> std::string override;
+    virtual auto dumpDir() -> std::string override;
+    virtual auto traceDir() -> std::string override;
+    virtual auto keylogDir() -> std::string override;
+
+    using IEnvironment::popupMsg;
+    virtual void popupMsg(const std::string & text) override;
+
+private:
+    std::string baseDir_m;
+};
+
+#endif // ENVIRONMENT_H
@@ -0,0 +1,1608 @@
+#include "jit.h"
+
+#if defined(JIT_SUPPORTED)
+
+#include <sys/mman.h>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <bitset>
+#include <vector>
+#include <initializer_list>
+
+namespace {
+
+constexpr size_t arenaSize    = 4 << 20;
+constexpr size_t maxBlockCode = 16 << 10; // native code of a single block, with a margin
+constexpr size_t maxBlockOps  = 32;
+constexpr size_t bankCount    = 4;
+constexpr size_t bankSize     = 65536;
+constexpr unsigned maxRamWait = 3;
+
+enum ExitReason: uint32_t {
+    exitBranch,    // target is not translated yet
+    exitInterpret, // op at pc has to be interpreted
+    exitLoop       // short backward branch taken
+};
+
+// State shared with native code, which addresses it relative to a pinned
+// register. Blocks are referred by offsets from the arena base, zero means
+// no block
+
+struct Context final
+{
+    CpuRegs * cpuRegs;
+    uint8_t * code;
+    uint8_t * ram;
+    uint32_t clockLimit;
+    uint32_t loopBytes;
+    std::array<uint8_t *, 4> readBankMap;
+    std::array<uint8_t, 4> regionBanks;
+    std::array<uint8_t, 256> flags;
+    std::array<uint16_t, 1024> daa; // a and f after daa, indexed by a, carry and aux carry
+    std::array<uint8_t, jitWaitCount> ramWaits;
+    std::array<uint8_t, bankSize> codeMap;
+    std::array<uint32_t, bankCount * bankSize> entries;
+};
+
+constexpr int32_t ctxOffset(size_t offset)
+{
+    return int32_t(offset);
+}
+
+//-- x86-64 code emitter --//
+
+enum Reg: uint8_t {
+    rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+    r8,  r9,  r10, r11, r12, r13, r14, r15,
+    noReg = 0xff
+};
+
+enum AluOp: uint8_t {
+    aluAdd = 0,
+    aluOr  = 1,
+    aluAnd = 4,
+    aluSub = 5,
+    aluXor = 6,
+    aluCmp = 7
+};
+
+enum Cond: uint8_t {
+    condB  = 0x2,
+    condAe = 0x3,
+    condE  = 0x4,
+    condNe = 0x5
+};
+
+struct Mem final
+{
+    Reg base;
+    Reg index;
+    uint8_t scale;
+    int32_t disp;
+};
+
+auto mem(Reg base, int32_t disp) -> Mem
+{
+    return {base, noReg, 1, disp};
+}
+
+auto mem(Reg base, Reg index, int32_t disp, uint8_t scale = 1) -> Mem
+{
+    return {base, index, scale, disp};
+}
+
+// Only the forms needed for translation are supported, memory operands are
+// always encoded with 32-bit displacement
+
+class Emitter final
+{
+public:
+    explicit Emitter(uint8_t * code, size_t pos):
+        code_m(code), pos_m(pos)
+    {}
+
+    auto pos() const -> size_t
+    {
+        return pos_m;
+    }
+
+    void bytes(std::initializer_list<uint8_t> data)
+    {
+        for(uint8_t b: data) {
+            byte(b);
+        }
+    }
+
+    void movRR(Reg dst, Reg src)
+    {
+        rex(false, src, noReg, dst);
+        byte(0x89);
+        modrm(src, dst);
+    }
+
+    void movRI(Reg dst, uint32_t imm)
+    {
+        rex(false, rax, noReg, dst);
+        byte(0xb8 + (dst & 7));
+        dword(imm);
+    }
+
+    void movRM(Reg dst, const Mem & m)
+    {
+        rex(false, dst, m.index, m.base);
+        byte(0x8b);
+        modrm(dst, m);
+    }
+
+    void movRM64(Reg dst, const Mem & m)
+    {
+        rex(true, dst, m.index, m.base);
+        byte(0x8b);
+        modrm(dst, m);
+    }
+
+    void movMR(const Mem & m, Reg src)
+    {
+        rex(false, src, m.index, m.base);
+        byte(0x89);
+        modrm(src, m);
+    }
+
+    void movMR16(const Mem & m, Reg src)
+    {
+        byte(0x66);
+        movMR(m, src);
+    }
+
+    void movMR8(const Mem & m, Reg src)
+    {
+        rex(false, src, m.index, m.base, src >= rsp && src <= rdi);
+        byte(0x88);
+        modrm(src, m);
+    }
+
+    void movzxRR8(Reg dst, Reg src)
+    {
+        rex(false, dst, noReg, src, src >= rsp && src <= rdi);
+        bytes({0x0f, 0xb6});
+        modrm(dst, src);
+    }
+
+    void movzxRR16(Reg dst, Reg src)
+    {
+        rex(false, dst, noReg, src);
+        bytes({0x0f, 0xb7});
+        modrm(dst, src);
+    }
+
+    void movzxRM8(Reg dst, const Mem & m)
+    {
+        rex(false, dst, m.index, m.base);
+        bytes({0x0f, 0xb6});
+        modrm(dst, m);
+    }
+
+    void movzxRM16(Reg dst, const Mem & m)
+    {
+        rex(false, dst, m.index, m.base);
+        bytes({0x0f, 0xb7});
+        modrm(dst, m);
+    }
+
+    void leaRM(Reg dst, const Mem & m)
+    {
+        rex(false, dst, m.index, m.base);
+        byte(0x8d);
+        modrm(dst, m);
+    }
+
+    void aluRR(AluOp op, Reg dst, Reg src)
+    {
+        rex(false, src, noReg, dst);
+        byte(uint8_t(op * 8 + 1));
+        modrm(src, dst);
+    }
+
+    void aluRI(AluOp op, Reg dst, int32_t imm, bool isWide = false)
+    {
+        rex(isWide, rax, noReg, dst);
+        if(imm >= -128 && imm < 128) {
+            byte(0x83);
+            modrm(Reg(op), dst);
+            byte(uint8_t(imm));
+        } else {
+            byte(0x81);
+            modrm(Reg(op), dst);
+            dword(uint32_t(imm));
+        }
+    }
+
+    void aluRM(AluOp op, Reg reg, const Mem & m)
+    {
+        rex(false, reg, m.index, m.base);
+        byte(uint8_t(op * 8 + 3));
+        modrm(reg, m);
+    }
+
+    void aluRM64(AluOp op, Reg reg, const Mem & m)
+    {
+        rex(true, reg, m.index, m.base);
+        byte(uint8_t(op * 8 + 3));
+        modrm(reg, m);
+    }
+
+    void aluMI(AluOp op, const Mem & m, int32_t imm)
+    {
+        rex(false, rax, m.index, m.base);
+        byte(0x81);
+        modrm(Reg(op), m);
+        dword(uint32_t(imm));
+    }
+
+    void cmpMI8(const Mem & m, uint8_t imm)
+    {
+        rex(false, rax, m.index, m.base);
+        byte(0x80);
+        modrm(Reg(7), m);
+        byte(imm);
+    }
+
+    void testRI(Reg reg, uint32_t imm)
+    {
+        rex(false, rax, noReg, reg);
+        byte(0xf7);
+        modrm(Reg(0), reg);
+        dword(imm);
+    }
+
+    void shlRI(Reg reg, uint8_t count)
+    {
+        rex(false, rax, noReg, reg);
+        byte(0xc1);
+        modrm(Reg(4), reg);
+        byte(count);
+    }
+
+    void shrRI(Reg reg, uint8_t count)
+    {
+        rex(false, rax, noReg, reg);
+        byte(0xc1);
+        modrm(Reg(5), reg);
+        byte(count);
+    }
+
+    void push(Reg reg)
+    {
+        rex(false, rax, noReg, reg);
+        byte(0x50 + (reg & 7));
+    }
+
+    void pop(Reg reg)
+    {
+        rex(false, rax, noReg, reg);
+        byte(0x58 + (reg & 7));
+    }
+
+    void ret()
+    {
+        byte(0xc3);
+    }
+
+    void jmpR(Reg reg)
+    {
+        rex(false, rax, noReg, reg);
+        byte(0xff);
+        modrm(Reg(4), reg);
+    }
+
+    // Forward jumps return the position to be bound later
+    auto jcc(Cond cond) -> size_t
+    {
+        bytes({0x0f, uint8_t(0x80 + cond)});
+        dword(0);
+        return pos_m - 4;
+    }
+
+    auto jmp() -> size_t
+    {
+        byte(0xe9);
+        dword(0);
+        return pos_m - 4;
+    }
+
+    void jcc(Cond cond, size_t target)
+    {
+        bind(jcc(cond), target);
+    }
+
+    void jmp(size_t target)
+    {
+        bind(jmp(), target);
+    }
+
+    void bind(size_t jumpPos)
+    {
+        bind(jumpPos, pos_m);
+    }
+
+    void bind(size_t jumpPos, size_t target)
+    {
+        int32_t rel = int32_t(int64_t(target) - int64_t(jumpPos + 4));
+        memcpy(code_m + jumpPos, &rel, sizeof(rel));
+    }
+
+private:
+    void byte(uint8_t data)
+    {
+        code_m[pos_m++] = data;
+    }
+
+    void dword(uint32_t data)
+    {
+        memcpy(code_m + pos_m, &data, sizeof(data));
+        pos_m += sizeof(data);
+    }
+
+    void rex(bool isWide, Reg reg, Reg index, Reg base, bool isForced = false)
+    {
+        uint8_t prefix = 0x40;
+        if(isWide) {
+            prefix |= 0x08;
+        }
+        if(reg & 8) {
+            prefix |= 0x04;
+        }
+        if(index != noReg && (index & 8)) {
+            prefix |= 0x02;
+        }
+        if(base != noReg && (base & 8)) {
+            prefix |= 0x01;
+        }
+        if(prefix != 0x40 || isForced) {
+            byte(prefix);
+        }
+    }
+
+    void modrm(Reg reg, Reg rm)
+    {
+        byte(uint8_t(0xc0 | ((reg & 7) << 3) | (rm & 7)));
+    }
+
+    void modrm(Reg reg, const Mem & m)
+    {
+        if(m.index == noReg && (m.base & 7) != rsp) {
+            byte(uint8_t(0x80 | ((reg & 7) << 3) | (m.base & 7)));
+        } else {
+            uint8_t scaleBits = (m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0);
+            uint8_t index = (m.index == noReg ? rsp : m.index & 7);
+            byte(uint8_t(0x84 | ((reg & 7) << 3)));
+            byte(uint8_t((scaleBits << 6) | (index << 3) | (m.base & 7)));
+        }
+        dword(uint32_t(m.disp));
+    }
+
+    uint8_t * code_m;
+    size_t pos_m;
+};
+
+//-- Register assignment --//
+
+// Register pairs are kept zero extended, so they may index memory right away.
+// Byte registers of the pairs map to x86 high and low byte registers, which
+// are reached through al only
+
+constexpr Reg regCtx   = r15;
+constexpr Reg regClock = r12;
+constexpr Reg regA     = r13;
+constexpr Reg regF     = r14;
+constexpr Reg regBC    = rbx;
+constexpr Reg regDE    = rdx;
+constexpr Reg regHL    = rcx;
+constexpr Reg regSP    = rbp;
+
+// i8080 register codes as in op bits
+enum OpReg: unsigned {
+    opRegB, opRegC, opRegD, opRegE, opRegH, opRegL, opRegM, opRegA
+};
+
+// movzx eax, r8 and mov r8, al for b, c, d, e, h, l
+constexpr std::array<uint8_t, 6> byteRegCodes = {
+    0x07, // bh
+    0x03, // bl
+    0x06, // dh
+    0x02, // dl
+    0x05, // ch
+    0x01  // cl
+};
+
+constexpr std::array<Reg, 4> pairRegs = {
+    regBC, regDE, regHL, regSP
+};
+
+auto opSize(uint8_t op) -> unsigned
+{
+    if((op & 0xc7) == 0x06 || (op & 0xc7) == 0xc6 || op == 0xd3 || op == 0xdb) {
+        return 2;
+    }
+    if((op & 0xcf) == 0x01 || op == 0x22 || op == 0x2a || op == 0x32 || op == 0x3a ||
+       (op & 0xc7) == 0xc2 || op == 0xc3 || op == 0xcb || (op & 0xc7) == 0xc4 || (op & 0xcf) == 0xcd)
+    {
+        return 3;
+    }
+    return 1;
+}
+
+// Ops touching ports or waiting for interrupt
+auto isInterpretedOp(uint8_t op) -> bool
+{
+    return (op == 0x76 || op == 0xd3 || op == 0xdb);
+}
+
+auto conditionMask(uint8_t op) -> uint8_t
+{
+    static constexpr std::array<uint8_t, 4> masks = {
+        CpuFlag::z, CpuFlag::c, CpuFlag::p, CpuFlag::s
+    };
+    return masks[(op >> 4) & 3];
+}
+
+auto isConditionSet(uint8_t op) -> bool
+{
+    return (op & 0x08);
+}
+
+} // namespace
+
+class Jit::Impl final:
+        public Jit
+{
+public:
+    explicit Impl(CpuRegs * cpuRegs, MemBanks * memBanks, uint8_t * arena):
+        cpuRegs_m(cpuRegs), memBanks_m(memBanks), arena_m(arena),
+        context_m(std::make_unique<Context>()), loopBytes_m(0)
+    {
+        context_m->cpuRegs = cpuRegs;
+        context_m->code = arena;
+        context_m->ram = memBanks->ram.data();
+        context_m->clockLimit = 0;
+        context_m->loopBytes = 0;
+        context_m->readBankMap.fill(memBanks->ram.data());
+        context_m->regionBanks.fill(uint8_t(MemBankType::ram));
+        context_m->ramWaits.fill(0);
+
+        initTables();
+        initRoutines();
+        flush();
+    }
+
+    ~Impl()
+    {
+        munmap(arena_m, arenaSize);
+    }
+
+    virtual void setReadBanks(const std::array<MemBankType, 4> & bankTypes) override
+    {
+        for(size_t i = 0; i < bankTypes.size(); ++i) {
+            context_m->readBankMap[i] = bankData(size_t(bankTypes[i]));
+            context_m->regionBanks[i] = uint8_t(bankTypes[i]);
+        }
+    }
+
+    virtual void setRamWaits(const MemFunc<unsigned(unsigned)> & ramWait) override
+    {
+        for(size_t clock = 0; clock < jitWaitCount; ++clock) {
+            context_m->ramWaits[clock] = uint8_t(ramWait(unsigned(clock)));
+        }
+    }
+
+    virtual void setLoopExit(unsigned maxLoopBytes) override
+    {
+        if(maxLoopBytes != loopBytes_m) {
+            loopBytes_m = maxLoopBytes;
+            context_m->loopBytes = maxLoopBytes;
+            flush(); // loop exits are compiled in
+        }
+    }
+
+    virtual void addTraps(uint16_t firstAddr, uint16_t lastAddr) override
+    {
+        setTraps(firstAddr, lastAddr, true);
+    }
+
+    virtual void removeTraps(uint16_t firstAddr, uint16_t lastAddr) override
+    {
+        setTraps(firstAddr, lastAddr, false);
+    }
+
+    virtual auto codeMap() const -> const uint8_t * override
+    {
+        return context_m->codeMap.data();
+    }
+
+    virtual void invalidate(uint16_t addr) override
+    {
+        size_t firstPage = addr >> 8;
+        size_t lastPage = firstPage;
+        for(uint32_t blockNum: pageBlocks_m[addr >> 8]) {
+            Block & block = blocks_m[blockNum];
+            if(!block.isAlive || addr < block.addr || addr >= block.endAddr) {
+                continue;
+            }
+            block.isAlive = false;
+            context_m->entries[size_t(MemBankType::ram) * bankSize + block.addr] = 0;
+            firstPage = std::min(firstPage, size_t(block.addr >> 8));
+            lastPage = std::max(lastPage, size_t((block.endAddr - 1) >> 8));
+        }
+
+        // Code map is rebuilt from the blocks left
+        for(size_t page = firstPage; page <= lastPage; ++page) {
+            std::vector<uint32_t> & blockNums = pageBlocks_m[page];
+            blockNums.erase(std::remove_if(blockNums.begin(), blockNums.end(), [this](uint32_t blockNum) {
+                return !blocks_m[blockNum].isAlive;
+            }), blockNums.end());
+
+            size_t pageAddr = page << 8;
+            memset(&context_m->codeMap[pageAddr], 0, 256);
+            for(uint32_t blockNum: blockNums) {
+                const Block & block = blocks_m[blockNum];
+                size_t beginAddr = std::max(pageAddr, size_t(block.addr));
+                size_t endAddr = std::min(pageAddr + 256, size_t(block.endAddr));
+                memset(&context_m->codeMap[beginAddr], 1, endAddr - beginAddr);
+            }
+        }
+    }
+
+    virtual void flush() override
+    {
+        codeSize_m = routinesSize_m;
+        blocks_m.clear();
+        for(auto & blockNums: pageBlocks_m) {
+            blockNums.clear();
+        }
+        context_m->codeMap.fill(0);
+        context_m->entries.fill(0);
+    }
+
+    virtual auto run(unsigned clockLimit) -> JitExit override
+    {
+        using EnterFunc = uint32_t (*)(Context *, uint8_t *);
+        EnterFunc enter = reinterpret_cast<EnterFunc>(arena_m);
+
+        context_m->clockLimit = clockLimit;
+        while(cpuRegs_m->clock < clockLimit) {
+            uint16_t pc = cpuRegs_m->pc;
+            uint32_t codeOffset = context_m->entries[context_m->regionBanks[pc >> 14] * bankSize + pc];
+            if(codeOffset == 0) {
+                codeOffset = translate(pc);
+                if(codeOffset == 0) {
+                    return JitExit::interpret;
+                }
+            }
+            switch(enter(context_m.get(), arena_m + codeOffset)) {
+                case exitInterpret:
+                    return JitExit::interpret;
+                case exitLoop:
+                    return JitExit::loop;
+                default:
+                    break;
+            }
+        }
+        return JitExit::limit;
+    }
+
+private:
+    void setTraps(uint16_t firstAddr, uint16_t lastAddr, bool isTrap)
+    {
+        bool isChanged = false;
+        for(unsigned addr = firstAddr; addr <= lastAddr; ++addr) {
+            if(traps_m[addr] != isTrap) {
+                traps_m[addr] = isTrap;
+                isChanged = true;
+            }
+        }
+        if(isChanged) {
+            flush();
+        }
+    }
+
+    struct Block final
+    {
+        uint16_t addr;
+        uint32_t endAddr;
+        bool isAlive;
+    };
+
+    // Exit taken before the op is run, so the interpreter runs it instead
+    struct Bail final
+    {
+        size_t jumpPos;
+        uint16_t pc;
+        unsigned clocks;
+    };
+
+    void initTables()
+    {
+        for(size_t i = 0; i < 256; ++i) {
+            uint8_t flags = 2;
+            if(i & 0x80) {
+                flags |= CpuFlag::s;
+            }
+            if(i == 0) {
+                flags |= CpuFlag::z;
+            }
+            size_t a = i;
+            a ^= a >> 4;
+            a ^= a >> 2;
+            a ^= a >> 1;
+            if(!(a & 1)) {
+                flags |= CpuFlag::p;
+            }
+            context_m->flags[i] = flags;
+        }
+
+        // Same as the interpreter does
+        for(size_t i = 0; i < context_m->daa.size(); ++i) {
+            uint8_t a = uint8_t(i);
+            uint8_t c = (i & 0x100 ? 0x01 : 0);
+            uint8_t ac = (i & 0x200 ? 0x10 : 0);
+            if((a & 0x0f) > 9 || ac) {
+                ac = ((a & ~0x10) + 0x06) & 0x10;
+                uint16_t tmp = uint16_t(a) + 0x06;
+                a = bytelo(tmp);
+                c |= bytehi(tmp) & 0x01;
+            }
+            if((a & 0xf0) > 0x90 || c) {
+                uint16_t tmp = uint16_t(a) + 0x60;
+                a = bytelo(tmp);
+                c |= bytehi(tmp) & 0x01;
+            }
+            uint8_t f = context_m->flags[a] | ac | c;
+            context_m->daa[i] = bytepack(f, a);
+        }
+    }
+
+    // Arena starts with the routines shared by all blocks:
+    //  enter(context, code) loads registers and jumps to the code
+    //  exit with pc in eax and reason in esi stores registers and returns
+    //  dispatch with target pc in eax and branch op pc in esi looks the
+    //  target block up, taking a loop exit first if enabled
+    void initRoutines()
+    {
+        Emitter e(arena_m, 0);
+
+        for(Reg reg: {rbx, rbp, r12, r13, r14, r15}) {
+            e.push(reg);
+        }
+        e.aluRI(aluSub, rsp, 8, true); // stack alignment, though nothing is called
+        e.bytes({0x49, 0x89, 0xff}); // mov r15, rdi
+        e.movRM64(rax, mem(regCtx, ctxOffset(offsetof(Context, cpuRegs))));
+        e.movRM(regClock, mem(rax, offsetof(CpuRegs, clock)));
+        e.movzxRM16(regBC, mem(rax, offsetof(CpuRegs, bc)));
+        e.movzxRM16(regDE, mem(rax, offsetof(CpuRegs, de)));
+        e.movzxRM16(regHL, mem(rax, offsetof(CpuRegs, hl)));
+        e.movzxRM16(regSP, mem(rax, offsetof(CpuRegs, sp)));
+        e.movzxRM8(regA, mem(rax, offsetof(CpuRegs, a)));
+        e.movzxRM8(regF, mem(rax, offsetof(CpuRegs, f)));
+        e.jmpR(rsi);
+
+        exitPos_m = e.pos();
+        e.movRM64(rdi, mem(regCtx, ctxOffset(offsetof(Context, cpuRegs))));
+        e.movMR(mem(rdi, offsetof(CpuRegs, clock)), regClock);
+        e.movMR16(mem(rdi, offsetof(CpuRegs, pc)), rax);
+        e.movMR16(mem(rdi, offsetof(CpuRegs, bc)), regBC);
+        e.movMR16(mem(rdi, offsetof(CpuRegs, de)), regDE);
+        e.movMR16(mem(rdi, offsetof(CpuRegs, hl)), regHL);
+        e.movMR16(mem(rdi, offsetof(CpuRegs, sp)), regSP);
+        e.movMR8(mem(rdi, offsetof(CpuRegs, a)), regA);
+        e.movMR8(mem(rdi, offsetof(CpuRegs, f)), regF);
+        e.movRR(rax, rsi);
+        e.aluRI(aluAdd, rsp, 8, true);
+        for(Reg reg: {r15, r14, r13, r12, rbp, rbx}) {
+            e.pop(reg);
+        }
+        e.ret();
+
+        dispatchPos_m = e.pos();
+        e.movRR(rdi, rsi);
+        e.aluRR(aluSub, rdi, rax);
+        e.aluRI(aluSub, rdi, 1);
+        e.aluRM(aluCmp, rdi, mem(regCtx, ctxOffset(offsetof(Context, loopBytes))));
+        size_t loopJump = e.jcc(condB);
+        e.movRR(rdi, rax);
+        e.shrRI(rdi, 14);
+        e.movzxRM8(rdi, mem(regCtx, rdi, ctxOffset(offsetof(Context, regionBanks))));
+        e.shlRI(rdi, 16);
+        e.aluRR(aluOr, rdi, rax);
+        e.movRM(rdi, mem(regCtx, rdi, ctxOffset(offsetof(Context, entries)), 4));
+        e.testRI(rdi, 0xffffffff);
+        size_t missJump = e.jcc(condE);
+        e.aluRM64(aluAdd, rdi, mem(regCtx, ctxOffset(offsetof(Context, code))));
+        e.jmpR(rdi);
+        e.bind(missJump);
+        e.movRI(rsi, exitBranch);
+        e.jmp(exitPos_m);
+        e.bind(loopJump);
+        e.movRI(rsi, exitLoop);
+        e.jmp(exitPos_m);
+
+        routinesSize_m = e.pos();
+    }
+
+    auto bankData(size_t bank) -> uint8_t *
+    {
+        switch(MemBankType(bank)) {
+            case MemBankType::ram:
+                return memBanks_m->ram.data();
+            case MemBankType::rom:
+                return memBanks_m->rom.data();
+            case MemBankType::x1:
+                return memBanks_m->x1.data();
+            case MemBankType::x2:
+                return memBanks_m->x2.data();
+        }
+        return nullptr;
+    }
+
+    // Returns code offset of the block, or zero if the op at pc has to be interpreted
+    auto translate(uint16_t pc) -> uint32_t
+    {
+        size_t bank = context_m->regionBanks[pc >> 14];
+        const uint8_t * data = bankData(bank);
+        if(!isTranslatable(pc, data)) {
+            return 0;
+        }
+        if(codeSize_m + maxBlockCode > arenaSize) {
+            flush();
+        }
+
+        Emitter e(arena_m, codeSize_m);
+        emitter_m = &e;
+        bank_m = bank;
+        clocks_m = 0;
+        waitCount_m = 0;
+        bails_m.clear();
+
+        // Every op must start before the clock limit, as the interpreter checks
+        // it before each op. Clocks taken by the ops but the last one are
+        // patched in once known
+        size_t blockPos = e.pos();
+        e.leaRM(rax, mem(regClock, 0));
+        size_t limitDispPos = e.pos() - 4;
+        e.aluRM(aluCmp, rax, mem(regCtx, ctxOffset(offsetof(Context, clockLimit))));
+        bails_m.push_back({e.jcc(condAe), pc, 0});
+
+        uint16_t opPc = pc;
+        unsigned lastOpClocks = 0;
+        size_t opCount = 0;
+        bool isFallThrough = true;
+        while(isFallThrough) {
+            if(opCount == maxBlockOps) {
+                emitJump(opPc, uint16_t(opPc - 1)); // not a backward branch
+                break;
+            }
+            if((opPc >> 14) != (pc >> 14)) {
+                emitJump(opPc, uint16_t(opPc - 1)); // next region may map another bank
+                break;
+            }
+            if(opCount > 0 && !isTranslatable(opPc, data)) {
+                emitExit(opPc, exitInterpret);
+                break;
+            }
+            lastOpClocks = clocks_m + waitCount_m * maxRamWait;
+            uint8_t op = data[opPc];
+            uint16_t opData = bytepack(data[uint16_t(opPc + 2)], data[uint16_t(opPc + 1)]);
+            isFallThrough = emitOp(opPc, op, opData);
+            opPc = uint16_t(opPc + opSize(op));
+            ++opCount;
+        }
+
+        int32_t limitDisp = int32_t(lastOpClocks);
+        memcpy(arena_m + limitDispPos, &limitDisp, sizeof(limitDisp));
+
+        for(const Bail & bail: bails_m) {
+            e.bind(bail.jumpPos);
+            clocks_m = bail.clocks;
+            emitExit(bail.pc, exitInterpret);
+        }
+
+        codeSize_m = e.pos();
+        emitter_m = nullptr;
+
+        uint32_t endAddr = (opPc > pc ? opPc : 0x10000); // block may end at the address space end
+        addBlock(pc, endAddr, bank, uint32_t(blockPos));
+        return uint32_t(blockPos);
+    }
+
+    auto isTranslatable(uint16_t pc, const uint8_t * data) const -> bool
+    {
+        uint8_t op = data[pc];
+        if(traps_m[pc] || isInterpretedOp(op)) {
+            return false;
+        }
+        // Op must not cross the region end, as the next region may map another bank
+        return ((pc & 0x3fff) + opSize(op) <= 0x4000);
+    }
+
+    void addBlock(uint16_t addr, uint32_t endAddr, size_t bank, uint32_t codeOffset)
+    {
+        context_m->entries[bank * bankSize + addr] = codeOffset;
+        if(bank != size_t(MemBankType::ram)) {
+            return; // never written
+        }
+        uint32_t blockNum = uint32_t(blocks_m.size());
+        blocks_m.push_back({addr, endAddr, true});
+        for(size_t page = addr >> 8; page <= ((endAddr - 1) >> 8); ++page) {
+            pageBlocks_m[page].push_back(blockNum);
+        }
+        memset(&context_m->codeMap[addr], 1, endAddr - addr);
+    }
+
+    //-- Timing, counted as by the interpreter. Constant clocks are accumulated
+    //-- and added to the clock register on exits only
+
+    void addClocks(unsigned clocks)
+    {
+        clocks_m += clocks;
+    }
+
+    void flushClocks()
+    {
+        if(clocks_m != 0) {
+            emitter_m->aluRI(aluAdd, regClock, int32_t(clocks_m));
+            clocks_m = 0;
+        }
+    }
+
+    void waitRam()
+    {
+        emitter_m->movzxRM8(r8, mem(regCtx, regClock, ctxOffset(offsetof(Context, ramWaits)) + int32_t(clocks_m)));
+        emitter_m->aluRR(aluAdd, regClock, r8);
+        ++waitCount_m;
+    }
+
+    // Reads wait in the upper region only, whatever bank it maps
+    void fetchClocks(uint16_t addr)
+    {
+        readClocks(addr);
+    }
+
+    void readClocks(uint16_t addr)
+    {
+        addClocks(3);
+        if(addr >= 0xc000) {
+            waitRam();
+        }
+        addClocks(1);
+    }
+
+    void readClocks(Reg addr)
+    {
+        addClocks(3);
+        emitter_m->aluRI(aluCmp, addr, 0xc000);
+        size_t skipJump = emitter_m->jcc(condB);
+        waitRam();
+        emitter_m->bind(skipJump);
+        addClocks(1);
+    }
+
+    void writeClocks()
+    {
+        addClocks(4);
+        waitRam();
+        addClocks(1);
+    }
+
+    //-- Memory access, data goes through eax --//
+
+    void readByte(Reg addr)
+    {
+        emitter_m->movRR(r9, addr);
+        emitter_m->shrRI(r9, 14);
+        emitter_m->movRM64(r9, mem(regCtx, r9, ctxOffset(offsetof(Context, readBankMap)), 8));
+        emitter_m->movzxRM8(rax, mem(r9, addr, 0));
+    }
+
+    void readByte(uint16_t addr)
+    {
+        emitter_m->movRM64(r9, mem(regCtx, ctxOffset(offsetof(Context, readBankMap)) + (addr >> 14) * 8));
+        emitter_m->movzxRM8(rax, mem(r9, addr));
+    }
+
+    void writeByte(Reg addr)
+    {
+        emitter_m->movRM64(r9, mem(regCtx, ctxOffset(offsetof(Context, ram))));
+        emitter_m->movMR8(mem(r9, addr, 0), rax);
+    }
+
+    void writeByte(uint16_t addr)
+    {
+        emitter_m->movRM64(r9, mem(regCtx, ctxOffset(offsetof(Context, ram))));
+        emitter_m->movMR8(mem(r9, addr), rax);
+    }
+
+    // Register gets the address plus offset wrapped to 16 bits
+    void offsetAddr(Reg dst, Reg addr, int32_t offset)
+    {
+        emitter_m->leaRM(dst, mem(addr, offset));
+        emitter_m->movzxRR16(dst, dst);
+    }
+
+    // Writes to translated code are left to the interpreter, which invalidates it
+    void checkCode(Reg addr, uint16_t pc)
+    {
+        emitter_m->cmpMI8(mem(regCtx, addr, ctxOffset(offsetof(Context, codeMap))), 0);
+        bails_m.push_back({emitter_m->jcc(condNe), pc, clocks_m});
+    }
+
+    void checkCode(uint16_t addr, uint16_t pc)
+    {
+        emitter_m->cmpMI8(mem(regCtx, ctxOffset(offsetof(Context, codeMap)) + addr), 0);
+        bails_m.push_back({emitter_m->jcc(condNe), pc, clocks_m});
+    }
+
+    void checkStackCode(uint16_t pc)
+    {
+        offsetAddr(rsi, regSP, -1);
+        checkCode(rsi, pc);
+        offsetAddr(rsi, regSP, -2);
+        checkCode(rsi, pc);
+    }
+
+    //-- Registers --//
+
+    void loadReg(unsigned reg)
+    {
+        if(reg == opRegA) {
+            emitter_m->movRR(rax, regA);
+        } else {
+            emitter_m->bytes({0x0f, 0xb6, uint8_t(0xc0 | byteRegCodes[reg])}); // movzx eax, r8
+        }
+    }
+
+    void storeReg(unsigned reg)
+    {
+        if(reg == opRegA) {
+            emitter_m->movRR(regA, rax);
+        } else {
+            emitter_m->bytes({0x88, uint8_t(0xc0 | byteRegCodes[reg])}); // mov r8, al
+        }
+    }
+
+    void pushWord(uint16_t data)
+    {
+        emitter_m->movRI(rax, bytehi(data));
+        pushByte(-1);
+        emitter_m->movRI(rax, bytelo(data));
+        pushByte(-2);
+        offsetAddr(regSP, regSP, -2);
+    }
+
+    void pushPair(unsigned pair)
+    {
+        if(pair == 3) {
+            emitter_m->movRR(rax, regA);
+        } else {
+            emitter_m->movRR(rax, pairRegs[pair]);
+            emitter_m->shrRI(rax, 8);
+        }
+        pushByte(-1);
+        if(pair == 3) {
+            emitter_m->movRR(rax, regF);
+        } else {
+            emitter_m->movzxRR8(rax, pairRegs[pair]);
+        }
+        pushByte(-2);
+        offsetAddr(regSP, regSP, -2);
+    }
+
+    void pushByte(int32_t offset)
+    {
+        offsetAddr(rsi, regSP, offset);
+        writeClocks();
+        writeByte(rsi);
+    }
+
+    // Word goes to eax
+    void popWord()
+    {
+        readClocks(regSP);
+        readByte(regSP);
+        emitter_m->movRR(rdi, rax);
+        offsetAddr(rsi, regSP, 1);
+        readClocks(rsi);
+        readByte(rsi);
+        emitter_m->shlRI(rax, 8);
+        emitter_m->aluRR(aluOr, rax, rdi);
+        offsetAddr(regSP, regSP, 2);
+    }
+
+    //-- Flags, operand goes in eax --//
+
+    // Sets s, z, p from the table and ors in the bits collected in esi
+    void setFlags(Reg result)
+    {
+        emitter_m->movzxRM8(regF, mem(regCtx, result, ctxOffset(offsetof(Context, flags))));
+        emitter_m->aluRR(aluOr, regF, rsi);
+    }
+
+    void emitAlu(unsigned aluOp)
+    {
+        Emitter & e = *emitter_m;
+        switch(aluOp) {
+            case 0: // add
+            case 1: // adc
+            case 2: // sub
+            case 3: // sbb
+            case 7: // cmp
+            {
+                // Aux carry is bit 4 of a ^ data ^ result, carry is bit 8 of the result
+                bool isSub = (aluOp >= 2);
+                bool isCarryIn = (aluOp == 1 || aluOp == 3);
+                Reg result = (aluOp == 7 ? rdi : regA);
+                if(isCarryIn) {
+                    e.movRR(r10, regF);
+                    e.aluRI(aluAnd, r10, CpuFlag::c);
+                }
+                e.movRR(rsi, regA);
+                e.aluRR(aluXor, rsi, rax);
+                if(result != regA) {
+                    e.movRR(result, regA);
+                }
+                e.aluRR(isSub ? aluSub : aluAdd, result, rax);
+                if(isCarryIn) {
+                    e.aluRR(isSub ? aluSub : aluAdd, result, r10);
+                }
+                e.aluRR(aluXor, rsi, result);
+                e.aluRI(aluAnd, rsi, 0x10);
+                e.movRR(r10, result);
+                e.shrRI(r10, 8);
+                e.aluRI(aluAnd, r10, CpuFlag::c);
+                e.aluRR(aluOr, rsi, r10);
+                e.movzxRR8(result, result);
+                setFlags(result);
+                break;
+            }
+            case 4: // ana
+                e.movRR(rsi, regA);
+                e.aluRR(aluOr, rsi, rax);
+                e.aluRI(aluAnd, rsi, 0x08);
+                e.shlRI(rsi, 1);
+                e.aluRR(aluAnd, regA, rax);
+                setFlags(regA);
+                break;
+            case 5: // xra
+            case 6: // ora
+                e.aluRR(aluOp == 5 ? aluXor : aluOr, regA, rax);
+                e.movzxRM8(regF, mem(regCtx, regA, ctxOffset(offsetof(Context, flags))));
+                break;
+        }
+    }
+
+    // Value in eax is changed by one, aux carry is taken as bit 4 of value ^ (value + acDelta)
+    void emitIncDec(int32_t delta, int32_t acDelta)
+    {
+        Emitter & e = *emitter_m;
+        e.leaRM(rsi, mem(rax, acDelta));
+        e.aluRR(aluXor, rsi, rax);
+        e.aluRI(aluAnd, rsi, 0x10);
+        e.leaRM(rax, mem(rax, delta));
+        e.movzxRR8(rax, rax);
+        e.aluRI(aluAnd, regF, CpuFlag::c);
+        e.aluRR(aluOr, regF, rsi);
+        e.movzxRM8(rsi, mem(regCtx, rax, ctxOffset(offsetof(Context, flags))));
+        e.aluRR(aluOr, regF, rsi);
+    }
+
+    //-- Control transfer --//
+
+    void emitExit(uint16_t pc, ExitReason reason)
+    {
+        flushClocks();
+        emitter_m->movRI(rax, pc);
+        emitter_m->movRI(rsi, reason);
+        emitter_m->jmp(exitPos_m);
+    }
+
+    // Targets in the same region are reached right away, the others are
+    // looked up as the region may map another bank by then
+    void emitJump(uint16_t target, uint16_t opPc)
+    {
+        flushClocks();
+        bool isLoop = (target < opPc && unsigned(opPc - target) <= loopBytes_m);
+        if(isLoop || (target >> 14) != (opPc >> 14)) {
+            emitter_m->movRI(rax, target);
+            emitter_m->movRI(rsi, opPc);
+            emitter_m->jmp(dispatchPos_m);
+            return;
+        }
+        int32_t entryDisp = ctxOffset(offsetof(Context, entries)) + int32_t((bank_m * bankSize + target) * 4);
+        emitter_m->movRM(rax, mem(regCtx, entryDisp));
+        emitter_m->testRI(rax, 0xffffffff);
+        size_t missJump = emitter_m->jcc(condE);
+        emitter_m->aluRM64(aluAdd, rax, mem(regCtx, ctxOffset(offsetof(Context, code))));
+        emitter_m->jmpR(rax);
+        emitter_m->bind(missJump);
+        emitter_m->movRI(rax, target);
+        emitter_m->movRI(rsi, exitBranch);
+        emitter_m->jmp(exitPos_m);
+    }
+
+    // Target in eax
+    void emitDynamicJump(uint16_t opPc)
+    {
+        flushClocks();
+        emitter_m->movRI(rsi, opPc);
+        emitter_m->jmp(dispatchPos_m);
+    }
+
+    // Jump over the code taken on condition, timing of the fall through path
+    // is not affected by it
+    auto skipUnless(uint8_t op) -> size_t
+    {
+        emitter_m->testRI(regF, conditionMask(op));
+        return emitter_m->jcc(isConditionSet(op) ? condE : condNe);
+    }
+
+    //-- Ops --//
+
+    // Returns false if control does not fall through to the next op
+    auto emitOp(uint16_t pc, uint8_t op, uint16_t data) -> bool
+    {
+        Emitter & e = *emitter_m;
+        uint8_t imm = bytelo(data);
+        unsigned dst = (op >> 3) & 7;
+        unsigned src = op & 7;
+        unsigned pair = (op >> 4) & 3;
+
+        if(op >= 0x40 && op < 0x80) { // mov
+            if(dst == opRegM) {
+                checkCode(regHL, pc);
+                fetchClocks(pc);
+                addClocks(1);
+                writeClocks();
+                loadReg(src);
+                writeByte(regHL);
+            } else if(src == opRegM) {
+                fetchClocks(pc);
+                addClocks(1);
+                readClocks(regHL);
+                readByte(regHL);
+                storeReg(dst);
+            } else {
+                fetchClocks(pc);
+                addClocks(2);
+                loadReg(src);
+                storeReg(dst);
+            }
+            return true;
+        }
+
+        if(op >= 0x80 && op < 0xc0) { // alu r/m
+            fetchClocks(pc);
+            if(src == opRegM) {
+                readClocks(regHL);
+                readByte(regHL);
+            } else {
+                loadReg(src);
+            }
+            addClocks(1);
+            emitAlu(dst);
+            return true;
+        }
+
+        if(op < 0x40) {
+            switch(op & 0x0f) {
+                case 0x00:
+                case 0x08: // nop
+                    fetchClocks(pc);
+                    addClocks(1);
+                    return true;
+                case 0x01: // lxi
+                    fetchClocks(pc);
+                    addClocks(1);
+                    fetchClocks(uint16_t(pc + 1));
+                    fetchClocks(uint16_t(pc + 2));
+                    e.movRI(pairRegs[pair], data);
+                    return true;
+                case 0x03: // inx
+                case 0x0b: // dcx
+                    fetchClocks(pc);
+                    addClocks(2);
+                    offsetAddr(pairRegs[pair], pairRegs[pair], (op & 0x08) ? -1 : 1);
+                    return true;
+                case 0x09: // dad
+                    fetchClocks(pc);
+                    addClocks(7);
+                    e.aluRR(aluAdd, regHL, pairRegs[pair]);
+                    e.movRR(rax, regHL);
+                    e.shrRI(rax, 16);
+                    e.aluRI(aluAnd, regF, ~int32_t(CpuFlag::c) & 0xff);
+                    e.aluRR(aluOr, regF, rax);
+                    e.movzxRR16(regHL, regHL);
+                    return true;
+            }
+            switch(op & 0x07) {
+                case 0x04: // inr
+                case 0x05: // dcr
+                {
+                    bool isDec = (op & 0x01);
+                    if(dst == opRegM) {
+                        // Interpreter takes aux carry of dcr m as for inr
+                        checkCode(regHL, pc);
+                        fetchClocks(pc);
+                        addClocks(1);
+                        readClocks(regHL);
+                        readByte(regHL);
+                        emitIncDec(isDec ? -1 : 1, 1);
+                        writeClocks();
+                        writeByte(regHL);
+                    } else {
+                        fetchClocks(pc);
+                        addClocks(2);
+                        loadReg(dst);
+                        emitIncDec(isDec ? -1 : 1, isDec ? -1 : 1);
+                        storeReg(dst);
+                    }
+                    return true;
+                }
+                case 0x06: // mvi
+                    if(dst == opRegM) {
+                        checkCode(regHL, pc);
+                        fetchClocks(pc);
+                        addClocks(1);
+                        fetchClocks(uint16_t(pc + 1));
+                        writeClocks();
+                        e.movRI(rax, imm);
+                        writeByte(regHL);
+                    } else {
+                        fetchClocks(pc);
+                        addClocks(1);
+                        fetchClocks(uint16_t(pc + 1));
+                        e.movRI(rax, imm);
+                        storeReg(dst);
+                    }
+                    return true;
+            }
+            switch(op) {
+                case 0x02: // stax b
+                case 0x12: // stax d
+                    checkCode(pairRegs[pair], pc);
+                    fetchClocks(pc);
+                    addClocks(1);
+                    writeClocks();
+                    e.movRR(rax, regA);
+                    writeByte(pairRegs[pair]);
+                    return true;
+                case 0x0a: // ldax b
+                case 0x1a: // ldax d
+                    fetchClocks(pc);
+                    addClocks(1);
+                    readClocks(pairRegs[pair]);
+                    readByte(pairRegs[pair]);
+                    e.movRR(regA, rax);
+                    return true;
+                case 0x22: // shld
+                    checkCode(data, pc);
+                    checkCode(uint16_t(data + 1), pc);
+                    fetchClocks(pc);
+                    addClocks(1);
+                    fetchClocks(uint16_t(pc + 1));
+                    fetchClocks(uint16_t(pc + 2));
+                    writeClocks();
+                    loadReg(opRegL);
+                    writeByte(data);
+                    writeClocks();
+                    loadReg(opRegH);
+                    writeByte(uint16_t(data + 1));
+                    return true;
+                case 0x2a: // lhld
+                    fetchClocks(pc);
+                    addClocks(1);
+                    fetchClocks(uint16_t(pc + 1));
+                    fetchClocks(uint16_t(pc + 2));
+                    readClocks(data);
+                    readByte(data);
+                    e.movRR(rdi, rax);
+                    readClocks(uint16_t(data + 1));
+                    readByte(uint16_t(data + 1));
+                    e.shlRI(rax, 8);
+                    e.aluRR(aluOr, rax, rdi);
+                    e.movRR(regHL, rax);
+                    return true;
+                case 0x32: // sta
+                    checkCode(data, pc);
+                    fetchClocks(pc);
+                    addClocks(1);
+                    fetchClocks(uint16_t(pc + 1));
+                    fetchClocks(uint16_t(pc + 2));
+                    writeClocks();
+                    e.movRR(rax, regA);
+                    writeByte(data);
+                    return true;
+                case 0x3a: // lda
+                    fetchClocks(pc);
+                    addClocks(1);
+                    fetchClocks(uint16_t(pc + 1));
+                    fetchClocks(uint16_t(pc + 2));
+                    readClocks(data);
+                    readByte(data);
+                    e.movRR(regA, rax);
+                    return true;
+            }
+            fetchClocks(pc);
+            addClocks(1);
+            switch(op) {
+                case 0x07: // rlc
+                    e.movRR(rax, regA);
+                    e.shrRI(rax, 7);
+                    e.aluRR(aluAdd, regA, regA);
+                    e.aluRR(aluOr, regA, rax);
+                    e.movzxRR8(regA, regA);
+                    break;
+                case 0x0f: // rrc
+                    e.movRR(rax, regA);
+                    e.aluRI(aluAnd, rax, 0x01);
+                    e.shrRI(regA, 1);
+                    e.movRR(rsi, rax);
+                    e.shlRI(rsi, 7);
+                    e.aluRR(aluOr, regA, rsi);
+                    break;
+                case 0x17: // ral
+                    e.movRR(rax, regA);
+                    e.shrRI(rax, 7);
+                    e.movRR(rsi, regF);
+                    e.aluRI(aluAnd, rsi, CpuFlag::c);
+                    e.aluRR(aluAdd, regA, regA);
+                    e.aluRR(aluOr, regA, rsi);
+                    e.movzxRR8(regA, regA);
+                    break;
+                case 0x1f: // rar
+                    e.movRR(rax, regA);
+                    e.aluRI(aluAnd, rax, 0x01);
+                    e.movRR(rsi, regF);
+                    e.aluRI(aluAnd, rsi, CpuFlag::c);
+                    e.shlRI(rsi, 7);
+                    e.shrRI(regA, 1);
+                    e.aluRR(aluOr, regA, rsi);
+                    break;
+                case 0x27: // daa
+                    e.movRR(rax, regF);
+                    e.aluRI(aluAnd, rax, CpuFlag::c);
+                    e.shlRI(rax, 8);
+                    e.movRR(rsi, regF);
+                    e.aluRI(aluAnd, rsi, CpuFlag::ac);
+                    e.shlRI(rsi, 5);
+                    e.aluRR(aluOr, rax, rsi);
+                    e.aluRR(aluOr, rax, regA);
+                    e.movzxRM16(rax, mem(regCtx, rax, ctxOffset(offsetof(Context, daa)), 2));
+                    e.movzxRR8(regA, rax);
+                    e.shrRI(rax, 8);
+                    e.movRR(regF, rax);
+                    return true;
+                case 0x2f: // cma
+                    e.aluRI(aluXor, regA, 0xff);
+                    return true;
+                case 0x37: // stc
+                    e.aluRI(aluOr, regF, CpuFlag::c);
+                    return true;
+                case 0x3f: // cmc
+                    e.aluRI(aluXor, regF, CpuFlag::c);
+                    return true;
+            }
+            // Rotations leave the carry in eax
+            e.aluRI(aluAnd, regF, ~int32_t(CpuFlag::c) & 0xff);
+            e.aluRR(aluOr, regF, rax);
+            return true;
+        }
+
+        // 0xc0..0xff
+        switch(op & 0x07) {
+            case 0x00: // r*
+            {
+                fetchClocks(pc);
+                addClocks(2);
+                size_t skipJump = skipUnless(op);
+                unsigned clocks = clocks_m;
+                popWord();
+                emitDynamicJump(pc);
+                clocks_m = clocks;
+                e.bind(skipJump);
+                return true;
+            }
+            case 0x02: // j*
+            {
+                fetchClocks(pc);
+                addClocks(2);
+                fetchClocks(uint16_t(pc + 1));
+                fetchClocks(uint16_t(pc + 2));
+                size_t skipJump = skipUnless(op);
+                unsigned clocks = clocks_m;
+                emitJump(data, pc);
+                clocks_m = clocks;
+                e.bind(skipJump);
+                return true;
+            }
+            case 0x04: // c*
+            {
+                checkStackCode(pc);
+                fetchClocks(pc);
+                addClocks(2);
+                fetchClocks(uint16_t(pc + 1));
+                fetchClocks(uint16_t(pc + 2));
+                size_t skipJump = skipUnless(op);
+                unsigned clocks = clocks_m;
+                pushWord(uint16_t(pc + 3));
+                emitJump(data, pc);
+                clocks_m = clocks;
+                e.bind(skipJump);
+                return true;
+            }
+            case 0x06: // alu data
+                fetchClocks(pc);
+                fetchClocks(uint16_t(pc + 1));
+                addClocks(1);
+                e.movRI(rax, imm);
+                emitAlu(dst);
+                return true;
+            case 0x07: // rst
+                checkStackCode(pc);
+                fetchClocks(pc);
+                addClocks(2);
+                pushWord(uint16_t(pc + 1));
+                emitJump(uint16_t(op & 0x38), pc);
+                return false;
+        }
+
+        switch(op) {
+            case 0xc1: // pop
+            case 0xd1:
+            case 0xe1:
+                fetchClocks(pc);
+                addClocks(1);
+                popWord();
+                e.movRR(pairRegs[pair], rax);
+                return true;
+            case 0xf1: // pop psw, f is taken as is
+                fetchClocks(pc);
+                addClocks(1);
+                popWord();
+                e.movzxRR8(regF, rax);
+                e.shrRI(rax, 8);
+                e.movRR(regA, rax);
+                return true;
+            case 0xc5: // push
+            case 0xd5:
+            case 0xe5:
+            case 0xf5:
+                checkStackCode(pc);
+                fetchClocks(pc);
+                addClocks(2);
+                pushPair(pair);
+                return true;
+            case 0xc3: // jmp
+            case 0xcb:
+                fetchClocks(pc);
+                addClocks(1);
+                fetchClocks(uint16_t(pc + 1));
+                fetchClocks(uint16_t(pc + 2));
+                emitJump(data, pc);
+                return false;
+            case 0xcd: // call
+            case 0xdd:
+            case 0xed:
+            case 0xfd:
+                checkStackCode(pc);
+                fetchClocks(pc);
+                addClocks(2);
+                fetchClocks(uint16_t(pc + 1));
+                fetchClocks(uint16_t(pc + 2));
+                pushWord(uint16_t(pc + 3));
+                emitJump(data, pc);
+                return false;
+            case 0xc9: // ret
+            case 0xd9:
+                fetchClocks(pc);
+                addClocks(2);
+                popWord();
+                emitDynamicJump(pc);
+                return false;
+            case 0xe9: // pchl
+                fetchClocks(pc);
+                addClocks(2);
+                e.movRR(rax, regHL);
+                emitDynamicJump(pc);
+                return false;
+            case 0xf9: // sphl
+                fetchClocks(pc);
+                addClocks(2);
+                e.movRR(regSP, regHL);
+                return true;
+            case 0xe3: // xthl
+                offsetAddr(rsi, regSP, 1);
+                checkCode(rsi, pc);
+                checkCode(regSP, pc);
+                fetchClocks(pc);
+                addClocks(1);
+                readClocks(regSP);
+                readByte(regSP);
+                e.movRR(rdi, rax);
+                offsetAddr(rsi, regSP, 1);
+                readClocks(rsi);
+                readByte(rsi);
+                e.shlRI(rax, 8);
+                e.aluRR(aluOr, rdi, rax);
+                writeClocks();
+                loadReg(opRegH);
+                writeByte(rsi);
+                writeClocks();
+                loadReg(opRegL);
+                writeByte(regSP);
+                addClocks(2);
+                e.movRR(regHL, rdi);
+                return true;
+            case 0xeb: // xchg
+                fetchClocks(pc);
+                addClocks(1);
+                e.movRR(rax, regHL);
+                e.movRR(regHL, regDE);
+                e.movRR(regDE, rax);
+                return true;
+            case 0xf3: // di
+            case 0xfb: // ei
+                fetchClocks(pc);
+                addClocks(1);
+                e.movRM64(rax, mem(regCtx, ctxOffset(offsetof(Context, cpuRegs))));
+                if(op == 0xfb) {
+                    e.aluMI(aluOr, mem(rax, offsetof(CpuRegs, state)), CpuState::inte);
+                } else {
+                    e.aluMI(aluAnd, mem(rax, offsetof(CpuRegs, state)), ~int32_t(CpuState::inte));
+                }
+                return true;
+        }
+
+        // Unreachable as in, out and hlt are interpreted
+        emitExit(pc, exitInterpret);
+        return false;
+    }
+
+    CpuRegs * cpuRegs_m;
+    MemBanks * memBanks_m;
+    uint8_t * arena_m;
+    std::unique_ptr<Context> context_m;
+
+    size_t exitPos_m;
+    size_t dispatchPos_m;
+    size_t routinesSize_m;
+    size_t codeSize_m;
+
+    std::vector<Block> blocks_m;
+    std::array<std::vector<uint32_t>, 256> pageBlocks_m; // ram blocks by pages they span
+    std::bitset<bankSize> traps_m;
+    unsigned loopBytes_m;
+
+    // Translation state
+    Emitter * emitter_m;
+    size_t bank_m;
+    unsigned clocks_m;
+    unsigned waitCount_m;
+    std::vector<Bail> bails_m;
+};
+
+auto Jit::create(CpuRegs * cpuRegs, MemBanks * memBanks) -> std::unique_ptr<Jit>
+{
+    void * arena = mmap(nullptr, arenaSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(arena == MAP_FAILED) {
+        return nullptr;
+    }
+    return std::make_unique<Impl>(cpuRegs, memBanks, static_cast<uint8_t *>(arena));
+}
+
+#else
+
+auto Jit::create(CpuRegs * cpuRegs, MemBanks * memBanks) -> std::unique_ptr<Jit>
+{
+    return nullptr;
+}
+
+#endif // JIT_SUPPORTED
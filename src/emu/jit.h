@@ -0,0 +1,58 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "cpu.h"
+#include "memfunc.h"
+
+// Native code is generated for x86-64 Linux only
+#if defined(__x86_64__) && defined(__linux__)
+# define JIT_SUPPORTED
+#endif
+
+constexpr size_t jitWaitCount = clocksPerFrame + 256; // ram waits a frame long with a margin for the last op
+
+enum struct JitExit {
+    interpret, // op at pc has to be interpreted
+    loop,      // short backward branch taken, so pc is a possible idle loop head
+    limit      // clock limit reached
+};
+
+// Translates i8080 code into native code, block by block, with cpu registers
+// pinned to host ones. Timing is counted exactly as by the interpreter, which
+// remains the reference and still runs ops having side effects beyond memory
+// and registers (in, out, hlt), ops at trap addresses and writes to memory
+// holding translated code
+
+class Jit:
+        public Logger
+{
+public:
+    // Returns nullptr where native code is not supported
+    static auto create(CpuRegs * cpuRegs, MemBanks * memBanks) -> std::unique_ptr<Jit>;
+
+    // Banks mapped to 16k regions for read, write always goes to ram
+    virtual void setReadBanks(const std::array<MemBankType, 4> & bankTypes) = 0;
+    virtual void setRamWaits(const MemFunc<unsigned(unsigned)> & ramWait) = 0;
+
+    // Short backward branches leave native code for idle loop detection,
+    // zero distance disables that
+    virtual void setLoopExit(unsigned maxLoopBytes) = 0;
+
+    // Whole range at once, with translated code flushed once if changed
+    virtual void addTraps(uint16_t firstAddr, uint16_t lastAddr) = 0;
+    virtual void removeTraps(uint16_t firstAddr, uint16_t lastAddr) = 0;
+
+    // Nonzero for ram bytes translated into native code, which has to be
+    // invalidated once any of them is written
+    virtual auto codeMap() const -> const uint8_t * = 0;
+    virtual void invalidate(uint16_t addr) = 0;
+    virtual void flush() = 0;
+
+    virtual auto run(unsigned clockLimit) -> JitExit = 0;
+
+private:
+    class Impl;
+    explicit Jit() = default;
+};
+
+#endif // JIT_H
@@ -26,6 +26,7 @@ struct LibRetroCallbacks final
 };
 
 class LibRetroImpl final:
+        public IEnvironment,
         public Logger
 {
 public:
@@ -40,8 +41,8 @@ public:
         system_info->library_name     = "PK8000";
         system_info->library_version  = "1.0";
         system_info->valid_extensions = "cas|rom|bin|wav|pmi|pcs|ptp|pwe";
-        system_info->need_fullpath    = true;
-        system_info->block_extract    = true;
+        system_info->need_fullpath    = false;
+        system_info->block_extract    = false;
     }
 
     void retro_set_environment(retro_environment_t environment)
@@ -51,6 +52,16 @@ public:
         static constexpr bool support_no_game = true;
         callbacks_m.environment(RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME,
                                 const_cast<bool *>(&support_no_game));
+
+        static constexpr retro_variable variables[] = {
+            {"pk8000_input_latch", "Input latch; early|late"},
+            {"pk8000_idle_skip", "Idle loop skip; enabled|disabled"},
+            {"pk8000_jit", "Native code translation; disabled|enabled"},
+            {"pk8000_record_format", "Tape record format; cas|wav"},
+            {}
+        };
+        callbacks_m.environment(RETRO_ENVIRONMENT_SET_VARIABLES,
+                                const_cast<retro_variable *>(variables));
     }
 
     void retro_init()
@@ -158,8 +169,22 @@ public:
             msg(LogLevel::warn, "Could not set keyboard callback");
         }
 
-        machine_m->media()->playbackFile.setFileName(game_info != nullptr ? game_info->path : "");
-        machine_m->media()->recordFile.setFileName(!saveDir_m.empty() ? saveDir_m + "/record.wav" : "");
+        // Content comes loaded by frontend, even from inside archives
+        std::string fileName;
+        MemBuf memBuf;
+        if(game_info != nullptr) {
+            fileName = (game_info->path != nullptr ? game_info->path : "");
+            if(game_info->data != nullptr) {
+                auto data = static_cast<const uint8_t *>(game_info->data);
+                memBuf = std::make_shared<const std::vector<uint8_t>>(data, data + game_info->size);
+            }
+        }
+        updateVariables();
+
+        machine_m->media()->playbackFile.setFileName(fileName, memBuf);
+        // Record format is applied on content load only, as media hooks are set up then
+        std::string recordExt = (isWavRecord_m ? ".wav" : ".cas");
+        machine_m->media()->recordFile.setFileName(!saveDir_m.empty() ? saveDir_m + "/record" + recordExt : "");
         machine_m->bios()->initMediaHooks();
 
         return true;
@@ -223,8 +248,40 @@ public:
 
     void retro_run()
     {
+        bool isUpdated = false;
+        if(callbacks_m.environment(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &isUpdated) && isUpdated) {
+            updateVariables();
+        }
+
         machine_m->startFrame();
 
+        // With late latch input is polled at the first controller port read,
+        // or after the frame if the program reads none
+        isInputPolled_m = false;
+        if(!isLateLatch_m) {
+            pollInput();
+        }
+
+        machine_m->renderFrame();
+        if(!isInputPolled_m) {
+            pollInput();
+        }
+        machine_m->endFrame();
+
+        FrameBuffer * frameBuffer = machine_m->video()->frameBuffer();
+        callbacks_m.video_refresh(frameBuffer->data(),
+                                  frameBuffer->width(),
+                                  frameBuffer->height(),
+                                  frameBuffer->pitch());
+
+        // TODO:
+        //callbacks_m.audio_sample_batch(audioBuf.data(), samplesPerFrame);
+    }
+
+    void pollInput()
+    {
+        isInputPolled_m = true;
+
         callbacks_m.input_poll();
         for(unsigned port = 0; port < joystickPortCount; ++port) {
             for(int key: {RETRO_DEVICE_ID_JOYPAD_B,
@@ -248,18 +305,40 @@ public:
                 retroJoystickMatrix_m->setPressed(portKey(port, key), isPressed);
             }
         }
+    }
 
-        machine_m->renderFrame();
-        machine_m->endFrame();
+    // Fires before the keyboard and joysticks hooks, which were created
+    // earlier, so the polled input gets latched by this very port read
+    void inPortHookFunc(uint8_t port)
+    {
+        if(isLateLatch_m && !isInputPolled_m) {
+            pollInput();
+        }
+    }
 
-        FrameBuffer * frameBuffer = machine_m->video()->frameBuffer();
-        callbacks_m.video_refresh(frameBuffer->data(),
-                                  frameBuffer->width(),
-                                  frameBuffer->height(),
-                                  frameBuffer->pitch());
+    void updateVariables()
+    {
+        retro_variable variable = {"pk8000_input_latch", nullptr};
+        if(callbacks_m.environment(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) && variable.value != nullptr) {
+            isLateLatch_m = (std::string(variable.value) == "late");
+        }
+        machine_m->keyboard()->setLateLatch(isLateLatch_m);
+        machine_m->joysticks()->setLateLatch(isLateLatch_m);
 
-        // TODO:
-        //callbacks_m.audio_sample_batch(audioBuf.data(), samplesPerFrame);
+        variable = {"pk8000_idle_skip", nullptr};
+        if(callbacks_m.environment(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) && variable.value != nullptr) {
+            machine_m->cpu()->setIdleSkip(std::string(variable.value) != "disabled");
+        }
+
+        variable = {"pk8000_jit", nullptr};
+        if(callbacks_m.environment(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) && variable.value != nullptr) {
+            machine_m->cpu()->setJit(std::string(variable.value) == "enabled");
+        }
+
+        variable = {"pk8000_record_format", nullptr};
+        if(callbacks_m.environment(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) && variable.value != nullptr) {
+            isWavRecord_m = (std::string(variable.value) == "wav");
+        }
     }
 
     void retro_set_controller_port_device(unsigned port, unsigned device)
@@ -343,7 +422,33 @@ public:
         callbacks_m.log_printf(log_level, "%s\n", text.data());
     }
 
-    void popupMsg(const std::string & text)
+    virtual auto systemDir() -> std::string override
+    {
+        return systemDir_m;
+    }
+
+    virtual auto saveDir() -> std::string override
+    {
+        return saveDir_m;
+    }
+
+    virtual auto dumpDir() -> std::string override
+    {
+        return dumpDir_m;
+    }
+
+    virtual auto traceDir() -> std::string override
+    {
+        return traceDir_m;
+    }
+
+    virtual auto keylogDir() -> std::string override
+    {
+        return keylogDir_m;
+    }
+
+    using IEnvironment::popupMsg;
+    virtual void popupMsg(const std::string & text) override
     {
         if(callbacks_m.environment != nullptr) {
             retro_message message { text.data(), 150 };
@@ -362,12 +467,19 @@ public:
     std::unique_ptr<Machine> machine_m;
     std::unique_ptr<RetroKeyboardMatrix> retroKeyboardMatrix_m;
     std::unique_ptr<RetroJoystickMatrix> retroJoystickMatrix_m;
+    std::unique_ptr<InPortHook> inPortHook_m;
+
+    bool isLateLatch_m;
+    bool isInputPolled_m;
+    bool isWavRecord_m;
 
 private:
     explicit LibRetroImpl():
-        machine_m(Machine::create()),
+        machine_m(Machine::create(this)),
         retroKeyboardMatrix_m(machine_m->keyboard()->createRetroKeyboardMatrix()),
-        retroJoystickMatrix_m(machine_m->joysticks()->createRetroJoystickMatrix())
+        retroJoystickMatrix_m(machine_m->joysticks()->createRetroJoystickMatrix()),
+        inPortHook_m(machine_m->cpu()->createInPortHook(memFunc(this, &LibRetroImpl::inPortHookFunc))),
+        isLateLatch_m(false), isInputPolled_m(false), isWavRecord_m(false)
     {}
 };
 
@@ -379,42 +491,6 @@ void LibRetroLog::msg(int level, const std::string & text)
 
 } // namespace
 
-void LibRetro::popupMsg(const std::string & text)
-{
-    LibRetroImpl * impl = LibRetroImpl::instance();
-    impl->popupMsg(text);
-}
-
-auto LibRetro::systemDir() -> std::string
-{
-    LibRetroImpl * impl = LibRetroImpl::instance();
-    return impl->systemDir_m;
-}
-
-auto LibRetro::saveDir() -> std::string
-{
-    LibRetroImpl * impl = LibRetroImpl::instance();
-    return impl->saveDir_m;
-}
-
-auto LibRetro::dumpDir() -> std::string
-{
-    LibRetroImpl * impl = LibRetroImpl::instance();
-    return impl->dumpDir_m;
-}
-
-auto LibRetro::traceDir() -> std::string
-{
-    LibRetroImpl * impl = LibRetroImpl::instance();
-    return impl->traceDir_m;
-}
-
-auto LibRetro::keylogDir() -> std::string
-{
-    LibRetroImpl * impl = LibRetroImpl::instance();
-    return impl->keylogDir_m;
-}
-
 RETRO_API void retro_get_system_info(retro_system_info * system_info)
 {
     LibRetroImpl * impl = LibRetroImpl::instance();
@@ -4,17 +4,19 @@ class Machine::Impl final:
         public Machine
 {
 public:
-    explicit Impl():
+    explicit Impl(IEnvironment * environment):
+        environment_m(environment),
         timeline_m(Timeline::create()),
         memory_m(Memory::create()),
         cpu_m(Cpu::create(memory_m.get())),
-        bios_m(Bios::create(&media_m, memory_m.get(), cpu_m.get())),
+        bios_m(Bios::create(environment_m, &media_m, timeline_m.get(), memory_m.get(), cpu_m.get())),
         video_m(Video::create(memory_m.get())),
-        keyboard_m(Keyboard::create(memory_m.get())),
-        joysticks_m(Joysticks::create(memory_m.get(), keyboard_m.get())),
-        dumper_m(Dumper::create(timeline_m.get(), memory_m.get(), cpu_m.get(), keyboard_m.get())),
-        tracer_m(Tracer::create(timeline_m.get(), cpu_m.get(), keyboard_m.get())),
-        keylogger_m(Keylogger::create(timeline_m.get(), keyboard_m.get(), joysticks_m.get()))
+        keyboard_m(Keyboard::create(memory_m.get(), cpu_m.get())),
+        joysticks_m(Joysticks::create(memory_m.get(), cpu_m.get(), keyboard_m.get())),
+        dumper_m(Dumper::create(environment_m, timeline_m.get(), memory_m.get(), cpu_m.get(), keyboard_m.get())),
+        tracer_m(Tracer::create(environment_m, timeline_m.get(), cpu_m.get(), keyboard_m.get())),
+        watcher_m(Watcher::create(environment_m, timeline_m.get(), cpu_m.get(), dumper_m.get(), keyboard_m.get())),
+        keylogger_m(Keylogger::create(environment_m, timeline_m.get(), keyboard_m.get(), joysticks_m.get()))
     {
         captureLog(timeline_m.get());
         captureLog(memory_m.get());
@@ -25,6 +27,7 @@ public:
         captureLog(joysticks_m.get());
         captureLog(dumper_m.get());
         captureLog(tracer_m.get());
+        captureLog(watcher_m.get());
         captureLog(keylogger_m.get());
     }
 
@@ -39,6 +42,7 @@ public:
         joysticks_m->init();
         dumper_m->init();
         tracer_m->init();
+        watcher_m->init();
         keylogger_m->init();
     }
 
@@ -53,12 +57,14 @@ public:
         joysticks_m->reset();
         dumper_m->reset();
         tracer_m->reset();
+        watcher_m->reset();
         keylogger_m->reset();
     }
 
     virtual void close() override
     {
         keylogger_m->close();
+        watcher_m->close();
         tracer_m->close();
         dumper_m->close();
         joysticks_m->close();
@@ -91,6 +97,11 @@ public:
         timeline_m->endFrame();
     }
 
+    virtual auto environment() -> IEnvironment * override
+    {
+        return environment_m;
+    }
+
     virtual auto media() -> Media * override
     {
         return &media_m;
@@ -141,12 +152,18 @@ public:
         return tracer_m.get();
     }
 
+    virtual auto watcher() -> Watcher * override
+    {
+        return watcher_m.get();
+    }
+
     virtual auto keylogger() -> Keylogger * override
     {
         return keylogger_m.get();
     }
 
 private:
+    IEnvironment * environment_m;
     Media media_m;
 
     std::unique_ptr<Timeline> timeline_m;
@@ -159,10 +176,11 @@ private:
 
     std::unique_ptr<Dumper> dumper_m;
     std::unique_ptr<Tracer> tracer_m;
+    std::unique_ptr<Watcher> watcher_m;
     std::unique_ptr<Keylogger> keylogger_m;
 };
 
-auto Machine::create() -> std::unique_ptr<Machine>
+auto Machine::create(IEnvironment * environment) -> std::unique_ptr<Machine>
 {
-    return std::make_unique<Impl>();
+    return std::make_unique<Impl>(environment);
 }
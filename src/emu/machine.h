@@ -1,6 +1,7 @@
 #ifndef MACHINE_H
 #define MACHINE_H
 
+#include "environment.h"
 #include "media.h"
 #include "timeline.h"
 #include "memory.h"
@@ -11,6 +12,7 @@
 #include "joysticks.h"
 #include "dumper.h"
 #include "tracer.h"
+#include "watcher.h"
 #include "keylogger.h"
 
 class Machine:
@@ -18,8 +20,9 @@ class Machine:
         public Logger
 {
 public:
-    static auto create() -> std::unique_ptr<Machine>;
+    static auto create(IEnvironment * environment) -> std::unique_ptr<Machine>;
 
+    virtual auto environment() -> IEnvironment * = 0;
     virtual auto media() -> Media * = 0;
 
     virtual auto timeline() -> Timeline * = 0;
@@ -32,6 +35,7 @@ public:
 
     virtual auto dumper() -> Dumper * = 0;
     virtual auto tracer() -> Tracer * = 0;
+    virtual auto watcher() -> Watcher * = 0;
     virtual auto keylogger() -> Keylogger * = 0;
 
 private:
@@ -0,0 +1,89 @@
+#include "machinepool.h"
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+class MachinePool::Impl final:
+        public MachinePool
+{
+public:
+    explicit Impl(IEnvironment * environment, unsigned threadCount):
+        environment_m(environment),
+        threadCount_m(threadCount > 0 ? threadCount : std::max(std::thread::hardware_concurrency(), 1u))
+    {}
+
+    virtual auto threadCount() const -> unsigned override
+    {
+        return threadCount_m;
+    }
+
+    virtual void run(size_t jobCount, const JobFunc & jobFunc) override
+    {
+        std::atomic<size_t> nextJobNum(0);
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        // First failure is kept for rethrow, and no more jobs are taken
+        auto worker = [&]() {
+            size_t jobNum;
+            while((jobNum = nextJobNum++) < jobCount) {
+                try {
+                    std::unique_ptr<Machine> machine = Machine::create(environment_m);
+                    machine->init();
+                    jobFunc(machine.get(), jobNum);
+                    machine->close();
+                } catch(...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if(!error) {
+                        error = std::current_exception();
+                    }
+                    nextJobNum = jobCount;
+                }
+            }
+        };
+
+        unsigned threadCount = unsigned(std::min<size_t>(threadCount_m, jobCount));
+        if(threadCount <= 1) {
+            worker();
+            if(error) {
+                std::rethrow_exception(error);
+            }
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount);
+        for(unsigned i = 0; i < threadCount; ++i) {
+            threads.emplace_back(worker);
+        }
+        for(std::thread & thread: threads) {
+            thread.join();
+        }
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    IEnvironment * environment_m;
+    unsigned threadCount_m;
+};
+
+auto MachinePool::create(IEnvironment * environment, unsigned threadCount) -> std::unique_ptr<MachinePool>
+{
+    return std::make_unique<Impl>(environment, threadCount);
+}
+
+auto MachinePool::runFrames(Machine * machine, unsigned maxFrames, const std::function<bool()> & isDone) -> unsigned
+{
+    unsigned frameCount = 0;
+    while(frameCount < maxFrames && !(isDone && isDone())) {
+        machine->startFrame();
+        machine->renderFrame();
+        machine->endFrame();
+        ++frameCount;
+    }
+    return frameCount;
+}
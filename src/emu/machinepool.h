@@ -0,0 +1,36 @@
+#ifndef MACHINEPOOL_H
+#define MACHINEPOOL_H
+
+#include "machine.h"
+#include <functional>
+
+// Runs independent jobs across worker threads. Every job gets a freshly
+// created and initialized machine of its own, so jobs share no mutable
+// state except the environment, which must be thread-safe.
+
+class MachinePool:
+        public Logger
+{
+public:
+    using JobFunc = std::function<void(Machine * machine, size_t jobNum)>;
+
+    static auto create(IEnvironment * environment, unsigned threadCount = 0) -> std::unique_ptr<MachinePool>;
+
+    virtual auto threadCount() const -> unsigned = 0;
+
+    // Blocks until all jobs are done. Jobs are taken in order of their
+    // numbers, but may complete in any order. If a job throws, no more jobs
+    // are started, and the first exception is rethrown once running ones end
+    virtual void run(size_t jobCount, const JobFunc & jobFunc) = 0;
+
+    // Runs the machine unthrottled until predicate returns true or the frame
+    // limit is reached. Returns number of frames passed
+    static auto runFrames(Machine * machine, unsigned maxFrames,
+                          const std::function<bool()> & isDone = nullptr) -> unsigned;
+
+private:
+    class Impl;
+    explicit MachinePool() = default;
+};
+
+#endif // MACHINEPOOL_H
@@ -1,6 +1,8 @@
 #include "media.h"
 #include "cas.h"
 #include "wav.h"
+#include "pmi.h"
+#include "pwe.h"
 
 class MediaFile::Impl final
 {
@@ -9,17 +11,18 @@ public:
         fileFmt_m(FileFmt::unknown)
     {}
 
-    void setFileName(const std::string & fileName)
+    void setFileName(const std::string & fileName, const MemBuf & memBuf)
     {
         fileName_m = fileName;
+        memBuf_m = memBuf;
         fileFmt_m = FileFmt::unknown;
 
-        if(fileName_m.empty()) {
+        if(fileName_m.empty() && !memBuf_m) {
             return;
         }
 
         std::unique_ptr<FileReader> file(FileReader::create());
-        file->open(fileName_m);
+        file->open(fileName_m, memBuf_m);
         if(file->isValid()) {
             if(probeFile<CasFileProber>(file.get())) {
                 fileFmt_m = FileFmt::cas;
@@ -29,6 +32,14 @@ public:
                 fileFmt_m = FileFmt::wav;
                 return;
             }
+            if(probeFile<PmiFileProber>(file.get())) {
+                fileFmt_m = FileFmt::pmi;
+                return;
+            }
+            if(probeFile<PweFileProber>(file.get())) {
+                fileFmt_m = FileFmt::pwe;
+                return;
+            }
         } else {
             std::string fileExt = extractExt(fileName_m);
             if(fileExt == ".cas") {
@@ -39,6 +50,14 @@ public:
                 fileFmt_m = FileFmt::wav;
                 return;
             }
+            if(fileExt == ".pmi") {
+                fileFmt_m = FileFmt::pmi;
+                return;
+            }
+            if(fileExt == ".pwe") {
+                fileFmt_m = FileFmt::pwe;
+                return;
+            }
         }
     }
 
@@ -65,6 +84,7 @@ public:
     }
 
     std::string fileName_m;
+    MemBuf memBuf_m;
     FileFmt fileFmt_m;
 };
 
@@ -77,9 +97,9 @@ MediaFile::~MediaFile()
 {
 }
 
-void MediaFile::setFileName(const std::string & fileName)
+void MediaFile::setFileName(const std::string & fileName, const MemBuf & memBuf)
 {
-    impl->setFileName(fileName);
+    impl->setFileName(fileName, memBuf);
 }
 
 auto MediaFile::fileName() const -> std::string
@@ -87,6 +107,11 @@ auto MediaFile::fileName() const -> std::string
     return impl->fileName_m;
 }
 
+auto MediaFile::memBuf() const -> MemBuf
+{
+    return impl->memBuf_m;
+}
+
 auto MediaFile::fileFmt() const -> FileFmt
 {
     return impl->fileFmt_m;
@@ -1,11 +1,12 @@
 #ifndef MEDIA_H
 #define MEDIA_H
 
+#include "membuf.h"
 #include <string>
 #include <memory>
 
 enum struct FileFmt {
-    unknown, cas, wav
+    unknown, cas, wav, pmi, pwe
 };
 
 class MediaFile final
@@ -14,8 +15,10 @@ public:
     explicit MediaFile();
     ~MediaFile();
 
-    void setFileName(const std::string & fileName);
+    // Content, if given, is used instead of reading the file
+    void setFileName(const std::string & fileName, const MemBuf & memBuf = MemBuf());
     auto fileName() const -> std::string;
+    auto memBuf() const -> MemBuf;
     auto fileFmt() const -> FileFmt;
 
 private:
@@ -9,6 +9,10 @@ namespace {
 
 static constexpr uint8_t casHeaderSignature[] = { 0x1f, 0xa6, 0xde, 0xba, 0xcc, 0x13, 0x7d, 0x74 };
 
+constexpr size_t casHeaderTypeSize  = 10; // type byte repeated
+constexpr size_t casHeaderBlockSize = 16; // type bytes followed by 6-char name
+constexpr size_t casBlockAlign      = 8;
+
 struct CasHeader final
 {
     uint8_t signature[8];
@@ -59,14 +63,14 @@ class CasFileReaderImpl final:
 {
 public:
     explicit CasFileReaderImpl(size_t bufSize):
-        buf_m(std::max(bufSize, sizeof(casHeaderSignature)))
+        bufSize_m(std::max(bufSize, blockScanOverlap * 2))
     {}
 
-    void open(const std::string & fileName)
+    void open(const std::string & fileName, const MemBuf & memBuf)
     {
         close();
 
-        file_m->open(fileName);
+        file_m->open(fileName, memBuf);
         if(!file_m->isValid()) {
             return;
         }
@@ -78,17 +82,22 @@ public:
             return;
         }
 
+        buildBlockIndex();
+        if(!file_m->isValid()) {
+            return;
+        }
+
         isOpen_m = true;
         isValid_m = true;
 
-        signaturePos_m = 0;
-        readFile();
+        seekBlock(0);
     }
 
     void close()
     {
         file_m->close();
         isOpen_m = false;
+        blocks_m.clear();
     }
 
     void nextBlock()
@@ -97,15 +106,44 @@ public:
             return;
         }
 
-        while(signaturePos_m < sizeof(casHeaderSignature)) {
-            if(!file_m->isValid() || file_m->isEof()) {
-                isValid_m = false;
-                return;
-            }
-            readFile();
+        if(blockNum_m + 1 >= blocks_m.size()) {
+            isValid_m = false;
+            return;
+        }
+        seekBlock(blockNum_m + 1);
+    }
+
+    void seekBlock(size_t blockNum)
+    {
+        if(!isOpen_m) {
+            return;
+        }
+        if(blockNum >= blocks_m.size()) {
+            msg(LogLevel::error, "CAS block number is out of range");
+            isValid_m = false;
+            return;
         }
-        signaturePos_m = 0;
-        findBlockHeader();
+
+        file_m->recover();
+        file_m->seek(blocks_m[blockNum].offset);
+        blockNum_m = blockNum;
+        blockLeft_m = blocks_m[blockNum].size;
+        isValid_m = file_m->isValid();
+    }
+
+    auto blockCount() const -> size_t
+    {
+        return blocks_m.size();
+    }
+
+    auto blockNum() const -> size_t
+    {
+        return blockNum_m;
+    }
+
+    auto blockInfo(size_t blockNum) const -> CasBlockInfo
+    {
+        return (blockNum < blocks_m.size() ? blocks_m[blockNum] : CasBlockInfo());
     }
 
     auto read(uint8_t * buf, size_t count, bool exact = true) -> size_t
@@ -114,36 +152,24 @@ public:
             return 0;
         }
 
-        Slice<uint8_t> target(buf, count);
-        while(target.count() > 0 && block_m.count() > 0) {
-            size_t chunkSize = std::min(target.count(), block_m.count());
-            memcpy(target.data(), block_m.data(), chunkSize);
-            target.advance(chunkSize);
-            block_m.advance(chunkSize);
-            if(block_m.count() == 0 && signaturePos_m < sizeof(casHeaderSignature)) {
-                readFile();
-            }
-        }
-        if(target.count() > 0 && exact) {
+        size_t desiredCount = std::min(count, blockLeft_m);
+        size_t actualCount = file_m->read(buf, desiredCount, false);
+        blockLeft_m -= actualCount;
+        if(actualCount < count && exact) {
             msg(LogLevel::error, "Could not read desired amount of data");
             isValid_m = false;
         }
-        return (count - target.count());
+        return actualCount;
     }
 
     auto isEof() const -> bool
     {
-        return (!isOpen_m || (block_m.count() == 0 && (
-                                  signaturePos_m >= sizeof(casHeaderSignature) ||
-                                  file_m->isEof())));
+        return (!isOpen_m || blockLeft_m == 0);
     }
 
     auto isValid() const -> bool
     {
-        return (isOpen_m && isValid_m && (
-                    block_m.count() > 0 ||
-                    signaturePos_m >= sizeof(casHeaderSignature) ||
-                    file_m->isValid()));
+        return (isOpen_m && isValid_m && file_m->isValid());
     }
 
     void recover()
@@ -153,48 +179,98 @@ public:
     }
 
 private:
-    void readFile()
+    // Enough to keep the signature and a header block data in view
+    static constexpr size_t blockScanOverlap = sizeof(casHeaderSignature) + casHeaderBlockSize;
+
+    // Single pass over the file locating all block signatures. Candidates
+    // are found with memchr on the first signature byte, which is vectorized
+    // by the C library, and then confirmed with memcmp
+    void buildBlockIndex()
     {
-        auto buf = Slice<uint8_t>(buf_m.data(), buf_m.size());
-        avail_m = Slice<const uint8_t>(buf_m.data(), 0);
+        blocks_m.clear();
+        blocks_m.push_back({file_m->pos(), 0, CasBlockType::data, std::string()});
 
-        memcpy(buf.data(), casHeaderSignature, signaturePos_m);
-        buf.advance(signaturePos_m);
-        avail_m.expand(signaturePos_m);
+        std::vector<uint8_t> buf(bufSize_m);
+        size_t bufPos = file_m->pos(); // file offset of buf[0]
+        size_t avail = 0;
+        bool isHeaderPending = true;
 
-        size_t actualCount = file_m->read(buf.data(), buf.count(), false);
-        avail_m.expand(actualCount);
+        while(true) {
+            avail += file_m->read(buf.data() + avail, buf.size() - avail, false);
+            if(!file_m->isValid()) {
+                return;
+            }
+            bool isEof = file_m->isEof() || avail < buf.size();
+
+            if(isHeaderPending && (isEof || blocks_m.back().offset + casHeaderBlockSize <= bufPos + avail)) {
+                parseBlockHeader(&blocks_m.back(), buf.data() + (blocks_m.back().offset - bufPos),
+                                 std::min(casHeaderBlockSize, bufPos + avail - blocks_m.back().offset));
+                isHeaderPending = false;
+            }
+
+            size_t scanEnd = (isEof ? avail : avail - blockScanOverlap);
+            size_t scanPos = 0;
+            while(scanPos < scanEnd) {
+                auto * found = static_cast<const uint8_t *>(
+                            memchr(buf.data() + scanPos, casHeaderSignature[0], scanEnd - scanPos));
+                if(found == nullptr) {
+                    break;
+                }
+                scanPos = size_t(found - buf.data());
+                if(scanPos + sizeof(casHeaderSignature) <= avail &&
+                        !memcmp(found, casHeaderSignature, sizeof(casHeaderSignature)))
+                {
+                    size_t offset = bufPos + scanPos + sizeof(casHeaderSignature);
+                    blocks_m.back().size = bufPos + scanPos - blocks_m.back().offset;
+                    blocks_m.push_back({offset, 0, CasBlockType::data, std::string()});
+                    parseBlockHeader(&blocks_m.back(), found + sizeof(casHeaderSignature),
+                                     std::min(casHeaderBlockSize, avail - (scanPos + sizeof(casHeaderSignature))));
+                    scanPos += sizeof(casHeaderSignature);
+                } else {
+                    ++scanPos;
+                }
+            }
 
-        findBlockHeader();
+            if(isEof) {
+                blocks_m.back().size = bufPos + avail - blocks_m.back().offset;
+                break;
+            }
+
+            memmove(buf.data(), buf.data() + scanEnd, avail - scanEnd);
+            bufPos += scanEnd;
+            avail -= scanEnd;
+        }
+
+        file_m->recover();
     }
 
-    void findBlockHeader()
+    static void parseBlockHeader(CasBlockInfo * block, const uint8_t * data, size_t count)
     {
-        block_m = Slice<const uint8_t>(avail_m.data(), 0);
-
-        avail_m.advance(signaturePos_m);
-        block_m.expand(signaturePos_m);
-        while(avail_m.count() > 0 && signaturePos_m < sizeof(casHeaderSignature)) {
-            if(casHeaderSignature[signaturePos_m] != *avail_m.data()) {
-                signaturePos_m = 0;
-            } else {
-                ++signaturePos_m;
+        if(count < casHeaderBlockSize) {
+            return;
+        }
+        for(size_t i = 1; i < casHeaderTypeSize; ++i) {
+            if(data[i] != data[0]) {
+                return;
             }
-            avail_m.advance();
-            block_m.expand();
         }
-        if(signaturePos_m < sizeof(casHeaderSignature) &&
-                avail_m.count() == 0 && file_m->isEof())
-        {
-            signaturePos_m = 0;
+        switch(CasBlockType(data[0])) {
+            case CasBlockType::binary:
+            case CasBlockType::basic:
+            case CasBlockType::ascii:
+                block->type = CasBlockType(data[0]);
+                block->name.assign(reinterpret_cast<const char *>(data + casHeaderTypeSize),
+                                   casHeaderBlockSize - casHeaderTypeSize);
+                break;
+            default:
+                break;
         }
-        block_m.reduce(signaturePos_m);
     }
 
-    std::vector<uint8_t> buf_m;
-    Slice<const uint8_t> avail_m;
-    Slice<const uint8_t> block_m;
-    size_t signaturePos_m;
+    size_t bufSize_m;
+    std::vector<CasBlockInfo> blocks_m;
+    size_t blockNum_m;
+    size_t blockLeft_m;
 };
 
 class CasFileWriterImpl final:
@@ -228,6 +304,7 @@ public:
 
         isOpen_m = true;
         isValid_m = true;
+        isBlockEmpty_m = false;
 
         if(trunc) {
             writeCasHeader();
@@ -240,11 +317,15 @@ public:
         isOpen_m = false;
     }
 
+    // Block signatures are aligned to 8 bytes as in CAS files made by other
+    // tools, and no empty blocks are made
     void addBlock()
     {
-        if(!isValid()) {
+        if(!isValid() || isBlockEmpty_m) {
             return;
         }
+        static constexpr uint8_t padding[casBlockAlign] = {};
+        file_m->write(padding, (casBlockAlign - file_m->pos() % casBlockAlign) % casBlockAlign);
         writeCasHeader();
     }
 
@@ -254,6 +335,7 @@ public:
             return;
         }
         file_m->write(buf, count);
+        isBlockEmpty_m = isBlockEmpty_m && count == 0;
     }
 
     void flush()
@@ -287,7 +369,10 @@ private:
             isValid_m = false;
             return;
         }
+        isBlockEmpty_m = true;
     }
+
+    bool isBlockEmpty_m;
 };
 
 } // namespace
@@ -302,9 +387,9 @@ public:
         captureLog(&file_m);
     }
 
-    virtual void open(const std::string & fileName) override
+    virtual void open(const std::string & fileName, const MemBuf & memBuf) override
     {
-        file_m.open(fileName);
+        file_m.open(fileName, memBuf);
     }
 
     virtual void close() override
@@ -317,6 +402,26 @@ public:
         file_m.nextBlock();
     }
 
+    virtual void seekBlock(size_t blockNum) override
+    {
+        file_m.seekBlock(blockNum);
+    }
+
+    virtual auto blockCount() const -> size_t override
+    {
+        return file_m.blockCount();
+    }
+
+    virtual auto blockNum() const -> size_t override
+    {
+        return file_m.blockNum();
+    }
+
+    virtual auto blockInfo(size_t blockNum) const -> CasBlockInfo override
+    {
+        return file_m.blockInfo(blockNum);
+    }
+
     virtual auto read(uint8_t * buf, size_t count, bool exact = true) -> size_t override
     {
         return file_m.read(buf, count, exact);
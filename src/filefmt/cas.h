@@ -5,6 +5,21 @@
 #include "logging.h"
 #include "fileprober.h"
 
+enum struct CasBlockType: uint8_t {
+    data   = 0x00, // not a header block
+    binary = 0xd0,
+    basic  = 0xd3,
+    ascii  = 0xea
+};
+
+struct CasBlockInfo final
+{
+    size_t offset = 0; // file offset of block data, right after the signature
+    size_t size = 0;
+    CasBlockType type = CasBlockType::data;
+    std::string name;
+};
+
 class CasFileReader:
         public ISequentalReader,
         public Logger
@@ -12,11 +27,17 @@ class CasFileReader:
 public:
     static auto create(size_t bufSize = 4096) -> std::unique_ptr<CasFileReader>;
 
-    virtual void open(const std::string & fileName) = 0;
+    virtual void open(const std::string & fileName, const MemBuf & memBuf = MemBuf()) = 0;
     virtual void close() = 0;
 
     virtual void nextBlock() = 0;
 
+    // Block index is built once on open
+    virtual void seekBlock(size_t blockNum) = 0;
+    virtual auto blockCount() const -> size_t = 0;
+    virtual auto blockNum() const -> size_t = 0;
+    virtual auto blockInfo(size_t blockNum) const -> CasBlockInfo = 0;
+
 private:
     class Impl;
     explicit CasFileReader() = default;
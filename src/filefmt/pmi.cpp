@@ -0,0 +1,316 @@
+#include "pmi.h"
+#include "file.h"
+#include "streamer.h"
+#include "bytes.h"
+#include <cstring>
+
+namespace {
+
+static constexpr uint8_t pmiHeaderSignature[] = { 'P', 'K', '8', '0', '0', '0', 'M', 'I' };
+
+constexpr uint16_t pmiVersion = 1;
+
+struct PmiHeader final
+{
+    uint8_t  signature[8];
+    uint16_t version;
+    uint16_t portCount;
+    uint32_t ramSize;
+
+    void init()
+    {
+        memcpy(signature, pmiHeaderSignature, sizeof(pmiHeaderSignature));
+        version   = pmiVersion;
+        portCount = uint16_t(pmiPortCount);
+        ramSize   = uint32_t(pmiRamSize);
+    }
+
+    void read(Streamer<FileReader> * streamer)
+    {
+        streamer->read(this, 1);
+        if(!streamer->isValid()) {
+            return;
+        }
+        if(memcmp(signature, pmiHeaderSignature, sizeof(pmiHeaderSignature))) {
+            streamer->msg(LogLevel::error, "Invalid PMI file header");
+            streamer->invalidate();
+            return;
+        }
+    #if BYTE_ORDER == BIG_ENDIAN
+        version   = byteswap(version);
+        portCount = byteswap(portCount);
+        ramSize   = byteswap(ramSize);
+    #endif
+        if(version != pmiVersion || portCount != pmiPortCount || ramSize != pmiRamSize) {
+            streamer->msg(LogLevel::error,
+                          "Unsupported PMI file: version %d, %d ports, %d bytes of RAM",
+                          version, portCount, ramSize);
+            streamer->invalidate();
+            return;
+        }
+    }
+
+    void write(Streamer<FileWriter> * streamer)
+    {
+    #if BYTE_ORDER == BIG_ENDIAN
+        PmiHeader pmiHeader = *this;
+        pmiHeader.version   = byteswap(pmiHeader.version);
+        pmiHeader.portCount = byteswap(pmiHeader.portCount);
+        pmiHeader.ramSize   = byteswap(pmiHeader.ramSize);
+    #else
+        PmiHeader & pmiHeader = *this;
+    #endif
+        streamer->write(&pmiHeader, 1);
+    }
+};
+
+#if BYTE_ORDER == BIG_ENDIAN
+void byteswapRegs(PmiRegs * regs)
+{
+    regs->clock = byteswap(regs->clock);
+    regs->state = byteswap(regs->state);
+    regs->psw   = byteswap(regs->psw);
+    regs->bc    = byteswap(regs->bc);
+    regs->de    = byteswap(regs->de);
+    regs->hl    = byteswap(regs->hl);
+    regs->sp    = byteswap(regs->sp);
+    regs->pc    = byteswap(regs->pc);
+}
+#endif
+
+template <typename FileT>
+class PmiFileImpl:
+        public Logger
+{
+public:
+    explicit PmiFileImpl():
+        file_m(FileT::create()), isOpen_m(false)
+    {
+        captureLog(file_m.get());
+    }
+
+    void close()
+    {
+        file_m->close();
+        isOpen_m = false;
+    }
+
+    auto isValid() const -> bool
+    {
+        return (isOpen_m && isValid_m && file_m->isValid());
+    }
+
+    void recover()
+    {
+        file_m->recover();
+        isValid_m = true;
+    }
+
+protected:
+    std::unique_ptr<FileT> file_m;
+    bool isOpen_m;
+    bool isValid_m;
+};
+
+class PmiFileReaderImpl final:
+        public PmiFileImpl<FileReader>
+{
+public:
+    void open(const std::string & fileName, const MemBuf & memBuf)
+    {
+        close();
+
+        file_m->open(fileName, memBuf);
+        if(!file_m->isValid()) {
+            return;
+        }
+
+        PmiHeader pmiHeader;
+        Streamer<FileReader> streamer(file_m.get());
+        pmiHeader.read(&streamer);
+        if(!streamer.isValid()) {
+            return;
+        }
+
+        isOpen_m = true;
+        isValid_m = true;
+    }
+
+    void read(PmiImage * image)
+    {
+        if(!isValid()) {
+            return;
+        }
+
+        Streamer<FileReader> streamer(file_m.get());
+        streamer.read(&image->regs, 1);
+        streamer.read(image->ports.data(), image->ports.size());
+        streamer.read(image->ram.data(), image->ram.size());
+        if(!streamer.isValid()) {
+            isValid_m = false;
+            return;
+        }
+    #if BYTE_ORDER == BIG_ENDIAN
+        byteswapRegs(&image->regs);
+    #endif
+    }
+};
+
+class PmiFileWriterImpl final:
+        public PmiFileImpl<FileWriter>
+{
+public:
+    void open(const std::string & fileName)
+    {
+        close();
+
+        file_m->open(fileName, true);
+        if(!file_m->isValid()) {
+            return;
+        }
+
+        isOpen_m = true;
+        isValid_m = true;
+    }
+
+    void write(const PmiImage & image)
+    {
+        if(!isValid()) {
+            return;
+        }
+
+        PmiHeader pmiHeader;
+        pmiHeader.init();
+
+        PmiRegs regs = image.regs;
+    #if BYTE_ORDER == BIG_ENDIAN
+        byteswapRegs(&regs);
+    #endif
+
+        // Image is written as a whole, so the file is rewritten from scratch
+        file_m->seek(0);
+        Streamer<FileWriter> streamer(file_m.get());
+        pmiHeader.write(&streamer);
+        streamer.write(&regs, 1);
+        streamer.write(image.ports.data(), image.ports.size());
+        streamer.write(image.ram.data(), image.ram.size());
+        streamer.flush();
+        if(!streamer.isValid()) {
+            isValid_m = false;
+            return;
+        }
+    }
+};
+
+} // namespace
+
+class PmiFileReader::Impl final:
+        public PmiFileReader
+{
+public:
+    explicit Impl()
+    {
+        captureLog(&file_m);
+    }
+
+    virtual void open(const std::string & fileName, const MemBuf & memBuf) override
+    {
+        file_m.open(fileName, memBuf);
+    }
+
+    virtual void close() override
+    {
+        file_m.close();
+    }
+
+    virtual void read(PmiImage * image) override
+    {
+        file_m.read(image);
+    }
+
+    virtual auto isValid() const -> bool override
+    {
+        return file_m.isValid();
+    }
+
+    virtual void recover() override
+    {
+        file_m.recover();
+    }
+
+private:
+    PmiFileReaderImpl file_m;
+};
+
+auto PmiFileReader::create() -> std::unique_ptr<PmiFileReader>
+{
+    return std::make_unique<Impl>();
+}
+
+class PmiFileWriter::Impl final:
+        public PmiFileWriter
+{
+public:
+    explicit Impl()
+    {
+        captureLog(&file_m);
+    }
+
+    virtual void open(const std::string & fileName) override
+    {
+        file_m.open(fileName);
+    }
+
+    virtual void close() override
+    {
+        file_m.close();
+    }
+
+    virtual void write(const PmiImage & image) override
+    {
+        file_m.write(image);
+    }
+
+    virtual auto isValid() const -> bool override
+    {
+        return file_m.isValid();
+    }
+
+    virtual void recover() override
+    {
+        file_m.recover();
+    }
+
+private:
+    PmiFileWriterImpl file_m;
+};
+
+auto PmiFileWriter::create() -> std::unique_ptr<PmiFileWriter>
+{
+    return std::make_unique<Impl>();
+}
+
+class PmiFileProber::Impl:
+        public PmiFileProber
+{
+public:
+    virtual auto probe(FileReader * file) -> bool override
+    {
+        PmiHeader pmiHeader;
+
+        Streamer<FileReader> streamer(file);
+        streamer.read(pmiHeader.signature, sizeof(pmiHeader.signature) / sizeof(pmiHeader.signature[0]));
+        if(!streamer.isValid()) {
+            return false;
+        }
+        if(memcmp(pmiHeader.signature, pmiHeaderSignature, sizeof(pmiHeaderSignature))) {
+            return false;
+        }
+        return true;
+    }
+};
+
+auto PmiFileProber::create() -> std::unique_ptr<PmiFileProber>
+{
+    return std::make_unique<Impl>();
+}
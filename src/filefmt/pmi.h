@@ -0,0 +1,81 @@
+#ifndef PMI_H
+#define PMI_H
+
+#include "streams.h"
+#include "logging.h"
+#include "fileprober.h"
+#include <array>
+
+constexpr size_t pmiRamSize   = 65536;
+constexpr size_t pmiPortBase  = 0x80;
+constexpr size_t pmiPortCount = 32; // ports 80h..9fh
+
+struct PmiRegs final
+{
+    uint32_t clock = 0;
+    uint16_t state = 0;
+    uint16_t psw = 0x0002;
+    uint16_t bc = 0;
+    uint16_t de = 0;
+    uint16_t hl = 0;
+    uint16_t sp = 0;
+    uint16_t pc = 0;
+    uint16_t reserved = 0; // pads to the size streamed, so no garbage gets saved
+};
+
+// Memory image: machine state sufficient to continue execution right away,
+// e.g. a program already loaded from tape
+
+struct PmiImage final
+{
+    PmiRegs regs;
+    std::array<uint8_t, pmiPortCount> ports; // indexed by port number minus pmiPortBase
+    std::array<uint8_t, pmiRamSize> ram;
+};
+
+class PmiFileReader:
+        public IStream,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<PmiFileReader>;
+
+    virtual void open(const std::string & fileName, const MemBuf & memBuf = MemBuf()) = 0;
+    virtual void close() = 0;
+
+    virtual void read(PmiImage * image) = 0;
+
+private:
+    class Impl;
+    explicit PmiFileReader() = default;
+};
+
+class PmiFileWriter:
+        public IStream,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<PmiFileWriter>;
+
+    virtual void open(const std::string & fileName) = 0;
+    virtual void close() = 0;
+
+    virtual void write(const PmiImage & image) = 0;
+
+private:
+    class Impl;
+    explicit PmiFileWriter() = default;
+};
+
+class PmiFileProber:
+        public FileProber
+{
+public:
+    static auto create() -> std::unique_ptr<PmiFileProber>;
+
+private:
+    class Impl;
+    explicit PmiFileProber() = default;
+};
+
+#endif // PMI_H
@@ -0,0 +1,595 @@
+#include "pwe.h"
+#include "file.h"
+#include "streamer.h"
+#include "bytes.h"
+#include <vector>
+#include <cstring>
+
+namespace {
+
+static constexpr uint8_t pweHeaderSignature[] = { 'P', 'K', '8', '0', '0', '0', 'W', 'E' };
+
+constexpr uint16_t pweVersion = 1;
+
+constexpr size_t pweMaxEdgeSize = 10; // LEB128 encoded 64-bit delta
+constexpr size_t pweBlockNameSize = 6;
+
+struct PweHeader final
+{
+    uint8_t  signature[8];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t clockRate;
+    uint32_t blockCount;
+    uint32_t indexOffset; // zero if the file was not closed properly
+    uint64_t edgeCount;
+
+    void init(uint32_t rate)
+    {
+        memcpy(signature, pweHeaderSignature, sizeof(pweHeaderSignature));
+        version     = pweVersion;
+        reserved    = 0;
+        clockRate   = rate;
+        blockCount  = 0;
+        indexOffset = 0;
+        edgeCount   = 0;
+    }
+
+    void read(Streamer<FileReader> * streamer)
+    {
+        streamer->read(this, 1);
+        if(!streamer->isValid()) {
+            return;
+        }
+        if(memcmp(signature, pweHeaderSignature, sizeof(pweHeaderSignature))) {
+            streamer->msg(LogLevel::error, "Invalid PWE file header");
+            streamer->invalidate();
+            return;
+        }
+    #if BYTE_ORDER == BIG_ENDIAN
+        version     = byteswap(version);
+        clockRate   = byteswap(clockRate);
+        blockCount  = byteswap(blockCount);
+        indexOffset = byteswap(indexOffset);
+        edgeCount   = byteswap(edgeCount);
+    #endif
+        if(version != pweVersion || clockRate == 0) {
+            streamer->msg(LogLevel::error, "Unsupported PWE file: version %d, clock rate %d",
+                          version, clockRate);
+            streamer->invalidate();
+            return;
+        }
+    }
+
+    void write(Streamer<FileWriter> * streamer)
+    {
+    #if BYTE_ORDER == BIG_ENDIAN
+        PweHeader pweHeader = *this;
+        pweHeader.version     = byteswap(pweHeader.version);
+        pweHeader.clockRate   = byteswap(pweHeader.clockRate);
+        pweHeader.blockCount  = byteswap(pweHeader.blockCount);
+        pweHeader.indexOffset = byteswap(pweHeader.indexOffset);
+        pweHeader.edgeCount   = byteswap(pweHeader.edgeCount);
+    #else
+        PweHeader & pweHeader = *this;
+    #endif
+        streamer->write(&pweHeader, 1);
+    }
+};
+
+struct PweIndexEntry final
+{
+    uint64_t clock;
+    uint32_t offset;
+    uint32_t edgeNum;
+    uint8_t  type;
+    uint8_t  name[pweBlockNameSize];
+    uint8_t  reserved;
+
+    void swapBytes()
+    {
+    #if BYTE_ORDER == BIG_ENDIAN
+        clock   = byteswap(clock);
+        offset  = byteswap(offset);
+        edgeNum = byteswap(edgeNum);
+    #endif
+    }
+};
+
+template <typename FileT>
+class PweFileImpl:
+        public Logger
+{
+public:
+    explicit PweFileImpl(size_t bufSize):
+        file_m(FileT::create()), buf_m(std::max(bufSize, pweMaxEdgeSize * 2)), isOpen_m(false)
+    {
+        captureLog(file_m.get());
+        pweHeader_m.init(pweDefaultClockRate);
+    }
+
+    auto isValid() const -> bool
+    {
+        return (isOpen_m && isValid_m && file_m->isValid());
+    }
+
+    void recover()
+    {
+        file_m->recover();
+        isValid_m = true;
+    }
+
+protected:
+    std::unique_ptr<FileT> file_m;
+    std::vector<uint8_t> buf_m;
+    PweHeader pweHeader_m;
+    bool isOpen_m;
+    bool isValid_m;
+};
+
+class PweFileReaderImpl final:
+        public PweFileImpl<FileReader>
+{
+public:
+    explicit PweFileReaderImpl(size_t bufSize):
+        PweFileImpl(bufSize)
+    {}
+
+    void open(const std::string & fileName, const MemBuf & memBuf)
+    {
+        close();
+
+        file_m->open(fileName, memBuf);
+        if(!file_m->isValid()) {
+            return;
+        }
+
+        Streamer<FileReader> streamer(file_m.get());
+        pweHeader_m.read(&streamer);
+        if(!streamer.isValid()) {
+            return;
+        }
+
+        loadBlockIndex();
+        if(!file_m->isValid()) {
+            return;
+        }
+
+        isOpen_m = true;
+        isValid_m = true;
+
+        seekBlock(0);
+    }
+
+    void close()
+    {
+        file_m->close();
+        isOpen_m = false;
+        blocks_m.clear();
+    }
+
+    auto clockRate() const -> uint32_t
+    {
+        return pweHeader_m.clockRate;
+    }
+
+    // Edges are decoded straight from the read buffer, so the cost per edge
+    // is a few byte operations
+    auto nextEdge() -> uint64_t
+    {
+        if(bufPos_m + pweMaxEdgeSize > bufEnd_m && !fillBuf()) {
+            return pweEndOfTape;
+        }
+
+        uint64_t delta = 0;
+        unsigned shift = 0;
+        uint8_t data;
+        do {
+            if(bufPos_m >= bufEnd_m || shift >= 64) {
+                msg(LogLevel::error, "Truncated or corrupted PWE edge data");
+                isValid_m = false;
+                return pweEndOfTape;
+            }
+            data = buf_m[bufPos_m++];
+            delta |= uint64_t(data & 0x7f) << shift;
+            shift += 7;
+        } while(data & 0x80);
+
+        clock_m += delta;
+        ++edgeNum_m;
+        return clock_m;
+    }
+
+    auto edgeNum() const -> size_t
+    {
+        return edgeNum_m;
+    }
+
+    auto isEof() const -> bool
+    {
+        return (!isOpen_m || (bufPos_m >= bufEnd_m && dataLeft_m == 0));
+    }
+
+    void seekBlock(size_t blockNum)
+    {
+        if(!isOpen_m) {
+            return;
+        }
+        if(blockNum >= blocks_m.size()) {
+            msg(LogLevel::error, "PWE block number is out of range");
+            isValid_m = false;
+            return;
+        }
+
+        const PweBlockInfo & block = blocks_m[blockNum];
+        file_m->recover();
+        file_m->seek(block.offset);
+        dataLeft_m = dataEnd_m - block.offset;
+        bufPos_m = bufEnd_m = 0;
+        clock_m = block.clock;
+        edgeNum_m = block.edgeNum;
+        isValid_m = file_m->isValid();
+    }
+
+    auto blockCount() const -> size_t
+    {
+        return blocks_m.size();
+    }
+
+    auto blockInfo(size_t blockNum) const -> PweBlockInfo
+    {
+        return (blockNum < blocks_m.size() ? blocks_m[blockNum] : PweBlockInfo());
+    }
+
+private:
+    auto fillBuf() -> bool
+    {
+        if(!isValid()) {
+            return false;
+        }
+
+        memmove(buf_m.data(), buf_m.data() + bufPos_m, bufEnd_m - bufPos_m);
+        bufEnd_m -= bufPos_m;
+        bufPos_m = 0;
+
+        size_t count = file_m->read(buf_m.data() + bufEnd_m, std::min(buf_m.size() - bufEnd_m, dataLeft_m), false);
+        dataLeft_m -= count;
+        bufEnd_m += count;
+        return (bufEnd_m > 0);
+    }
+
+    void loadBlockIndex()
+    {
+        blocks_m.clear();
+
+        size_t dataBegin = file_m->pos();
+        file_m->seek(0, SeekOrigin::end);
+        dataEnd_m = file_m->pos();
+        if(!file_m->isValid()) {
+            return;
+        }
+
+        if(pweHeader_m.indexOffset != 0 && pweHeader_m.indexOffset >= dataBegin &&
+                pweHeader_m.indexOffset + pweHeader_m.blockCount * sizeof(PweIndexEntry) <= dataEnd_m)
+        {
+            dataEnd_m = pweHeader_m.indexOffset;
+            file_m->seek(pweHeader_m.indexOffset);
+            Streamer<FileReader> streamer(file_m.get());
+            for(size_t i = 0; i < pweHeader_m.blockCount; ++i) {
+                PweIndexEntry entry;
+                streamer.read(&entry, 1);
+                if(!streamer.isValid()) {
+                    return;
+                }
+                entry.swapBytes();
+                PweBlockInfo block;
+                block.offset = entry.offset;
+                block.edgeNum = entry.edgeNum;
+                block.clock = entry.clock;
+                block.type = entry.type;
+                if(entry.type != 0) {
+                    block.name.assign(reinterpret_cast<const char *>(entry.name), pweBlockNameSize);
+                }
+                blocks_m.push_back(block);
+            }
+        } else {
+            msg(LogLevel::warn, "PWE file has no block index, treated as a single block");
+        }
+
+        if(blocks_m.empty() || blocks_m.front().offset != dataBegin) {
+            PweBlockInfo block;
+            block.offset = dataBegin;
+            blocks_m.insert(blocks_m.begin(), block);
+        }
+    }
+
+    std::vector<PweBlockInfo> blocks_m;
+    size_t dataEnd_m;
+    size_t dataLeft_m;
+    size_t bufPos_m;
+    size_t bufEnd_m;
+    uint64_t clock_m;
+    size_t edgeNum_m;
+};
+
+class PweFileWriterImpl final:
+        public PweFileImpl<FileWriter>
+{
+public:
+    explicit PweFileWriterImpl(size_t bufSize):
+        PweFileImpl(bufSize)
+    {}
+
+    void open(const std::string & fileName, uint32_t clockRate)
+    {
+        close();
+
+        file_m->open(fileName, true);
+        if(!file_m->isValid()) {
+            return;
+        }
+
+        isOpen_m = true;
+        isValid_m = true;
+
+        pweHeader_m.init(clockRate);
+        Streamer<FileWriter> streamer(file_m.get());
+        pweHeader_m.write(&streamer);
+        if(!streamer.isValid()) {
+            isValid_m = false;
+            return;
+        }
+
+        index_m.clear();
+        bufEnd_m = 0;
+        offset_m = sizeof(PweHeader);
+        clock_m = 0;
+    }
+
+    void close()
+    {
+        if(isValid()) {
+            writeBuf();
+            writeBlockIndex();
+        }
+
+        file_m->close();
+        isOpen_m = false;
+    }
+
+    void addBlock(uint8_t type, const std::string & name)
+    {
+        if(!isValid()) {
+            return;
+        }
+
+        PweIndexEntry entry = {};
+        entry.clock = clock_m;
+        entry.offset = uint32_t(offset_m + bufEnd_m);
+        entry.edgeNum = uint32_t(pweHeader_m.edgeCount);
+        entry.type = type;
+        memcpy(entry.name, name.data(), std::min(name.size(), pweBlockNameSize));
+        index_m.push_back(entry);
+    }
+
+    void writeEdge(uint64_t clock)
+    {
+        if(!isValid()) {
+            return;
+        }
+        if(clock < clock_m) {
+            msg(LogLevel::error, "PWE edges must be written in order of time");
+            isValid_m = false;
+            return;
+        }
+
+        if(bufEnd_m + pweMaxEdgeSize > buf_m.size()) {
+            writeBuf();
+        }
+
+        uint64_t delta = clock - clock_m;
+        do {
+            uint8_t data = uint8_t(delta & 0x7f);
+            delta >>= 7;
+            buf_m[bufEnd_m++] = (delta != 0 ? data | 0x80 : data);
+        } while(delta != 0);
+
+        clock_m = clock;
+        ++pweHeader_m.edgeCount;
+    }
+
+    void flush()
+    {
+        if(!isValid()) {
+            return;
+        }
+        writeBuf();
+        file_m->flush();
+    }
+
+private:
+    void writeBuf()
+    {
+        file_m->write(buf_m.data(), bufEnd_m);
+        offset_m += bufEnd_m;
+        bufEnd_m = 0;
+    }
+
+    void writeBlockIndex()
+    {
+        Streamer<FileWriter> streamer(file_m.get());
+        for(PweIndexEntry entry: index_m) {
+            entry.swapBytes();
+            streamer.write(&entry, 1);
+        }
+
+        pweHeader_m.blockCount = uint32_t(index_m.size());
+        pweHeader_m.indexOffset = uint32_t(offset_m);
+        streamer.seek(0);
+        pweHeader_m.write(&streamer);
+        streamer.flush();
+        if(!streamer.isValid()) {
+            isValid_m = false;
+        }
+    }
+
+    std::vector<PweIndexEntry> index_m;
+    size_t bufEnd_m;
+    size_t offset_m;
+    uint64_t clock_m;
+};
+
+} // namespace
+
+class PweFileReader::Impl final:
+        public PweFileReader
+{
+public:
+    explicit Impl(size_t bufSize):
+        file_m(bufSize)
+    {
+        captureLog(&file_m);
+    }
+
+    virtual void open(const std::string & fileName, const MemBuf & memBuf) override
+    {
+        file_m.open(fileName, memBuf);
+    }
+
+    virtual void close() override
+    {
+        file_m.close();
+    }
+
+    virtual auto clockRate() const -> uint32_t override
+    {
+        return file_m.clockRate();
+    }
+
+    virtual auto nextEdge() -> uint64_t override
+    {
+        return file_m.nextEdge();
+    }
+
+    virtual auto edgeNum() const -> size_t override
+    {
+        return file_m.edgeNum();
+    }
+
+    virtual auto isEof() const -> bool override
+    {
+        return file_m.isEof();
+    }
+
+    virtual void seekBlock(size_t blockNum) override
+    {
+        file_m.seekBlock(blockNum);
+    }
+
+    virtual auto blockCount() const -> size_t override
+    {
+        return file_m.blockCount();
+    }
+
+    virtual auto blockInfo(size_t blockNum) const -> PweBlockInfo override
+    {
+        return file_m.blockInfo(blockNum);
+    }
+
+    virtual auto isValid() const -> bool override
+    {
+        return file_m.isValid();
+    }
+
+    virtual void recover() override
+    {
+        file_m.recover();
+    }
+
+private:
+    PweFileReaderImpl file_m;
+};
+
+auto PweFileReader::create(size_t bufSize) -> std::unique_ptr<PweFileReader>
+{
+    return std::make_unique<Impl>(bufSize);
+}
+
+class PweFileWriter::Impl final:
+        public PweFileWriter
+{
+public:
+    explicit Impl(size_t bufSize):
+        file_m(bufSize)
+    {
+        captureLog(&file_m);
+    }
+
+    virtual void open(const std::string & fileName, uint32_t clockRate) override
+    {
+        file_m.open(fileName, clockRate);
+    }
+
+    virtual void close() override
+    {
+        file_m.close();
+    }
+
+    virtual void addBlock(uint8_t type, const std::string & name) override
+    {
+        file_m.addBlock(type, name);
+    }
+
+    virtual void writeEdge(uint64_t clock) override
+    {
+        file_m.writeEdge(clock);
+    }
+
+    virtual void flush() override
+    {
+        file_m.flush();
+    }
+
+    virtual auto isValid() const -> bool override
+    {
+        return file_m.isValid();
+    }
+
+    virtual void recover() override
+    {
+        file_m.recover();
+    }
+
+private:
+    PweFileWriterImpl file_m;
+};
+
+auto PweFileWriter::create(size_t bufSize) -> std::unique_ptr<PweFileWriter>
+{
+    return std::make_unique<Impl>(bufSize);
+}
+
+class PweFileProber::Impl:
+        public PweFileProber
+{
+public:
+    virtual auto probe(FileReader * file) -> bool override
+    {
+        PweHeader pweHeader;
+
+        Streamer<FileReader> streamer(file);
+        streamer.read(pweHeader.signature, sizeof(pweHeader.signature) / sizeof(pweHeader.signature[0]));
+        if(!streamer.isValid()) {
+            return false;
+        }
+        if(memcmp(pweHeader.signature, pweHeaderSignature, sizeof(pweHeaderSignature))) {
+            return false;
+        }
+        return true;
+    }
+};
+
+auto PweFileProber::create() -> std::unique_ptr<PweFileProber>
+{
+    return std::make_unique<Impl>();
+}
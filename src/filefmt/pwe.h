@@ -0,0 +1,82 @@
+#ifndef PWE_H
+#define PWE_H
+
+#include "streams.h"
+#include "logging.h"
+#include "fileprober.h"
+
+// Wave edges: tape signal stored as delta encoded edge timestamps in clocks
+// of the given rate, every edge toggles the signal level starting from low
+
+constexpr uint32_t pweDefaultClockRate = 2464000; // cpu clocks per second
+
+constexpr uint64_t pweEndOfTape = UINT64_MAX;
+
+struct PweBlockInfo final
+{
+    size_t offset = 0;  // file offset of the first block edge
+    size_t edgeNum = 0; // number of edges preceding the block
+    uint64_t clock = 0; // timestamp of the last edge preceding the block
+    uint8_t type = 0;   // CAS header type byte if known, zero otherwise
+    std::string name;
+};
+
+class PweFileReader:
+        public IStream,
+        public Logger
+{
+public:
+    static auto create(size_t bufSize = 4096) -> std::unique_ptr<PweFileReader>;
+
+    virtual void open(const std::string & fileName, const MemBuf & memBuf = MemBuf()) = 0;
+    virtual void close() = 0;
+
+    virtual auto clockRate() const -> uint32_t = 0;
+
+    // Returns timestamp of the next edge or pweEndOfTape
+    virtual auto nextEdge() -> uint64_t = 0;
+    virtual auto edgeNum() const -> size_t = 0;
+    virtual auto isEof() const -> bool = 0;
+
+    // Block index is loaded once on open
+    virtual void seekBlock(size_t blockNum) = 0;
+    virtual auto blockCount() const -> size_t = 0;
+    virtual auto blockInfo(size_t blockNum) const -> PweBlockInfo = 0;
+
+private:
+    class Impl;
+    explicit PweFileReader() = default;
+};
+
+class PweFileWriter:
+        public IStream,
+        public Logger
+{
+public:
+    static auto create(size_t bufSize = 4096) -> std::unique_ptr<PweFileWriter>;
+
+    // Block index is written on close
+    virtual void open(const std::string & fileName, uint32_t clockRate = pweDefaultClockRate) = 0;
+    virtual void close() = 0;
+
+    virtual void addBlock(uint8_t type = 0, const std::string & name = std::string()) = 0;
+    virtual void writeEdge(uint64_t clock) = 0;
+    virtual void flush() = 0;
+
+private:
+    class Impl;
+    explicit PweFileWriter() = default;
+};
+
+class PweFileProber:
+        public FileProber
+{
+public:
+    static auto create() -> std::unique_ptr<PweFileProber>;
+
+private:
+    class Impl;
+    explicit PweFileProber() = default;
+};
+
+#endif // PWE_H
@@ -3,6 +3,12 @@
 #include "streamer.h"
 #include "bytes.h"
 #include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
 
 namespace {
 
@@ -250,11 +256,11 @@ class WavFileReaderImpl final:
         public WavFileImpl<FileReader>
 {
 public:
-    void open(const std::string & fileName)
+    void open(const std::string & fileName, const MemBuf & memBuf)
     {
         close();
 
-        file_m->open(fileName);
+        file_m->open(fileName, memBuf);
         if(!file_m->isValid()) {
             return;
         }
@@ -421,9 +427,9 @@ public:
         captureLog(&file_m);
     }
 
-    virtual void open(const std::string & fileName) override
+    virtual void open(const std::string & fileName, const MemBuf & memBuf) override
     {
-        file_m.open(fileName);
+        file_m.open(fileName, memBuf);
     }
 
     virtual void close() override
@@ -565,12 +571,136 @@ auto WavFileProber::create() -> std::unique_ptr<WavFileProber>
     return std::make_unique<Impl>();
 }
 
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+constexpr size_t resamplerPhaseCount = 256;
+constexpr double resamplerPassband   = 0.95; // fraction of the lower Nyquist frequency
+
+constexpr int bestChannelProbeDivisor = 2; // probe for half a second
+
+auto dotProduct(const float * a, const float * b, size_t count) -> float
+{
+#if defined(__SSE__)
+    // Tap count is always a multiple of 4
+    __m128 sum = _mm_setzero_ps();
+    for(size_t i = 0; i < count; i += 4) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#else
+    float sum = 0;
+    for(size_t i = 0; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+// Polyphase windowed sinc resampler. Output position is kept in 32.32 fixed
+// point relative to the newest input sample, so it never overflows
+class Resampler final
+{
+public:
+    void init(int sourceRate, int targetRate, size_t tapCount)
+    {
+        tapCount_m = tapCount;
+        step_m = int64_t((uint64_t(sourceRate) << 32) / uint64_t(targetRate));
+
+        double cutoff = resamplerPassband * std::min(1.0, double(targetRate) / double(sourceRate));
+        double halfWidth = double(tapCount / 2);
+        filter_m.resize(resamplerPhaseCount * tapCount);
+        for(size_t phase = 0; phase < resamplerPhaseCount; ++phase) {
+            float * taps = filter_m.data() + phase * tapCount;
+            double sum = 0;
+            for(size_t i = 0; i < tapCount; ++i) {
+                // Distance from the output position to the input sample
+                double t = double(tapCount / 2 - 1 - i) + double(phase) / resamplerPhaseCount;
+                double x = pi * cutoff * t;
+                double sinc = (x == 0 ? 1.0 : sin(x) / x);
+                double w = t / halfWidth;
+                double window = 0.42 + 0.5 * cos(pi * w) + 0.08 * cos(2 * pi * w);
+                taps[i] = float(sinc * window);
+                sum += taps[i];
+            }
+            for(size_t i = 0; i < tapCount; ++i) {
+                taps[i] = float(taps[i] / sum);
+            }
+        }
+
+        // History is stored twice in a row, so the window is always contiguous
+        history_m.assign(tapCount * 2, 0.0f);
+        historyPos_m = 0;
+        pos_m = int64_t(tapCount / 2) << 32;
+    }
+
+    auto needsInput() const -> bool
+    {
+        return (pos_m >= 0);
+    }
+
+    void push(float sample)
+    {
+        history_m[historyPos_m] = sample;
+        history_m[historyPos_m + tapCount_m] = sample;
+        historyPos_m = (historyPos_m + 1) % tapCount_m;
+        pos_m -= int64_t(1) << 32;
+    }
+
+    auto pull() -> float
+    {
+        size_t phase = (uint64_t(pos_m) & 0xffffffff) >> 24;
+        float sample = dotProduct(history_m.data() + historyPos_m, filter_m.data() + phase * tapCount_m, tapCount_m);
+        pos_m += step_m;
+        return sample;
+    }
+
+private:
+    size_t tapCount_m = 0;
+    int64_t step_m = 0;
+    std::vector<float> filter_m;
+    std::vector<float> history_m;
+    size_t historyPos_m = 0;
+    int64_t pos_m = 0;
+};
+
+// Signal to noise estimate: tape signal is mostly low frequency, so broadband
+// noise shows up as a large sample to sample difference
+struct ChannelStats final
+{
+    double sum = 0;
+    double sumSquares = 0;
+    double sumDiffSquares = 0;
+    float lastSample = 0;
+
+    void add(float sample)
+    {
+        sum += sample;
+        sumSquares += double(sample) * sample;
+        sumDiffSquares += double(sample - lastSample) * (sample - lastSample);
+        lastSample = sample;
+    }
+
+    auto score(uint64_t count) const -> double
+    {
+        double mean = sum / double(count);
+        double variance = sumSquares / double(count) - mean * mean;
+        return variance / (sumDiffSquares / double(count) + 1.0);
+    }
+};
+
+} // namespace
+
 class WavCvt::Impl final:
         public WavCvt
 {
 public:
     explicit Impl():
-        sourceChannel_m(0), isValid_m(true)
+        sourceChannel_m(0), downmix_m(WavDownmix::channel), quality_m(WavResampleQuality::medium),
+        isValid_m(true), isPrepared_m(false)
     {}
 
     virtual void setSourceParams(const WavParams & params) override
@@ -586,6 +716,7 @@ public:
         }
         sourceParams_m = params;
         isValid_m = true;
+        isPrepared_m = false;
     }
 
     virtual void setTargetParams(const WavParams & params) override
@@ -602,6 +733,7 @@ public:
         }
         targetParams_m = params;
         isValid_m = true;
+        isPrepared_m = false;
     }
 
     virtual void setSourceChannel(int channel) override
@@ -614,19 +746,32 @@ public:
         sourceChannel_m = channel;
     }
 
+    virtual void setDownmix(WavDownmix downmix) override
+    {
+        downmix_m = downmix;
+        isPrepared_m = false;
+    }
+
+    virtual void setResampleQuality(WavResampleQuality quality) override
+    {
+        quality_m = quality;
+        isPrepared_m = false;
+    }
+
     virtual void convert(Slice<const uint8_t> * source, Slice<uint8_t> * target) override
     {
         if(!isValid()) {
             return;
         }
-
-        if(sourceParams_m.sampleRate != targetParams_m.sampleRate) {
-            msg(LogLevel::error, "Resampling isn't supported for WAV converter");
-            isValid_m = false;
-            return;
+        if(!isPrepared_m) {
+            prepare();
         }
 
-        convertSamples(source, target);
+        if(isResampling_m || downmix_m != WavDownmix::channel) {
+            convertSamples<true>(source, target);
+        } else {
+            convertSamples<false>(source, target);
+        }
     }
 
     virtual auto isValid() const -> bool override
@@ -646,14 +791,31 @@ private:
                 (params.bitsPerSample == 8 || params.bitsPerSample == 16));
     }
 
+    void prepare()
+    {
+        isResampling_m = (sourceParams_m.sampleRate != targetParams_m.sampleRate);
+        if(isResampling_m) {
+            size_t tapCount = (quality_m == WavResampleQuality::low ? 8 :
+                               quality_m == WavResampleQuality::high ? 32 : 16);
+            resampler_m.init(sourceParams_m.sampleRate, targetParams_m.sampleRate, tapCount);
+        }
+
+        bestChannel_m = -1;
+        probeCount_m = 0;
+        channelStats_m.assign(size_t(sourceParams_m.numChannels), ChannelStats());
+
+        isPrepared_m = true;
+    }
+
+    template <bool isGeneric>
     void convertSamples(Slice<const uint8_t> * source, Slice<uint8_t> * target)
     {
         switch(sourceParams_m.bitsPerSample) {
             case 8:
-                convertSamples<uint8_t>(source, target);
+                convertSamples<isGeneric, uint8_t>(source, target);
                 break;
             case 16:
-                convertSamples<int16_t>(source, target);
+                convertSamples<isGeneric, int16_t>(source, target);
                 break;
             default:
                 msg(LogLevel::error, "Unsupported source sample type for WAV converter");
@@ -662,15 +824,15 @@ private:
         }
     }
 
-    template <typename SourceSampleT>
+    template <bool isGeneric, typename SourceSampleT>
     void convertSamples(Slice<const uint8_t> * source, Slice<uint8_t> * target)
     {
         switch(targetParams_m.bitsPerSample) {
             case 8:
-                convertSamples<SourceSampleT, uint8_t>(source, target);
+                convertSamples<isGeneric, SourceSampleT, uint8_t>(source, target);
                 break;
             case 16:
-                convertSamples<SourceSampleT, int16_t>(source, target);
+                convertSamples<isGeneric, SourceSampleT, int16_t>(source, target);
                 break;
             default:
                 msg(LogLevel::error, "Unsupported target sample type for WAV converter");
@@ -679,8 +841,18 @@ private:
         }
     }
 
-    template <typename SourceSampleT, typename TargetSampleT>
+    template <bool isGeneric, typename SourceSampleT, typename TargetSampleT>
     void convertSamples(Slice<const uint8_t> * source, Slice<uint8_t> * target)
+    {
+        if constexpr(isGeneric) {
+            mixSamples<SourceSampleT, TargetSampleT>(source, target);
+        } else {
+            copySamples<SourceSampleT, TargetSampleT>(source, target);
+        }
+    }
+
+    template <typename SourceSampleT, typename TargetSampleT>
+    void copySamples(Slice<const uint8_t> * source, Slice<uint8_t> * target)
     {
         auto s = reinterpret_cast<Slice<const SourceSampleT> *>(source);
         auto t = reinterpret_cast<Slice<TargetSampleT> *>(target);
@@ -692,6 +864,104 @@ private:
         }
     }
 
+    // Samples are processed as floats in 16-bit scale
+    template <typename SourceSampleT, typename TargetSampleT>
+    void mixSamples(Slice<const uint8_t> * source, Slice<uint8_t> * target)
+    {
+        auto s = reinterpret_cast<Slice<const SourceSampleT> *>(source);
+        auto t = reinterpret_cast<Slice<TargetSampleT> *>(target);
+
+        size_t numChannels = size_t(sourceParams_m.numChannels);
+        while(t->count() > 0) {
+            if(isResampling_m && !resampler_m.needsInput()) {
+                storeSample(resampler_m.pull(), t->data());
+                t->advance(1);
+                continue;
+            }
+            if(s->count() < numChannels) {
+                break;
+            }
+            float sample = downmixFrame(s->data());
+            s->advance(numChannels);
+            if(isResampling_m) {
+                resampler_m.push(sample);
+            } else {
+                storeSample(sample, t->data());
+                t->advance(1);
+            }
+        }
+    }
+
+    template <typename SourceSampleT>
+    auto downmixFrame(const SourceSampleT * frame) -> float
+    {
+        switch(downmix_m) {
+            case WavDownmix::channel:
+                return loadSample(frame + sourceChannel_m);
+            case WavDownmix::average:
+                return averageFrame(frame);
+            case WavDownmix::bestChannel:
+                if(bestChannel_m >= 0) {
+                    return loadSample(frame + bestChannel_m);
+                }
+                probeFrame(frame);
+                return averageFrame(frame);
+        }
+        return 0;
+    }
+
+    template <typename SourceSampleT>
+    auto averageFrame(const SourceSampleT * frame) const -> float
+    {
+        float sum = 0;
+        for(int i = 0; i < sourceParams_m.numChannels; ++i) {
+            sum += loadSample(frame + i);
+        }
+        return sum / float(sourceParams_m.numChannels);
+    }
+
+    // Average is used until enough statistics are gathered to pick a channel
+    template <typename SourceSampleT>
+    void probeFrame(const SourceSampleT * frame)
+    {
+        for(int i = 0; i < sourceParams_m.numChannels; ++i) {
+            channelStats_m[size_t(i)].add(loadSample(frame + i));
+        }
+        if(++probeCount_m < uint64_t(sourceParams_m.sampleRate / bestChannelProbeDivisor)) {
+            return;
+        }
+
+        bestChannel_m = 0;
+        for(int i = 1; i < sourceParams_m.numChannels; ++i) {
+            if(channelStats_m[size_t(i)].score(probeCount_m) > channelStats_m[size_t(bestChannel_m)].score(probeCount_m)) {
+                bestChannel_m = i;
+            }
+        }
+        msg(LogLevel::info, "WAV converter picked channel %d as the best one", bestChannel_m);
+    }
+
+    static auto loadSample(const uint8_t * source) -> float
+    {
+        return float((int(*source) - 0x80) << 8);
+    }
+
+    static auto loadSample(const int16_t * source) -> float
+    {
+        return float(*source);
+    }
+
+    static void storeSample(float sample, uint8_t * target)
+    {
+        sample = std::min(std::max(floorf(sample / 256.0f), -128.0f), 127.0f);
+        *target = uint8_t(int(sample) + 0x80);
+    }
+
+    static void storeSample(float sample, int16_t * target)
+    {
+        sample = std::min(std::max(floorf(sample + 0.5f), -32768.0f), 32767.0f);
+        *target = int16_t(sample);
+    }
+
     void convertSample(const uint8_t * source, uint8_t * target)
     {
         *target = *source;
@@ -715,7 +985,15 @@ private:
     WavParams sourceParams_m;
     WavParams targetParams_m;
     int sourceChannel_m;
+    WavDownmix downmix_m;
+    WavResampleQuality quality_m;
     bool isValid_m;
+    bool isPrepared_m;
+    bool isResampling_m;
+    Resampler resampler_m;
+    int bestChannel_m;
+    uint64_t probeCount_m;
+    std::vector<ChannelStats> channelStats_m;
 };
 
 auto WavCvt::create() -> std::unique_ptr<WavCvt>
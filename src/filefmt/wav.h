@@ -25,7 +25,7 @@ class WavFileReader:
 public:
     static auto create() -> std::unique_ptr<WavFileReader>;
 
-    virtual void open(const std::string & fileName) = 0;
+    virtual void open(const std::string & fileName, const MemBuf & memBuf = MemBuf()) = 0;
     virtual void close() = 0;
 
     virtual auto params() const -> WavParams = 0;
@@ -63,6 +63,20 @@ private:
     explicit WavFileProber() = default;
 };
 
+enum struct WavDownmix
+{
+    channel,    // take the source channel as is
+    average,    // average all the channels
+    bestChannel // take the channel looking least noisy on the first half second
+};
+
+enum struct WavResampleQuality
+{
+    low,    // 8 taps
+    medium, // 16 taps
+    high    // 32 taps
+};
+
 class WavCvt:
         public ICvt,
         public Logger
@@ -73,6 +87,8 @@ public:
     virtual void setSourceParams(const WavParams & params) = 0;
     virtual void setTargetParams(const WavParams & params) = 0;
     virtual void setSourceChannel(int channel) = 0;
+    virtual void setDownmix(WavDownmix downmix) = 0;
+    virtual void setResampleQuality(WavResampleQuality quality) = 0;
 
 private:
     class Impl;
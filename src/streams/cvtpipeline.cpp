@@ -0,0 +1,167 @@
+#include "cvtpipeline.h"
+#include <vector>
+#include <array>
+#include <chrono>
+
+class CvtPipeline::Impl final:
+        public CvtPipeline
+{
+public:
+    explicit Impl(size_t bufSize):
+        bufs_m{{ std::vector<uint8_t>(bufSize), std::vector<uint8_t>(bufSize) }}
+    {}
+
+    virtual void addStage(ICvt * stage, const std::string & name) override
+    {
+        stages_m.push_back({ stage, name, {}, {} });
+    }
+
+    virtual auto stageCount() const -> size_t override
+    {
+        return stages_m.size();
+    }
+
+    virtual auto stageName(size_t stageNum) const -> std::string override
+    {
+        return stages_m.at(stageNum).name;
+    }
+
+    virtual auto stageStats(size_t stageNum) const -> CvtStageStats override
+    {
+        return stages_m.at(stageNum).stats;
+    }
+
+    virtual void reportStats() override
+    {
+        for(const Stage & stage: stages_m) {
+            double seconds = double(stage.stats.nanoseconds) / 1e9;
+            msg(LogLevel::info, "Stage %s: %llu bytes in, %llu bytes out, %.3f s, %.1f MB/s",
+                stage.name.data(),
+                (unsigned long long) stage.stats.sourceBytes,
+                (unsigned long long) stage.stats.targetBytes,
+                seconds, (seconds > 0 ? double(stage.stats.sourceBytes) / seconds / 1e6 : 0.0));
+        }
+    }
+
+    // Every pass takes a block through all the stages, passes are repeated
+    // while any stage makes progress and the target has room. No new source
+    // is taken while carried data piles up, e.g. when the target is short
+    virtual void convert(Slice<const uint8_t> * source, Slice<uint8_t> * target) override
+    {
+        if(stages_m.empty() || !isValid()) {
+            return;
+        }
+
+        bool isProgress = true;
+        while(isProgress && target->count() > 0) {
+            isProgress = false;
+            Slice<const uint8_t> input = *source;
+            for(size_t i = 0; i < stages_m.size(); ++i) {
+                bool isLast = (i + 1 == stages_m.size());
+                std::vector<uint8_t> & buf = bufs_m[i % 2];
+                Slice<uint8_t> output = (isLast ? *target : Slice<uint8_t>(buf.data(), buf.size()));
+
+                size_t outputCount = output.count();
+                if(i == 0) {
+                    if(isBacklogged()) {
+                        input = Slice<const uint8_t>();
+                        continue;
+                    }
+                    isProgress |= runStage(&stages_m[i], &input, &output);
+                    *source = input;
+                } else {
+                    isProgress |= runCarried(&stages_m[i], input, &output);
+                }
+                if(!stages_m[i].cvt->isValid()) {
+                    return;
+                }
+
+                size_t producedCount = outputCount - output.count();
+                if(isLast) {
+                    *target = output;
+                } else {
+                    input = Slice<const uint8_t>(buf.data(), producedCount);
+                }
+            }
+        }
+    }
+
+    virtual auto isValid() const -> bool override
+    {
+        for(const Stage & stage: stages_m) {
+            if(!stage.cvt->isValid()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    virtual void recover() override
+    {
+        for(Stage & stage: stages_m) {
+            stage.cvt->recover();
+            stage.carry.clear();
+        }
+    }
+
+private:
+    struct Stage final
+    {
+        ICvt * cvt;
+        std::string name;
+        std::vector<uint8_t> carry; // input left unconsumed by previous blocks
+        CvtStageStats stats;
+    };
+
+    auto isBacklogged() const -> bool
+    {
+        for(const Stage & stage: stages_m) {
+            if(stage.carry.size() >= bufs_m[0].size()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Input leftovers are rare and small (partial frames, full output), so
+    // they are copied aside instead of pinning the ping-pong buffer
+    auto runCarried(Stage * stage, Slice<const uint8_t> input, Slice<uint8_t> * output) -> bool
+    {
+        if(stage->carry.empty()) {
+            bool isProgress = runStage(stage, &input, output);
+            stage->carry.assign(input.data(), input.data() + input.count());
+            return isProgress;
+        }
+
+        stage->carry.insert(stage->carry.end(), input.data(), input.data() + input.count());
+        Slice<const uint8_t> carried(stage->carry.data(), stage->carry.size());
+        bool isProgress = runStage(stage, &carried, output);
+        stage->carry.erase(stage->carry.begin(), stage->carry.end() - ptrdiff_t(carried.count()));
+        return isProgress;
+    }
+
+    auto runStage(Stage * stage, Slice<const uint8_t> * input, Slice<uint8_t> * output) -> bool
+    {
+        size_t inputCount = input->count();
+        size_t outputCount = output->count();
+
+        auto startTime = std::chrono::steady_clock::now();
+        stage->cvt->convert(input, output);
+        auto endTime = std::chrono::steady_clock::now();
+
+        size_t consumed = inputCount - input->count();
+        size_t produced = outputCount - output->count();
+        stage->stats.sourceBytes += consumed;
+        stage->stats.targetBytes += produced;
+        stage->stats.nanoseconds += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count());
+        return (consumed > 0 || produced > 0);
+    }
+
+    std::array<std::vector<uint8_t>, 2> bufs_m;
+    std::vector<Stage> stages_m;
+};
+
+auto CvtPipeline::create(size_t bufSize) -> std::unique_ptr<CvtPipeline>
+{
+    return std::make_unique<Impl>(bufSize);
+}
@@ -0,0 +1,41 @@
+#ifndef CVTPIPELINE_H
+#define CVTPIPELINE_H
+
+#include "cvtstream.h"
+
+// Default is two buffers of 8 KiB, so the data passed between stages stays
+// in L1 cache along with stage state
+constexpr size_t cvtPipelineBufSize = 8192;
+
+struct CvtStageStats final
+{
+    uint64_t sourceBytes = 0; // consumed
+    uint64_t targetBytes = 0; // produced
+    uint64_t nanoseconds = 0;
+};
+
+// Runs several converters as a single one. Intermediate data goes through a
+// pair of ping-pong buffers block by block, and whatever a stage leaves
+// unconsumed is carried over to the next block
+
+class CvtPipeline:
+        public ICvt,
+        public Logger
+{
+public:
+    static auto create(size_t bufSize = cvtPipelineBufSize) -> std::unique_ptr<CvtPipeline>;
+
+    virtual void addStage(ICvt * stage, const std::string & name) = 0;
+    virtual auto stageCount() const -> size_t = 0;
+    virtual auto stageName(size_t stageNum) const -> std::string = 0;
+    virtual auto stageStats(size_t stageNum) const -> CvtStageStats = 0;
+
+    // Logs throughput of every stage
+    virtual void reportStats() = 0;
+
+private:
+    class Impl;
+    explicit CvtPipeline() = default;
+};
+
+#endif // CVTPIPELINE_H
@@ -81,4 +81,119 @@ auto CvtReader::create(ICvt * converter, size_t bufSize) -> std::unique_ptr<CvtR
     return std::make_unique<Impl>(converter, bufSize);
 }
 
-// TODO: Implement the CvtWriter::Impl class as it became necessary for something
+class CvtWriter::Impl final:
+        public CvtWriter
+{
+public:
+    explicit Impl(ICvt * converter, size_t bufSize):
+        converter_m(converter), buf_m(bufSize), bufCount_m(0), target_m(nullptr), isValid_m(true)
+    {}
+
+    ~Impl()
+    {
+        close();
+    }
+
+    virtual void open(ISequentalWriter * target) override
+    {
+        target_m = target;
+        bufCount_m = 0;
+        pending_m.clear();
+        isValid_m = true;
+    }
+
+    virtual void close() override
+    {
+        if(target_m) {
+            flush();
+        }
+        target_m = nullptr;
+    }
+
+    virtual void write(const uint8_t * buf, size_t count) override
+    {
+        if(!isValid()) {
+            return;
+        }
+
+        // Source data the converter left unconsumed, e.g. a partial sample
+        // frame, is kept until the next write
+        if(pending_m.empty()) {
+            Slice<const uint8_t> source(buf, count);
+            convert(&source);
+            pending_m.assign(source.data(), source.data() + source.count());
+        } else {
+            pending_m.insert(pending_m.end(), buf, buf + count);
+            Slice<const uint8_t> source(pending_m.data(), pending_m.size());
+            convert(&source);
+            pending_m.erase(pending_m.begin(), pending_m.end() - ptrdiff_t(source.count()));
+        }
+    }
+
+    // Converter is also drained of the data it still holds
+    virtual void flush() override
+    {
+        if(!isValid()) {
+            return;
+        }
+
+        Slice<const uint8_t> source;
+        convert(&source);
+        writeBuf();
+        target_m->flush();
+    }
+
+    virtual auto isValid() const -> bool override
+    {
+        return (target_m != nullptr && isValid_m && converter_m->isValid() && target_m->isValid());
+    }
+
+    virtual void recover() override
+    {
+        if(target_m) {
+            target_m->recover();
+        }
+        converter_m->recover();
+        isValid_m = true;
+    }
+
+private:
+    void convert(Slice<const uint8_t> * source)
+    {
+        while(true) {
+            Slice<uint8_t> target(buf_m.data() + bufCount_m, buf_m.size() - bufCount_m);
+            converter_m->convert(source, &target);
+            if(!converter_m->isValid()) {
+                return;
+            }
+            bufCount_m = buf_m.size() - target.count();
+            if(target.count() > 0) {
+                break;
+            }
+            writeBuf();
+            if(!target_m->isValid()) {
+                return;
+            }
+        }
+    }
+
+    void writeBuf()
+    {
+        if(bufCount_m > 0) {
+            target_m->write(buf_m.data(), bufCount_m);
+            bufCount_m = 0;
+        }
+    }
+
+    ICvt * converter_m;
+    std::vector<uint8_t> buf_m;
+    size_t bufCount_m;
+    std::vector<uint8_t> pending_m;
+    ISequentalWriter * target_m;
+    bool isValid_m;
+};
+
+auto CvtWriter::create(ICvt * converter, size_t bufSize) -> std::unique_ptr<CvtWriter>
+{
+    return std::make_unique<Impl>(converter, bufSize);
+}
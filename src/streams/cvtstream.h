@@ -19,6 +19,7 @@ class CvtReader:
         public ISequentalReader,
         public Logger
 {
+public:
     static auto create(ICvt * converter, size_t bufSize = 4096) -> std::unique_ptr<CvtReader>;
 
     virtual void open(ISequentalReader * source) = 0;
@@ -29,6 +30,9 @@ private:
     CvtReader() = default;
 };
 
+// Converted data is buffered and goes to the target when the buffer fills up
+// or on flush. Writers can be chained, as a writer is a target by itself
+
 class CvtWriter:
         public ISequentalWriter,
         public Logger
@@ -1,28 +1,39 @@
 #include "file.h"
 #include <fstream>
+#include <vector>
+#include <algorithm>
 #include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef _WIN32
+# include <io.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
 
 namespace {
 
-template <typename>
-class FileStreamBase;
+constexpr size_t fileMaxReadSize = 1 << 30; // single read call limit
 
-template <>
-class FileStreamBase<std::ifstream>
+namespace sys {
+
+// Plain off_t is 32-bit on mingw
+inline int64_t lseek(int fd, int64_t offset, int origin)
 {
-protected:
-    void seek(std::ios::off_type pos, std::ios::seekdir dir)
-    {
-        file_m.seekg(pos, dir);
-    }
+#ifdef _WIN32
+    return _lseeki64(fd, offset, origin);
+#else
+    return ::lseek64(fd, offset, origin);
+#endif
+}
 
-    auto pos() -> std::ios::pos_type
-    {
-        return file_m.tellg();
-    }
+} // namespace sys
 
-    std::ifstream file_m;
-};
+template <typename>
+class FileStreamBase;
 
 template <>
 class FileStreamBase<std::ofstream>
@@ -95,26 +106,47 @@ public:
     }
 };
 
+// Reads go through a read-ahead window. A miss right below the window, as
+// happens on backward scans, refills it towards the lower offsets instead,
+// so every direction costs about one system call per window
 class FileReaderImpl final:
-        public FileStreamImpl<std::ifstream>
+        public Logger
 {
 public:
+    explicit FileReaderImpl(size_t bufSize):
+        fd_m(-1), buf_m(std::max(bufSize, size_t(1))), bufPos_m(0), bufCount_m(0), pos_m(0),
+        isEof_m(false), isValid_m(false)
+    {}
+
+    ~FileReaderImpl()
+    {
+        close();
+    }
+
     void open(const std::string & fileName)
     {
         close();
 
-        file_m.open(fileName, std::ios::binary | std::ios::in);
-        if(!file_m) {
+        fd_m = ::open(fileName.data(), O_RDONLY | O_BINARY);
+        if(fd_m < 0) {
             msg(LogLevel::error, "Could not open file \"%s\": %s",
                 fileName.data(), strerror(errno));
+            return;
         }
+        bufPos_m = 0;
+        bufCount_m = 0;
+        pos_m = 0;
+        isEof_m = false;
+        isValid_m = true;
     }
 
     void close()
     {
-        if(file_m.is_open()) {
-            file_m.close();
+        if(fd_m >= 0) {
+            ::close(fd_m);
+            fd_m = -1;
         }
+        isValid_m = false;
     }
 
     auto read(uint8_t * buf, size_t count, bool exact) -> size_t
@@ -123,26 +155,133 @@ public:
             return 0;
         }
 
-        auto desiredCount = std::streamsize(count);
-        file_m.read(reinterpret_cast<char *>(buf), desiredCount);
-        std::streamsize actualCount = file_m.gcount();
-        if(file_m.bad()) {
-            msg(LogLevel::error, "Could not read file: %s", strerror(errno));
-        } else
-        if(actualCount < desiredCount) {
+        size_t doneCount = 0;
+        while(doneCount < count) {
+            if(pos_m >= bufPos_m && pos_m < bufPos_m + bufCount_m) {
+                size_t offset = pos_m - bufPos_m;
+                size_t chunk = std::min(count - doneCount, bufCount_m - offset);
+                memcpy(buf + doneCount, buf_m.data() + offset, chunk);
+                doneCount += chunk;
+                pos_m += chunk;
+                continue;
+            }
+
+            size_t leftCount = count - doneCount;
+            if(leftCount >= buf_m.size()) {
+                size_t actualCount = readAt(pos_m, buf + doneCount, leftCount);
+                doneCount += actualCount;
+                pos_m += actualCount;
+                break;
+            }
+
+            bool isBackward = (bufCount_m > 0 && pos_m < bufPos_m && bufPos_m - pos_m <= buf_m.size());
+            size_t fillPos = pos_m;
+            if(isBackward) {
+                size_t fillEnd = pos_m + leftCount;
+                fillPos = (fillEnd > buf_m.size() ? fillEnd - buf_m.size() : 0);
+            }
+            bufPos_m = fillPos;
+            bufCount_m = readAt(fillPos, buf_m.data(), buf_m.size());
+            if(!isValid_m || pos_m >= bufPos_m + bufCount_m) {
+                break;
+            }
+        }
+
+        if(isValid_m && doneCount < count) {
+            isEof_m = true;
             if(exact) {
                 msg(LogLevel::error, "Could not read desired amount of data");
-            } else {
-                file_m.clear(file_m.rdstate() & ~std::ios::failbit);
+                isValid_m = false;
             }
         }
-        return size_t(actualCount);
+        return doneCount;
     }
 
     auto isEof() const -> bool
     {
-        return (!file_m.is_open() || file_m.bad() || file_m.eof());
+        return (fd_m < 0 || isEof_m);
     }
+
+    void seek(size_t pos, SeekOrigin origin)
+    {
+        if(!isValid()) {
+            return;
+        }
+
+        switch(origin) {
+            case SeekOrigin::begin:
+            default:
+                pos_m = pos;
+                break;
+            case SeekOrigin::current:
+                pos_m += pos;
+                break;
+            case SeekOrigin::end: {
+                int64_t size = sys::lseek(fd_m, 0, SEEK_END);
+                if(size < 0) {
+                    msg(LogLevel::error, "Could not seek file: %s", strerror(errno));
+                    isValid_m = false;
+                    return;
+                }
+                pos_m = size_t(size) + pos;
+                break;
+            }
+        }
+        isEof_m = false;
+    }
+
+    auto pos() -> size_t
+    {
+        return (fd_m < 0 ? 0 : pos_m);
+    }
+
+    auto isValid() const -> bool
+    {
+        return (fd_m >= 0 && isValid_m);
+    }
+
+    void recover()
+    {
+        if(fd_m >= 0) {
+            isValid_m = true;
+        }
+    }
+
+private:
+    auto readAt(size_t pos, uint8_t * buf, size_t count) -> size_t
+    {
+        if(sys::lseek(fd_m, int64_t(pos), SEEK_SET) < 0) {
+            msg(LogLevel::error, "Could not seek file: %s", strerror(errno));
+            isValid_m = false;
+            return 0;
+        }
+
+        size_t doneCount = 0;
+        while(doneCount < count) {
+            auto actualCount = ::read(fd_m, buf + doneCount, unsigned(std::min(count - doneCount, fileMaxReadSize)));
+            if(actualCount < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                msg(LogLevel::error, "Could not read file: %s", strerror(errno));
+                isValid_m = false;
+                break;
+            }
+            if(actualCount == 0) {
+                break;
+            }
+            doneCount += size_t(actualCount);
+        }
+        return doneCount;
+    }
+
+    int fd_m;
+    std::vector<uint8_t> buf_m;
+    size_t bufPos_m;   // file offset of the window
+    size_t bufCount_m;
+    size_t pos_m;
+    bool isEof_m;
+    bool isValid_m;
 };
 
 class FileWriterImpl final:
@@ -203,58 +342,76 @@ class FileReader::Impl final:
         public FileReader
 {
 public:
-    explicit Impl()
+    explicit Impl(size_t bufSize):
+        file_m(bufSize)
     {
         captureLog(&file_m);
     }
 
-    virtual void open(const std::string & fileName) override
+    virtual void open(const std::string & fileName, const MemBuf & memBuf) override
     {
-        file_m.open(fileName);
+        close();
+        if(memBuf) {
+            memReader_m = MemReader::create();
+            captureLog(memReader_m.get());
+            memReader_m->open(memBuf);
+        } else {
+            file_m.open(fileName);
+        }
     }
 
     virtual void close() override
     {
         file_m.close();
+        memReader_m = nullptr;
     }
 
     virtual auto read(uint8_t * buf, size_t count, bool exact) -> size_t override
     {
-        return file_m.read(buf, count, exact);
+        return (memReader_m ? memReader_m->read(buf, count, exact) : file_m.read(buf, count, exact));
     }
 
     virtual auto isEof() const -> bool override
     {
-        return file_m.isEof();
+        return (memReader_m ? memReader_m->isEof() : file_m.isEof());
     }
 
     virtual void seek(size_t pos, SeekOrigin origin) override
     {
-        file_m.seek(pos, origin);
+        if(memReader_m) {
+            memReader_m->seek(pos, origin);
+        } else {
+            file_m.seek(pos, origin);
+        }
     }
 
     virtual auto pos() -> size_t override
     {
-        return file_m.pos();
+        return (memReader_m ? memReader_m->pos() : file_m.pos());
     }
 
     virtual auto isValid() const -> bool override
     {
-        return file_m.isValid();
+        return (memReader_m ? memReader_m->isValid() : file_m.isValid());
     }
 
     virtual void recover() override
     {
-        file_m.recover();
+        if(memReader_m) {
+            memReader_m->recover();
+        } else {
+            file_m.recover();
+        }
     }
 
 private:
     FileReaderImpl file_m;
+    std::unique_ptr<MemReader> memReader_m;
 };
 
-auto FileReader::create() -> std::unique_ptr<FileReader>
+auto FileReader::create(size_t bufSize) -> std::unique_ptr<FileReader>
 {
-    return std::make_unique<Impl>();
+    return std::make_unique<Impl>(bufSize);
 }
 
 class FileWriter::Impl final:
@@ -2,16 +2,20 @@
 #define FILE_H
 
 #include "streams.h"
+#include "membuf.h"
 #include "logging.h"
 
+// Buffered reader, fast both for forward and backward sequental access. When
+// the content is given, it's read from memory and the name is only a label
+
 class FileReader:
         public IRandomReader,
         public Logger
 {
 public:
-    static auto create() -> std::unique_ptr<FileReader>;
+    static auto create(size_t bufSize = 65536) -> std::unique_ptr<FileReader>;
 
-    virtual void open(const std::string & fileName) = 0;
+    virtual void open(const std::string & fileName, const MemBuf & memBuf = MemBuf()) = 0;
     virtual void close() = 0;
 
 private:
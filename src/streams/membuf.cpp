@@ -0,0 +1,98 @@
+#include "membuf.h"
+#include <cstring>
+
+class MemReader::Impl final:
+        public MemReader
+{
+public:
+    explicit Impl():
+        pos_m(0), isEof_m(false), isValid_m(false)
+    {}
+
+    virtual void open(const MemBuf & memBuf) override
+    {
+        memBuf_m = memBuf;
+        pos_m = 0;
+        isEof_m = false;
+        isValid_m = (memBuf_m != nullptr);
+    }
+
+    virtual void close() override
+    {
+        memBuf_m = nullptr;
+        isValid_m = false;
+    }
+
+    virtual auto read(uint8_t * buf, size_t count, bool exact = true) -> size_t override
+    {
+        if(!isValid()) {
+            return 0;
+        }
+
+        size_t actualCount = (pos_m < memBuf_m->size() ? std::min(count, memBuf_m->size() - pos_m) : 0);
+        if(actualCount > 0) {
+            memcpy(buf, memBuf_m->data() + pos_m, actualCount);
+        }
+        pos_m += actualCount;
+        if(actualCount < count) {
+            isEof_m = true;
+            if(exact) {
+                msg(LogLevel::error, "Could not read desired amount of data");
+                isValid_m = false;
+            }
+        }
+        return actualCount;
+    }
+
+    virtual auto isEof() const -> bool override
+    {
+        return (memBuf_m == nullptr || isEof_m);
+    }
+
+    virtual void seek(size_t pos, SeekOrigin origin = SeekOrigin::begin) override
+    {
+        if(!isValid()) {
+            return;
+        }
+
+        switch(origin) {
+            case SeekOrigin::begin:
+            default:
+                pos_m = pos;
+                break;
+            case SeekOrigin::current:
+                pos_m += pos;
+                break;
+            case SeekOrigin::end:
+                pos_m = memBuf_m->size() + pos;
+                break;
+        }
+        isEof_m = false;
+    }
+
+    virtual auto pos() -> size_t override
+    {
+        return (memBuf_m == nullptr ? 0 : pos_m);
+    }
+
+    virtual auto isValid() const -> bool override
+    {
+        return (memBuf_m != nullptr && isValid_m);
+    }
+
+    virtual void recover() override
+    {
+        isValid_m = (memBuf_m != nullptr);
+    }
+
+private:
+    MemBuf memBuf_m;
+    size_t pos_m;
+    bool isEof_m;
+    bool isValid_m;
+};
+
+auto MemReader::create() -> std::unique_ptr<MemReader>
+{
+    return std::make_unique<Impl>();
+}
@@ -0,0 +1,26 @@
+#ifndef MEMBUF_H
+#define MEMBUF_H
+
+#include "streams.h"
+#include "logging.h"
+#include <vector>
+
+// File content loaded into memory, shared by all the readers of it
+using MemBuf = std::shared_ptr<const std::vector<uint8_t>>;
+
+class MemReader:
+        public IRandomReader,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<MemReader>;
+
+    virtual void open(const MemBuf & memBuf) = 0;
+    virtual void close() = 0;
+
+private:
+    class Impl;
+    MemReader() = default;
+};
+
+#endif // MEMBUF_H
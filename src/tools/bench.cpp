@@ -0,0 +1,147 @@
+#include "bench.h"
+#include "machinepool.h"
+#include "stringf.h"
+#include <iostream>
+#include <chrono>
+
+namespace {
+
+class OpCounter final
+{
+public:
+    explicit OpCounter(Cpu * cpu):
+        opHook_m(cpu->createOpHook(memFunc(this, &OpCounter::opHookFunc))),
+        opCount_m(0)
+    {}
+
+    auto opCount() const -> uint64_t
+    {
+        return opCount_m;
+    }
+
+private:
+    void opHookFunc()
+    {
+        ++opCount_m;
+    }
+
+    std::unique_ptr<OpHook> opHook_m;
+    uint64_t opCount_m;
+};
+
+} // namespace
+
+class BenchCommand::Impl final:
+        public BenchCommand
+{
+public:
+    virtual auto name() const -> std::string override
+    {
+        return "bench";
+    }
+
+    virtual auto usage() const -> std::string override
+    {
+        return "bench [-f frames] [-n runs] [-i] [-j] [file]";
+    }
+
+    virtual auto run(const std::vector<std::string> & args) -> int override
+    {
+        unsigned frameCount = 3000;
+        unsigned runCount = 3;
+        bool isIdleSkip = false;
+        bool isJit = false;
+        std::string fileName;
+
+        for(size_t i = 0; i < args.size(); ++i) {
+            const std::string & arg = args[i];
+            bool hasValue = (i + 1 < args.size());
+            if(arg == "-f" && hasValue) {
+                if(!parseUnsigned(args[++i], &frameCount)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-n" && hasValue) {
+                if(!parseUnsigned(args[++i], &runCount)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-i") {
+                isIdleSkip = true;
+            } else if(arg == "-j") {
+                isJit = true;
+            } else if(!arg.empty() && arg[0] == '-') {
+                msg(LogLevel::error, "Unknown option \"%s\"", arg.data());
+                return 2;
+            } else if(fileName.empty()) {
+                fileName = arg;
+            } else {
+                msg(LogLevel::error, "Only one file can be benchmarked at once");
+                return 2;
+            }
+        }
+
+        if(frameCount == 0 || runCount == 0) {
+            msg(LogLevel::error, "Frame and run counts must be positive");
+            return 2;
+        }
+
+        HeadlessEnvironment environment;
+
+        // Op hook takes every op interpreted, idle skip still applies
+        uint64_t opCount;
+        {
+            std::unique_ptr<Machine> machine = createMachine(&environment, fileName, isIdleSkip, false);
+            OpCounter opCounter(machine->cpu());
+            MachinePool::runFrames(machine.get(), frameCount);
+            opCount = opCounter.opCount();
+            machine->close();
+        }
+
+        double bestSeconds = 0.0;
+        std::cout << "run,seconds,fps,mops" << std::endl;
+        for(unsigned runNum = 0; runNum < runCount; ++runNum) {
+            std::unique_ptr<Machine> machine = createMachine(&environment, fileName, isIdleSkip, isJit);
+            auto startTime = std::chrono::steady_clock::now();
+            MachinePool::runFrames(machine.get(), frameCount);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            machine->close();
+
+            std::cout << runNum << ',' << stringf("%.3f", seconds) << ','
+                      << stringf("%.0f", frameCount / seconds) << ','
+                      << stringf("%.2f", opCount / seconds / 1e6) << std::endl;
+            if(runNum == 0 || seconds < bestSeconds) {
+                bestSeconds = seconds;
+            }
+        }
+
+        msg(LogLevel::info, "Best of %u runs: %u frames in %.3f s, %.0f fps, %llu ops, %.2f Mops/s",
+            runCount, frameCount, bestSeconds, frameCount / bestSeconds,
+            static_cast<unsigned long long>(opCount), opCount / bestSeconds / 1e6);
+
+        return 0;
+    }
+
+private:
+    auto createMachine(IEnvironment * environment, const std::string & fileName,
+                       bool isIdleSkip, bool isJit) -> std::unique_ptr<Machine>
+    {
+        std::unique_ptr<Machine> machine = Machine::create(environment);
+        machine->setLog(std::make_unique<NullLog>());
+        machine->init();
+        machine->video()->setPixelFormat(PixelFormat::xrgb8888);
+        machine->cpu()->setIdleSkip(isIdleSkip);
+        machine->cpu()->setJit(isJit);
+        if(!fileName.empty()) {
+            machine->bios()->setInstantLoad(true);
+            machine->media()->playbackFile.setFileName(fileName);
+            machine->bios()->initMediaHooks();
+        }
+        return machine;
+    }
+};
+
+auto BenchCommand::create() -> std::unique_ptr<BenchCommand>
+{
+    return std::make_unique<Impl>();
+}
@@ -0,0 +1,24 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "command.h"
+#include "logging.h"
+#include <memory>
+
+// Headless emulation speed benchmark: runs the machine unthrottled for the
+// given number of frames and reports frames and cpu ops per second. Ops are
+// counted in a separate run, so the timed one goes with no hooks at all
+
+class BenchCommand:
+        public ICommand,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<BenchCommand>;
+
+private:
+    class Impl;
+    explicit BenchCommand() = default;
+};
+
+#endif // BENCH_H
@@ -0,0 +1,35 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "interface.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+class ICommand:
+        public Interface
+{
+public:
+    virtual auto name() const -> std::string = 0;
+    virtual auto usage() const -> std::string = 0;
+
+    // Returns process exit code
+    virtual auto run(const std::vector<std::string> & args) -> int = 0;
+};
+
+// Whole text has to be the number, which fits unsigned
+inline auto parseUnsigned(const std::string & text, unsigned * value, int base = 10) -> bool
+{
+    if(text.empty() || text[0] == '-' || text[0] == '+') {
+        return false;
+    }
+    char * end;
+    unsigned long number = strtoul(text.data(), &end, base);
+    if(*end != 0 || number > 0xffffffffu) {
+        return false;
+    }
+    *value = unsigned(number);
+    return true;
+}
+
+#endif // COMMAND_H
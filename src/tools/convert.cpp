@@ -0,0 +1,310 @@
+#include "convert.h"
+#include "media.h"
+#include "cas.h"
+#include "wav.h"
+#include "pwe.h"
+#include "comparator.h"
+#include "adaptivecomparator.h"
+#include "pulsewriter.h"
+#include "cvtpipeline.h"
+#include <vector>
+
+namespace {
+
+constexpr uint64_t wavGapClocks = pweDefaultClockRate / 4; // silence splitting WAV into blocks
+
+constexpr size_t wavBufFrames = 4096;
+
+// Comparators take 32-bit samples
+class WidenCvt final:
+        public ICvt
+{
+public:
+    virtual void convert(Slice<const uint8_t> * source, Slice<uint8_t> * target) override
+    {
+        auto s = reinterpret_cast<Slice<const int16_t> *>(source);
+        auto t = reinterpret_cast<Slice<int32_t> *>(target);
+
+        size_t count = std::min(s->count(), t->count());
+        std::copy(s->data(), s->data() + count, t->data());
+        s->advance(count);
+        t->advance(count);
+    }
+
+    virtual auto isValid() const -> bool override
+    {
+        return true;
+    }
+
+    virtual void recover() override
+    {
+    }
+};
+
+} // namespace
+
+class ConvertCommand::Impl final:
+        public ConvertCommand
+{
+public:
+    virtual auto name() const -> std::string override
+    {
+        return "convert";
+    }
+
+    virtual auto usage() const -> std::string override
+    {
+        return "convert [-o out.pwe] [-c channel|-m average|best] [-r rate] [-q low|medium|high] [-a] [-s] file.wav|file.cas";
+    }
+
+    virtual auto run(const std::vector<std::string> & args) -> int override
+    {
+        std::string outFileName;
+        std::string fileName;
+
+        for(size_t i = 0; i < args.size(); ++i) {
+            const std::string & arg = args[i];
+            bool hasValue = (i + 1 < args.size());
+            if(arg == "-o" && hasValue) {
+                outFileName = args[++i];
+            } else if(arg == "-c" && hasValue) {
+                unsigned value;
+                if(!parseUnsigned(args[++i], &value)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+                channel_m = int(value);
+            } else if(arg == "-m" && hasValue) {
+                const std::string & mode = args[++i];
+                if(mode == "average") {
+                    downmix_m = WavDownmix::average;
+                } else if(mode == "best") {
+                    downmix_m = WavDownmix::bestChannel;
+                } else {
+                    msg(LogLevel::error, "Unknown downmix mode \"%s\"", mode.data());
+                    return 2;
+                }
+            } else if(arg == "-a") {
+                isAdaptive_m = true;
+            } else if(arg == "-s") {
+                isStats_m = true;
+            } else if(arg == "-r" && hasValue) {
+                unsigned value;
+                if(!parseUnsigned(args[++i], &value)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+                sampleRate_m = int(value);
+            } else if(arg == "-q" && hasValue) {
+                const std::string & quality = args[++i];
+                if(quality == "low") {
+                    quality_m = WavResampleQuality::low;
+                } else if(quality == "medium") {
+                    quality_m = WavResampleQuality::medium;
+                } else if(quality == "high") {
+                    quality_m = WavResampleQuality::high;
+                } else {
+                    msg(LogLevel::error, "Unknown resample quality \"%s\"", quality.data());
+                    return 2;
+                }
+            } else if(!arg.empty() && arg[0] == '-') {
+                msg(LogLevel::error, "Unknown option \"%s\"", arg.data());
+                return 2;
+            } else if(fileName.empty()) {
+                fileName = arg;
+            } else {
+                msg(LogLevel::error, "Only one file can be converted at once");
+                return 2;
+            }
+        }
+
+        if(fileName.empty()) {
+            msg(LogLevel::error, "No file to convert");
+            return 2;
+        }
+        if(outFileName.empty()) {
+            size_t pos = fileName.rfind('.');
+            outFileName = (pos != std::string::npos && fileName.find('/', pos) == std::string::npos ?
+                               fileName.substr(0, pos) : fileName) + ".pwe";
+        }
+
+        MediaFile mediaFile;
+        mediaFile.setFileName(fileName);
+
+        std::unique_ptr<PweFileWriter> pweFileWriter = PweFileWriter::create();
+        captureLog(pweFileWriter.get());
+        pweFileWriter->open(outFileName);
+        if(!pweFileWriter->isValid()) {
+            return 1;
+        }
+
+        bool isConverted;
+        switch(mediaFile.fileFmt()) {
+            case FileFmt::cas:
+                isConverted = convertCas(fileName, pweFileWriter.get());
+                break;
+            case FileFmt::wav:
+                isConverted = convertWav(fileName, pweFileWriter.get());
+                break;
+            default:
+                msg(LogLevel::error, "Unsupported format of file \"%s\"", fileName.data());
+                isConverted = false;
+                break;
+        }
+
+        // Writer is not valid anymore once closed, so buffered edges are
+        // flushed and checked before
+        pweFileWriter->flush();
+        isConverted = (isConverted && pweFileWriter->isValid());
+        pweFileWriter->close();
+        if(!isConverted) {
+            return 1;
+        }
+
+        msg(LogLevel::info, "Converted \"%s\" to \"%s\"", fileName.data(), outFileName.data());
+        return 0;
+    }
+
+private:
+    auto convertCas(const std::string & fileName, PweFileWriter * pweFileWriter) -> bool
+    {
+        std::unique_ptr<CasFileReader> casFileReader = CasFileReader::create();
+        captureLog(casFileReader.get());
+        casFileReader->open(fileName);
+        if(!casFileReader->isValid()) {
+            return false;
+        }
+
+        PulseWriter<PweFileWriter> pulseWriter(pweFileWriter);
+        std::vector<uint8_t> buf;
+        for(size_t i = 0; i < casFileReader->blockCount(); ++i) {
+            CasBlockInfo block = casFileReader->blockInfo(i);
+            if(block.size == 0) {
+                continue;
+            }
+            casFileReader->seekBlock(i);
+            buf.resize(block.size);
+            casFileReader->read(buf.data(), buf.size());
+            if(!casFileReader->isValid()) {
+                return false;
+            }
+
+            bool isHeader = (block.type != CasBlockType::data);
+            pweFileWriter->addBlock(uint8_t(block.type), block.name);
+            pulseWriter.writeGap(isHeader ? headerGapClocks : dataGapClocks);
+            pulseWriter.writeTone(isHeader ? headerTonePulses : dataTonePulses);
+            for(uint8_t data: buf) {
+                pulseWriter.writeByte(data);
+            }
+        }
+        return pweFileWriter->isValid();
+    }
+
+    auto convertWav(const std::string & fileName, PweFileWriter * pweFileWriter) -> bool
+    {
+        std::unique_ptr<WavFileReader> wavFileReader = WavFileReader::create();
+        captureLog(wavFileReader.get());
+        wavFileReader->open(fileName);
+        if(!wavFileReader->isValid()) {
+            return false;
+        }
+
+        WavParams params = wavFileReader->params();
+        int sampleRate = (sampleRate_m > 0 ? sampleRate_m : params.sampleRate);
+        std::unique_ptr<WavCvt> wavCvt = WavCvt::create();
+        captureLog(wavCvt.get());
+        wavCvt->setSourceParams(params);
+        wavCvt->setTargetParams({1, sampleRate, 16});
+        wavCvt->setSourceChannel(channel_m);
+        wavCvt->setDownmix(downmix_m);
+        wavCvt->setResampleQuality(quality_m);
+        if(!wavCvt->isValid()) {
+            return false;
+        }
+        std::unique_ptr<ICvt> comparator;
+        if(isAdaptive_m) {
+            comparator = AdaptiveComparator::create(sampleRate);
+        } else {
+            comparator = Comparator::create();
+        }
+        WidenCvt widenCvt;
+
+        std::unique_ptr<CvtPipeline> pipeline = CvtPipeline::create();
+        captureLog(pipeline.get());
+        pipeline->addStage(wavCvt.get(), "wav");
+        pipeline->addStage(&widenCvt, "widen");
+        pipeline->addStage(comparator.get(), "comparator");
+
+        size_t frameSize = size_t(params.numChannels * (params.bitsPerSample / 8));
+        std::vector<uint8_t> sourceBuf(wavBufFrames * frameSize);
+        std::vector<int32_t> levelBuf(wavBufFrames);
+
+        uint64_t sampleNum = 0;
+        uint64_t lastEdgeClock = 0;
+        bool isHighLevel = false;
+        bool isFirstEdge = true;
+        auto writeEdges = [&](size_t levelCount) {
+            for(size_t i = 0; i < levelCount; ++i, ++sampleNum) {
+                if((levelBuf[i] > 0) == isHighLevel) {
+                    continue;
+                }
+                isHighLevel = !isHighLevel;
+                uint64_t clock = sampleNum * pweDefaultClockRate / uint64_t(sampleRate);
+                if(isFirstEdge || clock - lastEdgeClock > wavGapClocks) {
+                    pweFileWriter->addBlock();
+                    isFirstEdge = false;
+                }
+                pweFileWriter->writeEdge(clock);
+                lastEdgeClock = clock;
+            }
+        };
+
+        // Source is taken in chunks, resampling and carried data may produce
+        // more levels than fit at once, and the rest is drained at the end
+        bool isEof = false;
+        while(true) {
+            size_t count = 0;
+            if(!isEof) {
+                count = wavFileReader->read(sourceBuf.data(), sourceBuf.size(), false);
+                count -= count % frameSize;
+                if(!wavFileReader->isValid()) {
+                    return false;
+                }
+                isEof = (count == 0 || wavFileReader->isEof());
+            }
+
+            Slice<const uint8_t> source(sourceBuf.data(), count);
+            size_t levelCount;
+            do {
+                Slice<uint8_t> target(reinterpret_cast<uint8_t *>(levelBuf.data()), levelBuf.size() * sizeof(int32_t));
+                pipeline->convert(&source, &target);
+                if(!pipeline->isValid()) {
+                    return false;
+                }
+                levelCount = levelBuf.size() - target.count() / sizeof(int32_t);
+                writeEdges(levelCount);
+            } while(levelCount == levelBuf.size() || (source.count() > 0 && levelCount > 0));
+
+            if(isEof && levelCount == 0) {
+                break;
+            }
+        }
+
+        if(isStats_m) {
+            pipeline->reportStats();
+        }
+        return pweFileWriter->isValid();
+    }
+
+    int channel_m = 0;
+    int sampleRate_m = 0; // zero keeps the source rate
+    WavDownmix downmix_m = WavDownmix::channel;
+    WavResampleQuality quality_m = WavResampleQuality::medium;
+    bool isAdaptive_m = false;
+    bool isStats_m = false;
+};
+
+auto ConvertCommand::create() -> std::unique_ptr<ConvertCommand>
+{
+    return std::make_unique<Impl>();
+}
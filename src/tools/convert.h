@@ -0,0 +1,24 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include "command.h"
+#include "logging.h"
+#include <memory>
+
+// Converts WAV and CAS tape images into PWE wave edges format. WAV signal
+// goes through the comparator, CAS data is turned into pulses timed the way
+// BIOS save routine does
+
+class ConvertCommand:
+        public ICommand,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<ConvertCommand>;
+
+private:
+    class Impl;
+    explicit ConvertCommand() = default;
+};
+
+#endif // CONVERT_H
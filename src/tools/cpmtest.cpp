@@ -0,0 +1,218 @@
+#include "cpmtest.h"
+#include "machinepool.h"
+#include "stringf.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace {
+
+constexpr uint16_t warmBootAddr = 0x0000;
+constexpr uint16_t bdosAddr     = 0x0005;
+constexpr uint16_t bdosEntry    = 0xfe00; // also top of the stack programs take from bdos jump
+constexpr uint16_t rst38Addr    = 0x0038;
+constexpr uint16_t tpaAddr      = 0x0100;
+
+// Exercisers tell failures by these words in their output
+const std::vector<std::string> failWords = { "ERROR", "FAIL" };
+
+class Bdos final
+{
+public:
+    explicit Bdos(Cpu * cpu, bool isEcho):
+        cpu_m(cpu),
+        cpuRegs_m(cpu->cpuRegs()),
+        bdosHook_m(cpu->createPcHook(bdosAddr, memFunc(this, &Bdos::bdosHookFunc))),
+        warmBootHook_m(cpu->createPcHook(warmBootAddr, memFunc(this, &Bdos::warmBootHookFunc))),
+        isEcho_m(isEcho),
+        isDone_m(false)
+    {}
+
+    auto output() const -> const std::string &
+    {
+        return output_m;
+    }
+
+    auto isDone() const -> bool
+    {
+        return isDone_m;
+    }
+
+private:
+    void bdosHookFunc()
+    {
+        switch(cpuRegs_m->c) {
+            case 2:
+                print(char(cpuRegs_m->e));
+                break;
+            case 9:
+                for(uint16_t addr = cpuRegs_m->de; ; ++addr) {
+                    uint8_t data;
+                    cpu_m->memPeek(&data, addr);
+                    if(data == '$' || addr == bdosEntry) {
+                        break;
+                    }
+                    print(char(data));
+                }
+                break;
+        }
+    }
+
+    void warmBootHookFunc()
+    {
+        isDone_m = true;
+    }
+
+    void print(char c)
+    {
+        output_m += c;
+        if(isEcho_m) {
+            std::cout << c << std::flush;
+        }
+    }
+
+    Cpu * cpu_m;
+    CpuRegs * cpuRegs_m;
+    std::unique_ptr<PcHook> bdosHook_m;
+    std::unique_ptr<PcHook> warmBootHook_m;
+    bool isEcho_m;
+    bool isDone_m;
+    std::string output_m;
+};
+
+} // namespace
+
+class CpmTestCommand::Impl final:
+        public CpmTestCommand
+{
+public:
+    virtual auto name() const -> std::string override
+    {
+        return "cpmtest";
+    }
+
+    virtual auto usage() const -> std::string override
+    {
+        return "cpmtest [-f max_frames] [-i] [-j] [-v] file.com...";
+    }
+
+    virtual auto run(const std::vector<std::string> & args) -> int override
+    {
+        unsigned maxFrames = 2000000;
+        bool isIdleSkip = false;
+        bool isJit = false;
+        bool isEcho = false;
+        std::vector<std::string> fileNames;
+
+        for(size_t i = 0; i < args.size(); ++i) {
+            const std::string & arg = args[i];
+            bool hasValue = (i + 1 < args.size());
+            if(arg == "-f" && hasValue) {
+                if(!parseUnsigned(args[++i], &maxFrames)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-i") {
+                isIdleSkip = true;
+            } else if(arg == "-j") {
+                isJit = true;
+            } else if(arg == "-v") {
+                isEcho = true;
+            } else if(!arg.empty() && arg[0] == '-') {
+                msg(LogLevel::error, "Unknown option \"%s\"", arg.data());
+                return 2;
+            } else {
+                fileNames.push_back(arg);
+            }
+        }
+
+        if(fileNames.empty()) {
+            msg(LogLevel::error, "No programs to run");
+            return 2;
+        }
+
+        HeadlessEnvironment environment;
+        unsigned passCount = 0;
+        for(const std::string & fileName: fileNames) {
+            std::ifstream file(fileName, std::ios::binary);
+            if(!file) {
+                msg(LogLevel::error, "Could not open program file \"%s\"", fileName.data());
+                continue;
+            }
+            std::vector<uint8_t> program((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            if(program.empty() || program.size() > bdosEntry - tpaAddr) {
+                msg(LogLevel::error, "Program \"%s\" doesn't fit in memory", fileName.data());
+                continue;
+            }
+
+            std::unique_ptr<Machine> machine = Machine::create(&environment);
+            machine->setLog(std::make_unique<NullLog>());
+            machine->init();
+            machine->cpu()->setIdleSkip(isIdleSkip);
+            machine->cpu()->setJit(isJit);
+            load(machine.get(), program);
+
+            Bdos bdos(machine->cpu(), isEcho);
+            auto startTime = std::chrono::steady_clock::now();
+            unsigned frameCount = MachinePool::runFrames(machine.get(), maxFrames, [&]() {
+                return bdos.isDone();
+            });
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+            double clocks = double(frameCount) * clocksPerFrame;
+            machine->close();
+
+            bool isPassed = bdos.isDone();
+            for(const std::string & failWord: failWords) {
+                if(bdos.output().find(failWord) != std::string::npos) {
+                    isPassed = false;
+                }
+            }
+            if(isEcho) {
+                std::cout << std::endl;
+            }
+
+            msg(LogLevel::info, "%s: %s in %u frames, %.3f s, %.2f MHz emulated", fileName.data(),
+                (isPassed ? "passed" : (bdos.isDone() ? "failed" : "timed out")),
+                frameCount, seconds, clocks / seconds / 1e6);
+            if(isPassed) {
+                ++passCount;
+            }
+        }
+
+        msg(LogLevel::info, "Passed %u of %zu programs", passCount, fileNames.size());
+        return (passCount == fileNames.size() ? 0 : 1);
+    }
+
+private:
+    // All ram mapped, warm boot halts, bdos jumps to a ret, interrupt handler
+    // returns at once in case a program enables interrupts. Banks are mapped
+    // on frame start only, so ram is filled directly
+    void load(Machine * machine, const std::vector<uint8_t> & program)
+    {
+        Cpu * cpu = machine->cpu();
+        machine->memory()->ioPorts()->port80 = 0xff;
+
+        MemBank & ram = machine->memory()->memBanks()->ram;
+        ram[warmBootAddr] = 0x76; // hlt
+        ram[bdosAddr] = 0xc3;     // jmp bdosEntry
+        ram[bdosAddr + 1] = uint8_t(bdosEntry);
+        ram[bdosAddr + 2] = uint8_t(bdosEntry >> 8);
+        ram[rst38Addr] = 0xfb;     // ei
+        ram[rst38Addr + 1] = 0xc9; // ret
+        ram[bdosEntry] = 0xc9;     // ret
+        std::copy(program.begin(), program.end(), ram.begin() + tpaAddr);
+        cpu->memChanged();
+
+        CpuRegs * cpuRegs = cpu->cpuRegs();
+        cpuRegs->state = 0;
+        cpuRegs->sp = bdosEntry;
+        cpuRegs->pc = tpaAddr;
+    }
+};
+
+auto CpmTestCommand::create() -> std::unique_ptr<CpmTestCommand>
+{
+    return std::make_unique<Impl>();
+}
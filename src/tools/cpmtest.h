@@ -0,0 +1,25 @@
+#ifndef CPMTEST_H
+#define CPMTEST_H
+
+#include "command.h"
+#include "logging.h"
+#include <memory>
+
+// Runs CP/M cpu exercisers (TST8080, 8080PRE, CPUTEST, 8080EXM and alike)
+// from all ram, with BDOS console output calls trapped. A program passes
+// once it exits to warm boot with no error reported, and emulated clock rate
+// is reported along, so long exercisers double as a throughput benchmark
+
+class CpmTestCommand:
+        public ICommand,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<CpmTestCommand>;
+
+private:
+    class Impl;
+    explicit CpmTestCommand() = default;
+};
+
+#endif // CPMTEST_H
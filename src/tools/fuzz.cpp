@@ -0,0 +1,212 @@
+#include "fuzz.h"
+#include "machinepool.h"
+#include "validator.h"
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Loop bodies and tails the cpu fuses, zero bytes get random operands.
+// Conditional jumps are followed by a target, mostly back to the head
+const std::vector<std::vector<uint8_t>> idioms = {
+    { 0x1a, 0x77, 0x3e, 0x00, 0x12, 0x23, 0x13, 0x0b, 0x78, 0xb1, 0xc2 },
+    { 0x1a, 0x77, 0x23, 0x13, 0x0b, 0x78, 0xb1, 0xc2 },
+    { 0x7e, 0x12, 0x23, 0x13, 0x0b, 0x78, 0xb1, 0xc2 },
+    { 0x0a, 0x12, 0x03, 0x13, 0x2b, 0x7c, 0xb5, 0xc2 },
+    { 0x77, 0x23, 0x0b, 0x78, 0xb1, 0xc2 },
+    { 0x12, 0x13, 0x0b, 0x78, 0xb1, 0xc2 },
+    { 0x1a, 0x77, 0x23, 0x13 },
+    { 0x77, 0x23 },
+    { 0x0b, 0x78, 0xb1, 0xc2 },
+    { 0x0b, 0x79, 0xb0, 0xc2 },
+    { 0x1b, 0x7a, 0xb3, 0xc2 },
+    { 0x1b, 0x7b, 0xb2, 0xc2 },
+    { 0x05, 0xc2 },
+    { 0x0d, 0xc2 },
+    { 0x15, 0xc2 },
+    { 0x1d, 0xc2 }
+};
+
+constexpr unsigned idiomsPerProgram = 64;
+
+} // namespace
+
+class FuzzCommand::Impl final:
+        public FuzzCommand
+{
+public:
+    virtual auto name() const -> std::string override
+    {
+        return "fuzz";
+    }
+
+    virtual auto usage() const -> std::string override
+    {
+        return "fuzz [-n programs] [-f frames] [-s seed] [-t threads] [-j] [-d dir]";
+    }
+
+    virtual auto run(const std::vector<std::string> & args) -> int override
+    {
+        unsigned programCount = 1000;
+        unsigned frameCount = 3;
+        unsigned seed = 0;
+        unsigned threadCount = 0;
+        bool isJit = false;
+        std::string baseDir;
+
+        for(size_t i = 0; i < args.size(); ++i) {
+            const std::string & arg = args[i];
+            bool hasValue = (i + 1 < args.size());
+            if(arg == "-n" && hasValue) {
+                if(!parseUnsigned(args[++i], &programCount)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-f" && hasValue) {
+                if(!parseUnsigned(args[++i], &frameCount)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-s" && hasValue) {
+                if(!parseUnsigned(args[++i], &seed)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-t" && hasValue) {
+                if(!parseUnsigned(args[++i], &threadCount)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-j") {
+                isJit = true;
+            } else if(arg == "-d" && hasValue) {
+                baseDir = args[++i];
+            } else {
+                msg(LogLevel::error, "Unknown option \"%s\"", arg.data());
+                return 2;
+            }
+        }
+
+        if(programCount == 0 || frameCount == 0) {
+            msg(LogLevel::error, "Program and frame counts must be positive");
+            return 2;
+        }
+
+        // Reference machines dump to a directory of their own, as dump names
+        // would be the same
+        HeadlessEnvironment environment(baseDir);
+        HeadlessEnvironment refEnvironment(!baseDir.empty() ? baseDir + "/reference" : std::string());
+        std::unique_ptr<MachinePool> machinePool = MachinePool::create(&environment, threadCount);
+        captureLog(machinePool.get());
+
+        std::atomic<uint64_t> opCount(0);
+        std::atomic<uint64_t> stepCount(0);
+        std::atomic<bool> isDiverged(false);
+
+        auto startTime = std::chrono::steady_clock::now();
+        machinePool->run(programCount, [&](Machine * machine, size_t jobNum) {
+            if(isDiverged) {
+                return;
+            }
+
+            std::unique_ptr<Machine> refMachine = Machine::create(&refEnvironment);
+            refMachine->init();
+            machine->setLog(std::make_unique<NullLog>());
+            refMachine->setLog(std::make_unique<NullLog>());
+
+            machine->cpu()->setIdleSkip(true);
+            machine->cpu()->setJit(isJit);
+            machine->cpu()->setFusion(true);
+
+            std::unique_ptr<Validator> validator = Validator::create(machine, refMachine.get());
+            captureLog(validator.get());
+
+            std::mt19937 rng(seed + unsigned(jobNum));
+            setupProgram(machine, rng);
+            copyProgram(machine, refMachine.get());
+
+            for(unsigned frameNum = 0; frameNum < frameCount && !isDiverged; ++frameNum) {
+                if(!validator->runFrame()) {
+                    msg(LogLevel::error, "Program with seed %u diverged", seed + unsigned(jobNum));
+                    isDiverged = true;
+                }
+            }
+
+            opCount += validator->opCount();
+            stepCount += validator->stepCount();
+            refMachine->close();
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        msg(LogLevel::info, "Validated %u programs on %u threads: %llu ops in %llu steps, %.3f s, %.2f Mops/s",
+            programCount, machinePool->threadCount(),
+            static_cast<unsigned long long>(opCount.load()), static_cast<unsigned long long>(stepCount.load()),
+            seconds, opCount / seconds / 1e6);
+
+        return (isDiverged ? 1 : 0);
+    }
+
+private:
+    // Random code mostly avoiding hlt and out to port 80h, so it keeps
+    // running from ram, with idioms planted at random addresses
+    void setupProgram(Machine * machine, std::mt19937 & rng)
+    {
+        MemBank & ram = machine->memory()->memBanks()->ram;
+        for(uint8_t & data: ram) {
+            data = uint8_t(rng());
+            if(data == 0x76 || data == 0xd3) {
+                data = uint8_t(rng() & 0x3f);
+            }
+        }
+
+        uint16_t startAddr = uint16_t(rng());
+        for(unsigned idiomNum = 0; idiomNum < idiomsPerProgram; ++idiomNum) {
+            uint16_t headAddr = (idiomNum == 0 ? startAddr : uint16_t(rng()));
+            const std::vector<uint8_t> & idiom = idioms[rng() % idioms.size()];
+            uint16_t addr = headAddr;
+            for(uint8_t data: idiom) {
+                ram[addr++] = (data != 0 ? data : uint8_t(rng()));
+            }
+            if(idiom.back() == 0xc2) {
+                uint16_t targetAddr = (rng() % 4 != 0 ? headAddr : uint16_t(rng()));
+                ram[addr++] = uint8_t(targetAddr);
+                ram[addr++] = uint8_t(targetAddr >> 8);
+            }
+        }
+
+        IoPorts * ioPorts = machine->memory()->ioPorts();
+        ioPorts->port80 = 0xff;
+        ioPorts->port84 = (rng() % 2 != 0 ? 0x20 : 0x00);
+
+        // Small counters make loops end within a frame
+        CpuRegs * cpuRegs = machine->cpu()->cpuRegs();
+        cpuRegs->psw = uint16_t(rng());
+        cpuRegs->bc = uint16_t(rng());
+        cpuRegs->de = uint16_t(rng());
+        cpuRegs->hl = uint16_t(rng());
+        cpuRegs->sp = uint16_t(rng());
+        cpuRegs->pc = startAddr;
+        if(rng() % 2 != 0) {
+            cpuRegs->bc &= 0x03ff;
+            cpuRegs->de &= 0x03ff;
+            cpuRegs->hl &= 0x03ff;
+        }
+        cpuRegs->state = 0;
+    }
+
+    void copyProgram(Machine * machine, Machine * refMachine)
+    {
+        refMachine->memory()->memBanks()->ram = machine->memory()->memBanks()->ram;
+        *refMachine->memory()->ioPorts() = *machine->memory()->ioPorts();
+        *refMachine->cpu()->cpuRegs() = *machine->cpu()->cpuRegs();
+        machine->cpu()->memChanged();
+        refMachine->cpu()->memChanged();
+    }
+};
+
+auto FuzzCommand::create() -> std::unique_ptr<FuzzCommand>
+{
+    return std::make_unique<Impl>();
+}
@@ -0,0 +1,25 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include "command.h"
+#include "logging.h"
+#include <memory>
+
+// Random program fuzzer for cpu engine changes: fills ram with random code,
+// with op sequences run by fused handlers planted in, and runs it through
+// the validator against the plain interpreter, on all threads. Stops at the
+// first divergence, which is dumped when a directory is given
+
+class FuzzCommand:
+        public ICommand,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<FuzzCommand>;
+
+private:
+    class Impl;
+    explicit FuzzCommand() = default;
+};
+
+#endif // FUZZ_H
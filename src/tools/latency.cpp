@@ -0,0 +1,272 @@
+#include "latency.h"
+#include "machine.h"
+#include "stringf.h"
+#include <iostream>
+#include <cstring>
+
+namespace {
+
+// Wall time is counted in cpu clocks of real time since the machine start
+
+constexpr uint64_t neverClock = UINT64_MAX;
+constexpr unsigned clockRate = clocksPerFrame * videoFps;
+
+constexpr unsigned holdFrames = 5; // long enough for the key to be taken by the program
+
+// Frontend with scripted input: every frame is run at the start of its wall
+// time period taking 1/speed of it and presented right after
+
+class ScriptedMachine final
+{
+public:
+    explicit ScriptedMachine(IEnvironment * environment, bool isLateLatch, bool isJoystick, unsigned speed):
+        machine_m(Machine::create(environment)),
+        keyboardMatrix_m(machine_m->keyboard()->createTargetKeyboardMatrix()),
+        joystickMatrix_m(machine_m->joysticks()->createTargetJoystickMatrix()),
+        inPortHook_m(machine_m->cpu()->createInPortHook(memFunc(this, &ScriptedMachine::inPortHookFunc))),
+        isLateLatch_m(isLateLatch), isJoystick_m(isJoystick), speed_m(speed),
+        pressClock_m(neverClock), releaseClock_m(neverClock),
+        frameClock_m(0), isInputPolled_m(false)
+    {
+        machine_m->setLog(std::make_unique<NullLog>());
+        machine_m->init();
+        machine_m->video()->setPixelFormat(PixelFormat::xrgb8888);
+        machine_m->keyboard()->setLateLatch(isLateLatch_m);
+        machine_m->joysticks()->setLateLatch(isLateLatch_m);
+    }
+
+    ~ScriptedMachine()
+    {
+        machine_m->close();
+    }
+
+    void load(const std::string & fileName)
+    {
+        machine_m->bios()->setInstantLoad(true);
+        machine_m->media()->playbackFile.setFileName(fileName);
+        machine_m->bios()->initMediaHooks();
+    }
+
+    void press(uint64_t pressClock, uint64_t releaseClock)
+    {
+        pressClock_m = pressClock;
+        releaseClock_m = releaseClock;
+    }
+
+    // Returns wall time of the frame presentation
+    auto runFrame(unsigned frameNum) -> uint64_t
+    {
+        frameClock_m = uint64_t(frameNum) * clocksPerFrame;
+
+        machine_m->startFrame();
+        isInputPolled_m = false;
+        if(!isLateLatch_m) {
+            pollInput(frameClock_m);
+        }
+        machine_m->renderFrame();
+        if(!isInputPolled_m) {
+            pollInput(frameClock_m + clocksPerFrame / speed_m);
+        }
+        machine_m->endFrame();
+
+        return frameClock_m + clocksPerFrame / speed_m;
+    }
+
+    auto frameBuffer() -> FrameBuffer *
+    {
+        return machine_m->video()->frameBuffer();
+    }
+
+private:
+    void inPortHookFunc(uint8_t port)
+    {
+        if(isLateLatch_m && !isInputPolled_m) {
+            pollInput(frameClock_m + machine_m->cpu()->cpuRegs()->clock / speed_m);
+        }
+    }
+
+    void pollInput(uint64_t wallClock)
+    {
+        isInputPolled_m = true;
+
+        bool isPressed = (wallClock >= pressClock_m && wallClock < releaseClock_m);
+        if(isJoystick_m) {
+            joystickMatrix_m->setPressed(portKey(1, TargetJoystickKey::key1), isPressed);
+        } else {
+            keyboardMatrix_m->setPressed(TargetKeyboardKey::keyA, isPressed);
+        }
+    }
+
+    std::unique_ptr<Machine> machine_m;
+    std::unique_ptr<TargetKeyboardMatrix> keyboardMatrix_m;
+    std::unique_ptr<TargetJoystickMatrix> joystickMatrix_m;
+    std::unique_ptr<InPortHook> inPortHook_m;
+
+    bool isLateLatch_m;
+    bool isJoystick_m;
+    unsigned speed_m;
+
+    uint64_t pressClock_m;
+    uint64_t releaseClock_m;
+
+    uint64_t frameClock_m;
+    bool isInputPolled_m;
+};
+
+auto isSameFrame(FrameBuffer * lhs, FrameBuffer * rhs) -> bool
+{
+    return (memcmp(lhs->data(), rhs->data(), lhs->size()) == 0);
+}
+
+auto clocksToMs(uint64_t clocks) -> double
+{
+    return double(clocks) * 1000.0 / clockRate;
+}
+
+} // namespace
+
+class LatencyCommand::Impl final:
+        public LatencyCommand
+{
+public:
+    virtual auto name() const -> std::string override
+    {
+        return "latency";
+    }
+
+    virtual auto usage() const -> std::string override
+    {
+        return "latency [-n trials] [-s speed] [-w warmup_frames] [-f max_frames] [-j] [file]";
+    }
+
+    virtual auto run(const std::vector<std::string> & args) -> int override
+    {
+        unsigned trialCount = 10;
+        unsigned speed = 1;
+        unsigned warmupFrames = 300;
+        unsigned maxFrames = 50;
+        bool isJoystick = false;
+        std::string fileName;
+
+        for(size_t i = 0; i < args.size(); ++i) {
+            const std::string & arg = args[i];
+            bool hasValue = (i + 1 < args.size());
+            if(arg == "-n" && hasValue) {
+                if(!parseUnsigned(args[++i], &trialCount)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-s" && hasValue) {
+                if(!parseUnsigned(args[++i], &speed)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-w" && hasValue) {
+                if(!parseUnsigned(args[++i], &warmupFrames)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-f" && hasValue) {
+                if(!parseUnsigned(args[++i], &maxFrames)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-j") {
+                isJoystick = true;
+            } else if(!arg.empty() && arg[0] == '-') {
+                msg(LogLevel::error, "Unknown option \"%s\"", arg.data());
+                return 2;
+            } else if(fileName.empty()) {
+                fileName = arg;
+            } else {
+                msg(LogLevel::error, "Only one file can be tested at once");
+                return 2;
+            }
+        }
+
+        if(trialCount == 0 || speed == 0) {
+            msg(LogLevel::error, "Trial count and speed must be positive");
+            return 2;
+        }
+
+        HeadlessEnvironment environment;
+
+        double earlySum = 0.0;
+        double lateSum = 0.0;
+        unsigned respondedCount = 0;
+
+        std::cout << "phase,early_ms,late_ms" << std::endl;
+        for(unsigned trialNum = 0; trialNum < trialCount; ++trialNum) {
+            double phase = (trialNum + 0.5) / trialCount;
+            uint64_t pressClock = uint64_t(warmupFrames) * clocksPerFrame + uint64_t(phase * clocksPerFrame);
+
+            std::array<double, 2> latencies;
+            measure(&environment, fileName, isJoystick, speed, warmupFrames, maxFrames, pressClock, &latencies);
+
+            std::cout << stringf("%.3f", phase) << ','
+                      << (latencies[0] >= 0.0 ? stringf("%.2f", latencies[0]) : "") << ','
+                      << (latencies[1] >= 0.0 ? stringf("%.2f", latencies[1]) : "") << std::endl;
+
+            if(latencies[0] >= 0.0 && latencies[1] >= 0.0) {
+                earlySum += latencies[0];
+                lateSum += latencies[1];
+                ++respondedCount;
+            }
+        }
+
+        if(respondedCount == 0) {
+            msg(LogLevel::error, "No frame change within %u frames after the input", maxFrames);
+            return 1;
+        }
+        msg(LogLevel::info, "Mean input-to-pixel latency over %u trials at %ux speed: early latch %.2f ms, late latch %.2f ms",
+            respondedCount, speed, earlySum / respondedCount, lateSum / respondedCount);
+
+        return (respondedCount == trialCount ? 0 : 1);
+    }
+
+private:
+    // Runs an untouched machine along with the early and late latch ones, and
+    // takes the first frame differing from the untouched one as the response.
+    // Negative latency means no response
+    void measure(IEnvironment * environment, const std::string & fileName, bool isJoystick,
+                 unsigned speed, unsigned warmupFrames, unsigned maxFrames,
+                 uint64_t pressClock, std::array<double, 2> * latencies)
+    {
+        ScriptedMachine idleMachine(environment, false, isJoystick, speed);
+        std::array<std::unique_ptr<ScriptedMachine>, 2> machines = {
+            std::make_unique<ScriptedMachine>(environment, false, isJoystick, speed),
+            std::make_unique<ScriptedMachine>(environment, true, isJoystick, speed)
+        };
+
+        if(!fileName.empty()) {
+            idleMachine.load(fileName);
+        }
+        for(size_t i = 0; i < machines.size(); ++i) {
+            if(!fileName.empty()) {
+                machines[i]->load(fileName);
+            }
+            machines[i]->press(pressClock, pressClock + holdFrames * clocksPerFrame);
+            (*latencies)[i] = -1.0;
+        }
+
+        for(unsigned frameNum = 0; frameNum < warmupFrames + maxFrames; ++frameNum) {
+            idleMachine.runFrame(frameNum);
+            bool isDone = true;
+            for(size_t i = 0; i < machines.size(); ++i) {
+                uint64_t presentClock = machines[i]->runFrame(frameNum);
+                if((*latencies)[i] < 0.0 && !isSameFrame(machines[i]->frameBuffer(), idleMachine.frameBuffer())) {
+                    (*latencies)[i] = clocksToMs(presentClock - std::min(presentClock, pressClock));
+                }
+                isDone = isDone && (*latencies)[i] >= 0.0;
+            }
+            if(isDone) {
+                break;
+            }
+        }
+    }
+};
+
+auto LatencyCommand::create() -> std::unique_ptr<LatencyCommand>
+{
+    return std::make_unique<Impl>();
+}
@@ -0,0 +1,24 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "command.h"
+#include "logging.h"
+#include <memory>
+
+// Scripted input-to-pixel latency test: presses a key at different moments
+// of wall time with the frontend pacing emulated, and measures time until
+// the presented frame changes, both with early and late input latch
+
+class LatencyCommand:
+        public ICommand,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<LatencyCommand>;
+
+private:
+    class Impl;
+    explicit LatencyCommand() = default;
+};
+
+#endif // LATENCY_H
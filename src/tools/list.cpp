@@ -0,0 +1,69 @@
+#include "list.h"
+#include "cas.h"
+#include <cstdio>
+
+namespace {
+
+const char * blockTypeName(CasBlockType type)
+{
+    switch(type) {
+        case CasBlockType::data:
+            return "data";
+        case CasBlockType::binary:
+            return "binary";
+        case CasBlockType::basic:
+            return "basic";
+        case CasBlockType::ascii:
+            return "ascii";
+    }
+    return "";
+}
+
+} // namespace
+
+class ListCommand::Impl final:
+        public ListCommand
+{
+public:
+    virtual auto name() const -> std::string override
+    {
+        return "list";
+    }
+
+    virtual auto usage() const -> std::string override
+    {
+        return "list file.cas...";
+    }
+
+    virtual auto run(const std::vector<std::string> & args) -> int override
+    {
+        if(args.empty()) {
+            msg(LogLevel::error, "No files to list");
+            return 2;
+        }
+
+        int result = 0;
+        std::unique_ptr<CasFileReader> casFileReader = CasFileReader::create();
+        captureLog(casFileReader.get());
+        for(const std::string & fileName: args) {
+            casFileReader->open(fileName);
+            if(!casFileReader->isValid()) {
+                result = 1;
+                continue;
+            }
+            printf("%s\n", fileName.data());
+            for(size_t i = 0; i < casFileReader->blockCount(); ++i) {
+                CasBlockInfo block = casFileReader->blockInfo(i);
+                printf("%6zu %10zu %8zu  %-6s %s\n", i, block.offset, block.size,
+                       blockTypeName(block.type), block.name.data());
+            }
+            casFileReader->close();
+        }
+        return result;
+    }
+};
+
+auto ListCommand::create() -> std::unique_ptr<ListCommand>
+{
+    return std::make_unique<Impl>();
+}
@@ -0,0 +1,22 @@
+#ifndef LIST_H
+#define LIST_H
+
+#include "command.h"
+#include "logging.h"
+#include <memory>
+
+// Prints block index of CAS files
+
+class ListCommand:
+        public ICommand,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<ListCommand>;
+
+private:
+    class Impl;
+    explicit ListCommand() = default;
+};
+
+#endif // LIST_H
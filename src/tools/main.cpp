@@ -0,0 +1,42 @@
+#include "bench.h"
+#include "convert.h"
+#include "cpmtest.h"
+#include "fuzz.h"
+#include "latency.h"
+#include "list.h"
+#include "snapshot.h"
+#include "tapebench.h"
+#include "timing.h"
+#include "verify.h"
+#include <cstdio>
+
+int main(int argc, char * argv[])
+{
+    std::vector<std::unique_ptr<ICommand>> commands;
+    commands.push_back(ListCommand::create());
+    commands.push_back(VerifyCommand::create());
+    commands.push_back(SnapshotCommand::create());
+    commands.push_back(ConvertCommand::create());
+    commands.push_back(TapeBenchCommand::create());
+    commands.push_back(LatencyCommand::create());
+    commands.push_back(BenchCommand::create());
+    commands.push_back(FuzzCommand::create());
+    commands.push_back(CpmTestCommand::create());
+    commands.push_back(TimingCommand::create());
+
+    if(argc >= 2) {
+        std::string name = argv[1];
+        for(auto & command: commands) {
+            if(command->name() == name) {
+                return command->run(std::vector<std::string>(argv + 2, argv + argc));
+            }
+        }
+    }
+
+    fprintf(stderr, "Usage: %s <command> [args...]\n", argv[0]);
+    fprintf(stderr, "Commands:\n");
+    for(auto & command: commands) {
+        fprintf(stderr, "    %s\n", command->usage().data());
+    }
+    return 2;
+}
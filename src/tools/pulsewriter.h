@@ -0,0 +1,87 @@
+#ifndef PULSEWRITER_H
+#define PULSEWRITER_H
+
+#include "pwe.h"
+
+struct Pulse final
+{
+    uint64_t first;  // clocks before the rising edge
+    uint64_t second; // clocks before the falling edge
+};
+
+// Measured on BIOS save routine with default timing constants at fdf0h/fdf2h
+constexpr Pulse shortPulse = {  550, 536 };
+constexpr Pulse longPulse  = { 1200, 976 };
+constexpr Pulse startPulse = { 1165, 976 }; // start bit is a slightly shortened long pulse
+
+constexpr size_t headerTonePulses = 16384;
+constexpr size_t dataTonePulses   = 4096;
+
+constexpr uint64_t headerGapClocks = pweDefaultClockRate;     // silence before header block tone
+constexpr uint64_t dataGapClocks   = pweDefaultClockRate / 2; // silence before data block tone
+
+// Turns tape data into edges timed in cpu clocks, passed to anything having
+// writeEdge(uint64_t clock)
+
+template <typename EdgeWriterT>
+class PulseWriter final
+{
+public:
+    explicit PulseWriter(EdgeWriterT * edgeWriter):
+        edgeWriter_m(edgeWriter), clock_m(0)
+    {}
+
+    void writeGap(uint64_t clocks)
+    {
+        clock_m += clocks;
+    }
+
+    void writeTone(size_t pulseCount)
+    {
+        for(size_t i = 0; i < pulseCount; ++i) {
+            writePulse(shortPulse);
+        }
+    }
+
+    // Start bit, 8 data bits starting from the lowest one, 2 stop bits. Zero
+    // bit is a long pulse, one bit is two short pulses
+    void writeByte(uint8_t data)
+    {
+        writePulse(startPulse);
+        for(size_t i = 0; i < 8; ++i) {
+            writeBit(data & 1);
+            data >>= 1;
+        }
+        writeBit(true);
+        writeBit(true);
+    }
+
+    auto clock() const -> uint64_t
+    {
+        return clock_m;
+    }
+
+private:
+    void writeBit(bool bit)
+    {
+        if(bit) {
+            writePulse(shortPulse);
+            writePulse(shortPulse);
+        } else {
+            writePulse(longPulse);
+        }
+    }
+
+    void writePulse(const Pulse & pulse)
+    {
+        clock_m += pulse.first;
+        edgeWriter_m->writeEdge(clock_m);
+        clock_m += pulse.second;
+        edgeWriter_m->writeEdge(clock_m);
+    }
+
+    EdgeWriterT * edgeWriter_m;
+    uint64_t clock_m;
+};
+
+#endif // PULSEWRITER_H
@@ -0,0 +1,95 @@
+#include "snapshot.h"
+#include "machinepool.h"
+#include "pmi.h"
+
+class SnapshotCommand::Impl final:
+        public SnapshotCommand
+{
+public:
+    virtual auto name() const -> std::string override
+    {
+        return "snapshot";
+    }
+
+    virtual auto usage() const -> std::string override
+    {
+        return "snapshot [-f frame] [-o out.pmi] [-b] file";
+    }
+
+    virtual auto run(const std::vector<std::string> & args) -> int override
+    {
+        unsigned frameNum = 500;
+        bool isByteLoad = false;
+        std::string outFileName;
+        std::string fileName;
+
+        for(size_t i = 0; i < args.size(); ++i) {
+            const std::string & arg = args[i];
+            bool hasValue = (i + 1 < args.size());
+            if(arg == "-f" && hasValue) {
+                if(!parseUnsigned(args[++i], &frameNum)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-o" && hasValue) {
+                outFileName = args[++i];
+            } else if(arg == "-b") {
+                isByteLoad = true;
+            } else if(!arg.empty() && arg[0] == '-') {
+                msg(LogLevel::error, "Unknown option \"%s\"", arg.data());
+                return 2;
+            } else if(fileName.empty()) {
+                fileName = arg;
+            } else {
+                msg(LogLevel::error, "Only one file can be snapshotted at once");
+                return 2;
+            }
+        }
+
+        if(fileName.empty()) {
+            msg(LogLevel::error, "No file to snapshot");
+            return 2;
+        }
+        if(outFileName.empty()) {
+            size_t pos = fileName.rfind('.');
+            outFileName = (pos != std::string::npos && fileName.find('/', pos) == std::string::npos ?
+                               fileName.substr(0, pos) : fileName) + ".pmi";
+        }
+
+        HeadlessEnvironment environment;
+        std::unique_ptr<Machine> machine = Machine::create(&environment);
+        captureLog(machine.get());
+        machine->init();
+
+        machine->bios()->setInstantLoad(!isByteLoad);
+        machine->media()->playbackFile.setFileName(fileName);
+        if(machine->media()->playbackFile.fileFmt() == FileFmt::unknown) {
+            msg(LogLevel::error, "Unknown format of file \"%s\"", fileName.data());
+            return 1;
+        }
+        machine->bios()->initMediaHooks();
+
+        MachinePool::runFrames(machine.get(), frameNum);
+
+        std::unique_ptr<PmiImage> image = std::make_unique<PmiImage>();
+        machine->bios()->captureImage(image.get());
+        machine->close();
+
+        std::unique_ptr<PmiFileWriter> pmiFileWriter = PmiFileWriter::create();
+        captureLog(pmiFileWriter.get());
+        pmiFileWriter->open(outFileName);
+        pmiFileWriter->write(*image);
+        if(!pmiFileWriter->isValid()) {
+            return 1;
+        }
+        pmiFileWriter->close();
+
+        msg(LogLevel::info, "Saved frame %u of \"%s\" to \"%s\"", frameNum, fileName.data(), outFileName.data());
+        return 0;
+    }
+};
+
+auto SnapshotCommand::create() -> std::unique_ptr<SnapshotCommand>
+{
+    return std::make_unique<Impl>();
+}
@@ -0,0 +1,23 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "command.h"
+#include "logging.h"
+#include <memory>
+
+// Runs a machine with the given media up to the chosen frame and saves its
+// state as PMI memory image
+
+class SnapshotCommand:
+        public ICommand,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<SnapshotCommand>;
+
+private:
+    class Impl;
+    explicit SnapshotCommand() = default;
+};
+
+#endif // SNAPSHOT_H
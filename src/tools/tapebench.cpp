@@ -0,0 +1,351 @@
+#include "tapebench.h"
+#include "cas.h"
+#include "wav.h"
+#include "comparator.h"
+#include "adaptivecomparator.h"
+#include "pulsewriter.h"
+#include "stringf.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+struct Degradation final
+{
+    const char * name;
+    float gain;
+    float offset;
+    float noise; // standard deviation
+};
+
+constexpr Degradation degradations[] = {
+    { "clean",       1.00f,     0.0f,    0.0f },
+    { "quiet",       0.20f,     0.0f,    0.0f },
+    { "faint",       0.05f,     0.0f,    0.0f },
+    { "offset",      0.50f, 16384.0f,    0.0f },
+    { "noisy",       0.50f,     0.0f, 3000.0f },
+    { "faint-mixed", 0.10f,  4096.0f,  300.0f }
+};
+
+constexpr size_t degradationCount = sizeof(degradations) / sizeof(degradations[0]);
+
+constexpr double pi = 3.14159265358979323846;
+
+constexpr float  signalLevel     = 24576.0f;
+constexpr double tapeLowpassHz   = 6000.0; // head and amplifier response
+constexpr double tapeHighpassHz  = 100.0;  // AC coupling
+
+// Pulses are measured between falling edges, so every pulse is timed as a whole
+constexpr uint64_t bitThresholdClocks = (shortPulse.first + shortPulse.second +
+                                         longPulse.first + longPulse.second) / 2;
+constexpr uint64_t minPulseClocks     = (shortPulse.first + shortPulse.second) / 2;
+constexpr uint64_t maxPulseClocks     = (longPulse.first + longPulse.second) * 3 / 2;
+
+constexpr size_t syncPulses = 64; // tone pulses to lock on before taking bytes
+
+constexpr size_t bufSamples = 4096;
+
+struct EdgeList final
+{
+    std::vector<uint64_t> edges;
+
+    void writeEdge(uint64_t clock)
+    {
+        edges.push_back(clock);
+    }
+};
+
+// Deterministic noise, so the runs are comparable
+class NoiseSource final
+{
+public:
+    // Roughly gaussian with unit deviation
+    auto next() -> float
+    {
+        float sum = 0;
+        for(int i = 0; i < 4; ++i) {
+            sum += float(nextUniform()) / 2147483648.0f;
+        }
+        return sum * 0.8660254f;
+    }
+
+private:
+    auto nextUniform() -> int32_t
+    {
+        state_m ^= state_m << 13;
+        state_m ^= state_m >> 17;
+        state_m ^= state_m << 5;
+        return int32_t(state_m);
+    }
+
+    uint32_t state_m = 2463534242;
+};
+
+auto synthesize(const std::vector<uint64_t> & edges, int sampleRate, const Degradation & degradation) -> std::vector<int16_t>
+{
+    uint64_t clockCount = (edges.empty() ? 0 : edges.back()) + pweDefaultClockRate / 10;
+    std::vector<int16_t> samples(size_t(clockCount * uint64_t(sampleRate) / pweDefaultClockRate));
+
+    float lowpassFactor = float(1.0 - exp(-2.0 * pi * tapeLowpassHz / sampleRate));
+    float highpassFactor = float(1.0 - exp(-2.0 * pi * tapeHighpassHz / sampleRate));
+    float lowpass = -signalLevel;
+    float dc = -signalLevel;
+    bool isHighLevel = false;
+    size_t edgeNum = 0;
+    NoiseSource noise;
+
+    for(size_t i = 0; i < samples.size(); ++i) {
+        uint64_t clock = uint64_t(i) * pweDefaultClockRate / uint64_t(sampleRate);
+        while(edgeNum < edges.size() && edges[edgeNum] <= clock) {
+            isHighLevel = !isHighLevel;
+            ++edgeNum;
+        }
+        lowpass += ((isHighLevel ? signalLevel : -signalLevel) - lowpass) * lowpassFactor;
+        dc += (lowpass - dc) * highpassFactor;
+
+        float sample = (lowpass - dc) * degradation.gain + degradation.offset + noise.next() * degradation.noise;
+        samples[i] = int16_t(std::min(std::max(sample, -32768.0f), 32767.0f));
+    }
+    return samples;
+}
+
+auto readFallingEdges(const std::vector<int16_t> & samples, int sampleRate, ICvt * comparator) -> std::vector<uint64_t>
+{
+    std::vector<uint64_t> edges;
+    std::vector<int32_t> sampleBuf(bufSamples);
+    std::vector<int32_t> levelBuf(bufSamples);
+    bool isHighLevel = false;
+
+    for(size_t pos = 0; pos < samples.size(); pos += bufSamples) {
+        size_t count = std::min(bufSamples, samples.size() - pos);
+        std::copy(samples.begin() + ptrdiff_t(pos), samples.begin() + ptrdiff_t(pos + count), sampleBuf.begin());
+
+        Slice<const uint8_t> source(reinterpret_cast<const uint8_t *>(sampleBuf.data()), count * sizeof(int32_t));
+        Slice<uint8_t> target(reinterpret_cast<uint8_t *>(levelBuf.data()), count * sizeof(int32_t));
+        comparator->convert(&source, &target);
+
+        for(size_t i = 0; i < count; ++i) {
+            if((levelBuf[i] > 0) == isHighLevel) {
+                continue;
+            }
+            isHighLevel = !isHighLevel;
+            if(!isHighLevel) {
+                edges.push_back(uint64_t(pos + i) * pweDefaultClockRate / uint64_t(sampleRate));
+            }
+        }
+    }
+    return edges;
+}
+
+// Same byte framing as BIOS uses: tone and stop bits are short pulses, a long
+// pulse after them is the start bit. Bytes are only taken after the tone has
+// been locked on, any malformed pulse drops the lock
+auto decodeBytes(const std::vector<uint64_t> & edges) -> std::vector<uint8_t>
+{
+    std::vector<uint8_t> bytes;
+    size_t tonePulses = 0;
+    size_t i = 1;
+    auto nextPulse = [&]() -> uint64_t {
+        uint64_t period = edges[i] - edges[i - 1];
+        ++i;
+        if(period < minPulseClocks || period > maxPulseClocks) {
+            tonePulses = 0;
+            return 0;
+        }
+        return period;
+    };
+
+    while(i < edges.size()) {
+        uint64_t period = nextPulse();
+        if(period == 0) {
+            continue;
+        }
+        if(period < bitThresholdClocks) {
+            ++tonePulses;
+            continue;
+        }
+        if(tonePulses < syncPulses) {
+            tonePulses = 0;
+            continue;
+        }
+
+        uint8_t data = 0;
+        for(int bit = 0; bit < 8 && i < edges.size() && tonePulses > 0; ++bit) {
+            period = nextPulse();
+            if(period != 0 && period < bitThresholdClocks) {
+                data |= uint8_t(1 << bit);
+                if(i < edges.size()) {
+                    nextPulse(); // second short pulse
+                }
+            }
+        }
+        if(tonePulses > 0) {
+            bytes.push_back(data);
+        }
+    }
+    return bytes;
+}
+
+auto countErrors(const std::vector<uint8_t> & expected, const std::vector<uint8_t> & actual) -> size_t
+{
+    size_t count = std::min(expected.size(), actual.size());
+    size_t errors = std::max(expected.size(), actual.size()) - count;
+    for(size_t i = 0; i < count; ++i) {
+        if(expected[i] != actual[i]) {
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+auto baseName(const std::string & fileName) -> std::string
+{
+    size_t begin = fileName.find_last_of("/\\");
+    begin = (begin == std::string::npos ? 0 : begin + 1);
+    size_t end = fileName.rfind('.');
+    if(end == std::string::npos || end < begin) {
+        end = fileName.size();
+    }
+    return fileName.substr(begin, end - begin);
+}
+
+} // namespace
+
+class TapeBenchCommand::Impl final:
+        public TapeBenchCommand
+{
+public:
+    virtual auto name() const -> std::string override
+    {
+        return "tapebench";
+    }
+
+    virtual auto usage() const -> std::string override
+    {
+        return "tapebench [-r rate] [-w wav_dir] file.cas...";
+    }
+
+    virtual auto run(const std::vector<std::string> & args) -> int override
+    {
+        int sampleRate = 44100;
+        std::string wavDirName;
+        std::vector<std::string> fileNames;
+
+        for(size_t i = 0; i < args.size(); ++i) {
+            const std::string & arg = args[i];
+            bool hasValue = (i + 1 < args.size());
+            if(arg == "-r" && hasValue) {
+                unsigned value;
+                if(!parseUnsigned(args[++i], &value)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+                sampleRate = int(value);
+            } else if(arg == "-w" && hasValue) {
+                wavDirName = args[++i];
+            } else if(!arg.empty() && arg[0] == '-') {
+                msg(LogLevel::error, "Unknown option \"%s\"", arg.data());
+                return 2;
+            } else {
+                fileNames.push_back(arg);
+            }
+        }
+
+        if(fileNames.empty()) {
+            msg(LogLevel::error, "No files to benchmark");
+            return 2;
+        }
+        if(sampleRate < 8000 || sampleRate > wavMaxSampleRate) {
+            msg(LogLevel::error, "Invalid sample rate %d", sampleRate);
+            return 2;
+        }
+
+        size_t runCount = 0;
+        size_t fixedCount = 0;
+        size_t adaptiveCount = 0;
+        std::cout << "file,degradation,bytes,fixed_errors,adaptive_errors" << std::endl;
+        for(const std::string & fileName: fileNames) {
+            std::vector<uint8_t> data;
+            EdgeList edgeList;
+            if(!readCas(fileName, &data, &edgeList)) {
+                continue;
+            }
+
+            for(const Degradation & degradation: degradations) {
+                std::vector<int16_t> samples = synthesize(edgeList.edges, sampleRate, degradation);
+                if(!wavDirName.empty()) {
+                    writeWav(wavDirName + "/" + baseName(fileName) + "-" + degradation.name + ".wav",
+                             samples, sampleRate);
+                }
+
+                std::unique_ptr<ICvt> fixed = Comparator::create();
+                std::unique_ptr<ICvt> adaptive = AdaptiveComparator::create(sampleRate);
+                size_t fixedErrors = countErrors(data, decodeBytes(readFallingEdges(samples, sampleRate, fixed.get())));
+                size_t adaptiveErrors = countErrors(data, decodeBytes(readFallingEdges(samples, sampleRate, adaptive.get())));
+
+                std::cout << '"' << fileName << "\"," << degradation.name << ','
+                          << data.size() << ',' << fixedErrors << ',' << adaptiveErrors << std::endl;
+                ++runCount;
+                fixedCount += (fixedErrors == 0 ? 1 : 0);
+                adaptiveCount += (adaptiveErrors == 0 ? 1 : 0);
+            }
+        }
+
+        msg(LogLevel::info, "Decoded %zu captures of %zu degradation kinds: fixed=%zu adaptive=%zu",
+            runCount, degradationCount, fixedCount, adaptiveCount);
+
+        return (runCount > 0 && adaptiveCount == runCount ? 0 : 1);
+    }
+
+private:
+    // Pulses are timed the same way the convert command does
+    auto readCas(const std::string & fileName, std::vector<uint8_t> * data, EdgeList * edgeList) -> bool
+    {
+        std::unique_ptr<CasFileReader> casFileReader = CasFileReader::create();
+        captureLog(casFileReader.get());
+        casFileReader->open(fileName);
+        if(!casFileReader->isValid()) {
+            return false;
+        }
+
+        PulseWriter<EdgeList> pulseWriter(edgeList);
+        std::vector<uint8_t> buf;
+        for(size_t i = 0; i < casFileReader->blockCount(); ++i) {
+            CasBlockInfo block = casFileReader->blockInfo(i);
+            if(block.size == 0) {
+                continue;
+            }
+            casFileReader->seekBlock(i);
+            buf.resize(block.size);
+            casFileReader->read(buf.data(), buf.size());
+            if(!casFileReader->isValid()) {
+                return false;
+            }
+
+            bool isHeader = (block.type != CasBlockType::data);
+            pulseWriter.writeGap(isHeader ? headerGapClocks : dataGapClocks);
+            pulseWriter.writeTone(isHeader ? headerTonePulses : dataTonePulses);
+            for(uint8_t byte: buf) {
+                pulseWriter.writeByte(byte);
+            }
+            data->insert(data->end(), buf.begin(), buf.end());
+        }
+        return true;
+    }
+
+    void writeWav(const std::string & fileName, const std::vector<int16_t> & samples, int sampleRate)
+    {
+        std::unique_ptr<WavFileWriter> wavFileWriter = WavFileWriter::create();
+        captureLog(wavFileWriter.get());
+        wavFileWriter->open(fileName, true, {1, sampleRate, 16});
+        wavFileWriter->write(reinterpret_cast<const uint8_t *>(samples.data()), samples.size() * sizeof(int16_t));
+        wavFileWriter->close();
+    }
+};
+
+auto TapeBenchCommand::create() -> std::unique_ptr<TapeBenchCommand>
+{
+    return std::make_unique<Impl>();
+}
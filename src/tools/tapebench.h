@@ -0,0 +1,24 @@
+#ifndef TAPEBENCH_H
+#define TAPEBENCH_H
+
+#include "command.h"
+#include "logging.h"
+#include <memory>
+
+// Tape decoding benchmark: turns CAS files into a corpus of degraded captures
+// (quiet, DC offset, noisy), runs them through the fixed and the adaptive
+// comparators, decodes the bytes back and reports results as CSV
+
+class TapeBenchCommand:
+        public ICommand,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<TapeBenchCommand>;
+
+private:
+    class Impl;
+    explicit TapeBenchCommand() = default;
+};
+
+#endif // TAPEBENCH_H
@@ -0,0 +1,307 @@
+#include "timing.h"
+#include "machine.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <tuple>
+
+namespace {
+
+constexpr unsigned scanlineClocks = 160;
+
+constexpr uint16_t dataAddr  = 0xc000; // memory operands and stack are always in ram
+constexpr uint16_t stackAddr = 0xd000;
+
+// Bank code is run from and region it's mapped at. Waits are chosen by
+// region, so ram code is timed in region 0 as well as in region 3
+struct CodePlace final
+{
+    const char * name;
+    MemBankType bank;
+    uint8_t port80;
+    uint16_t addr;
+};
+
+constexpr std::array<CodePlace, 3> codePlaces = {{
+    {"rom0", MemBankType::rom, 0xfc, 0x0100},
+    {"ram0", MemBankType::ram, 0xff, 0x0100},
+    {"ram3", MemBankType::ram, 0xff, 0xe000}
+}};
+
+constexpr uint8_t flagsClear = 0x02;
+constexpr uint8_t flagsSet   = 0xd7;
+
+// Clocks an op takes starting at each scanline clock, as the shortest
+// repeating part of wait clocks over the minimum
+struct Timing final
+{
+    unsigned minClocks;
+    std::string waits;
+};
+
+// Op, code place name, ram mode and flags ("-" for ops not depending on them)
+using TimingKey = std::tuple<unsigned, std::string, unsigned, std::string>;
+
+auto isConditional(uint8_t op) -> bool
+{
+    return ((op & 0xc7) == 0xc0 || (op & 0xc7) == 0xc2 || (op & 0xc7) == 0xc4);
+}
+
+auto waitChar(unsigned waitClocks) -> char
+{
+    return char(waitClocks < 10 ? '0' + waitClocks : 'a' + waitClocks - 10);
+}
+
+} // namespace
+
+class TimingCommand::Impl final:
+        public TimingCommand
+{
+public:
+    virtual auto name() const -> std::string override
+    {
+        return "timing";
+    }
+
+    virtual auto usage() const -> std::string override
+    {
+        return "timing [-g] [-v] table.csv";
+    }
+
+    virtual auto run(const std::vector<std::string> & args) -> int override
+    {
+        bool isGenerate = false;
+        bool isVerbose = false;
+        std::string fileName;
+
+        for(size_t i = 0; i < args.size(); ++i) {
+            const std::string & arg = args[i];
+            if(arg == "-g") {
+                isGenerate = true;
+            } else if(arg == "-v") {
+                isVerbose = true;
+            } else if(!arg.empty() && arg[0] == '-') {
+                msg(LogLevel::error, "Unknown option \"%s\"", arg.data());
+                return 2;
+            } else if(fileName.empty()) {
+                fileName = arg;
+            } else {
+                msg(LogLevel::error, "Only one table can be used at once");
+                return 2;
+            }
+        }
+
+        if(fileName.empty()) {
+            msg(LogLevel::error, "No timing table given");
+            return 2;
+        }
+
+        std::map<TimingKey, Timing> timings = measure();
+
+        if(isGenerate) {
+            std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+            if(!file) {
+                msg(LogLevel::error, "Could not open table file \"%s\"", fileName.data());
+                return 1;
+            }
+            file << "op,bank,mode,flags,clocks,waits" << std::endl;
+            for(const auto & timing: timings) {
+                file << stringf("%02x,", std::get<0>(timing.first)) << std::get<1>(timing.first) << ','
+                     << std::get<2>(timing.first) << ',' << std::get<3>(timing.first) << ','
+                     << timing.second.minClocks << ',' << timing.second.waits << std::endl;
+            }
+            msg(LogLevel::info, "Written %zu timings to \"%s\"", timings.size(), fileName.data());
+            return 0;
+        }
+
+        std::map<TimingKey, Timing> expectedTimings;
+        if(!readTable(fileName, &expectedTimings)) {
+            return 1;
+        }
+
+        size_t failCount = 0;
+        for(const auto & timing: timings) {
+            auto it = expectedTimings.find(timing.first);
+            bool isMissing = (it == expectedTimings.end());
+            if(!isMissing && it->second.minClocks == timing.second.minClocks && it->second.waits == timing.second.waits) {
+                continue;
+            }
+            ++failCount;
+            if(isVerbose || failCount == 1) {
+                const TimingKey & key = timing.first;
+                std::string where = stringf("Op %02x from %s in mode %u with flags %s", std::get<0>(key),
+                                            std::get<1>(key).data(), std::get<2>(key), std::get<3>(key).data());
+                if(isMissing) {
+                    msg(LogLevel::error, "%s: no expected timing", where.data());
+                } else {
+                    unsigned phase = mismatchPhase(timing.second, it->second);
+                    msg(LogLevel::error, "%s: takes %u clocks at scanline clock %u, %u expected", where.data(),
+                        clocksAt(timing.second, phase), phase, clocksAt(it->second, phase));
+                }
+            }
+        }
+
+        msg(LogLevel::info, "Checked %zu timings: %zu mismatched", timings.size(), failCount);
+        return (failCount == 0 && timings.size() == expectedTimings.size() ? 0 : 1);
+    }
+
+private:
+    auto measure() -> std::map<TimingKey, Timing>
+    {
+        HeadlessEnvironment environment;
+        std::unique_ptr<Machine> machine = Machine::create(&environment);
+        machine->setLog(std::make_unique<NullLog>());
+        machine->init();
+
+        Cpu * cpu = machine->cpu();
+        cpu->setIdleSkip(false);
+        cpu->setJit(false);
+        cpu->setFusion(false);
+
+        std::map<TimingKey, Timing> timings;
+        for(const CodePlace & codePlace: codePlaces) {
+            for(unsigned ramMode: { 0u, 1u }) {
+                // Port 84h bit 5 selects ram mode 0, the rest is left as on reset
+                IoPorts * ioPorts = machine->memory()->ioPorts();
+                ioPorts->port80 = codePlace.port80;
+                ioPorts->port84 = (ramMode == 0 ? 0x2f : 0x0f);
+                cpu->startFrame();
+
+                // Hlt waits for the frame end, so takes no fixed time
+                for(unsigned op = 0; op < 0x100; ++op) {
+                    if(op == 0x76) {
+                        continue;
+                    }
+                    std::string bank = codePlace.name;
+                    if(isConditional(uint8_t(op))) {
+                        timings[TimingKey(op, bank, ramMode, "0")] = measureOp(machine.get(), uint8_t(op), codePlace, flagsClear);
+                        timings[TimingKey(op, bank, ramMode, "1")] = measureOp(machine.get(), uint8_t(op), codePlace, flagsSet);
+                    } else {
+                        timings[TimingKey(op, bank, ramMode, "-")] = measureOp(machine.get(), uint8_t(op), codePlace, flagsClear);
+                    }
+                }
+            }
+        }
+
+        machine->close();
+        return timings;
+    }
+
+    auto measureOp(Machine * machine, uint8_t op, const CodePlace & codePlace, uint8_t flags) -> Timing
+    {
+        Cpu * cpu = machine->cpu();
+        CpuRegs * cpuRegs = cpu->cpuRegs();
+        MemBanks * memBanks = machine->memory()->memBanks();
+
+        // Rom is patched for the op only
+        uint16_t codeAddr = codePlace.addr;
+        MemBank & codeBank = (codePlace.bank == MemBankType::rom ? memBanks->rom : memBanks->ram);
+        std::array<uint8_t, 3> savedCode = { codeBank[codeAddr], codeBank[codeAddr + 1], codeBank[codeAddr + 2] };
+        codeBank[codeAddr] = op;
+        codeBank[codeAddr + 1] = uint8_t(dataAddr);
+        codeBank[codeAddr + 2] = uint8_t(dataAddr >> 8);
+        cpu->memChanged();
+
+        std::array<unsigned, scanlineClocks> clocks;
+        for(unsigned phase = 0; phase < scanlineClocks; ++phase) {
+            cpuRegs->state = 0;
+            cpuRegs->a = 0;
+            cpuRegs->f = flags;
+            cpuRegs->bc = dataAddr;
+            cpuRegs->de = dataAddr;
+            cpuRegs->hl = dataAddr;
+            cpuRegs->sp = stackAddr;
+            cpuRegs->pc = codeAddr;
+            cpuRegs->clock = phase;
+            cpu->runStep();
+            clocks[phase] = cpuRegs->clock - phase;
+        }
+
+        std::copy(savedCode.begin(), savedCode.end(), &codeBank[codeAddr]);
+        cpu->memChanged();
+
+        Timing timing;
+        timing.minClocks = *std::min_element(clocks.begin(), clocks.end());
+        size_t period = 1;
+        while(period < scanlineClocks && !isPeriod(clocks, period)) {
+            ++period;
+        }
+        for(size_t phase = 0; phase < period; ++phase) {
+            timing.waits += waitChar(clocks[phase] - timing.minClocks);
+        }
+        return timing;
+    }
+
+    static auto isPeriod(const std::array<unsigned, scanlineClocks> & clocks, size_t period) -> bool
+    {
+        if(scanlineClocks % period != 0) {
+            return false;
+        }
+        for(size_t phase = period; phase < scanlineClocks; ++phase) {
+            if(clocks[phase] != clocks[phase - period]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static auto clocksAt(const Timing & timing, unsigned phase) -> unsigned
+    {
+        char c = timing.waits[phase % timing.waits.size()];
+        return timing.minClocks + unsigned(c <= '9' ? c - '0' : c - 'a' + 10);
+    }
+
+    static auto mismatchPhase(const Timing & timing, const Timing & expectedTiming) -> unsigned
+    {
+        for(unsigned phase = 0; phase < scanlineClocks; ++phase) {
+            if(clocksAt(timing, phase) != clocksAt(expectedTiming, phase)) {
+                return phase;
+            }
+        }
+        return 0;
+    }
+
+    auto readTable(const std::string & fileName, std::map<TimingKey, Timing> * timings) -> bool
+    {
+        std::ifstream file(fileName);
+        if(!file) {
+            msg(LogLevel::error, "Could not open table file \"%s\"", fileName.data());
+            return false;
+        }
+
+        std::string line;
+        std::getline(file, line); // header
+        for(unsigned lineNum = 2; std::getline(file, line); ++lineNum) {
+            if(!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if(line.empty()) {
+                continue;
+            }
+
+            std::vector<std::string> fields;
+            size_t pos = 0;
+            for(size_t commaPos; (commaPos = line.find(',', pos)) != std::string::npos; pos = commaPos + 1) {
+                fields.push_back(line.substr(pos, commaPos - pos));
+            }
+            fields.push_back(line.substr(pos));
+
+            unsigned op, ramMode, minClocks;
+            if(fields.size() != 6 || fields[5].empty() || scanlineClocks % fields[5].size() != 0 ||
+               !parseUnsigned(fields[0], &op, 16) || !parseUnsigned(fields[2], &ramMode) ||
+               !parseUnsigned(fields[4], &minClocks))
+            {
+                msg(LogLevel::error, "Malformed timing at line %u of \"%s\"", lineNum, fileName.data());
+                return false;
+            }
+            TimingKey key(op, fields[1], ramMode, fields[3]);
+            (*timings)[key] = Timing{ minClocks, fields[5] };
+        }
+        return true;
+    }
+};
+
+auto TimingCommand::create() -> std::unique_ptr<TimingCommand>
+{
+    return std::make_unique<Impl>();
+}
@@ -0,0 +1,25 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "command.h"
+#include "logging.h"
+#include <memory>
+
+// Cycle timing conformance: runs every op from ram and from a non-ram bank,
+// in both ram modes, starting at every clock of the scanline, and checks the
+// clocks taken against the expectation table, or regenerates that table.
+// Ops are interpreted, other engines are held to the interpreter by fuzz
+
+class TimingCommand:
+        public ICommand,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<TimingCommand>;
+
+private:
+    class Impl;
+    explicit TimingCommand() = default;
+};
+
+#endif // TIMING_H
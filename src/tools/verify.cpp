@@ -0,0 +1,352 @@
+#include "verify.h"
+#include "machinepool.h"
+#include "cas.h"
+#include "pwe.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+namespace {
+
+enum struct VerifyStatus {
+    started, ioError, timeout, noLoad, badFile, unsupported
+};
+
+const char * statusName(VerifyStatus status)
+{
+    switch(status) {
+        case VerifyStatus::started:
+            return "started";
+        case VerifyStatus::ioError:
+            return "ioerror";
+        case VerifyStatus::timeout:
+            return "timeout";
+        case VerifyStatus::noLoad:
+            return "noload";
+        case VerifyStatus::badFile:
+            return "badfile";
+        case VerifyStatus::unsupported:
+            return "unsupported";
+    }
+    return "";
+}
+
+struct VerifyResult final
+{
+    std::string fileName;
+    std::string type;
+    std::string name;
+    VerifyStatus status;
+    unsigned frames;
+};
+
+constexpr uint16_t userRamBegin = 0x4000; // right after BIOS ROM
+constexpr uint16_t userRamEnd   = 0xf000; // BIOS work area and RAM hooks reside above
+
+// Watches BIOS tape load routine and detects the moment the loaded program
+// gets control or the load fails. Every instruction is hooked, as the start
+// may be any jump to user RAM or to the returned address. That keeps the cpu
+// in the plain interpreter with no JIT, fusion or idle skip, which is fine
+// while loading is mostly spent in the BIOS, and the run ends right at start
+
+class LoadWatcher final
+{
+public:
+    explicit LoadWatcher(Cpu * cpu, bool isBinary):
+        cpuRegs_m(cpu->cpuRegs()), isBinary_m(isBinary),
+        opHook_m(cpu->createOpHook(memFunc(this, &LoadWatcher::opHookFunc))),
+        isLoadStarted_m(false), isExecArmed_m(false), isDone_m(false),
+        status_m(VerifyStatus::noLoad)
+    {}
+
+    auto isDone() const -> bool
+    {
+        return isDone_m;
+    }
+
+    auto status() const -> VerifyStatus
+    {
+        if(!isDone_m && isLoadStarted_m) {
+            return VerifyStatus::timeout;
+        }
+        return status_m;
+    }
+
+private:
+    void opHookFunc()
+    {
+        switch(cpuRegs_m->pc) {
+            case 0x34ca: // load routine entry
+                isLoadStarted_m = true;
+                break;
+            case 0x34c6: // load/save routine common exit
+                if(!isLoadStarted_m || (cpuRegs_m->f & CpuFlag::c)) {
+                    break;
+                }
+                if(isBinary_m) {
+                    execAddr_m = cpuRegs_m->hl; // execution address is returned in hl
+                    isExecArmed_m = true;
+                    break;
+                }
+                finish(VerifyStatus::started); // BASIC program is run by injected command
+                break;
+            case 0x3772: // "Device I/O error"
+                finish(VerifyStatus::ioError);
+                break;
+            default:
+                // Loaded programs may chain their own loaders placed in the system
+                // area, so any jump to user RAM is treated as program start too
+                if(isLoadStarted_m && cpuRegs_m->pc >= userRamBegin && cpuRegs_m->pc < userRamEnd) {
+                    finish(VerifyStatus::started);
+                } else if(isExecArmed_m && cpuRegs_m->pc == execAddr_m) {
+                    finish(VerifyStatus::started);
+                }
+                break;
+        }
+    }
+
+    void finish(VerifyStatus status)
+    {
+        if(!isDone_m) {
+            status_m = status;
+            isDone_m = true;
+        }
+    }
+
+    CpuRegs * cpuRegs_m;
+    bool isBinary_m;
+
+    std::unique_ptr<OpHook> opHook_m;
+
+    bool isLoadStarted_m;
+    bool isExecArmed_m;
+    uint16_t execAddr_m;
+    bool isDone_m;
+    VerifyStatus status_m;
+};
+
+auto csvQuote(const std::string & text) -> std::string
+{
+    std::string result = "\"";
+    for(char c: text) {
+        if(c == '"') {
+            result += '"';
+        }
+        result += c;
+    }
+    return result + "\"";
+}
+
+} // namespace
+
+class VerifyCommand::Impl final:
+        public VerifyCommand
+{
+public:
+    virtual auto name() const -> std::string override
+    {
+        return "verify";
+    }
+
+    virtual auto usage() const -> std::string override
+    {
+        return "verify [-j threads] [-f max_frames] [-o out.csv] [-l list.txt] [-b] [-v] file.cas|file.pwe...";
+    }
+
+    virtual auto run(const std::vector<std::string> & args) -> int override
+    {
+        unsigned threadCount = 0;
+        unsigned maxFrames = 3000;
+        std::string outFileName;
+        std::vector<std::string> fileNames;
+
+        for(size_t i = 0; i < args.size(); ++i) {
+            const std::string & arg = args[i];
+            bool hasValue = (i + 1 < args.size());
+            if(arg == "-j" && hasValue) {
+                if(!parseUnsigned(args[++i], &threadCount)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-f" && hasValue) {
+                if(!parseUnsigned(args[++i], &maxFrames)) {
+                    msg(LogLevel::error, "Invalid value \"%s\" of option \"%s\"", args[i].data(), arg.data());
+                    return 2;
+                }
+            } else if(arg == "-o" && hasValue) {
+                outFileName = args[++i];
+            } else if(arg == "-l" && hasValue) {
+                std::ifstream list(args[++i]);
+                if(!list) {
+                    msg(LogLevel::error, "Could not open list file \"%s\"", args[i].data());
+                    return 1;
+                }
+                std::string line;
+                while(std::getline(list, line)) {
+                    if(!line.empty() && line.back() == '\r') {
+                        line.pop_back();
+                    }
+                    if(!line.empty()) {
+                        fileNames.push_back(line);
+                    }
+                }
+            } else if(arg == "-b") {
+                isByteLoad_m = true;
+            } else if(arg == "-v") {
+                isVerbose_m = true;
+            } else if(!arg.empty() && arg[0] == '-') {
+                msg(LogLevel::error, "Unknown option \"%s\"", arg.data());
+                return 2;
+            } else {
+                fileNames.push_back(arg);
+            }
+        }
+
+        if(fileNames.empty()) {
+            msg(LogLevel::error, "No files to verify");
+            return 2;
+        }
+
+        HeadlessEnvironment environment;
+        std::unique_ptr<MachinePool> machinePool = MachinePool::create(&environment, threadCount);
+        captureLog(machinePool.get());
+
+        std::vector<VerifyResult> results(fileNames.size());
+        machinePool->run(fileNames.size(), [&](Machine * machine, size_t jobNum) {
+            results[jobNum] = verify(machine, fileNames[jobNum], maxFrames);
+        });
+
+        std::ofstream outFile;
+        if(!outFileName.empty()) {
+            outFile.open(outFileName, std::ios::out | std::ios::trunc);
+            if(!outFile) {
+                msg(LogLevel::error, "Could not open output file \"%s\"", outFileName.data());
+                return 1;
+            }
+        }
+        std::ostream & out = (outFileName.empty() ? std::cout : outFile);
+
+        std::array<size_t, 6> statusCounts = {};
+        out << "file,type,name,status,frames,seconds" << std::endl;
+        for(const VerifyResult & result: results) {
+            out << csvQuote(result.fileName) << ','
+                << result.type << ','
+                << csvQuote(result.name) << ','
+                << statusName(result.status) << ','
+                << result.frames << ','
+                << stringf("%.2f", double(result.frames) / videoFps) << std::endl;
+            ++statusCounts[size_t(result.status)];
+        }
+
+        std::string summary;
+        for(size_t i = 0; i < statusCounts.size(); ++i) {
+            if(statusCounts[i] > 0) {
+                summary += stringf(" %s=%zu", statusName(VerifyStatus(i)), statusCounts[i]);
+            }
+        }
+        msg(LogLevel::info, "Verified %zu files on %u threads:%s",
+            results.size(), machinePool->threadCount(), summary.data());
+
+        return (statusCounts[size_t(VerifyStatus::started)] == results.size() ? 0 : 1);
+    }
+
+private:
+    auto verify(Machine * machine, const std::string & fileName, unsigned maxFrames) -> VerifyResult
+    {
+        VerifyResult result = { fileName, "", "", VerifyStatus::badFile, 0 };
+
+        if(!isVerbose_m) {
+            machine->setLog(std::make_unique<NullLog>());
+        }
+
+        uint8_t type = 0;
+        std::string name;
+        if(!readTapeHeader(machine, fileName, &type, &name)) {
+            return result;
+        }
+
+        for(char c: name) {
+            result.name += (c >= 0x20 && c < 0x7f ? c : '?');
+        }
+        switch(type) {
+            case 0xd0:
+                result.type = "binary";
+                break;
+            case 0xd3:
+                result.type = "basic";
+                break;
+            case 0xea:
+                result.type = "ascii";
+                result.status = VerifyStatus::unsupported;
+                return result;
+            default:
+                result.type = "unknown";
+                result.status = VerifyStatus::unsupported;
+                return result;
+        }
+
+        machine->bios()->setInstantLoad(!isByteLoad_m);
+        machine->media()->playbackFile.setFileName(fileName);
+        machine->bios()->initMediaHooks();
+
+        LoadWatcher loadWatcher(machine->cpu(), type == 0xd0);
+        result.frames = MachinePool::runFrames(machine, maxFrames, [&]() {
+            return loadWatcher.isDone();
+        });
+        result.status = loadWatcher.status();
+
+        return result;
+    }
+
+    // Type and name of the first program on tape, either from CAS header
+    // block or from PWE block index
+    auto readTapeHeader(Machine * machine, const std::string & fileName, uint8_t * type, std::string * name) -> bool
+    {
+        MediaFile mediaFile;
+        mediaFile.setFileName(fileName);
+        switch(mediaFile.fileFmt()) {
+            case FileFmt::cas:
+            {
+                std::unique_ptr<CasFileReader> casFileReader = CasFileReader::create();
+                machine->captureLog(casFileReader.get());
+                casFileReader->open(fileName);
+                if(!casFileReader->isValid() || casFileReader->blockCount() == 0) {
+                    return false;
+                }
+                CasBlockInfo block = casFileReader->blockInfo(0);
+                *type = uint8_t(block.type);
+                *name = block.name;
+                return true;
+            }
+            case FileFmt::pwe:
+            {
+                std::unique_ptr<PweFileReader> pweFileReader = PweFileReader::create();
+                machine->captureLog(pweFileReader.get());
+                pweFileReader->open(fileName);
+                if(!pweFileReader->isValid()) {
+                    return false;
+                }
+                *type = 0;
+                for(size_t i = 0; i < pweFileReader->blockCount(); ++i) {
+                    PweBlockInfo block = pweFileReader->blockInfo(i);
+                    if(block.type != 0) {
+                        *type = block.type;
+                        *name = block.name;
+                        break;
+                    }
+                }
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool isByteLoad_m = false;
+    bool isVerbose_m = false;
+};
+
+auto VerifyCommand::create() -> std::unique_ptr<VerifyCommand>
+{
+    return std::make_unique<Impl>();
+}
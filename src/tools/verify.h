@@ -0,0 +1,25 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "command.h"
+#include "logging.h"
+#include <memory>
+
+// Bulk tape image verification: boots every given CAS or PWE file through the BIOS
+// autoload in a separate machine, runs unthrottled until the program starts
+// or loading fails, and reports results as CSV. Machines run interpreted
+// only, as the load is watched on every instruction
+
+class VerifyCommand:
+        public ICommand,
+        public Logger
+{
+public:
+    static auto create() -> std::unique_ptr<VerifyCommand>;
+
+private:
+    class Impl;
+    explicit VerifyCommand() = default;
+};
+
+#endif // VERIFY_H